@@ -0,0 +1,280 @@
+#pragma once
+// Minimal blocking TalkMe client for the load generators in this directory.
+// POSIX sockets only; packets are framed exactly as ChatSession reads them
+// ([u8 type][u32 size BE][body]). Benchmarks call Fail() on anything
+// unexpected: a load generator that keeps going after a protocol error only
+// produces meaningless numbers.
+#include "../src/Protocol.h"
+
+#include <nlohmann/json.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace TalkMe::Bench {
+
+    [[noreturn]] inline void Fail(const std::string& what) {
+        std::fprintf(stderr, "bench: %s\n", what.c_str());
+        std::exit(1);
+    }
+
+    inline double Seconds(std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    // Monotonic nanoseconds; cheap enough to stamp into every packet.
+    inline int64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Lock-free latency histogram in 10 us buckets up to one second; the
+    // last bucket takes everything slower. Add() is safe from any thread.
+    struct LatencyHistogram {
+        static constexpr size_t kBuckets = 100000;
+        std::array<std::atomic<uint64_t>, kBuckets + 1> counts{};
+        void Add(int64_t ns) {
+            const size_t b = std::min<size_t>(static_cast<size_t>(std::max<int64_t>(ns, 0) / 10000), kBuckets);
+            counts[b].fetch_add(1, std::memory_order_relaxed);
+        }
+        uint64_t Total() const {
+            uint64_t n = 0;
+            for (const auto& c : counts) n += c.load();
+            return n;
+        }
+        double PercentileMs(double p) const {
+            const uint64_t target = static_cast<uint64_t>(p * Total());
+            uint64_t seen = 0;
+            for (size_t i = 0; i <= kBuckets; ++i)
+                if ((seen += counts[i].load()) > target) return i / 100.0;
+            return kBuckets / 100.0;
+        }
+    };
+
+    // Reads an integer knob from the environment, e.g. BENCH_USERS=200.
+    inline long EnvOr(const char* name, long fallback) {
+        const char* v = std::getenv(name);
+        return v ? std::atol(v) : fallback;
+    }
+
+    // CPU seconds (user + system) the process has used so far, from
+    // /proc/<pid>/stat; -1 if it cannot be read. Point BENCH_SERVER_PID at the
+    // server to charge it, rather than the whole machine, for a run.
+    inline double ProcessCpuSeconds(long pid) {
+        char path[64];
+        std::snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
+        FILE* f = std::fopen(path, "r");
+        if (!f) return -1;
+        char buf[1024];
+        const size_t n = std::fread(buf, 1, sizeof(buf) - 1, f);
+        std::fclose(f);
+        buf[n] = 0;
+        // Fields after the parenthesised command name; utime and stime are 14 and 15.
+        const char* p = std::strrchr(buf, ')');
+        unsigned long utime = 0, stime = 0;
+        if (!p || std::sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) return -1;
+        return static_cast<double>(utime + stime) / static_cast<double>(::sysconf(_SC_CLK_TCK));
+    }
+
+    // A name no earlier run can have registered against the same talkme.db.
+    inline std::string UniqueName(std::string_view prefix) {
+        static std::mt19937_64 rng(std::random_device{}());
+        return std::string(prefix) + std::to_string(rng() % 1000000000000ULL);
+    }
+
+    inline int ConnectTcp(uint16_t port, const char* host = "127.0.0.1") {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) Fail("socket");
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        ::inet_pton(AF_INET, host, &addr.sin_addr);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+            Fail("connect to port " + std::to_string(port));
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    inline void WriteAll(int fd, const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+            if (n <= 0) Fail("send");
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    inline bool ReadAll(int fd, void* data, size_t size) {
+        char* p = static_cast<char*>(data);
+        while (size > 0) {
+            ssize_t n = ::recv(fd, p, size, 0);
+            if (n <= 0) return false;
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    class Connection {
+    public:
+        explicit Connection(uint16_t port = SERVER_PORT) : m_Fd(ConnectTcp(port)) {}
+        ~Connection() { if (m_Fd >= 0) ::close(m_Fd); }
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        int Fd() const { return m_Fd; }
+
+        // Appends one framed packet to `out`, so callers can pipeline a batch
+        // with a single WriteAll().
+        static void Frame(std::string& out, PacketType type, std::string_view body) {
+            const uint32_t size = HostToNet32(static_cast<uint32_t>(body.size()));
+            out.push_back(static_cast<char>(type));
+            out.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            out.append(body);
+        }
+
+        void Send(PacketType type, std::string_view body) {
+            std::string frame;
+            Frame(frame, type, body);
+            WriteAll(m_Fd, frame.data(), frame.size());
+        }
+
+        // Blocks for the next packet; false once the server closes.
+        bool Read(PacketType& type, std::string& body) {
+            uint8_t header[5];
+            if (!ReadAll(m_Fd, header, sizeof(header))) return false;
+            uint32_t size;
+            std::memcpy(&size, header + 1, sizeof(size));
+            type = static_cast<PacketType>(header[0]);
+            body.resize(NetToHost32(size));
+            return ReadAll(m_Fd, body.data(), body.size());
+        }
+
+        // Skips packets until one of `type` arrives and returns its body.
+        std::string Expect(PacketType type) {
+            PacketType t;
+            std::string body;
+            while (Read(t, body))
+                if (t == type) return body;
+            Fail("connection closed while waiting for packet "
+                + std::to_string(static_cast<int>(type)));
+        }
+
+        // Registers a fresh account and returns the tagged name the server
+        // assigned ("name#0001"); the session is logged in afterwards. Every
+        // account lands in the default server (sid 1). `presenceBatch` asks
+        // for coalesced presence, which keeps thousands of logins cheap.
+        std::string Register(const std::string& username, bool presenceBatch = false) {
+            SendRegister(username, presenceBatch);
+            return AwaitRegistered(username);
+        }
+
+        // Register() in two halves, so many connections can register at once.
+        void SendRegister(const std::string& username, bool presenceBatch = false) {
+            Send(PacketType::Register_Request,
+                R"({"e":")" + username + R"(@bench","u":")" + username + R"(","p":"pw123456")"
+                + (presenceBatch ? R"(,"presence_batch":1})" : "}"));
+        }
+
+        std::string AwaitRegistered(const std::string& username) {
+            PacketType t;
+            std::string body;
+            while (Read(t, body)) {
+                if (t == PacketType::Register_Success)
+                    return nlohmann::json::parse(body).value("u", username);
+                if (t == PacketType::Register_Failed) Fail("register " + username);
+            }
+            Fail("connection closed during register");
+        }
+
+        // Id of the first channel of `type` ("text", "voice") in server `sid`.
+        int FirstChannel(const std::string& type, int sid = 1) {
+            Send(PacketType::Get_Server_Content_Request, R"({"sid":)" + std::to_string(sid) + "}");
+            auto channels = nlohmann::json::parse(Expect(PacketType::Server_Content_Response));
+            for (const auto& c : channels)
+                if (c.value("type", "") == type) return c.value("id", -1);
+            Fail("server " + std::to_string(sid) + " has no " + type + " channel");
+        }
+
+        // No reply comes back; the caller gives SetVoiceChannel a moment.
+        void JoinVoice(int cid) {
+            Send(PacketType::Join_Voice_Channel, R"({"cid":)" + std::to_string(cid) + "}");
+        }
+
+    private:
+        int m_Fd;
+    };
+
+    // ---------------------------------------------------------------------------
+    // UDP voice. Datagrams are [u8 kind][body]; see HandleVoiceUdpPacket.
+    // ---------------------------------------------------------------------------
+    constexpr uint8_t kUdpVoice = 0;
+    constexpr uint8_t kUdpHello = 1;
+    constexpr uint8_t kUdpPing = 2;
+    constexpr uint8_t kUdpPong = 3;
+    constexpr uint8_t kUdpVoiceLevel = 4;
+
+    // A UDP socket on an ephemeral loopback port, connected to the voice port,
+    // so send()/recv() need no address.
+    inline int ConnectUdp(uint16_t port = VOICE_PORT) {
+        int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) Fail("udp socket");
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) Fail("udp connect");
+        int size = 4 << 20;
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        return fd;
+    }
+
+    // Binds this socket's endpoint to `username` in voice channel `cid`.
+    inline void SendUdpHello(int fd, const std::string& username, int cid) {
+        std::string d;
+        d.push_back(static_cast<char>(kUdpHello));
+        d.push_back(static_cast<char>(username.size()));
+        d += username;
+        const uint32_t c = HostToNet32(static_cast<uint32_t>(cid));
+        d.append(reinterpret_cast<const char*>(&c), sizeof(c));
+        ::send(fd, d.data(), d.size(), 0);
+    }
+
+    // A voice datagram: [kind][level if kind 4][u32 seq BE][u8 ulen][username][opus].
+    // Build it once and patch the sequence number with SetVoiceSeq().
+    inline std::string MakeVoicePacket(const std::string& username, size_t opusBytes,
+        uint8_t kind = kUdpVoice, uint8_t level = 127)
+    {
+        std::string d;
+        d.push_back(static_cast<char>(kind));
+        if (kind == kUdpVoiceLevel) d.push_back(static_cast<char>(level));
+        d.append(4, '\0');
+        d.push_back(static_cast<char>(username.size()));
+        d += username;
+        d.append(opusBytes, '\x5a');
+        return d;
+    }
+
+    inline void SetVoiceSeq(std::string& packet, uint32_t seq) {
+        const size_t at = static_cast<uint8_t>(packet[0]) == kUdpVoiceLevel ? 2 : 1;
+        const uint32_t s = HostToNet32(seq);
+        std::memcpy(packet.data() + at, &s, sizeof(s));
+    }
+
+}
@@ -0,0 +1,199 @@
+// Channel fan-out at scale: BENCH_SESSIONS connected users spread over
+// BENCH_SERVERS servers (created and joined through the normal requests;
+// every user is also in the default server, as registration puts them
+// there). Once everyone is connected, Typing_Indicator packets go out at
+// BENCH_RATE per second, round-robin over the servers, from a different
+// member each time. Typing indicators touch no table, so the cost measured
+// is BroadcastToChannelMembers itself: resolving the channel's server and
+// its online members, then queueing the copies. Reports delivered copies
+// per second against the expected count and send-to-receive latency; with
+// BENCH_SERVER_PID set, also the server's CPU time per broadcast, which is
+// the number to compare when this process shares the server's cores.
+//
+// Needs a file descriptor limit above BENCH_SESSIONS for both this process
+// and the server (ulimit -n).
+#include "BenchClient.h"
+
+#include <sys/epoll.h>
+
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    struct Group {
+        int sid = -1;
+        int cid = -1;
+        std::vector<std::unique_ptr<Connection>> members;
+        std::atomic<int64_t> sentAtNs{ 0 };   // last Typing_Indicator sent to this group
+    };
+
+    // Reads server lists until one includes `name` (login sends a list of
+    // its own first); returns that entry.
+    nlohmann::json AwaitServer(Connection& c, const std::string& name) {
+        for (;;)
+            for (const auto& s : nlohmann::json::parse(c.Expect(PacketType::Server_List_Response)))
+                if (s.value("name", "") == name) return s;
+    }
+
+    // Creates one server and fills it with `size` fresh users.
+    void SetUpGroup(Group& g, size_t size, const std::string& tag) {
+        for (size_t i = 0; i < size; ++i) g.members.push_back(std::make_unique<Connection>());
+        std::vector<std::string> names;
+        for (auto& c : g.members) {
+            names.push_back(UniqueName("fan"));
+            c->SendRegister(names.back(), true);
+        }
+        for (size_t i = 0; i < size; ++i) g.members[i]->AwaitRegistered(names[i]);
+
+        auto& owner = *g.members[0];
+        const std::string serverName = "fanout " + tag;
+        owner.Send(PacketType::Create_Server_Request, nlohmann::json{ { "name", serverName } }.dump());
+        const nlohmann::json created = AwaitServer(owner, serverName);
+        g.sid = created.value("id", -1);
+        const std::string code = created.value("code", "");
+        for (size_t i = 1; i < size; ++i)
+            g.members[i]->Send(PacketType::Join_Server_Request, nlohmann::json{ { "code", code } }.dump());
+        for (size_t i = 1; i < size; ++i) AwaitServer(*g.members[i], serverName);
+        g.cid = owner.FirstChannel("text", g.sid);
+    }
+
+    // Reads every connection, frames packets and times each Typing_Indicator
+    // against the last send to its channel's group.
+    class Receiver {
+    public:
+        Receiver(const std::unordered_map<int, Group*>& byChannel, LatencyHistogram& latency)
+            : m_ByChannel(byChannel), m_Latency(latency), m_Epoll(epoll_create1(0)) {}
+        ~Receiver() { ::close(m_Epoll); }
+
+        void Add(int fd) {
+            if (static_cast<size_t>(fd) >= m_Buffers.size()) Fail("fd beyond receiver table");
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            epoll_ctl(m_Epoll, EPOLL_CTL_ADD, fd, &ev);
+        }
+
+        void Run(const std::atomic<bool>& stop, const std::atomic<bool>& measuring) {
+            epoll_event events[256];
+            static char chunk[64 * 1024];
+            while (!stop.load(std::memory_order_relaxed)) {
+                const int n = epoll_wait(m_Epoll, events, 256, 50);
+                for (int i = 0; i < n; ++i) {
+                    const int fd = events[i].data.fd;
+                    std::string& buf = m_Buffers[static_cast<size_t>(fd)];
+                    ssize_t got;
+                    while ((got = ::recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0) {
+                        buf.append(chunk, static_cast<size_t>(got));
+                        m_LastReceiveNs.store(NowNs(), std::memory_order_relaxed);
+                    }
+                    Frame(buf, measuring.load(std::memory_order_relaxed));
+                }
+            }
+        }
+
+        int64_t LastReceiveNs() const { return m_LastReceiveNs.load(std::memory_order_relaxed); }
+
+    private:
+        void Frame(std::string& buf, bool measuring) {
+            size_t at = 0;
+            while (buf.size() - at >= 5) {
+                uint32_t size;
+                std::memcpy(&size, buf.data() + at + 1, sizeof(size));
+                size = NetToHost32(size);
+                if (buf.size() - at < 5 + size) break;
+                if (measuring && static_cast<PacketType>(buf[at]) == PacketType::Typing_Indicator) {
+                    const std::string_view body(buf.data() + at + 5, size);
+                    if (const size_t c = body.find("\"cid\":"); c != std::string_view::npos) {
+                        const int cid = std::atoi(body.data() + c + 6);
+                        if (auto it = m_ByChannel.find(cid); it != m_ByChannel.end())
+                            m_Latency.Add(NowNs() - it->second->sentAtNs.load(std::memory_order_relaxed));
+                    }
+                }
+                at += 5 + size;
+            }
+            buf.erase(0, at);
+        }
+
+        const std::unordered_map<int, Group*>& m_ByChannel;
+        LatencyHistogram& m_Latency;
+        int m_Epoll;
+        std::atomic<int64_t> m_LastReceiveNs{ NowNs() };
+        std::vector<std::string> m_Buffers = std::vector<std::string>(65536);
+    };
+
+}
+
+int main() {
+    const long sessions = EnvOr("BENCH_SESSIONS", 10000);
+    const long servers = EnvOr("BENCH_SERVERS", 500);
+    const long rate = EnvOr("BENCH_RATE", 2000);
+    const long seconds = EnvOr("BENCH_SECONDS", 10);
+    const long serverPid = EnvOr("BENCH_SERVER_PID", 0);
+    const size_t perServer = static_cast<size_t>(std::max(1L, sessions / servers));
+
+    std::vector<Group> groups(static_cast<size_t>(servers));
+    std::unordered_map<int, Group*> byChannel;
+    const auto setupStart = Clock::now();
+    for (size_t i = 0; i < groups.size(); ++i) {
+        SetUpGroup(groups[i], perServer, UniqueName(std::to_string(i) + "_"));
+        byChannel[groups[i].cid] = &groups[i];
+        if ((i + 1) % 50 == 0)
+            std::fprintf(stderr, "set up %zu/%zu servers (%.0f s)\n", i + 1, groups.size(), Seconds(Clock::now() - setupStart));
+    }
+
+    LatencyHistogram latency;
+    Receiver receiver(byChannel, latency);
+    for (auto& g : groups)
+        for (auto& c : g.members) receiver.Add(c->Fd());
+    std::atomic<bool> stop{ false }, measuring{ false };
+    std::thread reader([&] { receiver.Run(stop, measuring); });
+    // Every login is announced to the whole default server; wait for that
+    // presence traffic to drain (a second without a byte) before measuring.
+    while (NowNs() - receiver.LastReceiveNs() < 1'000'000'000)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    measuring = true;
+    uint64_t sent = 0;
+    const auto tick = std::chrono::milliseconds(1);
+    const double cpuBefore = serverPid ? ProcessCpuSeconds(serverPid) : -1;
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::seconds(seconds);
+    double owed = 0;
+    for (auto next = start; next < end; next += tick) {
+        for (owed += rate / 1000.0; owed >= 1; owed -= 1) {
+            Group& g = groups[sent % groups.size()];
+            Connection& from = *g.members[(sent / groups.size()) % g.members.size()];
+            g.sentAtNs.store(NowNs(), std::memory_order_relaxed);
+            from.Send(PacketType::Typing_Indicator, R"({"cid":)" + std::to_string(g.cid) + "}");
+            ++sent;
+        }
+        std::this_thread::sleep_until(next + tick);
+    }
+    const double elapsed = Seconds(Clock::now() - start);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    const double serverCpu = cpuBefore >= 0 ? ProcessCpuSeconds(serverPid) - cpuBefore : -1;
+    measuring = false;
+    stop = true;
+    reader.join();
+
+    // Broadcasts go to every online member of the server, sender included.
+    const uint64_t expected = sent * perServer;
+    std::printf("sessions=%zu servers=%ld per_server=%zu rate=%ld/s seconds=%ld (setup %.0f s)\n",
+        perServer * groups.size(), servers, perServer, rate, seconds, Seconds(start - setupStart));
+    std::printf("sent %.0f typing/s; delivered %.0f copies/s (%.2f%% of %llu)\n",
+        sent / elapsed, latency.Total() / elapsed, 100.0 * latency.Total() / std::max<uint64_t>(expected, 1),
+        static_cast<unsigned long long>(expected));
+    std::printf("fan-out latency: p50 %.2f ms  p99 %.2f ms  p99.9 %.2f ms\n",
+        latency.PercentileMs(0.50), latency.PercentileMs(0.99), latency.PercentileMs(0.999));
+    if (serverCpu >= 0)
+        std::printf("server CPU: %.2f s, %.1f us per broadcast\n", serverCpu, 1e6 * serverCpu / std::max<uint64_t>(sent, 1));
+    std::fflush(stdout);
+    std::_Exit(0);   // closing 10k sockets one by one is not part of the run
+}
@@ -0,0 +1,119 @@
+// Chat send load: BENCH_SENDERS sessions each push BENCH_MESSAGES
+// Message_Text packets into one channel, keeping BENCH_INFLIGHT unanswered.
+// A message counts once its own broadcast (which carries the committed id)
+// comes back, so the rate is what a single chatty session actually gets
+// through the database queue and the group commit.
+#include "BenchClient.h"
+
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <vector>
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    struct SenderResult {
+        double seconds = 0;
+        long lost = 0;
+        std::vector<double> latencyMs;
+    };
+
+    // The control lane sheds broadcasts to a client that falls too far
+    // behind, so a sender may never see some of its own messages. Broadcasts
+    // keep the send order: one for message k means any earlier message still
+    // unanswered was lost, and a quiet socket after the last send ends the run.
+    SenderResult RunSender(int cid, long messages, long inflight) {
+        Connection c;
+        const std::string me = c.Register(UniqueName("chat"));
+        const std::string mine = R"("u":")" + me + "\"";
+        timeval quiet{ 5, 0 };
+        ::setsockopt(c.Fd(), SOL_SOCKET, SO_RCVTIMEO, &quiet, sizeof(quiet));
+
+        SenderResult result;
+        result.latencyMs.reserve(static_cast<size_t>(messages));
+        std::deque<std::pair<long, Clock::time_point>> pending;   // message index, send time
+        long sent = 0, done = 0;
+        const auto start = Clock::now();
+        auto lastAnswer = start;
+        while (done + result.lost < messages) {
+            if (sent < messages && static_cast<long>(pending.size()) < inflight) {
+                std::string batch;
+                while (sent < messages && static_cast<long>(pending.size()) < inflight) {
+                    Connection::Frame(batch, PacketType::Message_Text,
+                        R"({"cid":)" + std::to_string(cid) + R"(,"msg":"load )" + std::to_string(sent) + "\"}");
+                    pending.emplace_back(sent, Clock::now());
+                    ++sent;
+                }
+                WriteAll(c.Fd(), batch.data(), batch.size());
+            }
+            PacketType t;
+            std::string body;
+            if (!c.Read(t, body)) {
+                if (sent < messages) Fail("server closed the connection");
+                result.lost += static_cast<long>(pending.size());
+                break;
+            }
+            if (t != PacketType::Message_Text || body.find(mine) == std::string::npos) continue;
+            const size_t at = body.find("\"load ");
+            if (at == std::string::npos) continue;
+            const long index = std::atol(body.c_str() + at + 6);
+            while (!pending.empty() && pending.front().first < index) {
+                pending.pop_front();
+                ++result.lost;
+            }
+            if (pending.empty() || pending.front().first != index) continue;
+            result.latencyMs.push_back(Seconds(Clock::now() - pending.front().second) * 1000.0);
+            pending.pop_front();
+            ++done;
+            lastAnswer = Clock::now();
+        }
+        result.seconds = Seconds(lastAnswer - start);
+        return result;
+    }
+
+    double Percentile(std::vector<double>& v, double p) {
+        if (v.empty()) return 0;
+        std::sort(v.begin(), v.end());
+        return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+    }
+
+}
+
+int main() {
+    const long senders = EnvOr("BENCH_SENDERS", 1);
+    const long messages = EnvOr("BENCH_MESSAGES", 2000);
+    const long inflight = EnvOr("BENCH_INFLIGHT", 32);
+
+    int cid;
+    {
+        Connection probe;
+        probe.Register(UniqueName("chatprobe"));
+        cid = probe.FirstChannel("text");
+    }
+
+    std::vector<SenderResult> results(static_cast<size_t>(senders));
+    std::vector<std::thread> threads;
+    for (long i = 0; i < senders; ++i)
+        threads.emplace_back([&, i] { results[static_cast<size_t>(i)] = RunSender(cid, messages, inflight); });
+    for (auto& t : threads) t.join();
+
+    std::vector<double> latency;
+    double slowest = 0;
+    long lost = 0;
+    for (auto& r : results) {
+        lost += r.lost;
+        latency.insert(latency.end(), r.latencyMs.begin(), r.latencyMs.end());
+        slowest = std::max(slowest, r.seconds);
+    }
+    const double total = static_cast<double>(latency.size());
+    std::printf("senders=%ld messages=%ld inflight=%ld cid=%d\n", senders, messages, inflight, cid);
+    std::printf("throughput: %.0f msg/s total, %.0f msg/s per session; %ld broadcasts shed\n",
+        total / slowest, total / senders / slowest, lost);
+    std::printf("send->broadcast: p50 %.2f ms  p99 %.2f ms\n",
+        Percentile(latency, 0.50), Percentile(latency, 0.99));
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Database cost of one chat message, in-process. Runs the queries a
+// Message_Text costs the database, one message after another on one thread:
+// the channel's server, the chat_mute check, the insert, and the member
+// list the broadcast used to fetch. Each call goes straight to Database,
+// so the numbers are statement preparation and SQLite work, with no
+// sockets or queues in between.
+//
+// Run it in a scratch directory: Database opens talkme.db there.
+#include "../src/Database.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+using namespace TalkMe;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    long EnvOr(const char* name, long fallback) {
+        const char* v = std::getenv(name);
+        return v ? std::atol(v) : fallback;
+    }
+
+    double NsPer(Clock::duration d, long n) {
+        return std::chrono::duration<double, std::nano>(d).count() / static_cast<double>(n);
+    }
+
+}
+
+int main() {
+    const long messages = EnvOr("BENCH_MESSAGES", 20000);
+    const long memberCount = EnvOr("BENCH_MEMBERS", 50);
+    const int cid = static_cast<int>(EnvOr("BENCH_CHANNEL", 1));   // default server's text channel
+
+    // The sender plus enough members that the member list is not trivial.
+    auto& db = Database::Get();
+    const std::string prefix = "dbbench" + std::to_string(std::random_device{}() % 1000000) + "_";
+    std::string user;
+    for (long i = 0; i < memberCount; ++i) {
+        const std::string name = prefix + std::to_string(i);
+        const std::string registered = db.RegisterUser(name + "@bench", name, "pw123456");
+        if (registered.empty()) { std::fprintf(stderr, "bench: register failed\n"); return 1; }
+        db.AddUserToDefaultServer(registered);
+        if (user.empty()) user = registered;
+    }
+
+    Clock::duration tServer{}, tMute{}, tInsert{}, tMembers{};
+    size_t members = 0;
+    const auto start = Clock::now();
+    for (long i = 0; i < messages; ++i) {
+        auto t0 = Clock::now();
+        const int sid = db.GetServerIdForChannel(cid);
+        auto t1 = Clock::now();
+        const bool muted = sid > 0 && db.IsUserSanctioned(sid, user, "chat_mute");
+        auto t2 = Clock::now();
+        const int mid = muted ? 0 : db.SaveMessageReturnId(cid, user, "bench message " + std::to_string(i));
+        auto t3 = Clock::now();
+        members = db.GetUsersInServerByChannel(cid).size();
+        auto t4 = Clock::now();
+        if (mid <= 0) { std::fprintf(stderr, "bench: insert failed\n"); return 1; }
+        tServer += t1 - t0;
+        tMute += t2 - t1;
+        tInsert += t3 - t2;
+        tMembers += t4 - t3;
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::printf("messages=%ld channel=%d members=%zu\n", messages, cid, members);
+    std::printf("throughput: %.0f msg/s\n", messages / seconds);
+    std::printf("per message: server %.0f ns, mute check %.0f ns, insert %.0f ns, members %.0f ns\n",
+        NsPer(tServer, messages), NsPer(tMute, messages), NsPer(tInsert, messages), NsPer(tMembers, messages));
+    std::fflush(stdout);
+    std::_Exit(0);   // skip the Database singleton's shutdown
+}
@@ -0,0 +1,117 @@
+// Targeted delivery against the number of connected users. BENCH_IDLE
+// sessions log in and stay connected; then BENCH_PAIRS pairs of friends
+// exchange traffic for BENCH_SECONDS, each sender keeping BENCH_INFLIGHT
+// packets outstanding (its own copy of each delivery is the completion).
+// BENCH_KIND=dm sends DM_Send (a database write, then delivery to both
+// ends); BENCH_KIND=call sends Call_Reject, which the server relays as
+// Call_State without touching the database. Reports deliveries per second
+// at the receivers. Sweep BENCH_IDLE to see whether finding the target
+// costs more as more users are online.
+#include "BenchClient.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    struct Pair {
+        std::unique_ptr<Connection> from, to;
+        std::string fromName, toName;
+        uint64_t delivered = 0;
+    };
+
+    void MakeFriends(Pair& p) {
+        p.from = std::make_unique<Connection>();
+        p.to = std::make_unique<Connection>();
+        p.fromName = p.from->Register(UniqueName("dmfrom"));
+        p.toName = p.to->Register(UniqueName("dmto"));
+        p.from->Send(PacketType::Friend_Request, nlohmann::json{ { "u", p.toName } }.dump());
+        p.to->Expect(PacketType::Friend_Update);
+        p.to->Send(PacketType::Friend_Accept, nlohmann::json{ { "u", p.fromName } }.dump());
+        p.from->Expect(PacketType::Friend_Update);
+    }
+
+    // Keeps `inflight` packets outstanding until `end`; the sender's own
+    // copy of each delivery (DM_Receive or Call_State) completes one.
+    void Send(Pair& p, bool dm, long inflight, Clock::time_point end) {
+        const PacketType request = dm ? PacketType::DM_Send : PacketType::Call_Reject;
+        const PacketType echo = dm ? PacketType::DM_Receive : PacketType::Call_State;
+        const std::string body = dm
+            ? nlohmann::json{ { "to", p.toName }, { "msg", "bench direct message" } }.dump()
+            : nlohmann::json{ { "to", p.toName } }.dump();
+        std::string batch;
+        for (long i = 0; i < inflight; ++i) Connection::Frame(batch, request, body);
+        WriteAll(p.from->Fd(), batch.data(), batch.size());
+
+        PacketType type;
+        std::string in;
+        while (Clock::now() < end) {
+            if (!p.from->Read(type, in)) Fail("sender disconnected");
+            if (type != echo) continue;
+            std::string one;
+            Connection::Frame(one, request, body);
+            WriteAll(p.from->Fd(), one.data(), one.size());
+        }
+    }
+
+    // Counts deliveries that arrive before `end`; returns once main shuts
+    // the socket down.
+    void Receive(Pair& p, bool dm, Clock::time_point end) {
+        const PacketType expected = dm ? PacketType::DM_Receive : PacketType::Call_State;
+        PacketType type;
+        std::string body;
+        while (p.to->Read(type, body))
+            if (type == expected && Clock::now() < end) ++p.delivered;
+    }
+
+}
+
+int main() {
+    const long idle = EnvOr("BENCH_IDLE", 1000);
+    const long pairs = EnvOr("BENCH_PAIRS", 8);
+    const long inflight = EnvOr("BENCH_INFLIGHT", 16);
+    const long seconds = EnvOr("BENCH_SECONDS", 5);
+    const char* kind = std::getenv("BENCH_KIND");
+    const bool dm = !kind || std::string_view(kind) != "call";
+
+    // Idle users log in a batch at a time, so registration is pipelined.
+    std::vector<std::unique_ptr<Connection>> idlers;
+    for (long done = 0; done < idle;) {
+        const long n = std::min(200L, idle - done);
+        std::vector<std::string> names;
+        for (long i = 0; i < n; ++i) {
+            idlers.push_back(std::make_unique<Connection>());
+            names.push_back(UniqueName("idle"));
+            idlers.back()->SendRegister(names.back(), true);
+        }
+        for (long i = 0; i < n; ++i) idlers[static_cast<size_t>(done + i)]->AwaitRegistered(names[static_cast<size_t>(i)]);
+        done += n;
+    }
+    // Nobody reads the idle sessions; the server sheds what they are sent.
+    std::vector<Pair> ps(static_cast<size_t>(pairs));
+    for (auto& p : ps) MakeFriends(p);
+    std::this_thread::sleep_for(std::chrono::seconds(2));   // let login presence settle
+
+    std::vector<std::thread> receivers, senders;
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::seconds(seconds);
+    for (auto& p : ps) receivers.emplace_back([&] { Receive(p, dm, end); });
+    for (auto& p : ps) senders.emplace_back([&] { Send(p, dm, inflight, end); });
+    for (auto& t : senders) t.join();
+    for (auto& p : ps) ::shutdown(p.to->Fd(), SHUT_RD);
+    for (auto& t : receivers) t.join();
+    const double elapsed = Seconds(end - start);
+
+    uint64_t delivered = 0;
+    for (const auto& p : ps) delivered += p.delivered;
+    std::printf("kind=%s connected=%ld (idle %ld + %ld pairs) inflight=%ld seconds=%ld\n",
+        dm ? "dm" : "call", idle + 2 * pairs, idle, pairs, inflight, seconds);
+    std::printf("delivered %.0f per second\n", delivered / elapsed);
+    std::fflush(stdout);
+    std::_Exit(0);   // closing thousands of idle sockets is not part of the run
+}
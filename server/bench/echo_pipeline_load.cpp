@@ -0,0 +1,113 @@
+// Small-packet throughput per connection: each of BENCH_CONNECTIONS logged-in
+// sessions keeps BENCH_INFLIGHT Echo_Requests of BENCH_BODY bytes in flight
+// until BENCH_PACKETS have come back, topping the window up with one write
+// per batch of replies it reads. Echo is the cheapest request the server
+// answers, so the run is dominated by reading, framing and writing packets.
+// Replies are checked for order. Set BENCH_SERVER_PID for the server's CPU
+// time per packet.
+#include "BenchClient.h"
+
+#include <thread>
+#include <vector>
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    struct Result {
+        Clock::time_point start, end;
+        uint64_t echoed = 0;
+    };
+
+    // Registers, waits until every connection has, then pumps.
+    void Pump(long packets, long inflight, size_t bodySize, std::atomic<long>& waiting, Result& result) {
+        Connection c;
+        c.Register(UniqueName("echo"));
+        waiting.fetch_sub(1);
+        while (waiting.load() > 0) std::this_thread::yield();
+        const int fd = c.Fd();
+
+        std::string body(std::max<size_t>(bodySize, sizeof(uint64_t)), 'e');
+        uint64_t sent = 0, echoed = 0;
+        std::string out;
+        auto queue = [&](long n) {
+            for (; n > 0 && sent < static_cast<uint64_t>(packets); --n, ++sent) {
+                std::memcpy(body.data(), &sent, sizeof(sent));
+                Connection::Frame(out, PacketType::Echo_Request, body);
+            }
+        };
+
+        std::string in;
+        std::vector<char> chunk(64 * 1024);
+        result.start = Clock::now();
+        queue(inflight);
+        while (echoed < static_cast<uint64_t>(packets)) {
+            if (!out.empty()) {
+                WriteAll(fd, out.data(), out.size());
+                out.clear();
+            }
+            const ssize_t got = ::recv(fd, chunk.data(), chunk.size(), 0);
+            if (got <= 0) Fail("connection closed after " + std::to_string(echoed) + " echoes");
+            in.append(chunk.data(), static_cast<size_t>(got));
+
+            size_t at = 0;
+            long replies = 0;
+            while (in.size() - at >= 5) {
+                uint32_t size;
+                std::memcpy(&size, in.data() + at + 1, sizeof(size));
+                size = NetToHost32(size);
+                if (in.size() - at < 5 + size) break;
+                if (static_cast<PacketType>(in[at]) == PacketType::Echo_Response) {
+                    uint64_t seq;
+                    std::memcpy(&seq, in.data() + at + 5, sizeof(seq));
+                    if (seq != echoed) Fail("echo " + std::to_string(seq) + " arrived, expected " + std::to_string(echoed));
+                    ++echoed;
+                    ++replies;
+                }
+                at += 5 + size;
+            }
+            in.erase(0, at);
+            queue(replies);
+        }
+        result.end = Clock::now();
+        result.echoed = echoed;
+    }
+
+}
+
+int main() {
+    const long connections = EnvOr("BENCH_CONNECTIONS", 1);
+    const long packets = EnvOr("BENCH_PACKETS", 200000);
+    const long inflight = EnvOr("BENCH_INFLIGHT", 64);
+    const size_t bodySize = static_cast<size_t>(EnvOr("BENCH_BODY", 16));
+    const long serverPid = EnvOr("BENCH_SERVER_PID", 0);
+
+    std::vector<Result> results(static_cast<size_t>(connections));
+    std::vector<std::thread> threads;
+    std::atomic<long> waiting{ connections };
+    for (auto& r : results) threads.emplace_back([&] { Pump(packets, inflight, bodySize, waiting, r); });
+    while (waiting.load() > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    // Registration is not part of the run; the server's CPU count starts here.
+    const double cpuBefore = serverPid ? ProcessCpuSeconds(serverPid) : -1;
+    for (auto& t : threads) t.join();
+    const double serverCpu = cpuBefore >= 0 ? ProcessCpuSeconds(serverPid) - cpuBefore : -1;
+
+    uint64_t total = 0;
+    double slowest = 0;
+    auto first = results[0].start, last = results[0].end;
+    for (const auto& r : results) {
+        total += r.echoed;
+        slowest = std::max(slowest, Seconds(r.end - r.start));
+        first = std::min(first, r.start);
+        last = std::max(last, r.end);
+    }
+    const double elapsed = Seconds(last - first);
+    std::printf("connections=%ld packets=%ld inflight=%ld body=%zu\n", connections, packets, inflight, bodySize);
+    std::printf("echoed %.0f packets/s in total, %.0f per connection (slowest connection)\n",
+        total / elapsed, packets / slowest);
+    if (serverCpu >= 0)
+        std::printf("server CPU: %.2f s, %.2f us per packet\n", serverCpu, 1e6 * serverCpu / std::max<uint64_t>(total, 1));
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Group-commit throughput, in-process. BENCH_PRODUCERS threads each keep
+// BENCH_INFLIGHT chat inserts outstanding through SaveMessageAsync (as that
+// many busy sessions would) until BENCH_MESSAGES have been saved, and the
+// bench reports messages/sec and enqueue-to-commit latency. The batch
+// window is the server's own knob, so sweep it across runs:
+//
+//   for w in 0 250 1000 4000 16000; do TALKME_MSG_BATCH_US=$w ./group_commit; done
+//
+// BENCH_MODE=sync runs the same producers through SaveMessageReturnId
+// instead, one autocommit transaction per message, for the baseline.
+//
+// Run it in a scratch directory: Database opens talkme.db there.
+#include "../src/Database.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace TalkMe;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    long EnvOr(const char* name, long fallback) {
+        const char* v = std::getenv(name);
+        return v ? std::atol(v) : fallback;
+    }
+
+    // Counts a producer's outstanding inserts; the producer waits while it
+    // has `limit` in flight.
+    struct Window {
+        std::mutex mutex;
+        std::condition_variable cv;
+        long inFlight = 0;
+    };
+
+}
+
+int main() {
+    const long producers = EnvOr("BENCH_PRODUCERS", 8);
+    const long inflight = EnvOr("BENCH_INFLIGHT", 32);
+    const long messages = EnvOr("BENCH_MESSAGES", 50000);
+    const int cid = static_cast<int>(EnvOr("BENCH_CHANNEL", 1));
+    const char* mode = std::getenv("BENCH_MODE");
+    const bool sync = mode && std::strcmp(mode, "sync") == 0;
+
+    auto& db = Database::Get();
+    const long perProducer = messages / producers;
+    std::vector<double> latencyUs(static_cast<size_t>(perProducer * producers));
+    std::atomic<int> failed{ 0 };
+
+    const auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (long p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            const std::string sender = "producer" + std::to_string(p);
+            Window window;
+            for (long i = 0; i < perProducer; ++i) {
+                const size_t slot = static_cast<size_t>(p * perProducer + i);
+                const auto queued = Clock::now();
+                std::string text = "group commit " + std::to_string(i);
+                if (sync) {
+                    if (db.SaveMessageReturnId(cid, sender, text) <= 0) ++failed;
+                    latencyUs[slot] = std::chrono::duration<double, std::micro>(Clock::now() - queued).count();
+                    continue;
+                }
+                {
+                    std::unique_lock lock(window.mutex);
+                    window.cv.wait(lock, [&] { return window.inFlight < inflight; });
+                    ++window.inFlight;
+                }
+                db.SaveMessageAsync(cid, sender, std::move(text), "", 0,
+                    [&, slot, queued](int mid) {
+                        if (mid <= 0) ++failed;
+                        latencyUs[slot] = std::chrono::duration<double, std::micro>(Clock::now() - queued).count();
+                        std::lock_guard lock(window.mutex);
+                        --window.inFlight;
+                        window.cv.notify_one();
+                    });
+            }
+            std::unique_lock lock(window.mutex);
+            window.cv.wait(lock, [&] { return window.inFlight == 0; });
+        });
+    }
+    for (auto& t : threads) t.join();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(latencyUs.begin(), latencyUs.end());
+    auto pct = [&](double q) { return latencyUs[std::min(latencyUs.size() - 1, static_cast<size_t>(q * latencyUs.size()))]; };
+    const char* window = std::getenv("TALKME_MSG_BATCH_US");
+    std::printf("mode=%s window_us=%s producers=%ld inflight=%ld messages=%zu failed=%d\n",
+        sync ? "sync" : "group", sync ? "-" : (window ? window : "default"),
+        producers, sync ? 1L : inflight, latencyUs.size(), failed.load());
+    std::printf("throughput: %.0f msg/s   latency p50 %.0f us  p99 %.0f us\n",
+        latencyUs.size() / seconds, pct(0.50), pct(0.99));
+    std::fflush(stdout);
+    std::_Exit(0);   // skip the Database singleton's shutdown
+}
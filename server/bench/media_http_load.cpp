@@ -0,0 +1,222 @@
+// Media HTTP load test against port 5557. Writes two files into
+// attachments/ of the working directory (run it in the server's directory)
+// and then runs three phases, each with BENCH_CONNECTIONS clients:
+//
+//  requests   keep-alive GETs of the small file (BENCH_SMALL_BYTES), up to
+//             BENCH_PIPELINE requests outstanding per connection. A server
+//             that answers "Connection: close" costs a reconnect, and the
+//             requests it did not answer are sent again.
+//  downloads  back-to-back GETs of the large file (BENCH_LARGE_BYTES):
+//             aggregate MB/s.
+//  slow       BENCH_STALLED clients (default BENCH_CONNECTIONS) request the
+//             large file, read 64 KiB and then stop reading. With the server stalled on them, a fresh
+//             client times one small GET, and with BENCH_SERVER_PID set the
+//             server's resident memory growth per stalled connection is
+//             read from /proc.
+//
+// The first two phases run BENCH_SECONDS each.
+#include "BenchClient.h"
+
+#include <sys/stat.h>
+
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    constexpr uint16_t kMediaPort = 5557;
+
+    // One keep-alive HTTP connection; reads responses, discarding bodies.
+    class HttpConnection {
+    public:
+        HttpConnection() : m_Fd(ConnectTcp(kMediaPort)) {}
+        ~HttpConnection() { ::close(m_Fd); }
+        HttpConnection(const HttpConnection&) = delete;
+        HttpConnection& operator=(const HttpConnection&) = delete;
+
+        int Fd() const { return m_Fd; }
+
+        void Get(const std::string& id, size_t count = 1) {
+            std::string out;
+            for (size_t i = 0; i < count; ++i)
+                out += "GET /media/" + id + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+            WriteAll(m_Fd, out.data(), out.size());
+        }
+
+        struct Response {
+            int status = 0;
+            uint64_t bodyBytes = 0;
+            bool close = false;
+        };
+
+        // Reads one response; `bodyLimit` stops reading the body after that
+        // many bytes (the rest stays unread in the socket). False on EOF.
+        bool Read(Response& r, uint64_t bodyLimit = UINT64_MAX) {
+            size_t end;
+            while ((end = m_In.find("\r\n\r\n")) == std::string::npos)
+                if (!Fill()) return false;
+            const std::string head = m_In.substr(0, end);
+            m_In.erase(0, end + 4);
+
+            r = {};
+            r.status = std::atoi(head.c_str() + head.find(' ') + 1);
+            uint64_t length = 0;
+            std::string lower(head);
+            for (char& c : lower) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            if (const size_t p = lower.find("\r\ncontent-length:"); p != std::string::npos)
+                length = std::strtoull(lower.c_str() + p + 17, nullptr, 10);
+            r.close = lower.find("\r\nconnection: close") != std::string::npos;
+
+            uint64_t want = std::min(length, bodyLimit);
+            while (r.bodyBytes < want) {
+                if (m_In.empty() && !Fill()) return false;
+                const size_t take = static_cast<size_t>(std::min<uint64_t>(m_In.size(), want - r.bodyBytes));
+                m_In.erase(0, take);
+                r.bodyBytes += take;
+            }
+            return true;
+        }
+
+    private:
+        bool Fill() {
+            char chunk[256 * 1024];
+            const ssize_t n = ::recv(m_Fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) return false;
+            m_In.append(chunk, static_cast<size_t>(n));
+            return true;
+        }
+
+        int m_Fd;
+        std::string m_In;
+    };
+
+    void WriteFile(const std::string& id, size_t bytes) {
+        ::mkdir("attachments", 0755);
+        std::ofstream f("attachments/" + id, std::ios::binary | std::ios::trunc);
+        std::string block(64 * 1024, 'm');
+        for (size_t left = bytes; left > 0; left -= std::min(left, block.size()))
+            f.write(block.data(), static_cast<std::streamsize>(std::min(left, block.size())));
+        if (!f) Fail("cannot write attachments/" + id);
+    }
+
+    long ResidentKb(long pid) {
+        std::ifstream f("/proc/" + std::to_string(pid) + "/status");
+        for (std::string line; std::getline(f, line);)
+            if (line.rfind("VmRSS:", 0) == 0) return std::atol(line.c_str() + 6);
+        return -1;
+    }
+
+    struct Counts {
+        uint64_t responses = 0, bytes = 0, connects = 1;
+        double seconds = 0;
+    };
+
+    // Keeps `pipeline` GETs outstanding on one connection until `end`.
+    void RequestLoop(const std::string& id, size_t pipeline, Clock::time_point end, Counts& c) {
+        auto conn = std::make_unique<HttpConnection>();
+        size_t outstanding = 0;
+        while (Clock::now() < end) {
+            if (outstanding < pipeline) {
+                conn->Get(id, pipeline - outstanding);
+                outstanding = pipeline;
+            }
+            HttpConnection::Response r;
+            const bool ok = conn->Read(r);
+            if (ok) {
+                if (r.status != 200) Fail("status " + std::to_string(r.status));
+                ++c.responses;
+                c.bytes += r.bodyBytes;
+                --outstanding;
+            }
+            if (!ok || r.close) {
+                conn = std::make_unique<HttpConnection>();
+                ++c.connects;
+                outstanding = 0;
+            }
+        }
+    }
+
+    Counts RunPhase(long clients, const std::string& id, size_t pipeline, long seconds) {
+        std::vector<Counts> counts(static_cast<size_t>(clients));
+        std::vector<std::thread> threads;
+        const auto start = Clock::now();
+        const auto end = start + std::chrono::seconds(seconds);
+        for (auto& c : counts) threads.emplace_back([&] { RequestLoop(id, pipeline, end, c); });
+        for (auto& t : threads) t.join();
+        Counts total{ 0, 0, 0, Seconds(Clock::now() - start) };
+        for (const auto& c : counts) {
+            total.responses += c.responses;
+            total.bytes += c.bytes;
+            total.connects += c.connects;
+        }
+        return total;
+    }
+
+}
+
+int main() {
+    const long clients = EnvOr("BENCH_CONNECTIONS", 32);
+    const long seconds = EnvOr("BENCH_SECONDS", 5);
+    const size_t pipeline = static_cast<size_t>(std::max(1L, EnvOr("BENCH_PIPELINE", 8)));
+    const size_t smallBytes = static_cast<size_t>(EnvOr("BENCH_SMALL_BYTES", 16 * 1024));
+    const size_t largeBytes = static_cast<size_t>(EnvOr("BENCH_LARGE_BYTES", 10 * 1024 * 1024));
+    const long stalledCount = EnvOr("BENCH_STALLED", clients);
+    const long serverPid = EnvOr("BENCH_SERVER_PID", 0);
+
+    const std::string smallId = "bench_small.bin", largeId = "bench_large.bin";
+    WriteFile(smallId, smallBytes);
+    WriteFile(largeId, largeBytes);
+    std::printf("connections=%ld seconds=%ld pipeline=%zu small=%zu B large=%zu B\n",
+        clients, seconds, pipeline, smallBytes, largeBytes);
+
+    Counts r = RunPhase(clients, smallId, pipeline, seconds);
+    std::printf("requests:  %.0f req/s, %llu connections opened\n",
+        r.responses / r.seconds, static_cast<unsigned long long>(r.connects));
+
+    Counts d = RunPhase(clients, largeId, 1, seconds);
+    std::printf("downloads: %.0f MB/s (%.1f files/s)\n",
+        d.bytes / 1e6 / d.seconds, d.responses / d.seconds);
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    const long rssBefore = serverPid ? ResidentKb(serverPid) : -1;
+    std::vector<std::unique_ptr<HttpConnection>> stalled;
+    for (long i = 0; i < stalledCount; ++i) {
+        stalled.push_back(std::make_unique<HttpConnection>());
+        stalled.back()->Get(largeId);
+    }
+    // Read only the start of each body; the server is left with the rest.
+    // A server answering one connection at a time may never reach them all,
+    // so these reads share a three second deadline.
+    const auto deadline = Clock::now() + std::chrono::seconds(3);
+    for (auto& c : stalled) {
+        const auto left = std::max<int64_t>(10'000, std::chrono::duration_cast<std::chrono::microseconds>(deadline - Clock::now()).count());
+        timeval timeout{ static_cast<time_t>(left / 1'000'000), static_cast<suseconds_t>(left % 1'000'000) };
+        ::setsockopt(c->Fd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        HttpConnection::Response resp;
+        c->Read(resp, 64 * 1024);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    const long rssStalled = serverPid ? ResidentKb(serverPid) : -1;
+
+    const auto probeStart = Clock::now();
+    HttpConnection probe;
+    timeval probeTimeout{ 10, 0 };
+    ::setsockopt(probe.Fd(), SOL_SOCKET, SO_RCVTIMEO, &probeTimeout, sizeof(probeTimeout));
+    probe.Get(smallId);
+    HttpConnection::Response pr;
+    const bool answered = probe.Read(pr);
+    const double probeMs = Seconds(Clock::now() - probeStart) * 1e3;
+    if (answered) std::printf("slow:      small GET beside %ld stalled downloads took %.1f ms\n", stalledCount, probeMs);
+    else std::printf("slow:      small GET beside %ld stalled downloads got no answer in %.0f ms\n", stalledCount, probeMs);
+    if (rssBefore >= 0 && rssStalled >= 0)
+        std::printf("server RSS: %ld KiB before, %ld KiB with the stalled downloads (%.0f KiB per connection)\n",
+            rssBefore, rssStalled, static_cast<double>(rssStalled - rssBefore) / stalledCount);
+    std::fflush(stdout);
+    std::_Exit(0);   // a server stuck on a stalled client would make close() linger
+}
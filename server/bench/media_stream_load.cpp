@@ -0,0 +1,195 @@
+// Attachment download over the chat connection: the base64 Media_Response
+// path against the streamed one (Media_Chunk with Media_Ack credit). Writes
+// attachments/bench_stream.bin (BENCH_FILE_BYTES) into the working
+// directory, so run it in the server's directory.
+//
+// One session downloads the file BENCH_TRANSFERS times per mode, back to
+// back, while
+//  - it sends itself an Echo_Request every BENCH_PROBE_MS, and
+//  - a second user posts a chat message to the default text channel every
+//    BENCH_PROBE_MS, which reaches the downloader as a broadcast.
+// Both carry their send time, so the report shows how long the
+// downloader's other traffic waits behind the transfer, next to the same
+// probes with no transfer running. Per mode: time to the first file byte,
+// time to the whole file, and echo and chat latency.
+#include "BenchClient.h"
+
+#include <sys/stat.h>
+
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    enum class Mode { Idle, Base64, Stream };
+    const char* Name(Mode m) { return m == Mode::Idle ? "idle" : m == Mode::Base64 ? "base64" : "stream"; }
+
+    // Writes from the probe thread and the downloader's acks share the socket.
+    class LockedConnection : public Connection {
+    public:
+        void SendLocked(PacketType type, std::string_view body) {
+            std::lock_guard lock(m_WriteMutex);
+            Send(type, body);
+        }
+
+    private:
+        std::mutex m_WriteMutex;
+    };
+
+    struct Probes {
+        LatencyHistogram echo, chat;
+    };
+
+    void PutU32(std::string& out, uint32_t v) {
+        v = HostToNet32(v);
+        out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    uint32_t GetU32(const std::string& body, size_t at) {
+        uint32_t v;
+        std::memcpy(&v, body.data() + at, sizeof(v));
+        return NetToHost32(v);
+    }
+
+    // Reads the downloader's connection until the transfer (if any) is done
+    // and `until` has passed, timing the probes that arrive meanwhile.
+    // Returns {first byte, last byte} in seconds from `requested`.
+    std::pair<double, double> Download(LockedConnection& c, Mode mode, uint32_t fileBytes,
+        Clock::time_point requested, Clock::time_point until, Probes& probes)
+    {
+        double first = -1, last = -1;
+        uint32_t tid = 0, received = 0, acked = 0;
+        bool done = mode == Mode::Idle;
+        PacketType type;
+        std::string body;
+        while (!done || Clock::now() < until) {
+            if (!c.Read(type, body)) Fail("downloader disconnected");
+            const auto now = Clock::now();
+            switch (type) {
+            case PacketType::Echo_Response: {
+                int64_t sent;
+                std::memcpy(&sent, body.data(), sizeof(sent));
+                probes.echo.Add(NowNs() - sent);
+                break;
+            }
+            case PacketType::Message_Text: {
+                const auto j = nlohmann::json::parse(body, nullptr, false);
+                const std::string msg = j.is_object() ? j.value("msg", "") : "";
+                if (msg.rfind("probe ", 0) == 0) probes.chat.Add(NowNs() - std::atoll(msg.c_str() + 6));
+                break;
+            }
+            case PacketType::Media_Response: {
+                const auto j = nlohmann::json::parse(body);
+                if (j.contains("error")) Fail("media error " + j["error"].get<std::string>());
+                if (j.contains("data")) {   // the whole file, base64, in this one packet
+                    first = last = Seconds(now - requested);
+                    done = true;
+                }
+                else {
+                    tid = j.value("tid", 0u);
+                    if (j.value("size", 0u) != fileBytes) Fail("stream size mismatch");
+                }
+                break;
+            }
+            case PacketType::Media_Chunk: {
+                if (GetU32(body, 0) != tid || GetU32(body, 4) != received) Fail("chunk out of order");
+                if (first < 0) first = Seconds(now - requested);
+                received += static_cast<uint32_t>(body.size() - 8);
+                if (received == fileBytes) {
+                    last = Seconds(now - requested);
+                    done = true;
+                }
+                else if (received - acked >= kMediaStreamAckBytes) {
+                    std::string ack;
+                    PutU32(ack, tid);
+                    PutU32(ack, received);
+                    c.SendLocked(PacketType::Media_Ack, ack);
+                    acked = received;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        return { first, last };
+    }
+
+    void WriteFile(const std::string& id, size_t bytes) {
+        ::mkdir("attachments", 0755);
+        std::ofstream f("attachments/" + id, std::ios::binary | std::ios::trunc);
+        std::string block(64 * 1024, 's');
+        for (size_t left = bytes; left > 0; left -= std::min(left, block.size()))
+            f.write(block.data(), static_cast<std::streamsize>(std::min(left, block.size())));
+        if (!f) Fail("cannot write attachments/" + id);
+    }
+
+}
+
+int main() {
+    const uint32_t fileBytes = static_cast<uint32_t>(EnvOr("BENCH_FILE_BYTES", 8 * 1024 * 1024));
+    const long transfers = EnvOr("BENCH_TRANSFERS", 20);
+    const long probeMs = EnvOr("BENCH_PROBE_MS", 1);
+    const std::string id = "bench_stream.bin";
+    WriteFile(id, fileBytes);
+
+    LockedConnection downloader;
+    downloader.Register(UniqueName("dl"));
+    Connection chatter;
+    chatter.Register(UniqueName("chat"));
+    const int cid = chatter.FirstChannel("text");
+    // The chatter's own copies of its broadcasts are not read; keep its
+    // socket drained so the server never sheds them.
+    std::thread([fd = chatter.Fd()] {
+        char buf[64 * 1024];
+        while (::recv(fd, buf, sizeof(buf), 0) > 0) {}
+    }).detach();
+
+    std::atomic<bool> stop{ false };
+    std::thread prober([&] {
+        for (auto next = Clock::now(); !stop.load(); next += std::chrono::milliseconds(probeMs)) {
+            const int64_t now = NowNs();
+            downloader.SendLocked(PacketType::Echo_Request, std::string_view(reinterpret_cast<const char*>(&now), sizeof(now)));
+            chatter.Send(PacketType::Message_Text,
+                nlohmann::json{ { "cid", cid }, { "msg", "probe " + std::to_string(now) } }.dump());
+            std::this_thread::sleep_until(next + std::chrono::milliseconds(probeMs));
+        }
+    });
+
+    std::printf("file=%u B transfers=%ld probe every %ld ms\n", fileBytes, transfers, probeMs);
+    std::printf("%-7s %14s %14s | %22s | %22s\n", "mode", "first byte ms", "complete ms", "echo p50/p99/p99.9 ms", "chat p50/p99/p99.9 ms");
+    for (Mode mode : { Mode::Idle, Mode::Stream, Mode::Base64 }) {
+        Probes probes;
+        double firstSum = 0, lastSum = 0;
+        for (long i = 0; i < transfers; ++i) {
+            const auto requested = Clock::now();
+            if (mode != Mode::Idle) {
+                nlohmann::json req{ { "id", id } };
+                if (mode == Mode::Stream) req["stream"] = 1;
+                downloader.SendLocked(PacketType::Media_Request, req.dump());
+            }
+            // Idle rounds just collect probes for a while.
+            const auto until = requested + std::chrono::milliseconds(mode == Mode::Idle ? 100 : 0);
+            const auto [first, last] = Download(downloader, mode, fileBytes, requested, until, probes);
+            firstSum += first;
+            lastSum += last;
+        }
+        char firstText[32] = "-", lastText[32] = "-";
+        if (mode != Mode::Idle) {
+            std::snprintf(firstText, sizeof(firstText), "%.1f", 1e3 * firstSum / transfers);
+            std::snprintf(lastText, sizeof(lastText), "%.1f", 1e3 * lastSum / transfers);
+        }
+        std::printf("%-7s %14s %14s | %6.2f %6.2f %7.2f | %6.2f %6.2f %7.2f\n", Name(mode), firstText, lastText,
+            probes.echo.PercentileMs(0.50), probes.echo.PercentileMs(0.99), probes.echo.PercentileMs(0.999),
+            probes.chat.PercentileMs(0.50), probes.chat.PercentileMs(0.99), probes.chat.PercentileMs(0.999));
+    }
+    stop = true;
+    prober.join();
+    std::fflush(stdout);
+    std::_Exit(0);
+}
@@ -0,0 +1,136 @@
+// Selective forwarding simulation. Feeds ActiveSpeakerTracker the packet
+// stream of one simulated voice channel and compares relay egress with
+// every active speaker forwarded against TALKME_VOICE_TOPN-style top-N
+// forwarding, using the same gate HandleVoiceUdpPacket applies per packet
+// (Touch, then ShouldForward). Time is simulated, so a long conversation
+// runs in well under a second.
+//
+// Channel model, per member: talk spurts and pauses alternate with
+// exponentially distributed lengths, tuned so BENCH_TALKERS members talk at
+// once on average; talking frames carry a speech level (10-35 -dBov).
+// BENCH_OPEN_MICS percent of members send every 20 ms frame even between
+// spurts, at a background level (50-90 -dBov), like clients without
+// DTX or with an open mic in a noisy room; the rest send only while talking.
+//
+// The quality check counts talking frames that top-N dropped while no more
+// than N members were talking: those would be audible losses.
+#include "../src/ActiveSpeakerTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using TalkMe::ActiveSpeakerTracker;
+
+namespace {
+
+    long EnvOr(const char* name, long fallback) {
+        const char* v = std::getenv(name);
+        return v ? std::atol(v) : fallback;
+    }
+
+    constexpr int64_t kFrameMs = 20;
+    constexpr int64_t kActiveSpeakerWindowMs = 2'000;   // TalkMeServer's value
+
+    struct Member {
+        uint32_t userId = 0;
+        bool openMic = false;
+        bool talking = false;
+        int64_t stateEndsMs = 0;
+        uint8_t speechLevel = 0;
+        uint8_t noiseLevel = 0;
+        int64_t phaseMs = 0;   // send offset within each frame
+        std::atomic<int> fullSlot{ -1 };
+        std::atomic<int> topSlot{ -1 };
+    };
+
+}
+
+int main() {
+    const long memberCount = EnvOr("BENCH_MEMBERS", 50);
+    const long topN = EnvOr("BENCH_TOPN", 3);
+    const long seconds = EnvOr("BENCH_SECONDS", 600);
+    const long talkers = std::max(1L, EnvOr("BENCH_TALKERS", 2));
+    const long openMicPct = EnvOr("BENCH_OPEN_MICS", 50);
+    const double spurtMs = 1500.0;
+    const double pauseMs = spurtMs * (static_cast<double>(memberCount) / talkers - 1.0);
+
+    std::mt19937 rng(12345);
+    std::exponential_distribution<double> spurt(1.0 / spurtMs), pause(1.0 / std::max(pauseMs, 1.0));
+    std::uniform_int_distribution<int> speech(10, 35), noise(50, 90), phase(0, kFrameMs - 1);
+    std::uniform_int_distribution<int> pct(0, 99);
+
+    std::vector<Member> members(static_cast<size_t>(memberCount));
+    for (size_t i = 0; i < members.size(); ++i) {
+        auto& m = members[i];
+        m.userId = static_cast<uint32_t>(i + 1);
+        m.openMic = pct(rng) < openMicPct;
+        m.noiseLevel = static_cast<uint8_t>(noise(rng));
+        m.phaseMs = phase(rng);
+        m.stateEndsMs = static_cast<int64_t>(pause(rng));
+    }
+
+    ActiveSpeakerTracker full, top;
+    uint64_t inbound = 0, fullForwarded = 0, topForwarded = 0, capDropped = 0;
+    uint64_t talkFrames = 0, talkForwarded = 0, audibleLosses = 0, framesAtOrBelowN = 0;
+    std::vector<Member*> order;
+    order.reserve(members.size());
+    for (int64_t frame = 0; frame < seconds * 1000; frame += kFrameMs) {
+        long talkingNow = 0;
+        for (auto& m : members) {
+            if (frame >= m.stateEndsMs) {
+                m.talking = !m.talking;
+                m.stateEndsMs = frame + static_cast<int64_t>(m.talking ? spurt(rng) : pause(rng));
+                if (m.talking) m.speechLevel = static_cast<uint8_t>(speech(rng));
+            }
+            talkingNow += m.talking;
+        }
+        if (talkingNow <= topN) ++framesAtOrBelowN;
+
+        // Within a frame, packets arrive in the order of their send phase.
+        order.clear();
+        for (auto& m : members)
+            if (m.talking || m.openMic) order.push_back(&m);
+        std::sort(order.begin(), order.end(), [](const Member* a, const Member* b) { return a->phaseMs < b->phaseMs; });
+
+        for (Member* m : order) {
+            const int64_t now = frame + m->phaseMs;
+            const uint8_t level = m->talking ? m->speechLevel : m->noiseLevel;
+            ++inbound;
+            if (m->talking) ++talkFrames;
+
+            if (full.Touch(m->userId, m->fullSlot, now, kActiveSpeakerWindowMs)) ++fullForwarded;
+            else ++capDropped;
+
+            const bool admitted = top.Touch(m->userId, m->topSlot, now, kActiveSpeakerWindowMs);
+            if (admitted && top.ShouldForward(m->topSlot.load(), level, static_cast<size_t>(topN), now)) {
+                ++topForwarded;
+                if (m->talking) ++talkForwarded;
+            }
+            else if (m->talking && talkingNow <= topN) {
+                ++audibleLosses;
+            }
+        }
+    }
+
+    const double listeners = static_cast<double>(memberCount - 1);
+    const double perListenerFull = fullForwarded * listeners / memberCount / seconds;
+    const double perListenerTop = topForwarded * listeners / memberCount / seconds;
+    std::printf("members=%ld topN=%ld talkers=%ld open_mics=%ld%% simulated=%lds\n",
+        memberCount, topN, talkers, openMicPct, seconds);
+    std::printf("inbound %.0f pkt/s (speaker cap dropped %.2f%%)\n",
+        static_cast<double>(inbound) / seconds, 100.0 * capDropped / std::max<uint64_t>(inbound, 1));
+    std::printf("egress per listener: all speakers %.0f pkt/s, top-%ld %.0f pkt/s (%.1fx less)\n",
+        perListenerFull, topN, perListenerTop, perListenerFull / std::max(perListenerTop, 1e-9));
+    std::printf("channel egress: all speakers %.0f pkt/s, top-%ld %.0f pkt/s\n",
+        fullForwarded * listeners / seconds, topN, topForwarded * listeners / seconds);
+    std::printf("talking frames forwarded by top-%ld: %.2f%%; dropped while <=%ld talking: %llu of %llu frames\n",
+        topN, 100.0 * talkForwarded / std::max<uint64_t>(talkFrames, 1), topN,
+        static_cast<unsigned long long>(audibleLosses), static_cast<unsigned long long>(talkFrames));
+    std::printf("(%.1f%% of the time at most %ld members were talking)\n",
+        100.0 * framesAtOrBelowN * kFrameMs / (seconds * 1000.0), topN);
+    return 0;
+}
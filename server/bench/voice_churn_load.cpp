@@ -0,0 +1,157 @@
+// Voice routing contention: BENCH_MEMBERS users speak in one voice channel
+// at BENCH_PPS while BENCH_CHURNERS other sessions join it, send a UDP hello
+// and leave again, each BENCH_CHURN_RATE times a second (0: as fast as the
+// server lets them). Every join, hello and leave rebuilds the channel's
+// routing, so this shows what membership churn costs the packets being
+// relayed meanwhile. Each voice datagram carries its send time; the report
+// is relay latency and delivery (run once with BENCH_CHURNERS=0 for the
+// baseline).
+#include "BenchClient.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    struct Member {
+        std::unique_ptr<Connection> tcp;
+        std::string name;
+        int udp = -1;
+        std::string packet;
+        uint32_t seq = 0;
+    };
+
+    // The send timestamp sits in the last 8 bytes of the packet.
+    void Stamp(std::string& packet) {
+        const int64_t now = NowNs();
+        std::memcpy(packet.data() + packet.size() - sizeof(now), &now, sizeof(now));
+    }
+
+    void Receive(const std::vector<Member>& members, const std::atomic<bool>& stop,
+        const std::atomic<bool>& measuring, LatencyHistogram& latency)
+    {
+        int ep = epoll_create1(0);
+        for (const auto& m : members) {
+            for (int fd : { m.udp, m.tcp->Fd() }) {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.u64 = (static_cast<uint64_t>(fd) << 1) | (fd == m.udp ? 1 : 0);
+                epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+            }
+        }
+        epoll_event events[64];
+        static char buf[64 * 1024];
+        while (!stop.load(std::memory_order_relaxed)) {
+            const int n = epoll_wait(ep, events, 64, 50);
+            for (int i = 0; i < n; ++i) {
+                const int fd = static_cast<int>(events[i].data.u64 >> 1);
+                const bool udp = events[i].data.u64 & 1;
+                ssize_t got;
+                while ((got = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                    if (!udp || got < 8 || !measuring.load(std::memory_order_relaxed)) continue;
+                    int64_t sentAt;
+                    std::memcpy(&sentAt, buf + got - sizeof(sentAt), sizeof(sentAt));
+                    latency.Add(NowNs() - sentAt);
+                }
+            }
+        }
+        ::close(ep);
+    }
+
+    // Joins, hellos and leaves `rate` times a second (0: flat out) until
+    // `stop`; counts completed cycles.
+    void Churn(int cid, long rate, const std::atomic<bool>& stop, std::atomic<uint64_t>& cycles) {
+        Connection c;
+        const std::string name = c.Register(UniqueName("churn"));
+        const int udp = ConnectUdp();
+        ::fcntl(c.Fd(), F_SETFL, ::fcntl(c.Fd(), F_GETFL) | O_NONBLOCK);
+        char buf[16 * 1024];
+        const auto period = std::chrono::nanoseconds(rate > 0 ? 1000000000L / rate : 0);
+        auto next = Clock::now();
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (rate > 0) std::this_thread::sleep_until(next += period);
+            c.JoinVoice(cid);
+            SendUdpHello(udp, name, cid);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            c.JoinVoice(-1);
+            while (::recv(c.Fd(), buf, sizeof(buf), MSG_DONTWAIT) > 0) {}
+            cycles.fetch_add(1, std::memory_order_relaxed);
+        }
+        ::close(udp);
+    }
+
+}
+
+int main() {
+    const long memberCount = EnvOr("BENCH_MEMBERS", 30);
+    const long churners = EnvOr("BENCH_CHURNERS", 20);
+    const long churnRate = EnvOr("BENCH_CHURN_RATE", 0);
+    const long pps = EnvOr("BENCH_PPS", 100);
+    const long seconds = EnvOr("BENCH_SECONDS", 5);
+
+    std::vector<Member> members(static_cast<size_t>(memberCount));
+    int cid = -1;
+    for (auto& m : members) {
+        m.tcp = std::make_unique<Connection>();
+        m.name = m.tcp->Register(UniqueName("vc"));
+        if (cid < 0) cid = m.tcp->FirstChannel("voice");
+        m.tcp->JoinVoice(cid);
+        m.udp = ConnectUdp();
+        m.packet = MakeVoicePacket(m.name, 80);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    for (auto& m : members) SendUdpHello(m.udp, m.name, cid);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    std::atomic<bool> stop{ false }, measuring{ false };
+    std::atomic<uint64_t> cycles{ 0 };
+    LatencyHistogram latency;
+    std::thread receiver([&] { Receive(members, stop, measuring, latency); });
+    std::vector<std::thread> churn;
+    for (long i = 0; i < churners; ++i) churn.emplace_back([&] { Churn(cid, churnRate, stop, cycles); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    const auto tick = std::chrono::nanoseconds(1000000000L / pps);
+    const uint64_t cyclesBefore = cycles.load();
+    uint64_t sent = 0;
+    measuring = true;
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::seconds(seconds);
+    for (auto next = start; next < end; next += tick) {
+        for (auto& m : members) {
+            SetVoiceSeq(m.packet, ++m.seq);
+            Stamp(m.packet);
+            if (::send(m.udp, m.packet.data(), m.packet.size(), 0) > 0) ++sent;
+        }
+        std::this_thread::sleep_until(next + tick);
+    }
+    const double elapsed = Seconds(Clock::now() - start);
+    const uint64_t churned = cycles.load() - cyclesBefore;
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    measuring = false;
+    stop = true;
+    for (auto& t : churn) t.join();
+    receiver.join();
+
+    const uint64_t expected = sent * static_cast<uint64_t>(memberCount - 1);
+    std::printf("members=%ld churners=%ld churn_rate=%ld pps=%ld seconds=%ld\n",
+        memberCount, churners, churnRate, pps, seconds);
+    std::printf("churn: %.0f join/hello/leave cycles/s\n", churned / elapsed);
+    std::printf("relayed %llu of %llu datagrams (%.2f%%)\n",
+        static_cast<unsigned long long>(latency.Total()), static_cast<unsigned long long>(expected),
+        100.0 * latency.Total() / std::max<uint64_t>(expected, 1));
+    std::printf("relay latency: p50 %.2f ms  p99 %.2f ms  p99.9 %.2f ms\n",
+        latency.PercentileMs(0.50), latency.PercentileMs(0.99), latency.PercentileMs(0.999));
+    return 0;
+}
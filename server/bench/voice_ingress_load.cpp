@@ -0,0 +1,88 @@
+// UDP voice ingress load: BENCH_SOURCES client sockets (distinct source
+// ports, so SO_REUSEPORT hashes them across the server's voice sockets)
+// flood VOICE_PORT with ping datagrams from BENCH_THREADS threads, keeping
+// at most BENCH_WINDOW pings unanswered per socket. Every ping is echoed
+// by HandleVoiceUdpPacket, so the pong rate is the rate at which the
+// ingress loops receive, dispatch and reply. Compare server runs with
+// TALKME_VOICE_SOCKETS=1 and =N on a machine with at least N cores.
+#include "BenchClient.h"
+
+#include <poll.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    struct Totals {
+        std::atomic<uint64_t> sent{ 0 };
+        std::atomic<uint64_t> received{ 0 };
+    };
+
+    void Drive(std::vector<int> sockets, long window, Clock::time_point end, Totals& totals) {
+        char ping[1 + 8] = { static_cast<char>(kUdpPing) };
+        char buf[64];
+        std::vector<long> outstanding(sockets.size(), 0);
+        std::vector<pollfd> fds;
+        for (int fd : sockets) fds.push_back({ fd, POLLIN, 0 });
+        uint64_t seq = 0, sent = 0, received = 0;
+        while (Clock::now() < end) {
+            for (size_t i = 0; i < sockets.size(); ++i) {
+                while (outstanding[i] < window) {
+                    ++seq;
+                    std::memcpy(ping + 1, &seq, sizeof(seq));
+                    if (::send(sockets[i], ping, sizeof(ping), MSG_DONTWAIT) <= 0) break;
+                    ++outstanding[i];
+                    ++sent;
+                }
+            }
+            // A lost datagram must not stall a socket forever: after a quiet
+            // poll the windows are reopened.
+            if (::poll(fds.data(), fds.size(), 20) == 0) {
+                std::fill(outstanding.begin(), outstanding.end(), 0);
+                continue;
+            }
+            for (size_t i = 0; i < sockets.size(); ++i) {
+                while (::recv(sockets[i], buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+                    if (static_cast<uint8_t>(buf[0]) != kUdpPong) continue;
+                    if (outstanding[i] > 0) --outstanding[i];
+                    ++received;
+                }
+            }
+        }
+        totals.sent += sent;
+        totals.received += received;
+    }
+
+}
+
+int main() {
+    const long sources = EnvOr("BENCH_SOURCES", 32);
+    const long threads = std::max(1L, EnvOr("BENCH_THREADS", 4));
+    const long window = EnvOr("BENCH_WINDOW", 16);
+    const long seconds = EnvOr("BENCH_SECONDS", 5);
+
+    std::vector<std::vector<int>> perThread(static_cast<size_t>(threads));
+    for (long i = 0; i < sources; ++i)
+        perThread[static_cast<size_t>(i % threads)].push_back(ConnectUdp());
+
+    Totals totals;
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::seconds(seconds);
+    std::vector<std::thread> workers;
+    for (auto& sockets : perThread)
+        workers.emplace_back([&, sockets] { Drive(sockets, window, end, totals); });
+    for (auto& w : workers) w.join();
+    const double elapsed = Seconds(Clock::now() - start);
+
+    std::printf("sources=%ld threads=%ld window=%ld seconds=%ld\n", sources, threads, window, seconds);
+    std::printf("sent %.0f pings/s, echoed %.0f pongs/s (%.1f%% answered)\n",
+        totals.sent / elapsed, totals.received / elapsed,
+        100.0 * totals.received / std::max<uint64_t>(totals.sent, 1));
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Voice relay microbenchmark. Runs a TalkMeServer in-process, puts
+// BENCH_MEMBERS users in one voice channel and has every member speak at
+// BENCH_PPS over real loopback UDP, so each datagram goes through
+// HandleVoiceUdpPacket exactly as in production. Reports the io threads' CPU
+// time per inbound packet and heap allocations per inbound packet; a global
+// operator new counts the latter. The client side of this file does not
+// allocate once traffic starts, so every counted allocation is the server's.
+//
+// Run it in a scratch directory: the server opens talkme.db there.
+#include "BenchClient.h"
+#include "../src/TalkMeServer.h"
+
+#include <asio.hpp>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace {
+    std::atomic<uint64_t> g_Allocations{ 0 };
+}
+
+void* operator new(std::size_t size) {
+    g_Allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+    g_Allocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t a = static_cast<size_t>(align);
+    if (void* p = std::aligned_alloc(a, (size + a - 1) / a * a)) return p;
+    throw std::bad_alloc();
+}
+// GCC flags free() inside a replaced operator delete as mismatched with
+// new; here both sides are the malloc family, so the warning is spurious.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+using namespace TalkMe;
+using namespace TalkMe::Bench;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    struct Member {
+        std::unique_ptr<Connection> tcp;
+        std::string name;
+        int udp = -1;
+        std::string packet;
+        uint32_t seq = 0;
+    };
+
+    double ThreadCpuSeconds(std::vector<std::thread>& threads) {
+        double total = 0;
+        for (auto& t : threads) {
+            clockid_t id;
+            timespec ts{};
+            if (pthread_getcpuclockid(t.native_handle(), &id) == 0 && clock_gettime(id, &ts) == 0)
+                total += static_cast<double>(ts.tv_sec) + ts.tv_nsec / 1e9;
+        }
+        return total;
+    }
+
+    // Drains every member socket; UDP datagrams are counted, TCP control
+    // traffic (voice state, speaker updates) is discarded.
+    void Receive(const std::vector<Member>& members, std::atomic<bool>& stop,
+        std::atomic<uint64_t>& datagrams)
+    {
+        int ep = epoll_create1(0);
+        for (size_t i = 0; i < members.size(); ++i) {
+            for (int fd : { members[i].udp, members[i].tcp->Fd() }) {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.u64 = (static_cast<uint64_t>(fd) << 1) | (fd == members[i].udp ? 1 : 0);
+                epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+            }
+        }
+        epoll_event events[64];
+        static char buf[64 * 1024];
+        while (!stop.load(std::memory_order_relaxed)) {
+            const int n = epoll_wait(ep, events, 64, 50);
+            for (int i = 0; i < n; ++i) {
+                const int fd = static_cast<int>(events[i].data.u64 >> 1);
+                const bool udp = events[i].data.u64 & 1;
+                while (::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+                    if (udp) datagrams.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        ::close(ep);
+    }
+
+    // Every member sends one packet per tick for `seconds`; returns packets sent.
+    uint64_t Speak(std::vector<Member>& members, long pps, double seconds) {
+        const auto tick = std::chrono::nanoseconds(1000000000L / pps);
+        const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(seconds));
+        uint64_t sent = 0;
+        for (auto next = Clock::now(); next < end; next += tick) {
+            for (auto& m : members) {
+                SetVoiceSeq(m.packet, ++m.seq);
+                if (::send(m.udp, m.packet.data(), m.packet.size(), 0) > 0) ++sent;
+            }
+            std::this_thread::sleep_until(next + tick);
+        }
+        return sent;
+    }
+
+}
+
+int main() {
+    const long memberCount = EnvOr("BENCH_MEMBERS", 30);
+    const long pps = EnvOr("BENCH_PPS", 100);
+    const long seconds = EnvOr("BENCH_SECONDS", 5);
+    const long opusBytes = EnvOr("BENCH_OPUS_BYTES", 80);
+    const long threadCount = EnvOr("BENCH_THREADS",
+        std::clamp<long>(std::thread::hardware_concurrency(), 1, 16));
+
+    asio::io_context io;
+    TalkMeServer server(io, static_cast<short>(SERVER_PORT));
+    std::vector<std::thread> ioThreads;
+    for (long i = 0; i < threadCount; ++i) ioThreads.emplace_back([&io] { io.run(); });
+
+    std::vector<Member> members(static_cast<size_t>(memberCount));
+    int cid = -1;
+    for (auto& m : members) {
+        m.tcp = std::make_unique<Connection>();
+        m.name = m.tcp->Register(UniqueName("vr"));
+        if (cid < 0) cid = m.tcp->FirstChannel("voice");
+        m.tcp->JoinVoice(cid);
+        m.udp = ConnectUdp();
+        m.packet = MakeVoicePacket(m.name, static_cast<size_t>(opusBytes));
+    }
+    // Hellos are checked against the session's voice channel, so they go
+    // out once the joins have been applied.
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    for (auto& m : members) SendUdpHello(m.udp, m.name, cid);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> datagrams{ 0 };
+    std::thread receiver([&] { Receive(members, stop, datagrams); });
+
+    Speak(members, pps, 1.0);   // warm-up: pools, scratch vectors, snapshots
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    const uint64_t allocBefore = g_Allocations.load();
+    const uint64_t recvBefore = datagrams.load();
+    const double cpuBefore = ThreadCpuSeconds(ioThreads);
+    const uint64_t sent = Speak(members, pps, static_cast<double>(seconds));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    const double cpu = ThreadCpuSeconds(ioThreads) - cpuBefore;
+    const uint64_t received = datagrams.load() - recvBefore;
+    const uint64_t allocations = g_Allocations.load() - allocBefore;
+
+    const uint64_t expected = sent * static_cast<uint64_t>(memberCount - 1);
+    std::printf("members=%ld pps=%ld seconds=%ld opus=%ldB io_threads=%ld\n",
+        memberCount, pps, seconds, opusBytes, threadCount);
+    std::printf("inbound %llu packets, relayed %llu of %llu datagrams (%.1f%%)\n",
+        static_cast<unsigned long long>(sent), static_cast<unsigned long long>(received),
+        static_cast<unsigned long long>(expected), 100.0 * received / std::max<uint64_t>(expected, 1));
+    std::printf("server CPU: %.0f ns/inbound packet, %.0f ns/relayed datagram\n",
+        cpu * 1e9 / std::max<uint64_t>(sent, 1), cpu * 1e9 / std::max<uint64_t>(received, 1));
+    std::printf("allocations: %llu total, %.3f per inbound packet\n",
+        static_cast<unsigned long long>(allocations),
+        static_cast<double>(allocations) / std::max<uint64_t>(sent, 1));
+    std::fflush(stdout);
+
+    // Tearing the server down cleanly is not what is being measured.
+    stop = true;
+    receiver.join();
+    std::_Exit(0);
+}
@@ -0,0 +1,171 @@
+// Wire codec microbenchmark, no server: bytes on the wire and encode/decode
+// time per message for each packet type WireCodec covers, against the JSON
+// body the server builds for the same packet. The JSON side does what the
+// senders and receivers do today: build an nlohmann::json and dump() it;
+// copy the body into a std::string, parse it and read the fields. The
+// binary side is Wire::Encode and Wire::Decode (string_views into the body).
+//
+// BENCH_ITERATIONS per measurement; BENCH_BATCH is the number of deltas in
+// the Presence_Batch case.
+#include "../src/WireCodec.h"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace TalkMe;
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+    long EnvOr(const char* name, long fallback) {
+        const char* v = std::getenv(name);
+        return v ? std::atol(v) : fallback;
+    }
+
+    volatile size_t g_Sink;   // keeps the optimiser from dropping the work
+
+    double NsPerCall(long iterations, const std::function<size_t()>& f) {
+        const auto start = Clock::now();
+        for (long i = 0; i < iterations; ++i) g_Sink = f();
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(iterations);
+    }
+
+    const uint8_t* Bytes(const std::string& s) { return reinterpret_cast<const uint8_t*>(s.data()); }
+
+    struct Case {
+        const char* name;
+        std::function<std::string()> encodeJson, encodeBinary;
+        std::function<size_t(const std::string&)> decodeJson, decodeBinary;
+    };
+
+}
+
+int main() {
+    const long iterations = EnvOr("BENCH_ITERATIONS", 200000);
+    const long batch = EnvOr("BENCH_BATCH", 16);
+    const std::string user = "alice#1234";
+    const std::string text = "hello world, this is a typical chat message";
+    const std::string status = "In a meeting";
+
+    std::vector<std::string> batchUsers;
+    for (long i = 0; i < batch; ++i) batchUsers.push_back("member" + std::to_string(i) + "#0001");
+
+    const std::vector<Case> cases = {
+        { "Typing_Indicator",
+            [&] { json o; o["u"] = user; o["cid"] = 42; return o.dump(); },
+            [&] { return Wire::Encode(Wire::TypingIndicator{ 42, user }); },
+            [](const std::string& body) {
+                json j = json::parse(std::string(body));
+                return j.value("u", std::string()).size() + static_cast<size_t>(j.value("cid", 0));
+            },
+            [](const std::string& body) {
+                Wire::TypingIndicator m;
+                Wire::Decode(Bytes(body), body.size(), m);
+                return m.user.size() + static_cast<size_t>(m.cid);
+            } },
+        { "Presence_Update",
+            [&] { json o; o["u"] = user; o["online"] = true; return o.dump(); },
+            [&] { return Wire::Encode(Wire::PresenceUpdate{ true, user }); },
+            [](const std::string& body) {
+                json j = json::parse(std::string(body));
+                return j.value("u", std::string()).size() + j.value("online", false);
+            },
+            [](const std::string& body) {
+                Wire::PresenceUpdate m;
+                Wire::Decode(Bytes(body), body.size(), m);
+                return m.user.size() + m.online;
+            } },
+        { "Status_Update",
+            [&] { json o; o["u"] = user; o["status"] = status; return o.dump(); },
+            [&] { return Wire::Encode(Wire::StatusUpdate{ user, status }); },
+            [](const std::string& body) {
+                json j = json::parse(std::string(body));
+                return j.value("u", std::string()).size() + j.value("status", std::string()).size();
+            },
+            [](const std::string& body) {
+                Wire::StatusUpdate m;
+                Wire::Decode(Bytes(body), body.size(), m);
+                return m.user.size() + m.status.size();
+            } },
+        { "Voice_Mute_State",
+            [&] { json o; o["u"] = user; o["muted"] = true; o["deafened"] = false; o["cid"] = 42; return o.dump(); },
+            [&] { return Wire::Encode(Wire::VoiceMuteState{ true, false, 42, user }); },
+            [](const std::string& body) {
+                json j = json::parse(std::string(body));
+                return j.value("u", std::string()).size() + j.value("muted", false) + static_cast<size_t>(j.value("cid", 0));
+            },
+            [](const std::string& body) {
+                Wire::VoiceMuteState m;
+                Wire::Decode(Bytes(body), body.size(), m);
+                return m.user.size() + m.muted + static_cast<size_t>(m.cid);
+            } },
+        { "Message_Text",
+            [&] {
+                json o;
+                o["mid"] = 123456; o["cid"] = 42; o["u"] = user; o["msg"] = text; o["attachment_id"] = "";
+                return o.dump();
+            },
+            [&] { return Wire::Encode(Wire::MessageText{ 123456, 42, 0, user, text, "" }); },
+            [](const std::string& body) {
+                json j = json::parse(std::string(body));
+                return j.value("msg", std::string()).size() + j.value("u", std::string()).size() + static_cast<size_t>(j.value("mid", 0));
+            },
+            [](const std::string& body) {
+                Wire::MessageText m;
+                Wire::Decode(Bytes(body), body.size(), m);
+                return m.msg.size() + m.user.size() + static_cast<size_t>(m.mid);
+            } },
+        { "Presence_Batch",
+            // Stitched from per-change objects, as FlushPresence builds it.
+            [&] {
+                std::string body = "[";
+                for (const auto& u : batchUsers) {
+                    json j; j["u"] = u; j["online"] = true;
+                    if (body.size() > 1) body += ',';
+                    body += j.dump();
+                }
+                return body + "]";
+            },
+            [&] {
+                std::vector<Wire::PresenceDelta> deltas;
+                for (const auto& u : batchUsers) deltas.push_back({ u, true, true, false, {} });
+                return Wire::Encode(std::span<const Wire::PresenceDelta>(deltas));
+            },
+            [](const std::string& body) {
+                size_t n = 0;
+                for (const auto& d : json::parse(std::string(body))) n += d.value("u", std::string()).size() + d.value("online", false);
+                return n;
+            },
+            [](const std::string& body) {
+                std::vector<Wire::PresenceDelta> deltas;
+                Wire::Decode(Bytes(body), body.size(), deltas);
+                size_t n = 0;
+                for (const auto& d : deltas) n += d.user.size() + d.online;
+                return n;
+            } },
+    };
+
+    std::printf("iterations=%ld presence_batch=%ld\n", iterations, batch);
+    std::printf("%-17s %9s %9s | %12s %12s | %12s %12s\n",
+        "packet", "json B", "binary B", "enc json ns", "enc bin ns", "dec json ns", "dec bin ns");
+    for (const auto& c : cases) {
+        const std::string js = c.encodeJson(), bin = c.encodeBinary();
+        if (c.decodeJson(js) != c.decodeBinary(bin)) {
+            std::fprintf(stderr, "bench: %s decodes differ\n", c.name);
+            return 1;
+        }
+        std::printf("%-17s %9zu %9zu | %12.0f %12.0f | %12.0f %12.0f\n", c.name, js.size(), bin.size(),
+            NsPerCall(iterations, [&] { return c.encodeJson().size(); }),
+            NsPerCall(iterations, [&] { return c.encodeBinary().size(); }),
+            NsPerCall(iterations, [&] { return c.decodeJson(js); }),
+            NsPerCall(iterations, [&] { return c.decodeBinary(bin); }));
+    }
+    return 0;
+}
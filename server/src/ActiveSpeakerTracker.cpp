@@ -0,0 +1,131 @@
+#include "ActiveSpeakerTracker.h"
+#include <bit>
+
+namespace TalkMe {
+
+    bool ActiveSpeakerTracker::Touch(uint32_t userId, std::atomic<int>& slotHint,
+        int64_t nowMs, int64_t windowMs)
+    {
+        // Fast path: the speaker still owns the slot it was last given.
+        const int hint = slotHint.load(std::memory_order_relaxed);
+        if (hint >= 0 && static_cast<size_t>(hint) < kCapacity) {
+            Slot& slot = m_Slots[hint];
+            if (slot.userId.load(std::memory_order_acquire) == userId) {
+                slot.lastSpokeMs.store(nowMs, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        // The hint can be stale (a fresh binding starts at -1) while the
+        // speaker still owns a slot; find that one before claiming another,
+        // or the speaker would hold two and be counted twice.
+        for (size_t i = 0; i < kCapacity; ++i) {
+            Slot& slot = m_Slots[i];
+            if (slot.userId.load(std::memory_order_acquire) == userId) {
+                slot.lastSpokeMs.store(nowMs, std::memory_order_relaxed);
+                slotHint.store(static_cast<int>(i), std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        // New (or re-admitted) speaker: take the first slot that is free or
+        // whose owner fell out of the window.
+        const int64_t cutoff = nowMs - windowMs;
+        for (size_t i = 0; i < kCapacity; ++i) {
+            Slot& slot = m_Slots[i];
+            uint32_t owner = slot.userId.load(std::memory_order_acquire);
+            bool claimed = false;
+            if (owner == 0) {
+                claimed = slot.userId.compare_exchange_strong(owner, userId,
+                    std::memory_order_acq_rel);
+                if (claimed) m_Occupied.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (owner != userId && slot.lastSpokeMs.load(std::memory_order_relaxed) < cutoff) {
+                claimed = slot.userId.compare_exchange_strong(owner, userId,
+                    std::memory_order_acq_rel);
+            }
+            if (claimed) {
+                slot.lastSpokeMs.store(nowMs, std::memory_order_relaxed);
+                slotHint.store(static_cast<int>(i), std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t ActiveSpeakerTracker::ActiveCount(int64_t nowMs, int64_t windowMs) {
+        MaybeSweep(nowMs, windowMs);
+        return m_Occupied.load(std::memory_order_relaxed);
+    }
+
+    void ActiveSpeakerTracker::MaybeSweep(int64_t nowMs, int64_t windowMs) {
+        int64_t last = m_LastSweepMs.load(std::memory_order_relaxed);
+        if (nowMs - last < kSweepIntervalMs) return;
+        // One sweeper per interval; losers just read the current count.
+        if (!m_LastSweepMs.compare_exchange_strong(last, nowMs, std::memory_order_relaxed))
+            return;
+
+        const int64_t cutoff = nowMs - windowMs;
+        for (auto& slot : m_Slots) {
+            uint32_t owner = slot.userId.load(std::memory_order_acquire);
+            if (owner == 0 || slot.lastSpokeMs.load(std::memory_order_relaxed) >= cutoff)
+                continue;
+            if (slot.userId.compare_exchange_strong(owner, 0, std::memory_order_acq_rel))
+                m_Occupied.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool ActiveSpeakerTracker::ShouldForward(int slotIndex, uint8_t level,
+        size_t topN, int64_t nowMs)
+    {
+        if (slotIndex < 0 || static_cast<size_t>(slotIndex) >= kCapacity) return true;
+        Slot& slot = m_Slots[slotIndex];
+
+        // Light smoothing so a single click or breath does not reshuffle the
+        // set; a speaker returning from silence starts from its current level.
+        if (level > kSilentLevel) level = kSilentLevel;
+        const bool fresh = nowMs - slot.lastLevelMs.load(std::memory_order_relaxed) > kLevelHoldMs;
+        const uint8_t prev = slot.level.load(std::memory_order_relaxed);
+        slot.level.store(fresh ? level : static_cast<uint8_t>((prev * 3 + level) / 4),
+            std::memory_order_relaxed);
+        slot.lastLevelMs.store(nowMs, std::memory_order_relaxed);
+
+        const int64_t window = nowMs / kLevelWindowMs;
+        int64_t seen = m_LevelWindow.load(std::memory_order_acquire);
+        if (seen != window
+            && m_LevelWindow.compare_exchange_strong(seen, window, std::memory_order_acq_rel))
+            RecomputeForwardSet(topN, nowMs);
+
+        const uint32_t mask = m_ForwardMask.load(std::memory_order_acquire);
+        if (mask & (1u << slotIndex)) return true;
+        // Spare capacity: admit a speaker that started after the last recompute.
+        return static_cast<size_t>(std::popcount(mask)) < topN;
+    }
+
+    void ActiveSpeakerTracker::RecomputeForwardSet(size_t topN, int64_t nowMs) {
+        const int64_t cutoff = nowMs - kLevelHoldMs;
+        uint32_t candidates = 0;
+        for (size_t i = 0; i < kCapacity; ++i) {
+            const Slot& slot = m_Slots[i];
+            if (slot.userId.load(std::memory_order_relaxed) != 0
+                && slot.lastLevelMs.load(std::memory_order_relaxed) >= cutoff)
+                candidates |= 1u << i;
+        }
+
+        // Partial selection of the topN smallest levels (loudest); N is small.
+        uint32_t mask = 0;
+        for (size_t n = 0; n < topN && candidates; ++n) {
+            int best = -1;
+            uint8_t bestLevel = 0;
+            for (uint32_t c = candidates; c; c &= c - 1) {
+                const int i = std::countr_zero(c);
+                const uint8_t lvl = m_Slots[i].level.load(std::memory_order_relaxed);
+                if (best < 0 || lvl < bestLevel) { best = i; bestLevel = lvl; }
+            }
+            mask |= 1u << best;
+            candidates &= ~(1u << best);
+        }
+        m_ForwardMask.store(mask, std::memory_order_release);
+    }
+
+} // namespace TalkMe
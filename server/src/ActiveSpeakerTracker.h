@@ -0,0 +1,66 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // Per-channel active-speaker tracker.
+    //
+    // A fixed ring of kCapacity slots, each holding a user id and the time that
+    // user last spoke. A speaker remembers its slot index (slotHint), so a packet
+    // from an already admitted speaker is one compare and one store. Admitting a
+    // new speaker scans the ring once and may take over a slot whose owner has
+    // been silent for longer than the window. The number of occupied slots is
+    // kept incrementally; a lazy sweep (at most every kSweepIntervalMs) releases
+    // expired slots so ActiveCount() stays O(1) as well. All state is atomic and
+    // private to one channel, so channels never contend with each other.
+    //
+    // Selective forwarding: slots also carry a smoothed audio level. Once per
+    // kLevelWindowMs the first caller recomputes a bitmask of the top-N loudest
+    // recent speakers; ShouldForward() is then a single mask test.
+    // ---------------------------------------------------------------------------
+    class ActiveSpeakerTracker {
+    public:
+        static constexpr size_t  kCapacity = 32;   // must fit m_ForwardMask
+        static constexpr int64_t kSweepIntervalMs = 250;
+        static constexpr int64_t kLevelWindowMs = 10;
+        static constexpr int64_t kLevelHoldMs = 60;   // silent (DTX) speakers drop out after this
+
+        // Audio levels follow RFC 6464: -dBov, 0 = loudest, 127 = silence.
+        static constexpr uint8_t kSilentLevel = 127;
+
+        // Records that userId spoke at nowMs. Returns false when every slot is
+        // held by another speaker active within windowMs (speaker cap reached).
+        bool Touch(uint32_t userId, std::atomic<int>& slotHint,
+            int64_t nowMs, int64_t windowMs);
+
+        // Speakers active within windowMs, accurate to one sweep interval.
+        uint32_t ActiveCount(int64_t nowMs, int64_t windowMs);
+
+        // Records `level` for the speaker in `slot` (as granted by Touch) and
+        // reports whether it is among the topN loudest for the current window.
+        // While fewer than topN speakers are selected, everyone is forwarded.
+        bool ShouldForward(int slot, uint8_t level, size_t topN, int64_t nowMs);
+
+    private:
+        struct Slot {
+            std::atomic<uint32_t> userId{ 0 };   // 0 = free
+            std::atomic<int64_t>  lastSpokeMs{ 0 };
+            std::atomic<uint8_t>  level{ kSilentLevel };
+            std::atomic<int64_t>  lastLevelMs{ 0 };
+        };
+
+        void MaybeSweep(int64_t nowMs, int64_t windowMs);
+        void RecomputeForwardSet(size_t topN, int64_t nowMs);
+
+        std::array<Slot, kCapacity> m_Slots;
+        std::atomic<uint32_t>       m_Occupied{ 0 };
+        std::atomic<int64_t>        m_LastSweepMs{ 0 };
+        std::atomic<int64_t>        m_LevelWindow{ -1 };
+        std::atomic<uint32_t>       m_ForwardMask{ 0 };   // bit i = slot i forwarded
+    };
+
+} // namespace TalkMe
@@ -0,0 +1,133 @@
+#include "AttachmentStore.h"
+#include "Database.h"
+#include "Thumbnailer.h"
+#include "UploadManager.h"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <random>
+
+namespace TalkMe {
+namespace AttachmentStore {
+
+    namespace {
+        const std::filesystem::path kRoot = "attachments";
+        const std::filesystem::path kIncoming = kRoot / "incoming";
+        constexpr size_t kHashLen = 64;
+        constexpr size_t kMaxExtLen = 8;
+
+        bool IsHex(char c) {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        }
+    }
+
+    Stats& GetStats() {
+        static Stats s;
+        return s;
+    }
+
+    std::string NormalizeHash(std::string_view hex) {
+        if (hex.size() != kHashLen) return {};
+        std::string out(hex);
+        for (char& c : out) {
+            if (!IsHex(c)) return {};
+            if (c >= 'A' && c <= 'F') c = static_cast<char>(c - 'A' + 'a');
+        }
+        return out;
+    }
+
+    std::string ContentId(std::string_view hash, std::string_view filename) {
+        std::string id(hash);
+        const size_t slash = filename.find_last_of("/\\");
+        if (slash != std::string_view::npos) filename.remove_prefix(slash + 1);
+        const size_t dot = filename.rfind('.');
+        if (dot == std::string_view::npos || dot + 1 == filename.size() || filename.size() - dot - 1 > kMaxExtLen)
+            return id;
+        std::string ext = ".";
+        for (char c : filename.substr(dot + 1)) {
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+            if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) return id;
+            ext += c;
+        }
+        return id + ext;
+    }
+
+    std::string_view HashOf(std::string_view id) {
+        if (id.size() < kHashLen || (id.size() > kHashLen && id[kHashLen] != '.')) return {};
+        for (size_t i = 0; i < kHashLen; ++i)
+            if (!((id[i] >= '0' && id[i] <= '9') || (id[i] >= 'a' && id[i] <= 'f'))) return {};
+        return id.substr(0, kHashLen);
+    }
+
+    bool IsValidId(std::string_view id) {
+        constexpr std::string_view kForbidden("/\\:\0", 4);
+        return !id.empty() && id.find_first_of(kForbidden) == std::string_view::npos &&
+               id.find("..") == std::string_view::npos;
+    }
+
+    std::filesystem::path PathFor(const std::string& id) {
+        return kRoot / id;
+    }
+
+    std::filesystem::path NewIncomingPath() {
+        std::error_code ec;
+        std::filesystem::create_directories(kIncoming, ec);
+        static thread_local std::mt19937_64 rng(std::random_device{}());
+        char name[40];
+        std::snprintf(name, sizeof(name), "%lld_%016llx", static_cast<long long>(std::time(nullptr)),
+            static_cast<unsigned long long>(rng()));
+        return kIncoming / name;
+    }
+
+    void Commit(const std::filesystem::path& incoming, const std::string& id, uint64_t size) {
+        auto& stats = GetStats();
+        const auto target = PathFor(id);
+        std::error_code ec;
+        if (std::filesystem::exists(target, ec)) {
+            // Someone else finished the same content first.
+            std::filesystem::remove(incoming, ec);
+            stats.duplicates.fetch_add(1, std::memory_order_relaxed);
+            stats.bytesSaved.fetch_add(size, std::memory_order_relaxed);
+        }
+        else {
+            std::filesystem::rename(incoming, target, ec);
+            if (ec) {
+                std::fprintf(stderr, "[TalkMe Server] Attachment commit failed: %s: %s\n", id.c_str(), ec.message().c_str());
+                std::filesystem::remove(incoming, ec);
+                return;
+            }
+            stats.stored.fetch_add(1, std::memory_order_relaxed);
+            Thumbnailer::Get().Enqueue(id);
+        }
+        Database::Get().RegisterAttachment(id, size);
+    }
+
+    bool Claim(const std::string& id, uint64_t size) {
+        std::error_code ec;
+        const auto onDisk = std::filesystem::file_size(PathFor(id), ec);
+        if (ec || onDisk != size) return false;
+        return Database::Get().ClaimAttachment(id, size);
+    }
+
+    size_t Sweep() {
+        std::error_code ec;
+        const auto ids = Database::Get().TakeUnreferencedAttachments(kSweepGraceSeconds);
+        for (const auto& id : ids) {
+            std::filesystem::remove(PathFor(id), ec);
+            Thumbnailer::Remove(id);
+        }
+        GetStats().swept.fetch_add(ids.size(), std::memory_order_relaxed);
+
+        // Uploads interrupted by a crash leave their incoming file behind.
+        const auto cutoff = std::filesystem::file_time_type::clock::now() - std::chrono::seconds(kSweepGraceSeconds);
+        for (std::filesystem::directory_iterator it(kIncoming, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code fec;
+            if (it->is_regular_file(fec) && it->last_write_time(fec) < cutoff && !fec &&
+                !UploadManager::Get().IsActive(it->path()))
+                std::filesystem::remove(it->path(), fec);
+        }
+        return ids.size();
+    }
+
+} // namespace AttachmentStore
+} // namespace TalkMe
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace TalkMe {
+namespace AttachmentStore {
+
+    // ---------------------------------------------------------------------------
+    // Content-addressed attachment storage.
+    //
+    // An upload whose client announced its SHA-256 is stored once, as
+    // attachments/<hash><.ext>; ext is the lower-cased extension of the
+    // uploaded file name and only picks the Content-Type on the media port.
+    // Posting the same bytes again yields the same id, so the file, its
+    // MediaCache entry and every client's texture cache are shared, and an
+    // upload of bytes already stored is answered at once without a transfer.
+    //
+    // Uploads are written to attachments/incoming/ (UploadManager.h) and
+    // moved into place by Commit() once the hash matches the announced one.
+    // The attachments table counts the messages referencing each file (kept
+    // by triggers on messages); Sweep() deletes files that are unreferenced
+    // and were not claimed by an upload within kSweepGraceSeconds. Uploads
+    // from clients that send no hash keep their per-upload id and are never
+    // swept.
+    //
+    // Commit, Claim and Sweep touch both the database and the directory, and
+    // run on the database writer thread so they never interleave.
+    // ---------------------------------------------------------------------------
+    constexpr int kSweepGraceSeconds = 60 * 60;
+
+    struct Stats {
+        std::atomic<uint64_t> stored{ 0 };        // new content committed
+        std::atomic<uint64_t> instant{ 0 };       // uploads skipped: content already stored
+        std::atomic<uint64_t> duplicates{ 0 };    // transferred, but already stored by then
+        std::atomic<uint64_t> bytesSaved{ 0 };    // upload bytes not transferred or not stored
+        std::atomic<uint64_t> rejected{ 0 };      // hash or size mismatch
+        std::atomic<uint64_t> swept{ 0 };         // unreferenced files removed
+    };
+    Stats& GetStats();
+
+    // Lower-case hex SHA-256, or empty if `hex` is not 64 hex digits.
+    std::string NormalizeHash(std::string_view hex);
+    // Id for content `hash` (normalized) uploaded as `filename`.
+    std::string ContentId(std::string_view hash, std::string_view filename);
+    // Hash part of a content-addressed id; empty for legacy ids.
+    std::string_view HashOf(std::string_view id);
+
+    // True when `id`, as sent by a client, names a file directly under
+    // attachments/: non-empty, no path separator, drive or stream colon, NUL
+    // or "..". Anything else could resolve outside the directory once joined
+    // onto it (an absolute id replaces the base path entirely).
+    bool IsValidId(std::string_view id);
+    // Only for ids that passed IsValidId() or were generated here.
+    std::filesystem::path PathFor(const std::string& id);
+    // Unique path under attachments/incoming/ for an upload in progress.
+    std::filesystem::path NewIncomingPath();
+
+    // Moves a verified upload into place, or discards it when the content is
+    // already stored, and registers the id. Writer thread.
+    void Commit(const std::filesystem::path& incoming, const std::string& id, uint64_t size);
+    // True if `id` is stored with `size` bytes; protects it from the next
+    // sweep. Writer thread.
+    bool Claim(const std::string& id, uint64_t size);
+    // Removes unreferenced attachments (with their previews) and abandoned
+    // incoming files; returns how many attachments were removed. Writer
+    // thread.
+    size_t Sweep();
+
+} // namespace AttachmentStore
+} // namespace TalkMe
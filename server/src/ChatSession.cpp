@@ -1,9 +1,12 @@
 #include "ChatSession.h"
+#include "AttachmentStore.h"
+#include "Thumbnailer.h"
 #include "TalkMeServer.h"
 #include "Database.h"
 #include "Crypto.h"
 #include "Logger.h"
 #include "Protocol.h"
+#include "WireCodec.h"
 #include <nlohmann/json.hpp>
 #include <cstring>
 #include <filesystem>
@@ -44,6 +47,30 @@ namespace {
         }
         return out;
     }
+
+    // talkme_packets_total / talkme_packet_handle_seconds of one packet type,
+    // registered when the first packet of that type arrives.
+    struct PacketTypeMetrics {
+        TalkMe::Counter&   received;
+        TalkMe::Histogram& handleTime;
+    };
+
+    const PacketTypeMetrics& MetricsFor(TalkMe::PacketType type) {
+        static std::array<std::atomic<const PacketTypeMetrics*>, 256> byType{};
+        auto& slot = byType[static_cast<uint8_t>(type)];
+        if (const auto* known = slot.load(std::memory_order_acquire)) return *known;
+
+        auto& registry = TalkMe::Metrics::Get();
+        const std::string labels = "type=\"" + std::to_string(static_cast<int>(type)) + "\"";
+        const auto* fresh = new PacketTypeMetrics{
+            registry.GetCounter("talkme_packets_total", "Packets received, by PacketType value (Protocol.h).", labels),
+            registry.GetHistogram("talkme_packet_handle_seconds", "Time ProcessPacket spent on one packet, by PacketType value.", labels) };
+        // A racing thread registered the same series; keep its copy.
+        const PacketTypeMetrics* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) return *fresh;
+        delete fresh;
+        return *expected;
+    }
 }
 using asio::ip::tcp;
 
@@ -56,95 +83,218 @@ namespace TalkMe {
     void ChatSession::Start() {
         m_LastVoicePacket = std::chrono::steady_clock::now();
         m_Server.JoinClient(shared_from_this());
-        ReadHeader();
+        m_ReadBuf.resize(kReadBufferSize);
+        ReadSome();
     }
 
     void ChatSession::Disconnect() {
-        if (m_UploadFile.is_open()) {
-            m_UploadFile.close();
-            // Prevent storage exhaustion: delete partial files if the transfer didn't finish
-            if (m_UploadBytesReceived < m_UploadTargetSize && !m_UploadId.empty()) {
-                std::error_code ec;
-                std::filesystem::remove("attachments/" + m_UploadId, ec);
-            }
+        if (m_Upload) {
+            // Windowed uploads wait for a resume; an unfinished legacy upload
+            // is deleted (it is never moved into place either way).
+            UploadManager::Get().Detach(m_Upload, this);
+            m_Upload.reset();
         }
         m_Server.LeaveClient(shared_from_this());
         if (m_Socket.is_open()) m_Socket.close();
     }
 
-    void ChatSession::ReadHeader() {
-        asio::async_read(m_Socket, asio::buffer(&m_Header, sizeof(TalkMe::PacketHeader)),
-            asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec, std::size_t) {
+    void ChatSession::ReadSome() {
+        // Move the unconsumed tail to the front, then make room for the
+        // packet in progress if it is larger than the buffer.
+        const size_t pending = m_ReadEnd - m_ReadStart;
+        if (m_ReadStart > 0) {
+            if (pending > 0) std::memmove(m_ReadBuf.data(), m_ReadBuf.data() + m_ReadStart, pending);
+            m_ReadStart = 0;
+            m_ReadEnd = pending;
+        }
+        size_t need = kReadBufferSize;
+        if (pending >= sizeof(PacketHeader)) {
+            PacketHeader h;
+            std::memcpy(&h, m_ReadBuf.data(), sizeof(h));
+            h.ToHost();
+            need = std::max(need, sizeof(h) + static_cast<size_t>(h.size));
+        }
+        if (need != m_ReadBuf.size() && pending <= need) {
+            m_ReadBuf.resize(need);
+            m_ReadBuf.shrink_to_fit();
+        }
+
+        m_Socket.async_read_some(asio::buffer(m_ReadBuf.data() + m_ReadEnd, m_ReadBuf.size() - m_ReadEnd),
+            asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec, std::size_t n) {
                 if (!ec) {
-                    m_Header.ToHost();
-                    if (m_Header.size > 10 * 1024 * 1024) { Disconnect(); return; }
-                    m_Body.resize(m_Header.size);
-                    ReadBody();
+                    m_ReadEnd += n;
+                    DispatchPackets();
                 }
                 else {
                     // EOF (2) and connection_reset (104) are normal when client disconnects; avoid flooding logs
                     if (ec.value() != 2 && ec.value() != 104)
-                        std::fprintf(stderr, "[TalkMe Server] ReadHeader error: %s (%d), disconnecting\n", ec.message().c_str(), ec.value());
+                        std::fprintf(stderr, "[TalkMe Server] Read error: %s (%d), disconnecting\n", ec.message().c_str(), ec.value());
                     Disconnect();
                 }
                 }));
     }
 
-    void ChatSession::ReadBody() {
-        asio::async_read(m_Socket, asio::buffer(m_Body),
-            asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec, std::size_t) {
-                if (!ec) { ProcessPacket(); ReadHeader(); }
-                else {
-                    if (ec.value() != 2 && ec.value() != 104)
-                        std::fprintf(stderr, "[TalkMe Server] ReadBody error: %s (%d), disconnecting\n", ec.message().c_str(), ec.value());
-                    Disconnect();
-                }
-                }));
+    void ChatSession::DispatchPackets() {
+        while (!m_ReadPaused && !m_ReadThrottled && m_Socket.is_open()) {
+            // A buffer full of requests must not outrun the writer: stop
+            // framing while the replies back up and let DoWrite() resume us.
+            if (PendingReplyDepth() >= kReadBackpressureDepth) {
+                m_ReadThrottled = true;
+                break;
+            }
+            const size_t avail = m_ReadEnd - m_ReadStart;
+            if (avail < sizeof(PacketHeader)) break;
+            std::memcpy(&m_Header, m_ReadBuf.data() + m_ReadStart, sizeof(PacketHeader));
+            m_Header.ToHost();
+            if (m_Header.size > kMaxPacketSize) { Disconnect(); return; }
+            if (avail < sizeof(PacketHeader) + m_Header.size) break;
+
+            m_Body = std::span<const uint8_t>(m_ReadBuf.data() + m_ReadStart + sizeof(PacketHeader), m_Header.size);
+            m_ReadStart += sizeof(PacketHeader) + m_Header.size;
+            ProcessPacket();
+            m_Body = {};
+        }
+        // While paused or throttled, ResumeReading() / DoWrite() dispatch what
+        // is left and read on.
+        if (!m_ReadPaused && !m_ReadThrottled && m_Socket.is_open()) ReadSome();
+    }
+
+    WriteLane ChatSession::LaneFor(PacketType type) {
+        switch (type) {
+        case PacketType::Voice_Data:
+        case PacketType::Voice_Data_Opus:
+            return WriteLane::Voice;
+        case PacketType::Screen_Share_Frame:
+        case PacketType::Message_History_Response:
+        case PacketType::DM_History_Response:
+        case PacketType::Media_Response:
+        case PacketType::Media_Chunk:
+        case PacketType::Avatar_Response:
+        case PacketType::Audit_Log_Response:
+            return WriteLane::Bulk;
+        default:
+            return WriteLane::Control;
+        }
+    }
+
+    WriteLaneStats& ChatSession::GetWriteLaneStats(WriteLane lane) {
+        static std::array<WriteLaneStats, kWriteLaneCount> stats;
+        static const bool exported = [] {
+            auto& registry = Metrics::Get();
+            for (size_t i = 0; i < kWriteLaneCount; ++i) {
+                const std::string labels = std::string("lane=\"") + kWriteLaneNames[i] + "\"";
+                registry.AddCounter("talkme_write_queued_total", "Packets queued by SendShared.", stats[i].queued, labels);
+                registry.AddCounter("talkme_write_dropped_total", "Packets SendShared discarded because their lane was backed up.", stats[i].dropped, labels);
+            }
+            return true;
+        }();
+        (void)exported;
+        return stats[static_cast<size_t>(lane)];
+    }
+
+    std::atomic<uint64_t>& ChatSession::GetWriteCallCount() {
+        static std::atomic<uint64_t> calls{ 0 };
+        return calls;
+    }
+
+    size_t ChatSession::DropThreshold() const {
+        const size_t load = m_CurrentVoiceLoad.load(std::memory_order_relaxed);
+        if (load > 80) return 12;
+        if (load > 30) return 24;
+        if (load > 8) return 32;
+        if (load > 4) return 48;
+        return 100;
     }
 
     void ChatSession::DoWrite() {
-        if (m_WriteQueue.empty()) return;
+        const auto now = std::chrono::steady_clock::now();
+        m_Inflight.clear();
+        m_InflightBufs.clear();
+        {
+            std::lock_guard lock(m_WriteMutex);
+            size_t bytes = 0;
+            for (size_t lane = 0; lane < kWriteLaneCount; ++lane) {
+                auto& q = m_Lanes[lane];
+                auto& stats = GetWriteLaneStats(static_cast<WriteLane>(lane));
+                while (!q.empty() && m_Inflight.size() < kMaxGatherBuffers) {
+                    const size_t size = q.front().buffer->size();
+                    if (!m_Inflight.empty() && bytes + size > kMaxGatherBytes) break;
+                    const uint64_t waitUs = static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(now - q.front().queuedAt).count());
+                    stats.written.fetch_add(1, std::memory_order_relaxed);
+                    stats.waitUsTotal.fetch_add(waitUs, std::memory_order_relaxed);
+                    uint64_t prevMax = stats.waitUsMax.load(std::memory_order_relaxed);
+                    while (waitUs > prevMax && !stats.waitUsMax.compare_exchange_weak(prevMax, waitUs, std::memory_order_relaxed)) {}
+                    bytes += size;
+                    m_Inflight.push_back(std::move(q.front().buffer));
+                    q.pop_front();
+                }
+                m_LaneDepth[lane].store(q.size(), std::memory_order_relaxed);
+                // Whatever is left here (the gather is full, or the head did
+                // not fit) goes before any lower lane's packets.
+                if (!q.empty()) break;
+            }
+            if (m_Inflight.empty()) m_WriteActive = false;
+        }
+        if (m_Inflight.empty()) {
+            ResumeThrottledRead();
+            return;
+        }
 
-        asio::async_write(m_Socket, asio::buffer(*m_WriteQueue.front()),
+        for (const auto& buf : m_Inflight) m_InflightBufs.push_back(asio::buffer(*buf));
+        GetWriteCallCount().fetch_add(1, std::memory_order_relaxed);
+        asio::async_write(m_Socket, m_InflightBufs,
             asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec, std::size_t) {
                 if (!ec) {
-                    m_WriteQueue.pop_front();
-                    if (!m_WriteQueue.empty()) DoWrite();
+                    DoWrite();
                 }
                 else {
+                    // m_WriteActive stays set: nothing else is written to a dead socket.
                     m_IsHealthy.store(false, std::memory_order_relaxed);
                     Disconnect();
                 }
                 }));
+        ResumeThrottledRead();
     }
 
-    void ChatSession::SendShared(std::shared_ptr<std::vector<uint8_t>> buffer, bool isVoiceData) {
-        asio::post(m_Strand, [this, self = shared_from_this(), buffer, isVoiceData]() {
-            bool writeInProgress = !m_WriteQueue.empty();
-            // OPTIMIZATION & BUG FIX: Never pop_front() if writeInProgress is true.
-            // ASIO is actively reading from m_WriteQueue.front() in the background.
-            // Freeing it causes severe Use-After-Free memory corruption and crashes.
-
-            if (isVoiceData) {
-                // Just drop the incoming packet if the queue is backed up
-                size_t voiceDropAt = 100;
-                if (m_CurrentVoiceLoad > 80) voiceDropAt = 12;
-                else if (m_CurrentVoiceLoad > 30) voiceDropAt = 24;
-                else if (m_CurrentVoiceLoad > 8) voiceDropAt = 32;
-                else if (m_CurrentVoiceLoad > 4) voiceDropAt = 48;
-                if (m_WriteQueue.size() >= voiceDropAt) {
-                    return; // Discard late voice frame gracefully
-                }
-            }
-            else {
-                // Control/Text packets should be queued with higher tolerance
-                if (m_WriteQueue.size() > 200) {
-                    return; // Extreme congestion limit
-                }
+    size_t ChatSession::PendingReplyDepth() const {
+        return GetWriteQueueDepth(WriteLane::Control) + GetWriteQueueDepth(WriteLane::Bulk);
+    }
+
+    void ChatSession::ResumeThrottledRead() {
+        if (!m_ReadThrottled || PendingReplyDepth() >= kReadBackpressureDepth) return;
+        m_ReadThrottled = false;
+        if (m_Socket.is_open()) DispatchPackets();
+    }
+
+    bool ChatSession::SendShared(std::shared_ptr<std::vector<uint8_t>> buffer, bool droppable) {
+        if (!buffer || buffer->size() < sizeof(PacketHeader)) return false;
+        const size_t lane = static_cast<size_t>(LaneFor(static_cast<PacketType>((*buffer)[0])));
+        auto& stats = GetWriteLaneStats(static_cast<WriteLane>(lane));
+        bool startWriter = false;
+        {
+            std::lock_guard lock(m_WriteMutex);
+            auto& q = m_Lanes[lane];
+            // Late voice and screen frames are worthless; drop them early.
+            // Control and bulk packets tolerate a much deeper backlog.
+            if (droppable ? q.size() >= DropThreshold() : q.size() > kMaxLaneDepth) {
+                stats.dropped.Add();
+                return false;
+            }
+            q.push_back({ std::move(buffer), std::chrono::steady_clock::now() });
+            const size_t depth = q.size();
+            m_LaneDepth[lane].store(depth, std::memory_order_relaxed);
+            uint64_t prevPeak = stats.peakDepth.load(std::memory_order_relaxed);
+            while (depth > prevPeak && !stats.peakDepth.compare_exchange_weak(prevPeak, depth, std::memory_order_relaxed)) {}
+            if (!m_WriteActive) {
+                m_WriteActive = true;
+                startWriter = true;
             }
-            m_WriteQueue.push_back(buffer);
-            if (!writeInProgress) DoWrite();
-        });
+        }
+        stats.queued.Add();
+        if (startWriter)
+            asio::post(m_Strand, [this, self = shared_from_this()]() { DoWrite(); });
+        return true;
     }
 
     void ChatSession::UpdateActivity() {
@@ -168,9 +318,366 @@ namespace TalkMe {
         SendShared(buffer, false);
     }
 
+    void ChatSession::SetUsername(const std::string& username) {
+        const uint32_t previous = m_UserId.load(std::memory_order_relaxed);
+        m_Username = username;
+        m_UserId.store(m_Server.InternUser(username), std::memory_order_relaxed);
+        m_Server.IndexUserSession(shared_from_this(), previous);
+    }
+
+    void ChatSession::OnAuthenticated(const std::string& username, const std::vector<std::pair<int, int>>& serverChannels) {
+        SetUsername(username);
+        m_Server.SetUserMembership(username, serverChannels);
+        // Announced once the friend list is in, so friends outside the
+        // user's servers hear of it too.
+        DbRead([this, username]() -> std::function<void()> {
+            auto friends = Database::Get().GetFriendNames(username);
+            return [this, friends = std::move(friends)]() {
+                auto self = shared_from_this();
+                m_Server.SetUserFriends(self, friends);
+                m_Server.PublishPresence(self);
+            };
+        });
+    }
+
+    void ChatSession::NegotiateWire(int offered, bool presenceBatch) {
+        if (offered >= Wire::kVersion) m_BinaryWire.store(true, std::memory_order_relaxed);
+        if (presenceBatch) m_PresenceBatch.store(true, std::memory_order_relaxed);
+    }
+
+    void ChatSession::BeginUpload(const std::string& id, const std::string& hash, size_t size, bool windowed) {
+        json res;
+        res["id"] = id;
+        m_Upload = UploadManager::Get().Begin(this, m_Username, id, hash, size, windowed);
+        if (!m_Upload) {
+            res["action"] = "upload_failed";
+            SendPacket(PacketType::File_Transfer_Complete, res.dump());
+            return;
+        }
+        m_UploadNextOffset = 0;
+        res["action"] = "upload_approved";
+        res["offset"] = 0;
+        SendPacket(PacketType::File_Transfer_Complete, res.dump());
+    }
+
+    void ChatSession::FinishUpload() {
+        if (!m_Upload) return;
+        // Verification and the commit run in this session's DB queue, so a
+        // Message_Text naming the upload still waits for the file to be in
+        // place, while the strand goes on reading packets.
+        DbReadDeferred([this, upload = std::move(m_Upload)](DbFinish finish) {
+            UploadManager::Get().Finish(upload, [this, upload, finish](bool ok) {
+                json res;
+                res["id"] = upload->id;
+                if (!ok) {
+                    if (!upload->hash.empty())
+                        AttachmentStore::GetStats().rejected.fetch_add(1, std::memory_order_relaxed);
+                    res["action"] = "upload_failed";
+                    finish([this, res]() { SendPacket(PacketType::File_Transfer_Complete, res.dump()); });
+                    return;
+                }
+                res["action"] = "upload_finished";
+                if (upload->hash.empty()) {
+                    std::error_code ec;
+                    std::filesystem::rename(upload->path, AttachmentStore::PathFor(upload->id), ec);
+                    if (!ec) Thumbnailer::Get().Enqueue(upload->id);
+                    finish([this, res]() { SendPacket(PacketType::File_Transfer_Complete, res.dump()); });
+                    return;
+                }
+                Database::Get().ExecuteWrite([this, upload, finish, res]() {
+                    AttachmentStore::Commit(upload->path, upload->id, upload->size);
+                    finish([this, res]() { SendPacket(PacketType::File_Transfer_Complete, res.dump()); });
+                }, [finish]() { finish(nullptr); });
+            });
+        });
+    }
+
+    void ChatSession::StartMediaStream(const std::string& id, int previewSize) {
+        json res;
+        res["id"] = id;
+        std::filesystem::path filePath = AttachmentStore::PathFor(id);
+        std::error_code ec;
+        uint64_t originalSize = 0;
+        if (previewSize > 0) {
+            if (auto preview = Thumbnailer::Get().Find(id, previewSize); !preview.empty()) {
+                originalSize = std::filesystem::file_size(filePath, ec);
+                if (ec) originalSize = 0;
+                filePath = std::move(preview);
+                res["preview"] = 1;
+            }
+        }
+        const auto size = std::filesystem::file_size(filePath, ec);
+        MediaStream stream;
+        if (!ec && size <= 10 * 1024 * 1024) stream.file.open(filePath, std::ios::binary);
+        if (!stream.file) {
+            res["error"] = "not_found";
+            SendPacket(PacketType::Media_Response, res.dump());
+            return;
+        }
+        if (originalSize > 0) {
+            auto& ps = Thumbnailer::GetStats();
+            ps.served.fetch_add(1, std::memory_order_relaxed);
+            if (originalSize > size) ps.bytesSaved.fetch_add(originalSize - size, std::memory_order_relaxed);
+        }
+        const uint32_t tid = m_NextMediaTid++;
+        stream.size = static_cast<uint32_t>(size);
+        stream.lastProgress = std::chrono::steady_clock::now();
+        res["tid"] = tid;
+        res["size"] = stream.size;
+        res["stream"] = 1;
+        SendPacket(PacketType::Media_Response, res.dump());
+        m_MediaStreams.emplace(tid, std::move(stream));
+    }
+
+    void ChatSession::PumpMediaStreams() {
+        // One chunk per open stream per pass, so a large file cannot starve
+        // a small one requested after it.
+        bool progressed = true;
+        while (progressed) {
+            progressed = false;
+            while (m_MediaStreams.size() < kMaxMediaStreams && !m_MediaQueue.empty()) {
+                auto [id, previewSize] = std::move(m_MediaQueue.front());
+                m_MediaQueue.pop_front();
+                StartMediaStream(id, previewSize);
+            }
+            for (auto it = m_MediaStreams.begin(); it != m_MediaStreams.end();) {
+                auto& st = it->second;
+                if (st.sent - st.acked >= kMediaStreamWindow) { ++it; continue; }
+
+                const uint32_t n = std::min(kMediaChunkSize, st.size - st.sent);
+                PacketHeader h{ PacketType::Media_Chunk, static_cast<uint32_t>(sizeof(MediaChunkHeader) + n) };
+                MediaChunkHeader ch{ it->first, st.sent };
+                h.ToNetwork();
+                ch.ToNetwork();
+                auto buf = std::make_shared<std::vector<uint8_t>>(sizeof(h) + sizeof(ch) + n);
+                std::memcpy(buf->data(), &h, sizeof(h));
+                std::memcpy(buf->data() + sizeof(h), &ch, sizeof(ch));
+                if (n > 0 && !st.file.read(reinterpret_cast<char*>(buf->data() + sizeof(h) + sizeof(ch)), n)) {
+                    EndMediaStream(it->first, "read_failed");
+                    it = m_MediaStreams.erase(it);
+                    continue;
+                }
+                // A chunk the bulk lane refused leaves a gap the client cannot
+                // recover from; nothing pumps again when the lane drains.
+                if (!SendShared(buf, false)) {
+                    EndMediaStream(it->first, "send_failed");
+                    it = m_MediaStreams.erase(it);
+                    continue;
+                }
+                st.sent += n;
+                progressed = true;
+                // The last chunk (an empty one for an empty file) ends the
+                // transfer; acks for it are not needed.
+                if (st.sent == st.size) it = m_MediaStreams.erase(it);
+                else ++it;
+            }
+        }
+        WatchMediaStreams();
+    }
+
+    void ChatSession::EndMediaStream(uint32_t tid, const char* error) {
+        json res;
+        res["tid"] = tid;
+        res["error"] = error;
+        SendPacket(PacketType::Media_Response, res.dump());
+    }
+
+    void ChatSession::WatchMediaStreams() {
+        if (m_MediaStallWatched || m_MediaStreams.empty()) return;
+        m_MediaStallWatched = true;
+        m_MediaStallTimer.expires_after(kMediaStreamStallTimeout / 6);
+        m_MediaStallTimer.async_wait(asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec) {
+            m_MediaStallWatched = false;
+            if (ec || !m_Socket.is_open()) return;
+            // A client that gave up without acking would otherwise hold its
+            // slot, and the requests queued behind it, forever.
+            const auto now = std::chrono::steady_clock::now();
+            for (auto it = m_MediaStreams.begin(); it != m_MediaStreams.end();) {
+                if (now - it->second.lastProgress >= kMediaStreamStallTimeout) {
+                    EndMediaStream(it->first, "timeout");
+                    it = m_MediaStreams.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+            PumpMediaStreams();   // starts queued requests and re-arms the watch
+            }));
+    }
+
+    void ChatSession::QueueDb(bool write, bool pipelined, DbDeferredJob job) {
+        m_DbJobs.push_back({ write, pipelined, std::move(job) });
+        if (!m_DbJobRunning) RunNextDbJob();
+    }
+
+    void ChatSession::RunDbCompletion(const std::function<void()>& done) {
+        try { if (done) done(); }
+        catch (const std::exception& e) {
+            std::fprintf(stderr, "[TalkMe Server] DB completion failed: user=%s err=%s\n", m_Username.c_str(), e.what());
+        }
+    }
+
+    void ChatSession::RunNextDbJob() {
+        if (m_DbJobs.empty()) {
+            if (m_ReadPaused) ResumeReading();
+            return;
+        }
+        auto& next = m_DbJobs.front();
+        // Picked up again by the last pipelined finish().
+        if (!next.pipelined && m_DbPipelinedPending > 0) return;
+        m_DbJobRunning = true;
+        auto self = shared_from_this();
+        auto advance = [this, self]() {
+            asio::post(m_Strand, [this, self]() {
+                m_DbJobRunning = false;
+                m_DbJobs.pop_front();
+                RunNextDbJob();
+            });
+        };
+        DbFinish finish;
+        if (next.pipelined) {
+            ++m_DbPipelinedPending;
+            finish = [this, self](std::function<void()> done) {
+                asio::post(m_Strand, [this, self, done = std::move(done)]() {
+                    RunDbCompletion(done);
+                    if (--m_DbPipelinedPending == 0 && !m_DbJobRunning) RunNextDbJob();
+                });
+            };
+        }
+        else {
+            finish = [this, self](std::function<void()> done) {
+                asio::post(m_Strand, [this, self, done = std::move(done)]() {
+                    RunDbCompletion(done);
+                    m_DbJobRunning = false;
+                    m_DbJobs.pop_front();
+                    RunNextDbJob();
+                });
+            };
+        }
+        auto task = [job = std::move(next.job), finish, advance, pipelined = next.pipelined]() {
+            try { job(finish); }
+            catch (const std::exception& e) {
+                // Jobs only throw before handing off to finish().
+                std::fprintf(stderr, "[TalkMe Server] DB job failed: %s\n", e.what());
+                finish(nullptr);
+            }
+            if (pipelined) advance();
+        };
+        // A job refused at shutdown still advances the queue, without a
+        // continuation.
+        auto rejected = [finish, advance, pipelined = next.pipelined]() {
+            finish(nullptr);
+            if (pipelined) advance();
+        };
+        if (next.write) Database::Get().ExecuteWrite(std::move(task), std::move(rejected));
+        else Database::Get().ExecuteRead(std::move(task), std::move(rejected));
+    }
+
+    void ChatSession::ResumeReading() {
+        m_ReadPaused = false;
+        if (m_Socket.is_open()) DispatchPackets();
+    }
+
+    // ---------------------------------------------------------------------------
+    // High-frequency control packets, reached from both the JSON path and
+    // ProcessBinaryPacket. The session is authenticated.
+    // ---------------------------------------------------------------------------
+    void ChatSession::ProcessBinaryPacket() {
+        if (m_Username.empty()) return;
+        const uint8_t* data = m_Body.data();
+        const size_t size = m_Body.size();
+        switch (m_Header.type) {
+        case PacketType::Message_Text: {
+            Wire::MessageText m;
+            if (Wire::Decode(data, size, m))
+                HandleMessageText(m.cid, std::string(m.msg), std::string(m.attachmentId), m.replyTo);
+            break;
+        }
+        case PacketType::Typing_Indicator: {
+            Wire::TypingIndicator m;
+            if (Wire::Decode(data, size, m)) HandleTypingIndicator(m.cid);
+            break;
+        }
+        case PacketType::Voice_Mute_State: {
+            Wire::VoiceMuteState m;
+            if (Wire::Decode(data, size, m)) HandleVoiceMuteState(m.muted, m.deafened);
+            break;
+        }
+        case PacketType::Set_Status: {
+            Wire::StatusUpdate m;
+            if (Wire::Decode(data, size, m)) HandleSetStatus(std::string(m.status));
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void ChatSession::HandleMessageText(int cid, std::string msg, std::string attachmentId, int replyTo) {
+        DbReadPipelined([this, user = m_Username, cid, msg, attachmentId, replyTo](DbFinish finish) {
+            int sid = Database::Get().GetServerIdForChannel(cid);
+            if (sid > 0 && Database::Get().IsUserSanctioned(sid, user, "chat_mute")) {
+                finish([this]() {
+                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"You are muted in this server"})");
+                });
+                return;
+            }
+            // Group-committed insert. The next queued Message_Text may join
+            // the same batch; anything else in the session's queue waits for
+            // the commit, so a later history read sees it. Batches commit and
+            // call back in queue order, so broadcasts keep the sender's order
+            // and carry the committed id.
+            Database::Get().SaveMessageAsync(cid, user, msg, attachmentId, replyTo,
+                [this, finish, user, cid, msg, attachmentId, replyTo](int mid) {
+                    json out;
+                    out["mid"] = mid;
+                    out["cid"] = cid;
+                    out["u"] = user;
+                    out["msg"] = msg;
+                    out["attachment_id"] = attachmentId;
+                    if (replyTo > 0) out["reply_to"] = replyTo;
+                    std::string bin = Wire::Encode(Wire::MessageText{ mid, cid, replyTo, user, msg, attachmentId });
+                    finish([this, cid, body = out.dump(), bin = std::move(bin)]() {
+                        m_Server.BroadcastToChannelMembers(cid, PacketType::Message_Text, body, bin);
+                    });
+                });
+        });
+    }
+
+    void ChatSession::HandleTypingIndicator(int cid) {
+        json out;
+        out["u"] = m_Username;
+        out["cid"] = cid;
+        m_Server.BroadcastToChannelMembers(cid, PacketType::Typing_Indicator, out.dump(),
+            Wire::Encode(Wire::TypingIndicator{ cid, m_Username }));
+    }
+
+    void ChatSession::HandleVoiceMuteState(bool muted, bool deafened) {
+        int cid = m_CurrentVoiceCid.load(std::memory_order_relaxed);
+        if (cid == -1) return;
+        json out;
+        out["u"] = m_Username;
+        out["muted"] = muted;
+        out["deafened"] = deafened;
+        out["cid"] = cid;
+        m_Server.BroadcastToVoiceChannel(cid,
+            m_Server.CreateBroadcastBuffer(PacketType::Voice_Mute_State, out.dump()),
+            m_Server.CreateBroadcastBuffer(PacketType::Voice_Mute_State,
+                Wire::Encode(Wire::VoiceMuteState{ muted, deafened, cid, m_Username })));
+    }
+
+    void ChatSession::HandleSetStatus(std::string status) {
+        if (status.size() > 128) status = status.substr(0, 128);
+        m_Server.PublishStatus(shared_from_this(), status);
+    }
+
     void ChatSession::ProcessPacket() {
         using namespace TalkMe;
 
+        const auto& metrics = MetricsFor(m_Header.type);
+        metrics.received.Add();
+        const ScopedTimer handleTimer(metrics.handleTime);
+
         UpdateActivity();
 
         if (m_Header.type == PacketType::Voice_Data_Opus || m_Header.type == PacketType::Voice_Data) {
@@ -256,15 +763,62 @@ namespace TalkMe {
         }
 
         if (m_Header.type == PacketType::File_Transfer_Chunk) {
-            if (m_UploadFile.is_open()) {
-                // Prevent infinite chunking DoS attacks
-                if (m_UploadBytesReceived + m_Body.size() > m_UploadTargetSize) {
-                    m_UploadFile.close();
-                    Disconnect();
-                    return;
+            if (!m_Upload) return;
+            uint64_t offset = m_UploadNextOffset;
+            auto data = m_Body;
+            UploadManager::AckFn onAck;
+            if (m_Upload->windowed) {
+                if (data.size() < sizeof(UploadChunkHeader)) return;
+                UploadChunkHeader ch;
+                std::memcpy(&ch, data.data(), sizeof(ch));
+                ch.ToHost();
+                offset = ch.offset;
+                data = data.subspan(sizeof(ch));
+                // SendShared may be called from any thread.
+                onAck = [this, self = shared_from_this()](uint64_t stored) {
+                    UploadAckPayload ack{ static_cast<uint32_t>(stored) };
+                    PacketHeader h{ PacketType::File_Transfer_Ack, static_cast<uint32_t>(sizeof(ack)) };
+                    ack.ToNetwork();
+                    h.ToNetwork();
+                    auto buffer = std::make_shared<std::vector<uint8_t>>(sizeof(h) + sizeof(ack));
+                    std::memcpy(buffer->data(), &h, sizeof(h));
+                    std::memcpy(buffer->data() + sizeof(h), &ack, sizeof(ack));
+                    SendShared(buffer, false);
+                };
+            }
+            // Prevent infinite chunking DoS attacks; a client far past its
+            // window is cut off as well.
+            if (offset + data.size() > m_Upload->size ||
+                !UploadManager::Get().Write(m_Upload, offset, data, std::move(onAck))) {
+                Disconnect();
+                return;
+            }
+            m_UploadNextOffset = offset + data.size();
+            return;
+        }
+
+        if (m_Header.type == PacketType::Media_Ack) {
+            if (m_Body.size() >= sizeof(MediaAckPayload)) {
+                MediaAckPayload ack;
+                std::memcpy(&ack, m_Body.data(), sizeof(ack));
+                ack.ToHost();
+                auto it = m_MediaStreams.find(ack.transferId);
+                if (it != m_MediaStreams.end()) {
+                    auto& st = it->second;
+                    const uint32_t acked = std::max(st.acked, std::min(ack.bytesReceived, st.sent));
+                    if (acked > st.acked) st.lastProgress = std::chrono::steady_clock::now();
+                    st.acked = acked;
+                    PumpMediaStreams();
                 }
-                m_UploadFile.write(reinterpret_cast<const char*>(m_Body.data()), static_cast<std::streamsize>(m_Body.size()));
-                m_UploadBytesReceived += m_Body.size();
+            }
+            return;
+        }
+
+        if (m_Header.type == PacketType::Media_Cancel) {
+            if (m_Body.size() >= sizeof(uint32_t)) {
+                uint32_t tid;
+                std::memcpy(&tid, m_Body.data(), sizeof(tid));
+                if (m_MediaStreams.erase(NetToHost32(tid)) > 0) PumpMediaStreams();
             }
             return;
         }
@@ -279,29 +833,9 @@ namespace TalkMe {
                 std::fflush(stderr);
             }
             if (cid == -1 || m_Body.empty()) return;
-            PacketHeader h{ PacketType::Screen_Share_Frame, static_cast<uint32_t>(m_Body.size()) };
-            h.ToNetwork();
-            auto buf = std::make_shared<std::vector<uint8_t>>(sizeof(h) + m_Body.size());
-            std::memcpy(buf->data(), &h, sizeof(h));
-            std::memcpy(buf->data() + sizeof(h), m_Body.data(), m_Body.size());
-            int relayCount = 0;
-            {
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                auto it = m_Server.GetVoiceChannels().find(cid);
-                if (it != m_Server.GetVoiceChannels().end()) {
-                    for (const auto& s : it->second) {
-                        if (s.get() != this) {
-                            s->SendShared(buf, true);
-                            relayCount++;
-                        }
-                    }
-                } else if (s_frameLog < 5) {
-                    std::fprintf(stderr, "[Server] Screen_Share_Frame: cid=%d NOT FOUND in voice channels!\n", cid);
-                    std::fflush(stderr);
-                }
-            }
+            const size_t relayCount = m_Server.RelayScreenShareFrame(cid, this, m_Body);
             if (s_frameLog < 5) {
-                std::fprintf(stderr, "[Server] Screen_Share_Frame: relayed to %d clients\n", relayCount);
+                std::fprintf(stderr, "[Server] Screen_Share_Frame: relayed to %zu clients\n", relayCount);
                 std::fflush(stderr);
             }
             s_frameLog++;
@@ -309,82 +843,126 @@ namespace TalkMe {
         }
 
         if (m_Body.empty()) return; // Skip empty packets
-        std::string payload(m_Body.begin(), m_Body.end());
-        if (payload.empty() || (payload[0] != '{' && payload[0] != '[')) return; // Not JSON
+        if (Wire::IsBinary(m_Body.data(), m_Body.size())) {
+            ProcessBinaryPacket();
+            return;
+        }
+        if (m_Body[0] != '{' && m_Body[0] != '[') return; // Not JSON
         try {
-            auto j = json::parse(payload);
+            auto j = json::parse(m_Body.begin(), m_Body.end());
 
             if (m_Header.type == PacketType::Register_Request) {
                 if (!j.contains("u") || !j.contains("p")) { SendPacket(PacketType::Register_Failed, ""); return; }
-                std::string new_user = Database::Get().RegisterUser(j.value("e", ""), j["u"], j["p"]);
-                if (!new_user.empty()) {
-                    m_Username = new_user;
-                    Database::Get().AddUserToDefaultServer(new_user);
-                    json res; res["u"] = new_user;
-                    SendPacket(PacketType::Register_Success, res.dump());
-                    SendPacket(PacketType::Server_List_Response, Database::Get().GetUserServersJSON(new_user));
-                }
-                else {
-                    SendPacket(PacketType::Register_Failed, "");
-                }
+                std::string email = j.value("e", "");
+                std::string user = j["u"];
+                std::string pass = j["p"];
+                NegotiateWire(j.value("wire", 0), j.value("presence_batch", 0) != 0);
+                m_ReadPaused = true;
+                DbWrite([this, email, user, pass]() -> std::function<void()> {
+                    std::string new_user = Database::Get().RegisterUser(email, user, pass);
+                    std::string serversJson;
+                    std::vector<std::pair<int, int>> serverChannels;
+                    if (!new_user.empty()) {
+                        Database::Get().AddUserToDefaultServer(new_user);
+                        serversJson = Database::Get().GetUserServersJSON(new_user);
+                        serverChannels = Database::Get().GetUserServerChannels(new_user);
+                    }
+                    return [this, new_user, serversJson, serverChannels]() {
+                        if (!new_user.empty()) {
+                            OnAuthenticated(new_user, serverChannels);
+                            json res; res["u"] = new_user;
+                            if (UsesBinaryWire()) res["wire"] = Wire::kVersion;
+                            SendPacket(PacketType::Register_Success, res.dump());
+                            SendPacket(PacketType::Server_List_Response, serversJson);
+                        }
+                        else {
+                            SendPacket(PacketType::Register_Failed, "");
+                        }
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Login_Request) {
-                std::fprintf(stderr, "[TalkMe Server] Login_Request received, calling LoginUserAsync...\n");
+                std::fprintf(stderr, "[TalkMe Server] Login_Request received, queueing LoginUser...\n");
                 std::fflush(stderr);
                 std::string email = j.value("e", "");
                 std::string pass;
                 if (j.contains("p") && j["p"].is_string())
                     pass = j["p"].get<std::string>();
                 std::string hwid = j.value("hwid", "");
-                auto self = shared_from_this();
-                Database::Get().LoginUserAsync(email, pass, hwid,
-                    [this, self, hwid](int loginResult, std::string username, std::string serversJson, bool has2fa) {
-                        asio::post(m_Strand, [this, self, loginResult, username = std::move(username),
-                            serversJson = std::move(serversJson), has2fa, hwid]() {
-                                std::fprintf(stderr, "[TalkMe Server] LoginUserAsync returned %d\n", loginResult);
-                                std::fflush(stderr);
-                                if (loginResult == 1) {
-                                    m_Username = username;
-                                    json res; res["u"] = username; res["2fa_enabled"] = has2fa;
-                                    SendPacket(PacketType::Login_Success, res.dump());
-                                    if (!serversJson.empty())
-                                        SendPacket(PacketType::Server_List_Response, serversJson);
-                                    SendPacket(PacketType::Friend_List_Response, Database::Get().GetFriendListJSON(m_Username));
-                                    m_Server.BroadcastPresence(m_Username, true);
-                                }
-                                else if (loginResult == 2) {
-                                    m_PendingHWID = hwid;
-                                    json res; res["u"] = username;
-                                    SendPacket(PacketType::Login_Requires_2FA, res.dump());
-                                }
-                                else {
-                                    SendPacket(PacketType::Login_Failed, "");
-                                }
-                            });
-                    });
+                NegotiateWire(j.value("wire", 0), j.value("presence_batch", 0) != 0);
+                m_ReadPaused = true;
+                DbRead([this, email, pass, hwid]() -> std::function<void()> {
+                    auto& db = Database::Get();
+                    std::string username;
+                    int loginResult = db.LoginUser(email, pass, hwid, &username);
+                    std::string serversJson, friendsJson;
+                    std::vector<std::pair<int, int>> serverChannels;
+                    bool has2fa = false;
+                    if (loginResult == 1 && !username.empty()) {
+                        has2fa = !db.GetUserTOTPSecret(username, nullptr).empty();
+                        serversJson = db.GetUserServersJSON(username);
+                        serverChannels = db.GetUserServerChannels(username);
+                        friendsJson = db.GetFriendListJSON(username);
+                    }
+                    return [this, loginResult, username, serversJson, serverChannels, friendsJson, has2fa, hwid]() {
+                        std::fprintf(stderr, "[TalkMe Server] LoginUser returned %d\n", loginResult);
+                        std::fflush(stderr);
+                        if (loginResult == 1) {
+                            OnAuthenticated(username, serverChannels);
+                            json res; res["u"] = username; res["2fa_enabled"] = has2fa;
+                            if (UsesBinaryWire()) res["wire"] = Wire::kVersion;
+                            SendPacket(PacketType::Login_Success, res.dump());
+                            if (!serversJson.empty())
+                                SendPacket(PacketType::Server_List_Response, serversJson);
+                            SendPacket(PacketType::Friend_List_Response, friendsJson);
+                        }
+                        else if (loginResult == 2) {
+                            m_PendingHWID = hwid;
+                            json res; res["u"] = username;
+                            SendPacket(PacketType::Login_Requires_2FA, res.dump());
+                        }
+                        else {
+                            SendPacket(PacketType::Login_Failed, "");
+                        }
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Validate_Session_Request) {
-                std::string u = Database::Get().ValidateSession(j.value("e", ""), j.value("ph", ""));
-                if (!u.empty()) {
-                    m_Username = u;
-                    json res; res["valid"] = true; res["u"] = u;
-                    SendPacket(PacketType::Validate_Session_Response, res.dump());
-                    // Bug fix: the old code stopped here. A reconnecting client
-                    // (network switch, brief drop) needs the server/channel list
-                    // to restore its full UI state. Without it every reconnect
-                    // appeared as a blank slate. Send the list immediately after
-                    // confirming the session, mirroring the Login_Success flow.
-                    SendPacket(PacketType::Server_List_Response,
-                        Database::Get().GetUserServersJSON(u));
-                }
-                else {
-                    json res; res["valid"] = false;
-                    SendPacket(PacketType::Validate_Session_Response, res.dump());
-                }
+                std::string email = j.value("e", "");
+                std::string hash = j.value("ph", "");
+                NegotiateWire(j.value("wire", 0), j.value("presence_batch", 0) != 0);
+                m_ReadPaused = true;
+                DbRead([this, email, hash]() -> std::function<void()> {
+                    std::string u = Database::Get().ValidateSession(email, hash);
+                    std::string serversJson;
+                    std::vector<std::pair<int, int>> serverChannels;
+                    if (!u.empty()) {
+                        serversJson = Database::Get().GetUserServersJSON(u);
+                        serverChannels = Database::Get().GetUserServerChannels(u);
+                    }
+                    return [this, u, serversJson, serverChannels]() {
+                        if (!u.empty()) {
+                            OnAuthenticated(u, serverChannels);
+                            json res; res["valid"] = true; res["u"] = u;
+                            if (UsesBinaryWire()) res["wire"] = Wire::kVersion;
+                            SendPacket(PacketType::Validate_Session_Response, res.dump());
+                            // Bug fix: the old code stopped here. A reconnecting client
+                            // (network switch, brief drop) needs the server/channel list
+                            // to restore its full UI state. Without it every reconnect
+                            // appeared as a blank slate. Send the list immediately after
+                            // confirming the session, mirroring the Login_Success flow.
+                            SendPacket(PacketType::Server_List_Response, serversJson);
+                        }
+                        else {
+                            json res; res["valid"] = false;
+                            SendPacket(PacketType::Validate_Session_Response, res.dump());
+                        }
+                    };
+                });
                 return;
             }
 
@@ -396,21 +974,27 @@ namespace TalkMe {
                 // is recreated between Login_Request and Submit_2FA_Login_Request.
                 std::string submitHwid = j.value("hwid", "");
                 if (!submitHwid.empty()) m_PendingHWID = submitHwid;
-                std::string username;
-                std::string secret = Database::Get().GetUserTOTPSecret(email, &username);
-                if (secret.empty() || !VerifyTOTP(secret, code)) {
-                    SendPacket(PacketType::Login_Failed, "");
-                }
-                else {
-                    m_Username = username;
-                    if (m_PendingHWID.empty())
+                std::string hwid = m_PendingHWID;
+                m_ReadPaused = true;
+                DbWrite([this, email, code, hwid]() -> std::function<void()> {
+                    auto& db = Database::Get();
+                    std::string username;
+                    std::string secret = db.GetUserTOTPSecret(email, &username);
+                    if (secret.empty() || !VerifyTOTP(secret, code))
+                        return [this]() { SendPacket(PacketType::Login_Failed, ""); };
+                    if (hwid.empty())
                         std::fprintf(stderr, "[TalkMe] 2FA verified but no HWID present — device will not be trusted; user will be prompted for 2FA on next login.\n");
-                    Database::Get().TrustDevice(username, m_PendingHWID);
-                    json res; res["u"] = m_Username; res["2fa_enabled"] = true;
-                    SendPacket(PacketType::Login_Success, res.dump());
-                    SendPacket(PacketType::Server_List_Response, Database::Get().GetUserServersJSON(m_Username));
-                    m_Server.BroadcastPresence(m_Username, true);
-                }
+                    db.TrustDevice(username, hwid);
+                    std::string serversJson = db.GetUserServersJSON(username);
+                    auto serverChannels = db.GetUserServerChannels(username);
+                    return [this, username, serversJson, serverChannels]() {
+                        OnAuthenticated(username, serverChannels);
+                        json res; res["u"] = m_Username; res["2fa_enabled"] = true;
+                        if (UsesBinaryWire()) res["wire"] = Wire::kVersion;
+                        SendPacket(PacketType::Login_Success, res.dump());
+                        SendPacket(PacketType::Server_List_Response, serversJson);
+                    };
+                });
                 return;
             }
 
@@ -418,10 +1002,14 @@ namespace TalkMe {
 
             if (m_Header.type == PacketType::Disable_2FA_Request) {
                 std::string code = j.value("code", "");
-                std::string secret = Database::Get().GetUserTOTPSecret(m_Username, nullptr);
-                bool ok = (!secret.empty() && VerifyTOTP(secret, code)) && Database::Get().DisableUser2FA(m_Username);
-                json res; res["ok"] = ok;
-                SendPacket(PacketType::Disable_2FA_Response, res.dump());
+                DbWrite([this, user = m_Username, code]() -> std::function<void()> {
+                    std::string secret = Database::Get().GetUserTOTPSecret(user, nullptr);
+                    bool ok = (!secret.empty() && VerifyTOTP(secret, code)) && Database::Get().DisableUser2FA(user);
+                    return [this, ok]() {
+                        json res; res["ok"] = ok;
+                        SendPacket(PacketType::Disable_2FA_Response, res.dump());
+                    };
+                });
                 return;
             }
 
@@ -442,13 +1030,13 @@ namespace TalkMe {
                     json res; res["ok"] = false; SendPacket(PacketType::Verify_2FA_Setup_Request, res.dump());
                 }
                 else if (VerifyTOTP(m_Pending2FASecret, code)) {
-                    if (Database::Get().EnableUser2FA(m_Username, m_Pending2FASecret)) {
-                        m_Pending2FASecret.clear();
-                        json res; res["ok"] = true; SendPacket(PacketType::Verify_2FA_Setup_Request, res.dump());
-                    }
-                    else {
-                        json res; res["ok"] = false; SendPacket(PacketType::Verify_2FA_Setup_Request, res.dump());
-                    }
+                    DbWrite([this, user = m_Username, secret = m_Pending2FASecret]() -> std::function<void()> {
+                        bool ok = Database::Get().EnableUser2FA(user, secret);
+                        return [this, ok, secret]() {
+                            if (ok && m_Pending2FASecret == secret) m_Pending2FASecret.clear();
+                            json res; res["ok"] = ok; SendPacket(PacketType::Verify_2FA_Setup_Request, res.dump());
+                        };
+                    });
                 }
                 else {
                     json res; res["ok"] = false; SendPacket(PacketType::Verify_2FA_Setup_Request, res.dump());
@@ -458,34 +1046,63 @@ namespace TalkMe {
 
             if (m_Header.type == PacketType::Create_Server_Request) {
                 if (!j.contains("name") || !j["name"].is_string()) return;
-                Database::Get().CreateServer(j["name"], m_Username);
-                SendPacket(PacketType::Server_List_Response, Database::Get().GetUserServersJSON(m_Username));
+                DbWrite([this, user = m_Username, name = j["name"].get<std::string>()]() -> std::function<void()> {
+                    Database::Get().CreateServer(name, user);
+                    std::string serversJson = Database::Get().GetUserServersJSON(user);
+                    auto serverChannels = Database::Get().GetUserServerChannels(user);
+                    return [this, user, serversJson, serverChannels]() {
+                        m_Server.SetUserMembership(user, serverChannels);
+                        SendPacket(PacketType::Server_List_Response, serversJson);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Join_Server_Request) {
                 if (!j.contains("code") || !j["code"].is_string()) return;
-                Database::Get().JoinServer(m_Username, j["code"]);
-                SendPacket(PacketType::Server_List_Response, Database::Get().GetUserServersJSON(m_Username));
+                DbWrite([this, user = m_Username, code = j["code"].get<std::string>()]() -> std::function<void()> {
+                    Database::Get().JoinServer(user, code);
+                    std::string serversJson = Database::Get().GetUserServersJSON(user);
+                    auto serverChannels = Database::Get().GetUserServerChannels(user);
+                    return [this, user, serversJson, serverChannels]() {
+                        m_Server.SetUserMembership(user, serverChannels);
+                        SendPacket(PacketType::Server_List_Response, serversJson);
+                    };
+                });
                 return;
             }
             if (m_Header.type == PacketType::Get_Server_Content_Request) {
                 if (!j.contains("sid") || !j["sid"].is_number_integer()) return;
-                SendPacket(PacketType::Server_Content_Response, Database::Get().GetServerContentJSON(j["sid"]));
+                DbRead([this, sid = j["sid"].get<int>()]() -> std::function<void()> {
+                    std::string content = Database::Get().GetServerContentJSON(sid);
+                    return [this, content]() { SendPacket(PacketType::Server_Content_Response, content); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Create_Channel_Request) {
                 if (!j.contains("sid") || !j.contains("name") || !j.contains("type")) return;
-                Database::Get().CreateChannel(j["sid"], j["name"], j["type"]);
-                SendPacket(PacketType::Server_Content_Response, Database::Get().GetServerContentJSON(j["sid"]));
+                int sid = j["sid"];
+                std::string name = j["name"];
+                std::string type = j["type"];
+                DbWrite([this, sid, name, type]() -> std::function<void()> {
+                    int cid = Database::Get().CreateChannel(sid, name, type);
+                    std::string content = Database::Get().GetServerContentJSON(sid);
+                    return [this, sid, cid, content]() {
+                        m_Server.IndexChannel(sid, cid);
+                        SendPacket(PacketType::Server_Content_Response, content);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Select_Text_Channel) {
                 if (!j.contains("cid") || !j["cid"].is_number_integer()) return;
                 const int cid = j["cid"];
-                SendPacket(PacketType::Message_History_Response, Database::Get().GetMessageHistoryEnvelopeJSON(cid, 0, 0, 0, 0, 0, 50));
+                DbRead([this, cid]() -> std::function<void()> {
+                    std::string history = Database::Get().GetMessageHistoryEnvelopeJSON(cid, 0, 0, 0, 0, 0, 50);
+                    return [this, history]() { SendPacket(PacketType::Message_History_Response, history); };
+                });
                 return;
             }
 
@@ -500,82 +1117,125 @@ namespace TalkMe {
 
             if (m_Header.type == PacketType::Delete_Message_Request) {
                 if (!j.contains("mid") || !j.contains("cid")) return;
-                if (Database::Get().DeleteMessage(j["mid"], j["cid"], m_Username)) {
-                    int cid = j["cid"];
-                    json res;
-                    res["mid"] = j["mid"];
-                    res["cid"] = cid;
-                    m_Server.BroadcastToChannelMembers(cid, PacketType::Message_Delete, res.dump());
-                }
+                int mid = j["mid"];
+                int cid = j["cid"];
+                DbWrite([this, user = m_Username, mid, cid]() -> std::function<void()> {
+                    if (!Database::Get().DeleteMessage(mid, cid, user)) return nullptr;
+                    return [this, mid, cid]() {
+                        json res;
+                        res["mid"] = mid;
+                        res["cid"] = cid;
+                        m_Server.BroadcastToChannelMembers(cid, PacketType::Message_Delete, res.dump());
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Edit_Message_Request) {
                 if (!j.contains("mid") || !j.contains("msg") || !j.contains("cid")) return;
-                if (Database::Get().EditMessage(j["mid"], m_Username, j["msg"])) {
-                    const int cid = j["cid"];
-                    json res;
-                    res["mid"] = j["mid"];
-                    res["cid"] = cid;
-                    res["msg"] = j["msg"];
-                    m_Server.BroadcastToChannelMembers(cid, PacketType::Message_Edit, res.dump());
-                }
+                int mid = j["mid"];
+                const int cid = j["cid"];
+                std::string msg = j["msg"];
+                DbWrite([this, user = m_Username, mid, cid, msg]() -> std::function<void()> {
+                    if (!Database::Get().EditMessage(mid, user, msg)) return nullptr;
+                    return [this, mid, cid, msg]() {
+                        json res;
+                        res["mid"] = mid;
+                        res["cid"] = cid;
+                        res["msg"] = msg;
+                        m_Server.BroadcastToChannelMembers(cid, PacketType::Message_Edit, res.dump());
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Pin_Message_Request) {
                 if (!j.contains("mid") || !j.contains("cid") || !j.contains("pin")) return;
-                if (Database::Get().PinMessage(j["mid"], j["cid"], m_Username, j["pin"])) {
-                    const int cid = j["cid"];
-                    json res;
-                    res["mid"] = j["mid"];
-                    res["cid"] = cid;
-                    res["pin"] = j["pin"];
-                    m_Server.BroadcastToChannelMembers(cid, PacketType::Message_Pin_Update, res.dump());
-                }
+                int mid = j["mid"];
+                const int cid = j["cid"];
+                bool pin = j["pin"];
+                DbWrite([this, user = m_Username, mid, cid, pin]() -> std::function<void()> {
+                    if (!Database::Get().PinMessage(mid, cid, user, pin)) return nullptr;
+                    return [this, mid, cid, pin]() {
+                        json res;
+                        res["mid"] = mid;
+                        res["cid"] = cid;
+                        res["pin"] = pin;
+                        m_Server.BroadcastToChannelMembers(cid, PacketType::Message_Pin_Update, res.dump());
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::File_Transfer_Request) {
-                if (m_UploadFile.is_open()) m_UploadFile.close();
+                if (m_Upload) {
+                    UploadManager::Get().Detach(m_Upload, this);
+                    m_Upload.reset();
+                }
                 size_t size = j.value("size", 0);
                 if (size > 10 * 1024 * 1024) return;
-                // Enforce maximum size during chunking
-                m_UploadTargetSize = size;
                 std::string filename = j.value("filename", "");
+                std::string hash = AttachmentStore::NormalizeHash(j.value("sha256", ""));
+                const bool windowed = j.value("window", 0) != 0;
+                if (const std::string resumeId = j.value("resume", ""); windowed && !resumeId.empty()) {
+                    uint64_t offset = 0;
+                    if (auto upload = UploadManager::Get().Resume(this, m_Username, resumeId, hash, size, offset)) {
+                        m_Upload = std::move(upload);
+                        m_UploadNextOffset = offset;
+                        json res;
+                        res["action"] = "upload_approved";
+                        res["id"] = resumeId;
+                        res["offset"] = offset;
+                        SendPacket(PacketType::File_Transfer_Complete, res.dump());
+                        return;
+                    }
+                }
+                if (!hash.empty()) {
+                    // Content-addressed: if these bytes are already stored the
+                    // client skips the transfer and posts the id straight away.
+                    std::string id = AttachmentStore::ContentId(hash, filename);
+                    DbWrite([this, id, hash, size, windowed]() -> std::function<void()> {
+                        const bool stored = AttachmentStore::Claim(id, size);
+                        return [this, id, hash, size, windowed, stored]() {
+                            if (!stored) { BeginUpload(id, hash, size, windowed); return; }
+                            auto& stats = AttachmentStore::GetStats();
+                            stats.instant.fetch_add(1, std::memory_order_relaxed);
+                            stats.bytesSaved.fetch_add(size, std::memory_order_relaxed);
+                            json res;
+                            res["action"] = "upload_exists";
+                            res["id"] = id;
+                            SendPacket(PacketType::File_Transfer_Complete, res.dump());
+                        };
+                    });
+                    return;
+                }
                 size_t pos = filename.find_last_of("/\\");
                 std::string base = (pos != std::string::npos) ? filename.substr(pos + 1) : filename;
                 std::mt19937 rng(std::random_device{}());
                 std::uniform_int_distribution<uint32_t> dist;
                 char randHex[9];
                 std::snprintf(randHex, sizeof(randHex), "%08x", dist(rng));
-                m_UploadId = std::to_string(std::time(nullptr)) + "_" + randHex + "_" + base;
-                m_UploadBytesReceived = 0;
-                // Ensure the directory actually exists before opening the file
-                std::error_code ec;
-                std::filesystem::create_directories("attachments", ec);
-                m_UploadFile.open("attachments/" + m_UploadId, std::ios::binary);
-                json res;
-                res["action"] = "upload_approved";
-                res["id"] = m_UploadId;
-                SendPacket(PacketType::File_Transfer_Complete, res.dump());
+                BeginUpload(std::to_string(std::time(nullptr)) + "_" + randHex + "_" + base, {}, size, windowed);
                 return;
             }
 
             if (m_Header.type == PacketType::File_Transfer_Complete) {
-                m_UploadFile.close();
-                json res;
-                res["action"] = "upload_finished";
-                res["id"] = m_UploadId;
-                SendPacket(PacketType::File_Transfer_Complete, res.dump());
+                FinishUpload();
                 return;
             }
 
             if (m_Header.type == PacketType::Media_Request) {
                 if (!j.contains("id") || !j["id"].is_string()) return;
                 std::string id = j["id"].get<std::string>();
-                if (id.empty() || id.find("..") != std::string::npos) return;
-                std::filesystem::path filePath = std::filesystem::path("attachments") / id;
+                if (!AttachmentStore::IsValidId(id)) return;
+                if (j.value("stream", 0) != 0) {
+                    if (m_MediaQueue.size() >= kMaxMediaQueue) return;
+                    const int previewSize = j.contains("size") && j["size"].is_number_integer() ? j["size"].get<int>() : 0;
+                    m_MediaQueue.emplace_back(std::move(id), previewSize);
+                    PumpMediaStreams();
+                    return;
+                }
+                const std::filesystem::path filePath = AttachmentStore::PathFor(id);
                 if (!std::filesystem::is_regular_file(filePath)) return;
                 std::ifstream file(filePath, std::ios::binary);
                 if (!file) return;
@@ -591,39 +1251,26 @@ namespace TalkMe {
 
             if (m_Header.type == PacketType::Message_Text) {
                 if (!j.contains("cid") || !j.contains("msg")) return;
-                int cid = j["cid"];
-                int sid = Database::Get().GetServerIdForChannel(cid);
-                if (sid > 0 && Database::Get().IsUserSanctioned(sid, m_Username, "chat_mute")) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"You are muted in this server"})");
-                    return;
-                }
-                int replyTo = j.value("reply_to", 0);
-                int mid = Database::Get().SaveMessageReturnId(cid, m_Username, j["msg"], j.value("attachment_id", ""), replyTo);
-                json out;
-                out["mid"] = mid;
-                out["cid"] = cid;
-                out["u"] = m_Username;
-                out["msg"] = j["msg"];
-                out["attachment_id"] = j.value("attachment_id", "");
-                if (replyTo > 0) out["reply_to"] = replyTo;
-                m_Server.BroadcastToChannelMembers(cid, PacketType::Message_Text, out.dump());
+                HandleMessageText(j["cid"], j["msg"], j.value("attachment_id", ""), j.value("reply_to", 0));
                 return;
             }
 
             if (m_Header.type == PacketType::Member_List_Request) {
                 if (!j.contains("sid") || !j["sid"].is_number_integer()) return;
                 int sid = j["sid"];
-                auto members = Database::Get().GetServerMembers(sid);
-                auto onlineUsers = m_Server.GetOnlineUsers();
-                std::set<std::string> onlineSet(onlineUsers.begin(), onlineUsers.end());
-                json res = json::array();
-                for (const auto& m : members) {
-                    json entry;
-                    entry["u"] = m;
-                    entry["online"] = onlineSet.count(m) > 0;
-                    res.push_back(entry);
-                }
-                SendPacket(PacketType::Member_List_Response, res.dump());
+                DbRead([this, sid]() -> std::function<void()> {
+                    auto members = Database::Get().GetServerMembers(sid);
+                    return [this, members]() {
+                        json res = json::array();
+                        for (const auto& m : members) {
+                            json entry;
+                            entry["u"] = m;
+                            entry["online"] = m_Server.IsOnline(m);
+                            res.push_back(entry);
+                        }
+                        SendPacket(PacketType::Member_List_Response, res.dump());
+                    };
+                });
                 return;
             }
 
@@ -758,9 +1405,7 @@ namespace TalkMe {
                 if (m_Header.type == PacketType::Game_Accept) respType = PacketType::Game_State;
                 auto buf = m_Server.CreateBroadcastBuffer(respType, out.dump());
                 SendPacket(respType, out.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == target) s->SendShared(buf, false);
+                m_Server.SendToUser(target, buf);
                 return;
             }
 
@@ -773,63 +1418,77 @@ namespace TalkMe {
                 const int limit = j.value("limit", 50);
                 const int beforeLimit = j.value("before_limit", 0);
                 const int afterLimit = j.value("after_limit", 0);
-                SendPacket(PacketType::Message_History_Response,
-                    Database::Get().GetMessageHistoryEnvelopeJSON(cid, beforeId, afterId, anchorId, beforeLimit, afterLimit, limit));
+                DbRead([this, cid, beforeId, afterId, anchorId, beforeLimit, afterLimit, limit]() -> std::function<void()> {
+                    std::string history = Database::Get().GetMessageHistoryEnvelopeJSON(cid, beforeId, afterId, anchorId, beforeLimit, afterLimit, limit);
+                    return [this, history]() { SendPacket(PacketType::Message_History_Response, history); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Block_User) {
                 std::string target = j.value("u", "");
-                if (!target.empty()) Database::Get().BlockUser(m_Username, target);
-                SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"User blocked"})");
+                DbWrite([this, user = m_Username, target]() -> std::function<void()> {
+                    if (!target.empty()) Database::Get().BlockUser(user, target);
+                    return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"User blocked"})"); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Unblock_User) {
                 std::string target = j.value("u", "");
-                if (!target.empty()) Database::Get().UnblockUser(m_Username, target);
-                SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"User unblocked"})");
+                DbWrite([this, user = m_Username, target]() -> std::function<void()> {
+                    if (!target.empty()) Database::Get().UnblockUser(user, target);
+                    return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"User unblocked"})"); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Audit_Log_Request) {
                 if (!j.contains("sid")) return;
                 int sid = j["sid"];
-                if (!Database::Get().IsUserAdmin(sid, m_Username)) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})");
-                    return;
-                }
-                SendPacket(PacketType::Audit_Log_Response, Database::Get().GetAuditLogJSON(sid));
+                DbRead([this, user = m_Username, sid]() -> std::function<void()> {
+                    if (!Database::Get().IsUserAdmin(sid, user))
+                        return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})"); };
+                    std::string log = Database::Get().GetAuditLogJSON(sid);
+                    return [this, log]() { SendPacket(PacketType::Audit_Log_Response, log); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Set_Avatar) {
                 std::string avatarData = j.value("data", "");
                 if (avatarData.size() > 500000) return; // 500KB max base64
-                Database::Get().SetAvatar(m_Username, avatarData);
-                json res; res["ok"] = true;
-                SendPacket(PacketType::Avatar_Response, res.dump());
+                DbWrite([this, user = m_Username, avatarData = std::move(avatarData)]() -> std::function<void()> {
+                    Database::Get().SetAvatar(user, avatarData);
+                    return [this]() {
+                        json res; res["ok"] = true;
+                        SendPacket(PacketType::Avatar_Response, res.dump());
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Get_Avatar) {
                 std::string target = j.value("u", "");
                 if (target.empty()) return;
-                std::string avatar = Database::Get().GetAvatar(target);
-                json res; res["u"] = target; res["data"] = avatar;
-                SendPacket(PacketType::Avatar_Response, res.dump());
+                DbRead([this, target]() -> std::function<void()> {
+                    json res; res["u"] = target; res["data"] = Database::Get().GetAvatar(target);
+                    return [this, body = res.dump()]() { SendPacket(PacketType::Avatar_Response, body); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Bot_Register) {
                 if (!j.contains("sid") || !j.contains("name")) return;
                 int sid = j["sid"];
-                if (!Database::Get().IsUserAdmin(sid, m_Username)) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})");
-                    return;
-                }
-                std::string result = Database::Get().RegisterBot(sid, m_Username, j["name"]);
-                if (!result.empty()) SendPacket(PacketType::Bot_List_Response, result);
+                std::string name = j["name"];
+                DbWrite([this, user = m_Username, sid, name]() -> std::function<void()> {
+                    if (!Database::Get().IsUserAdmin(sid, user))
+                        return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})"); };
+                    std::string result = Database::Get().RegisterBot(sid, user, name);
+                    if (result.empty()) return nullptr;
+                    return [this, result]() { SendPacket(PacketType::Bot_List_Response, result); };
+                });
                 return;
             }
 
@@ -848,139 +1507,155 @@ namespace TalkMe {
             if (m_Header.type == PacketType::Admin_Move_User) {
                 if (!j.contains("sid") || !j.contains("u") || !j.contains("cid")) return;
                 int sid = j["sid"];
-                if (!Database::Get().IsUserAdmin(sid, m_Username)) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})");
-                    return;
-                }
                 std::string target = j["u"];
                 int newCid = j["cid"];
-                json notify; notify["action"] = "move"; notify["cid"] = newCid; notify["by"] = m_Username;
-                auto buf = m_Server.CreateBroadcastBuffer(PacketType::Admin_Action_Result, notify.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == target) s->SendShared(buf, false);
-                Database::Get().AddAuditLog(sid, m_Username, "move_user", target, "Moved to channel " + std::to_string(newCid));
-                SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"User moved"})");
+                DbWrite([this, user = m_Username, sid, target, newCid]() -> std::function<void()> {
+                    if (!Database::Get().IsUserAdmin(sid, user))
+                        return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})"); };
+                    Database::Get().AddAuditLog(sid, user, "move_user", target, "Moved to channel " + std::to_string(newCid));
+                    return [this, target, newCid]() {
+                        json notify; notify["action"] = "move"; notify["cid"] = newCid; notify["by"] = m_Username;
+                        auto buf = m_Server.CreateBroadcastBuffer(PacketType::Admin_Action_Result, notify.dump());
+                        m_Server.SendToUser(target, buf);
+                        SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"User moved"})");
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Admin_Disconnect_User) {
                 if (!j.contains("sid") || !j.contains("u")) return;
                 int sid = j["sid"];
-                if (!Database::Get().IsUserAdmin(sid, m_Username)) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})");
-                    return;
-                }
                 std::string target = j["u"];
-                json notify; notify["action"] = "disconnect"; notify["by"] = m_Username;
-                auto buf = m_Server.CreateBroadcastBuffer(PacketType::Admin_Action_Result, notify.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == target) s->SendShared(buf, false);
-                SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"User disconnected"})");
+                DbRead([this, user = m_Username, sid, target]() -> std::function<void()> {
+                    if (!Database::Get().IsUserAdmin(sid, user))
+                        return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})"); };
+                    return [this, target]() {
+                        json notify; notify["action"] = "disconnect"; notify["by"] = m_Username;
+                        auto buf = m_Server.CreateBroadcastBuffer(PacketType::Admin_Action_Result, notify.dump());
+                        m_Server.SendToUser(target, buf);
+                        SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"User disconnected"})");
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Admin_Force_Mute || m_Header.type == PacketType::Admin_Force_Deafen) {
                 if (!j.contains("sid") || !j.contains("u")) return;
                 int sid = j["sid"];
-                if (!Database::Get().IsUserAdmin(sid, m_Username)) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})");
-                    return;
-                }
                 std::string target = j["u"];
-                bool state = j.value("state", true);
                 json notify;
                 notify["action"] = (m_Header.type == PacketType::Admin_Force_Mute) ? "force_mute" : "force_deafen";
-                notify["state"] = state;
+                notify["state"] = j.value("state", true);
                 notify["by"] = m_Username;
-                auto buf = m_Server.CreateBroadcastBuffer(PacketType::Admin_Action_Result, notify.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == target) s->SendShared(buf, false);
-                SendPacket(PacketType::Admin_Action_Result, R"({"ok":true})");
+                DbRead([this, user = m_Username, sid, target, body = notify.dump()]() -> std::function<void()> {
+                    if (!Database::Get().IsUserAdmin(sid, user))
+                        return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})"); };
+                    return [this, target, body]() {
+                        auto buf = m_Server.CreateBroadcastBuffer(PacketType::Admin_Action_Result, body);
+                        m_Server.SendToUser(target, buf);
+                        SendPacket(PacketType::Admin_Action_Result, R"({"ok":true})");
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Admin_Sanction_User) {
                 if (!j.contains("sid") || !j.contains("u") || !j.contains("type")) return;
                 int sid = j["sid"];
-                if (!Database::Get().IsUserAdmin(sid, m_Username)) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})");
-                    return;
-                }
                 std::string target = j["u"];
                 std::string sType = j["type"];
                 std::string reason = j.value("reason", "");
                 int durationMin = j.value("duration_minutes", 0);
-                Database::Get().AddSanction(sid, target, sType, reason, durationMin, m_Username);
-                json notify; notify["action"] = "sanctioned"; notify["type"] = sType; notify["by"] = m_Username;
-                if (durationMin > 0) notify["duration_minutes"] = durationMin;
-                auto buf = m_Server.CreateBroadcastBuffer(PacketType::Admin_Action_Result, notify.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == target) s->SendShared(buf, false);
-                SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"Sanction applied"})");
+                DbWrite([this, user = m_Username, sid, target, sType, reason, durationMin]() -> std::function<void()> {
+                    if (!Database::Get().IsUserAdmin(sid, user))
+                        return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})"); };
+                    Database::Get().AddSanction(sid, target, sType, reason, durationMin, user);
+                    return [this, target, sType, durationMin]() {
+                        json notify; notify["action"] = "sanctioned"; notify["type"] = sType; notify["by"] = m_Username;
+                        if (durationMin > 0) notify["duration_minutes"] = durationMin;
+                        auto buf = m_Server.CreateBroadcastBuffer(PacketType::Admin_Action_Result, notify.dump());
+                        m_Server.SendToUser(target, buf);
+                        SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"Sanction applied"})");
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Admin_Create_Role) {
                 if (!j.contains("sid") || !j.contains("name")) return;
                 int sid = j["sid"];
-                if (!Database::Get().IsUserAdmin(sid, m_Username)) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})");
-                    return;
-                }
-                int roleId = Database::Get().CreateRole(sid, j["name"], j.value("perms", 0), j.value("color", "#FFFFFF"));
-                json res; res["ok"] = (roleId > 0); res["role_id"] = roleId;
-                res["roles"] = json::parse(Database::Get().GetServerRolesJSON(sid));
-                SendPacket(PacketType::Admin_Action_Result, res.dump());
+                std::string name = j["name"];
+                uint32_t perms = j.value("perms", 0);
+                std::string color = j.value("color", "#FFFFFF");
+                DbWrite([this, user = m_Username, sid, name, perms, color]() -> std::function<void()> {
+                    if (!Database::Get().IsUserAdmin(sid, user))
+                        return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})"); };
+                    int roleId = Database::Get().CreateRole(sid, name, perms, color);
+                    json res; res["ok"] = (roleId > 0); res["role_id"] = roleId;
+                    res["roles"] = json::parse(Database::Get().GetServerRolesJSON(sid));
+                    return [this, body = res.dump()]() { SendPacket(PacketType::Admin_Action_Result, body); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Admin_Assign_Role) {
                 if (!j.contains("sid") || !j.contains("u") || !j.contains("role_id")) return;
                 int sid = j["sid"];
-                if (!Database::Get().IsUserAdmin(sid, m_Username)) {
-                    SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})");
-                    return;
-                }
-                Database::Get().AssignRole(j["u"], j["role_id"]);
-                SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"Role assigned"})");
+                std::string target = j["u"];
+                int roleId = j["role_id"];
+                DbWrite([this, user = m_Username, sid, target, roleId]() -> std::function<void()> {
+                    if (!Database::Get().IsUserAdmin(sid, user))
+                        return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":false,"msg":"No permission"})"); };
+                    Database::Get().AssignRole(target, roleId);
+                    return [this]() { SendPacket(PacketType::Admin_Action_Result, R"({"ok":true,"msg":"Role assigned"})"); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Rename_Server_Request) {
                 if (!j.contains("sid") || !j.contains("name")) return;
-                if (Database::Get().RenameServer(j["sid"], j["name"], m_Username))
-                    SendPacket(PacketType::Server_List_Response, Database::Get().GetUserServersJSON(m_Username));
+                int sid = j["sid"];
+                std::string name = j["name"];
+                DbWrite([this, user = m_Username, sid, name]() -> std::function<void()> {
+                    if (!Database::Get().RenameServer(sid, name, user)) return nullptr;
+                    std::string serversJson = Database::Get().GetUserServersJSON(user);
+                    return [this, serversJson]() { SendPacket(PacketType::Server_List_Response, serversJson); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Delete_Server_Request) {
                 if (!j.contains("sid")) return;
-                if (Database::Get().DeleteServer(j["sid"], m_Username))
-                    SendPacket(PacketType::Server_List_Response, Database::Get().GetUserServersJSON(m_Username));
+                int sid = j["sid"];
+                DbWrite([this, user = m_Username, sid]() -> std::function<void()> {
+                    if (!Database::Get().DeleteServer(sid, user)) return nullptr;
+                    std::string serversJson = Database::Get().GetUserServersJSON(user);
+                    return [this, sid, serversJson]() {
+                        m_Server.UnindexServer(sid);
+                        SendPacket(PacketType::Server_List_Response, serversJson);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Leave_Server_Request) {
                 if (!j.contains("sid")) return;
-                Database::Get().LeaveServer(m_Username, j["sid"]);
-                SendPacket(PacketType::Server_List_Response, Database::Get().GetUserServersJSON(m_Username));
+                int sid = j["sid"];
+                DbWrite([this, user = m_Username, sid]() -> std::function<void()> {
+                    Database::Get().LeaveServer(user, sid);
+                    std::string serversJson = Database::Get().GetUserServersJSON(user);
+                    auto serverChannels = Database::Get().GetUserServerChannels(user);
+                    return [this, user, serversJson, serverChannels]() {
+                        m_Server.SetUserMembership(user, serverChannels);
+                        SendPacket(PacketType::Server_List_Response, serversJson);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Set_Status) {
-                std::string status = j.value("status", "");
-                if (status.size() > 128) status = status.substr(0, 128);
-                json out; out["u"] = m_Username; out["status"] = status;
-                auto buf = m_Server.CreateBroadcastBuffer(PacketType::Status_Update, out.dump());
-                {
-                    std::shared_lock lock(m_Server.GetRoomMutex());
-                    for (const auto& s : m_Server.GetAllSessions())
-                        s->SendShared(buf, false);
-                }
+                HandleSetStatus(j.value("status", ""));
                 return;
             }
 
@@ -1005,10 +1680,21 @@ namespace TalkMe {
                 out["u"] = m_Username;
                 out["cid"] = cid;
                 out["action"] = "stop";
+                m_Server.EndScreenShare(this);
                 m_Server.BroadcastToChannelMembers(cid, PacketType::Screen_Share_State, out.dump());
                 return;
             }
 
+            if (m_Header.type == PacketType::Screen_Share_Watch) {
+                int cid = m_CurrentVoiceCid.load(std::memory_order_relaxed);
+                if (cid == -1 || !j.contains("u") || !j["u"].is_array()) return;
+                std::vector<std::string> sharers;
+                for (const auto& u : j["u"])
+                    if (u.is_string() && sharers.size() < ScreenShareRelay::kMaxWatched) sharers.push_back(u.get<std::string>());
+                m_Server.WatchScreenShares(shared_from_this(), cid, sharers);
+                return;
+            }
+
             // Screen_Share_Frame handled above (binary, before JSON parse)
 
             if (m_Header.type == PacketType::Set_Member_Role) {
@@ -1016,32 +1702,42 @@ namespace TalkMe {
                 int sid = j["sid"];
                 std::string target = j["u"];
                 uint32_t perms = j["perms"];
-                if (Database::Get().SetMemberPermissions(sid, target, perms, m_Username)) {
-                    json res; res["u"] = target; res["perms"] = perms; res["sid"] = sid;
-                    SendPacket(PacketType::Member_Role_Response, res.dump());
-                }
+                DbWrite([this, user = m_Username, sid, target, perms]() -> std::function<void()> {
+                    if (!Database::Get().SetMemberPermissions(sid, target, perms, user)) return nullptr;
+                    return [this, sid, target, perms]() {
+                        json res; res["u"] = target; res["perms"] = perms; res["sid"] = sid;
+                        SendPacket(PacketType::Member_Role_Response, res.dump());
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Get_Member_Role) {
                 if (!j.contains("sid") || !j.contains("u")) return;
-                uint32_t perms = Database::Get().GetUserPermissions(j["sid"], j["u"]);
-                json res; res["u"] = j["u"]; res["perms"] = perms; res["sid"] = j["sid"];
-                std::string owner = Database::Get().GetServerOwner(j["sid"]);
-                res["is_owner"] = (j["u"] == owner);
-                SendPacket(PacketType::Member_Role_Response, res.dump());
+                int sid = j["sid"];
+                std::string target = j["u"];
+                DbRead([this, sid, target]() -> std::function<void()> {
+                    uint32_t perms = Database::Get().GetUserPermissions(sid, target);
+                    json res; res["u"] = target; res["perms"] = perms; res["sid"] = sid;
+                    std::string owner = Database::Get().GetServerOwner(sid);
+                    res["is_owner"] = (target == owner);
+                    return [this, body = res.dump()]() { SendPacket(PacketType::Member_Role_Response, body); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Call_Request) {
                 std::string target = j.value("to", "");
-                if (target.empty() || !Database::Get().AreFriends(m_Username, target)) return;
-                json out; out["from"] = m_Username; out["state"] = "ringing";
-                auto buf = m_Server.CreateBroadcastBuffer(PacketType::Call_State, out.dump());
-                SendPacket(PacketType::Call_State, out.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == target) s->SendShared(buf, false);
+                if (target.empty()) return;
+                DbRead([this, user = m_Username, target]() -> std::function<void()> {
+                    if (!Database::Get().AreFriends(user, target)) return nullptr;
+                    return [this, target]() {
+                        json out; out["from"] = m_Username; out["state"] = "ringing";
+                        auto buf = m_Server.CreateBroadcastBuffer(PacketType::Call_State, out.dump());
+                        SendPacket(PacketType::Call_State, out.dump());
+                        m_Server.SendToUser(target, buf);
+                    };
+                });
                 return;
             }
 
@@ -1051,9 +1747,7 @@ namespace TalkMe {
                 json out; out["from"] = caller; out["to"] = m_Username; out["state"] = "active";
                 auto buf = m_Server.CreateBroadcastBuffer(PacketType::Call_State, out.dump());
                 SendPacket(PacketType::Call_State, out.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == caller) s->SendShared(buf, false);
+                m_Server.SendToUser(caller, buf);
                 return;
             }
 
@@ -1064,9 +1758,7 @@ namespace TalkMe {
                 json out; out["from"] = m_Username; out["state"] = "ended";
                 auto buf = m_Server.CreateBroadcastBuffer(PacketType::Call_State, out.dump());
                 SendPacket(PacketType::Call_State, out.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == other) s->SendShared(buf, false);
+                m_Server.SendToUser(other, buf);
                 return;
             }
 
@@ -1074,62 +1766,78 @@ namespace TalkMe {
                 std::string target = j.value("to", "");
                 std::string content = j.value("msg", "");
                 if (target.empty() || content.empty()) return;
-                if (!Database::Get().AreFriends(m_Username, target)) return;
-                int mid = Database::Get().SaveDirectMessage(m_Username, target, content);
-                json out;
-                out["mid"] = mid;
-                out["u"] = m_Username;
-                out["to"] = target;
-                out["msg"] = content;
-                SendPacket(PacketType::DM_Receive, out.dump());
-                auto buf = m_Server.CreateBroadcastBuffer(PacketType::DM_Receive, out.dump());
-                std::shared_lock lock(m_Server.GetRoomMutex());
-                for (const auto& s : m_Server.GetAllSessions())
-                    if (s->GetUsername() == target) s->SendShared(buf, false);
+                DbWrite([this, user = m_Username, target, content]() -> std::function<void()> {
+                    if (!Database::Get().AreFriends(user, target)) return nullptr;
+                    int mid = Database::Get().SaveDirectMessage(user, target, content);
+                    json out;
+                    out["mid"] = mid;
+                    out["u"] = user;
+                    out["to"] = target;
+                    out["msg"] = content;
+                    return [this, target, body = out.dump()]() {
+                        SendPacket(PacketType::DM_Receive, body);
+                        auto buf = m_Server.CreateBroadcastBuffer(PacketType::DM_Receive, body);
+                        m_Server.SendToUser(target, buf);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::DM_History_Request) {
                 std::string target = j.value("u", "");
                 if (target.empty()) return;
-                SendPacket(PacketType::DM_History_Response,
-                    Database::Get().GetDMHistoryJSON(m_Username, target));
+                DbRead([this, user = m_Username, target]() -> std::function<void()> {
+                    std::string history = Database::Get().GetDMHistoryJSON(user, target);
+                    return [this, history]() { SendPacket(PacketType::DM_History_Response, history); };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Friend_Request) {
                 std::string target = j.value("u", "");
-                if (!target.empty() && Database::Get().SendFriendRequest(m_Username, target)) {
-                    SendPacket(PacketType::Friend_List_Response, Database::Get().GetFriendListJSON(m_Username));
-                    // Notify the target if they're online
-                    json notify; notify["u"] = m_Username; notify["status"] = "pending"; notify["direction"] = "received";
-                    auto buf = m_Server.CreateBroadcastBuffer(PacketType::Friend_Update, notify.dump());
-                    std::shared_lock lock(m_Server.GetRoomMutex());
-                    for (const auto& s : m_Server.GetAllSessions())
-                        if (s->GetUsername() == target) s->SendShared(buf, false);
-                }
+                if (target.empty()) return;
+                DbWrite([this, user = m_Username, target]() -> std::function<void()> {
+                    if (!Database::Get().SendFriendRequest(user, target)) return nullptr;
+                    std::string friendsJson = Database::Get().GetFriendListJSON(user);
+                    return [this, target, friendsJson]() {
+                        SendPacket(PacketType::Friend_List_Response, friendsJson);
+                        // Notify the target if they're online
+                        json notify; notify["u"] = m_Username; notify["status"] = "pending"; notify["direction"] = "received";
+                        auto buf = m_Server.CreateBroadcastBuffer(PacketType::Friend_Update, notify.dump());
+                        m_Server.SendToUser(target, buf);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Friend_Accept) {
                 std::string target = j.value("u", "");
-                if (!target.empty() && Database::Get().AcceptFriendRequest(m_Username, target)) {
-                    SendPacket(PacketType::Friend_List_Response, Database::Get().GetFriendListJSON(m_Username));
-                    json notify; notify["u"] = m_Username; notify["status"] = "accepted"; notify["direction"] = "sent";
-                    auto buf = m_Server.CreateBroadcastBuffer(PacketType::Friend_Update, notify.dump());
-                    std::shared_lock lock(m_Server.GetRoomMutex());
-                    for (const auto& s : m_Server.GetAllSessions())
-                        if (s->GetUsername() == target) s->SendShared(buf, false);
-                }
+                if (target.empty()) return;
+                DbWrite([this, user = m_Username, target]() -> std::function<void()> {
+                    if (!Database::Get().AcceptFriendRequest(user, target)) return nullptr;
+                    std::string friendsJson = Database::Get().GetFriendListJSON(user);
+                    return [this, target, friendsJson]() {
+                        m_Server.AddFriendship(m_Username, target);
+                        SendPacket(PacketType::Friend_List_Response, friendsJson);
+                        json notify; notify["u"] = m_Username; notify["status"] = "accepted"; notify["direction"] = "sent";
+                        auto buf = m_Server.CreateBroadcastBuffer(PacketType::Friend_Update, notify.dump());
+                        m_Server.SendToUser(target, buf);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Friend_Reject) {
                 std::string target = j.value("u", "");
-                if (!target.empty()) {
-                    Database::Get().RejectOrRemoveFriend(m_Username, target);
-                    SendPacket(PacketType::Friend_List_Response, Database::Get().GetFriendListJSON(m_Username));
-                }
+                if (target.empty()) return;
+                DbWrite([this, user = m_Username, target]() -> std::function<void()> {
+                    Database::Get().RejectOrRemoveFriend(user, target);
+                    std::string friendsJson = Database::Get().GetFriendListJSON(user);
+                    return [this, target, friendsJson]() {
+                        m_Server.RemoveFriendship(m_Username, target);
+                        SendPacket(PacketType::Friend_List_Response, friendsJson);
+                    };
+                });
                 return;
             }
 
@@ -1138,15 +1846,21 @@ namespace TalkMe {
                 int mid = j["mid"];
                 std::string emoji = j["emoji"];
                 if (emoji.size() > 16) return;
-                Database::Get().AddReaction(mid, m_Username, emoji);
-                json out;
-                out["mid"] = mid;
-                out["emoji"] = emoji;
-                out["u"] = m_Username;
-                out["action"] = "add";
-                out["reactions"] = json::parse(Database::Get().GetReactionsJSON(mid));
-                if (j.contains("cid"))
-                    m_Server.BroadcastToChannelMembers(j["cid"], PacketType::Reaction_Update, out.dump());
+                const bool hasCid = j.contains("cid");
+                const int cid = hasCid ? j["cid"].get<int>() : -1;
+                DbWrite([this, user = m_Username, mid, emoji, hasCid, cid]() -> std::function<void()> {
+                    Database::Get().AddReaction(mid, user, emoji);
+                    if (!hasCid) return nullptr;
+                    json out;
+                    out["mid"] = mid;
+                    out["emoji"] = emoji;
+                    out["u"] = user;
+                    out["action"] = "add";
+                    out["reactions"] = json::parse(Database::Get().GetReactionsJSON(mid));
+                    return [this, cid, body = out.dump()]() {
+                        m_Server.BroadcastToChannelMembers(cid, PacketType::Reaction_Update, body);
+                    };
+                });
                 return;
             }
 
@@ -1154,47 +1868,47 @@ namespace TalkMe {
                 if (!j.contains("mid") || !j.contains("emoji")) return;
                 int mid = j["mid"];
                 std::string emoji = j["emoji"];
-                Database::Get().RemoveReaction(mid, m_Username, emoji);
-                json out;
-                out["mid"] = mid;
-                out["emoji"] = emoji;
-                out["u"] = m_Username;
-                out["action"] = "remove";
-                out["reactions"] = json::parse(Database::Get().GetReactionsJSON(mid));
-                if (j.contains("cid"))
-                    m_Server.BroadcastToChannelMembers(j["cid"], PacketType::Reaction_Update, out.dump());
+                const bool hasCid = j.contains("cid");
+                const int cid = hasCid ? j["cid"].get<int>() : -1;
+                DbWrite([this, user = m_Username, mid, emoji, hasCid, cid]() -> std::function<void()> {
+                    Database::Get().RemoveReaction(mid, user, emoji);
+                    if (!hasCid) return nullptr;
+                    json out;
+                    out["mid"] = mid;
+                    out["emoji"] = emoji;
+                    out["u"] = user;
+                    out["action"] = "remove";
+                    out["reactions"] = json::parse(Database::Get().GetReactionsJSON(mid));
+                    return [this, cid, body = out.dump()]() {
+                        m_Server.BroadcastToChannelMembers(cid, PacketType::Reaction_Update, body);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Delete_Channel_Request) {
                 if (!j.contains("cid") || !j.contains("sid")) return;
-                if (Database::Get().DeleteChannel(j["cid"], m_Username)) {
-                    SendPacket(PacketType::Server_Content_Response,
-                        Database::Get().GetServerContentJSON(j["sid"]));
-                }
+                int cid = j["cid"];
+                int sid = j["sid"];
+                DbWrite([this, user = m_Username, cid, sid]() -> std::function<void()> {
+                    if (!Database::Get().DeleteChannel(cid, user)) return nullptr;
+                    std::string content = Database::Get().GetServerContentJSON(sid);
+                    return [this, cid, content]() {
+                        m_Server.UnindexChannel(cid);
+                        SendPacket(PacketType::Server_Content_Response, content);
+                    };
+                });
                 return;
             }
 
             if (m_Header.type == PacketType::Voice_Mute_State) {
-                int cid = m_CurrentVoiceCid.load(std::memory_order_relaxed);
-                if (cid == -1) return;
-                json out;
-                out["u"] = m_Username;
-                out["muted"] = j.value("muted", false);
-                out["deafened"] = j.value("deafened", false);
-                out["cid"] = cid;
-                auto buf = m_Server.CreateBroadcastBuffer(PacketType::Voice_Mute_State, out.dump());
-                m_Server.BroadcastToVoiceChannel(cid, buf);
+                HandleVoiceMuteState(j.value("muted", false), j.value("deafened", false));
                 return;
             }
 
             if (m_Header.type == PacketType::Typing_Indicator) {
                 if (!j.contains("cid")) return;
-                int cid = j["cid"];
-                json out;
-                out["u"] = m_Username;
-                out["cid"] = cid;
-                m_Server.BroadcastToChannelMembers(cid, PacketType::Typing_Indicator, out.dump());
+                HandleTypingIndicator(j["cid"]);
                 return;
             }
 
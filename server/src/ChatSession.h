@@ -2,11 +2,20 @@
 #include <memory>
 #include <vector>
 #include <deque>
+#include <array>
+#include <mutex>
 #include <string>
 #include <chrono>
 #include <atomic>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <span>
+#include <utility>
+#include "Metrics.h"
 #include "Protocol.h"
+#include "UploadManager.h"
 #include <asio.hpp>
 
 namespace TalkMe {
@@ -15,6 +24,24 @@ namespace TalkMe {
 
 namespace TalkMe {
 
+    // Outbound priority lanes, drained in this order. The lane comes from the
+    // packet type in the buffer's header (see ChatSession::LaneFor).
+    enum class WriteLane : uint8_t { Voice, Control, Bulk };
+    constexpr size_t kWriteLaneCount = 3;
+    constexpr const char* kWriteLaneNames[kWriteLaneCount] = { "voice", "control", "bulk" };
+
+    // Process-wide counters per lane, reported in voice_stats.json. queued
+    // and dropped are bumped on every SendShared and are also exported as
+    // talkme_write_{queued,dropped}_total{lane}.
+    struct WriteLaneStats {
+        Counter               queued;
+        Counter               dropped;
+        std::atomic<uint64_t> written{ 0 };
+        std::atomic<uint64_t> waitUsTotal{ 0 };   // enqueue -> handed to the socket
+        std::atomic<uint64_t> waitUsMax{ 0 };
+        std::atomic<uint64_t> peakDepth{ 0 };     // deepest single-session queue
+    };
+
     class ChatSession : public std::enable_shared_from_this<ChatSession> {
     public:
         ChatSession(asio::ip::tcp::socket socket, TalkMeServer& server);
@@ -22,33 +49,152 @@ namespace TalkMe {
         void Start();
         int GetVoiceChannelId() const { return m_CurrentVoiceCid.load(std::memory_order_relaxed); }
         const std::string& GetUsername() const { return m_Username; }
+        uint32_t GetUserId() const { return m_UserId.load(std::memory_order_relaxed); }
         bool IsHealthy() const { return m_IsHealthy.load(std::memory_order_relaxed); }
         std::chrono::steady_clock::time_point GetLastVoicePacketTime() const { return m_LastVoicePacket; }
         int64_t GetLastActivityTimeMs() const { return m_LastActivityTimeMs.load(std::memory_order_relaxed); }
+        size_t GetWriteQueueDepth(WriteLane lane) const {
+            return m_LaneDepth[static_cast<size_t>(lane)].load(std::memory_order_relaxed);
+        }
+
+        static WriteLane LaneFor(PacketType type);
+        static WriteLaneStats& GetWriteLaneStats(WriteLane lane);
+        static std::atomic<uint64_t>& GetWriteCallCount();
         void SetVoiceLoad(size_t load) { m_CurrentVoiceLoad.store(std::max<size_t>(1, load), std::memory_order_relaxed); }
 
         void UpdateActivity();
         void TouchVoiceActivity();
-        void SendShared(std::shared_ptr<std::vector<uint8_t>> buffer, bool isVoiceData);
+        // Thread-safe. `droppable` packets (voice, screen frames) are discarded
+        // instead of queued once their lane is backed up. False if discarded.
+        bool SendShared(std::shared_ptr<std::vector<uint8_t>> buffer, bool droppable);
+
+        // True once the client offered the binary control encoding (WireCodec.h).
+        bool UsesBinaryWire() const { return m_BinaryWire.load(std::memory_order_relaxed); }
+        // True once the client asked for Presence_Batch ("presence_batch":1).
+        bool WantsPresenceBatch() const { return m_PresenceBatch.load(std::memory_order_relaxed); }
+        // Order in which sessions were authenticated; set by the server.
+        uint64_t GetOnlineOrder() const { return m_OnlineOrder.load(std::memory_order_relaxed); }
+        void SetOnlineOrder(uint64_t order) { m_OnlineOrder.store(order, std::memory_order_relaxed); }
+        // Set while the server has a voice idle check of this session filed.
+        // Arm returns false if one already was.
+        bool ArmVoiceIdleCheck() { return !m_VoiceIdleCheck.exchange(true, std::memory_order_relaxed); }
+        void DisarmVoiceIdleCheck() { m_VoiceIdleCheck.store(false, std::memory_order_relaxed); }
+        // Sends whichever prebuilt encoding of a control packet this client reads.
+        void SendControl(const std::shared_ptr<std::vector<uint8_t>>& json,
+                         const std::shared_ptr<std::vector<uint8_t>>& binary) {
+            SendShared(binary && UsesBinaryWire() ? binary : json, false);
+        }
 
     private:
-        void ReadHeader();
-        void ReadBody();
+        void ReadSome();
+        void DispatchPackets();
         void ProcessPacket();
+        void ProcessBinaryPacket();
+        void HandleMessageText(int cid, std::string msg, std::string attachmentId, int replyTo);
+        void HandleTypingIndicator(int cid);
+        void HandleVoiceMuteState(bool muted, bool deafened);
+        void HandleSetStatus(std::string status);
+        void NegotiateWire(int offered, bool presenceBatch);
+        void BeginUpload(const std::string& id, const std::string& hash, size_t size, bool windowed);
+        void FinishUpload();
+        void StartMediaStream(const std::string& id, int previewSize);
+        void PumpMediaStreams();
+        void WatchMediaStreams();
+        void EndMediaStream(uint32_t tid, const char* error);
         void DoWrite();
+        size_t PendingReplyDepth() const;
+        void ResumeThrottledRead();
         void Disconnect();
         void SendPacket(TalkMe::PacketType type, const std::string& data);
+        void SetUsername(const std::string& username);
+        // Sets the username and registers the session in the server's channel
+        // membership index; serverChannels as from Database::GetUserServerChannels.
+        void OnAuthenticated(const std::string& username, const std::vector<std::pair<int, int>>& serverChannels);
+
+        // Database work for this session. A job runs on the DB executor and may
+        // return a continuation, which is posted back to the strand. Jobs run one
+        // at a time in submission order, so a read queued after a write sees it.
+        // A deferred job hands its continuation to finish() itself, possibly
+        // later from another thread; the queue does not advance until it does.
+        // A pipelined job is deferred too, but the queue moves on as soon as
+        // it returns: back-to-back pipelined jobs overlap (a session's chat
+        // messages join one group commit), while any other job still waits
+        // for every earlier pipelined job to finish.
+        using DbJob = std::function<std::function<void()>()>;
+        using DbFinish = std::function<void(std::function<void()>)>;
+        using DbDeferredJob = std::function<void(DbFinish)>;
+        void DbRead(DbJob job) { QueueDb(false, false, Immediate(std::move(job))); }
+        void DbWrite(DbJob job) { QueueDb(true, false, Immediate(std::move(job))); }
+        void DbReadDeferred(DbDeferredJob job) { QueueDb(false, false, std::move(job)); }
+        void DbReadPipelined(DbDeferredJob job) { QueueDb(false, true, std::move(job)); }
+        static DbDeferredJob Immediate(DbJob job) {
+            return [job = std::move(job)](DbFinish finish) { finish(job()); };
+        }
+        void QueueDb(bool write, bool pipelined, DbDeferredJob job);
+        void RunNextDbJob();
+        void RunDbCompletion(const std::function<void()>& done);
+        void ResumeReading();
 
         asio::ip::tcp::socket m_Socket;
         TalkMeServer& m_Server;
         asio::strand<asio::any_io_executor> m_Strand;
+
+        // --- Inbound path -------------------------------------------------------
+        // One async_read_some fills m_ReadBuf with as much as the socket holds;
+        // DispatchPackets then frames every complete packet in it. m_Body is a
+        // view into m_ReadBuf and is only valid during ProcessPacket. The buffer
+        // grows to fit a single oversized packet and shrinks back afterwards.
+        static constexpr size_t kReadBufferSize = 64 * 1024;
+        static constexpr size_t kMaxPacketSize = 10 * 1024 * 1024;
+        // Framing stops while this many control/bulk replies are queued.
+        static constexpr size_t kReadBackpressureDepth = 128;
         TalkMe::PacketHeader m_Header;
-        std::vector<uint8_t> m_Body;
-        std::deque<std::shared_ptr<std::vector<uint8_t>>> m_WriteQueue;
+        std::span<const uint8_t> m_Body;
+        std::vector<uint8_t> m_ReadBuf;
+        size_t m_ReadStart = 0;   // first unconsumed byte
+        size_t m_ReadEnd = 0;     // one past the last received byte
+
+        // --- Outbound path ------------------------------------------------------
+        // Producers append to a lane under m_WriteMutex; the first one to find
+        // the writer idle posts a single DoWrite to the strand. DoWrite gathers
+        // voice, then control, then bulk packets into one scatter-gather
+        // async_write (up to kMaxGatherBytes) and keeps them alive in
+        // m_Inflight until it completes. Priority applies at packet
+        // boundaries: a bulk packet already on the wire finishes first.
+        static constexpr size_t kMaxGatherBytes = 256 * 1024;
+        static constexpr size_t kMaxGatherBuffers = 64;
+        static constexpr size_t kMaxLaneDepth = 200;
+        struct QueuedWrite {
+            std::shared_ptr<std::vector<uint8_t>> buffer;
+            std::chrono::steady_clock::time_point queuedAt;
+        };
+        size_t DropThreshold() const;
+        std::mutex m_WriteMutex;
+        std::array<std::deque<QueuedWrite>, kWriteLaneCount> m_Lanes;      // guarded by m_WriteMutex
+        bool m_WriteActive = false;                                           // guarded by m_WriteMutex
+        std::array<std::atomic<size_t>, kWriteLaneCount> m_LaneDepth{};
+        std::vector<std::shared_ptr<std::vector<uint8_t>>> m_Inflight;        // strand only
+        std::vector<asio::const_buffer> m_InflightBufs;                       // strand only
         std::atomic<int> m_CurrentVoiceCid{ -1 };
         std::string m_Username;
+        std::atomic<uint32_t> m_UserId{ 0 };
+
+        struct PendingDbJob { bool write; bool pipelined; DbDeferredJob job; };
+        std::deque<PendingDbJob> m_DbJobs;
+        bool m_DbJobRunning = false;          // front of m_DbJobs handed to the executor
+        size_t m_DbPipelinedPending = 0;      // pipelined jobs whose finish() has not run
+        // Set by auth requests: the read loop stays parked until the DB queue
+        // drains, so the packets that follow see m_Username already set.
+        bool m_ReadPaused = false;
+        // Set when the replies queued for this peer back up past
+        // kReadBackpressureDepth; DoWrite() clears it as the backlog drains.
+        bool m_ReadThrottled = false;
 
         std::atomic<bool> m_IsHealthy{ true };
+        std::atomic<bool> m_BinaryWire{ false };
+        std::atomic<bool> m_PresenceBatch{ false };
+        std::atomic<uint64_t> m_OnlineOrder{ 0 };
+        std::atomic<bool> m_VoiceIdleCheck{ false };
         std::atomic<size_t> m_CurrentVoiceLoad{ 1 };
         std::atomic<int64_t> m_LastActivityTimeMs{ 0 };
 
@@ -59,10 +205,37 @@ namespace TalkMe {
         int m_ConsecutiveStableReports = 0;
         uint32_t m_CurrentAssignedBitrateKbps = 48;
 
-        std::ofstream m_UploadFile;
-        std::string m_UploadId;
-        size_t m_UploadBytesReceived{ 0 };
-        size_t m_UploadTargetSize{ 0 };
+        // Upload in progress. Chunks go to UploadManager, which writes them
+        // to attachments/incoming/ off the strand; File_Transfer_Complete
+        // verifies it there and moves it into place. Windowed chunks carry
+        // their offset; legacy chunks follow each other at m_UploadNextOffset.
+        UploadManager::UploadPtr m_Upload;
+        uint64_t m_UploadNextOffset{ 0 };
+
+        // Streamed attachment downloads (Media_Request with "stream"). Each
+        // transfer sends kMediaChunkSize Media_Chunk packets on the bulk lane
+        // while less than kMediaStreamWindow is unacknowledged; Media_Ack
+        // reopens the window. Up to kMaxMediaStreams run at once, served
+        // round-robin; later requests wait in m_MediaQueue. A request with
+        // "size" streams the image preview when one exists. A transfer ends
+        // with an error Media_Response when a chunk cannot be queued or no
+        // ack moves it forward for kMediaStreamStallTimeout. Strand only.
+        static constexpr uint32_t kMediaChunkSize = 32 * 1024;
+        static constexpr size_t kMaxMediaStreams = 4;
+        static constexpr size_t kMaxMediaQueue = 256;
+        static constexpr auto   kMediaStreamStallTimeout = std::chrono::seconds(30);
+        struct MediaStream {
+            std::ifstream file;
+            uint32_t size = 0;
+            uint32_t sent = 0;
+            uint32_t acked = 0;
+            std::chrono::steady_clock::time_point lastProgress;   // start or last ack that moved `acked`
+        };
+        std::map<uint32_t, MediaStream> m_MediaStreams;   // by transfer id
+        asio::steady_timer m_MediaStallTimer{ m_Strand };
+        bool m_MediaStallWatched = false;
+        std::deque<std::pair<std::string, int>> m_MediaQueue;   // id, preview size (0: original)
+        uint32_t m_NextMediaTid = 1;
 
         std::string m_Pending2FASecret;
         std::string m_PendingHWID;
@@ -1,4 +1,5 @@
 #include "Crypto.h"
+#include <algorithm>
 #include <random>
 #include <cstring>
 #include <ctime>
@@ -120,6 +121,86 @@ namespace {
 
 namespace TalkMe {
 
+    namespace {
+        constexpr uint32_t kSha256K[64] = {
+            0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+            0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+            0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+            0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+            0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+            0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+            0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+            0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2,
+        };
+    }
+
+    Sha256::Sha256()
+        : m_H{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 } {}
+
+    void Sha256::Block(const uint8_t* blk) {
+        auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+        uint32_t W[64];
+        for (int t = 0; t < 16; ++t) W[t] = (uint32_t)blk[t * 4] << 24 | (uint32_t)blk[t * 4 + 1] << 16 | (uint32_t)blk[t * 4 + 2] << 8 | blk[t * 4 + 3];
+        for (int t = 16; t < 64; ++t) {
+            uint32_t s0 = rotr(W[t - 15], 7) ^ rotr(W[t - 15], 18) ^ (W[t - 15] >> 3);
+            uint32_t s1 = rotr(W[t - 2], 17) ^ rotr(W[t - 2], 19) ^ (W[t - 2] >> 10);
+            W[t] = W[t - 16] + s0 + W[t - 7] + s1;
+        }
+        uint32_t a = m_H[0], b = m_H[1], c = m_H[2], d = m_H[3], e = m_H[4], f = m_H[5], g = m_H[6], h = m_H[7];
+        for (int t = 0; t < 64; ++t) {
+            uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ ((~e) & g);
+            uint32_t t1 = h + S1 + ch + kSha256K[t] + W[t];
+            uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = S0 + maj;
+            h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+        m_H[0] += a; m_H[1] += b; m_H[2] += c; m_H[3] += d; m_H[4] += e; m_H[5] += f; m_H[6] += g; m_H[7] += h;
+    }
+
+    void Sha256::Update(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        m_Total += len;
+        if (m_BufLen > 0) {
+            const size_t take = std::min(len, sizeof(m_Buf) - m_BufLen);
+            std::memcpy(m_Buf + m_BufLen, p, take);
+            m_BufLen += take; p += take; len -= take;
+            if (m_BufLen < sizeof(m_Buf)) return;
+            Block(m_Buf);
+            m_BufLen = 0;
+        }
+        while (len >= 64) { Block(p); p += 64; len -= 64; }
+        if (len > 0) { std::memcpy(m_Buf, p, len); m_BufLen = len; }
+    }
+
+    std::array<uint8_t, 32> Sha256::Final() {
+        const uint64_t bits = m_Total * 8;
+        m_Buf[m_BufLen++] = 0x80;
+        if (m_BufLen > 56) {
+            std::memset(m_Buf + m_BufLen, 0, sizeof(m_Buf) - m_BufLen);
+            Block(m_Buf);
+            m_BufLen = 0;
+        }
+        std::memset(m_Buf + m_BufLen, 0, 56 - m_BufLen);
+        for (int j = 0; j < 8; ++j) m_Buf[63 - j] = (uint8_t)(bits >> (j * 8));
+        Block(m_Buf);
+        std::array<uint8_t, 32> out{};
+        for (int j = 0; j < 8; ++j) {
+            out[j * 4 + 0] = (uint8_t)(m_H[j] >> 24); out[j * 4 + 1] = (uint8_t)(m_H[j] >> 16);
+            out[j * 4 + 2] = (uint8_t)(m_H[j] >> 8);  out[j * 4 + 3] = (uint8_t)(m_H[j]);
+        }
+        return out;
+    }
+
+    std::string ToHex(const uint8_t* data, size_t len) {
+        static const char hex[] = "0123456789abcdef";
+        std::string s;
+        s.reserve(len * 2);
+        for (size_t i = 0; i < len; ++i) { s += hex[data[i] >> 4]; s += hex[data[i] & 15]; }
+        return s;
+    }
+
     std::string GenerateBase32Secret(size_t length) {
         static constexpr size_t kAlphabetSize = sizeof(kBase32Alphabet) - 1;
 
@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace TalkMe {
@@ -8,4 +10,23 @@ namespace TalkMe {
 	std::string GenerateBase32Secret(size_t length = 16);
 	bool VerifyTOTP(const std::string& base32Secret, const std::string& userCode);
 
+	// Incremental SHA-256 (standalone, no OpenSSL), for hashing data that
+	// arrives or is read in pieces.
+	class Sha256 {
+	public:
+		Sha256();
+		void Update(const void* data, size_t len);
+		std::array<uint8_t, 32> Final();
+
+	private:
+		void Block(const uint8_t* blk);
+
+		uint32_t m_H[8];
+		uint8_t  m_Buf[64];
+		size_t   m_BufLen = 0;
+		uint64_t m_Total = 0;
+	};
+
+	std::string ToHex(const uint8_t* data, size_t len);
+
 } // namespace TalkMe
\ No newline at end of file
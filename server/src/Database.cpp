@@ -1,4 +1,6 @@
 #include "Database.h"
+#include "Crypto.h"
+#include "Metrics.h"
 #include "Protocol.h"
 #include <sqlite3.h>
 #include <nlohmann/json.hpp>
@@ -6,9 +8,12 @@
 #include <algorithm>
 #include <random>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <array>
 #include <vector>
+#include <string_view>
+#include <unordered_map>
 #include <sstream>
 #include <iomanip>
 
@@ -16,64 +21,7 @@ using json = nlohmann::json;
 
 namespace {
 
-    // Lightweight SHA-256 (standalone, no OpenSSL). Output 32 bytes.
-    void Sha256(const uint8_t* data, size_t len, uint8_t out[32]) {
-        static const uint32_t K[64] = {
-            0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
-            0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
-            0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
-            0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
-            0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
-            0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
-            0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
-            0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2,
-        };
-        uint32_t H[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
-        uint8_t block[64];
-        size_t i = 0;
-        auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
-        auto step = [&](const uint8_t* blk) {
-            uint32_t W[64];
-            for (int t = 0; t < 16; ++t) W[t] = (uint32_t)blk[t * 4] << 24 | (uint32_t)blk[t * 4 + 1] << 16 | (uint32_t)blk[t * 4 + 2] << 8 | blk[t * 4 + 3];
-            for (int t = 16; t < 64; ++t) {
-                uint32_t s0 = rotr(W[t - 15], 7) ^ rotr(W[t - 15], 18) ^ (W[t - 15] >> 3);
-                uint32_t s1 = rotr(W[t - 2], 17) ^ rotr(W[t - 2], 19) ^ (W[t - 2] >> 10);
-                W[t] = W[t - 16] + s0 + W[t - 7] + s1;
-            }
-            uint32_t a = H[0], b = H[1], c = H[2], d = H[3], e = H[4], f = H[5], g = H[6], h = H[7];
-            for (int t = 0; t < 64; ++t) {
-                uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
-                uint32_t ch = (e & f) ^ ((~e) & g);
-                uint32_t t1 = h + S1 + ch + K[t] + W[t];
-                uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
-                uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
-                uint32_t t2 = S0 + maj;
-                h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
-            }
-            H[0] += a; H[1] += b; H[2] += c; H[3] += d; H[4] += e; H[5] += f; H[6] += g; H[7] += h;
-            };
-        while (i + 64 <= len) { step(data + i); i += 64; }
-        std::memset(block, 0, sizeof(block));
-        std::memcpy(block, data + i, len - i);
-        block[len - i] = 0x80;
-        if (len - i >= 56) { step(block); std::memset(block, 0, sizeof(block)); }
-        uint64_t bits = len * 8;
-        for (int j = 0; j < 8; ++j) block[63 - j] = (uint8_t)(bits >> (j * 8));
-        step(block);
-        for (int j = 0; j < 8; ++j) {
-            out[j * 4 + 0] = (uint8_t)(H[j] >> 24);
-            out[j * 4 + 1] = (uint8_t)(H[j] >> 16);
-            out[j * 4 + 2] = (uint8_t)(H[j] >> 8);
-            out[j * 4 + 3] = (uint8_t)(H[j]);
-        }
-    }
-
-    std::string BytesToHex(const uint8_t* buf, size_t n) {
-        static const char hex[] = "0123456789abcdef";
-        std::string s; s.reserve(n * 2);
-        for (size_t i = 0; i < n; ++i) { s += hex[buf[i] >> 4]; s += hex[buf[i] & 15]; }
-        return s;
-    }
+    std::string BytesToHex(const uint8_t* buf, size_t n) { return TalkMe::ToHex(buf, n); }
 
     bool HexToBytes(const std::string& hex, uint8_t* buf, size_t maxLen) {
         if (hex.size() % 2 != 0 || hex.size() / 2 > maxLen) return false;
@@ -92,9 +40,10 @@ namespace {
         input.reserve(16 + password.size());
         input.insert(input.end(), salt, salt + 16);
         input.insert(input.end(), password.begin(), password.end());
-        uint8_t hash[32];
-        Sha256(input.data(), input.size(), hash);
-        return BytesToHex(hash, 32);
+        TalkMe::Sha256 sha;
+        sha.Update(input.data(), input.size());
+        const auto hash = sha.Final();
+        return BytesToHex(hash.data(), hash.size());
     }
 
     bool ConstantTimeEquals(const std::string& a, const std::string& b) {
@@ -108,6 +57,112 @@ namespace {
 
 namespace TalkMe {
 
+    namespace {
+        // Set for the lifetime of each reader thread; null everywhere else.
+        thread_local sqlite3* t_ReadDb = nullptr;
+
+        // ---------------------------------------------------------------------------
+        // Prepared-statement cache.
+        //
+        // Statements are cached per thread and per connection, keyed by SQL text,
+        // and prepared once with SQLITE_PREPARE_PERSISTENT. PrepareCached() checks
+        // one out; ReleaseCached() resets it and clears its bindings rather than
+        // finalizing it, so the open read transaction ends exactly where
+        // sqlite3_finalize() used to end it. Per-thread ownership means a cached
+        // statement is never stepped by two threads, even on the shared handle.
+        // ---------------------------------------------------------------------------
+        struct SqlHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view sql) const noexcept { return std::hash<std::string_view>{}(sql); }
+        };
+
+        struct CachedStatement {
+            sqlite3_stmt* stmt = nullptr;
+            bool          inUse = false;
+        };
+
+        using ConnectionStatements = std::unordered_map<std::string, CachedStatement, SqlHash, std::equal_to<>>;
+
+        struct StatementCache {
+            std::unordered_map<sqlite3*, ConnectionStatements> byConnection;
+            ~StatementCache() {
+                for (auto& [db, stmts] : byConnection)
+                    for (auto& [sql, cached] : stmts) sqlite3_finalize(cached.stmt);
+            }
+        };
+
+        StatementCache& LocalStatements() {
+            thread_local StatementCache cache;
+            return cache;
+        }
+
+        // Same contract as sqlite3_prepare_v2(). A statement that is already
+        // checked out on this thread (nested use of the same SQL) is not shared:
+        // the caller gets a one-shot statement that ReleaseCached() finalizes.
+        int PrepareCached(sqlite3* db, std::string_view sql, sqlite3_stmt** out) {
+            *out = nullptr;
+            auto& stmts = LocalStatements().byConnection[db];
+            auto it = stmts.find(sql);
+            if (it == stmts.end()) {
+                sqlite3_stmt* stmt = nullptr;
+                int rc = sqlite3_prepare_v3(db, sql.data(), static_cast<int>(sql.size()), SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+                if (rc != SQLITE_OK) {
+                    sqlite3_finalize(stmt);
+                    return rc;
+                }
+                it = stmts.emplace(std::string(sql), CachedStatement{ stmt, false }).first;
+            }
+            if (it->second.inUse)
+                return sqlite3_prepare_v2(db, sql.data(), static_cast<int>(sql.size()), out, nullptr);
+            it->second.inUse = true;
+            *out = it->second.stmt;
+            return SQLITE_OK;
+        }
+
+        void ReleaseCached(sqlite3_stmt* stmt) {
+            if (!stmt) return;
+            auto& byConnection = LocalStatements().byConnection;
+            if (auto conn = byConnection.find(sqlite3_db_handle(stmt)); conn != byConnection.end()) {
+                auto it = conn->second.find(std::string_view(sqlite3_sql(stmt)));
+                if (it != conn->second.end() && it->second.stmt == stmt) {
+                    sqlite3_reset(stmt);
+                    sqlite3_clear_bindings(stmt);
+                    it->second.inUse = false;
+                    return;
+                }
+            }
+            sqlite3_finalize(stmt);
+        }
+
+        // Finalizes this thread's cached statements for db; call before closing it.
+        void ForgetStatements(sqlite3* db) {
+            auto& byConnection = LocalStatements().byConnection;
+            auto conn = byConnection.find(db);
+            if (conn == byConnection.end()) return;
+            for (auto& [sql, cached] : conn->second) sqlite3_finalize(cached.stmt);
+            byConnection.erase(conn);
+        }
+
+        Histogram& DbCallHistogram(const char* method) {
+            return Metrics::Get().GetHistogram("talkme_db_call_seconds",
+                "Database call latency (lock wait and SQLite work, not queueing), by method.",
+                std::string("method=\"") + method + "\"");
+        }
+    }
+
+    // Times the rest of the enclosing Database method into
+    // talkme_db_call_seconds{method="<name>"}.
+#define TALKME_DB_TIMED()                                                  \
+    static Histogram& dbCallTime = DbCallHistogram(__func__);              \
+    const ScopedTimer dbCallTimer(dbCallTime)
+
+    Database::ReadConnection::ReadConnection(Database& db) : m_Conn(t_ReadDb) {
+        if (!m_Conn) {
+            m_Lock = std::shared_lock<std::shared_mutex>(db.m_RwMutex);
+            m_Conn = db.m_Db;
+        }
+    }
+
     Database& Database::Get() {
         static Database db;
         return db;
@@ -161,6 +216,17 @@ namespace TalkMe {
         // Indexes for efficient chat paging / reactions.
         sqlite3_exec(m_Db, "CREATE INDEX IF NOT EXISTS idx_messages_channel_id_id ON messages(channel_id, id);", 0, 0, 0);
         sqlite3_exec(m_Db, "CREATE INDEX IF NOT EXISTS idx_reactions_message_id ON reactions(message_id);", 0, 0, 0);
+        sqlite3_exec(m_Db, "CREATE INDEX IF NOT EXISTS idx_channels_server_id ON channels(server_id);", 0, 0, 0);
+
+        // Content-addressed attachments (AttachmentStore.h). refs counts the
+        // messages pointing at each file and is kept by triggers, so every
+        // path that inserts or deletes messages maintains it. Legacy
+        // per-upload ids have no row and are never swept.
+        sqlite3_exec(m_Db, "CREATE TABLE IF NOT EXISTS attachments (id TEXT PRIMARY KEY, size INTEGER, refs INTEGER NOT NULL DEFAULT 0, claimed_at DATETIME DEFAULT CURRENT_TIMESTAMP);", 0, 0, 0);
+        sqlite3_exec(m_Db, "CREATE TRIGGER IF NOT EXISTS trg_attachments_ref AFTER INSERT ON messages WHEN NEW.attachment_id <> '' "
+                           "BEGIN UPDATE attachments SET refs = refs + 1 WHERE id = NEW.attachment_id; END;", 0, 0, 0);
+        sqlite3_exec(m_Db, "CREATE TRIGGER IF NOT EXISTS trg_attachments_unref AFTER DELETE ON messages WHEN OLD.attachment_id <> '' "
+                           "BEGIN UPDATE attachments SET refs = refs - 1 WHERE id = OLD.attachment_id; END;", 0, 0, 0);
 
         sqlite3_stmt* countStmt = nullptr;
         if (sqlite3_prepare_v2(m_Db, "SELECT COUNT(*) FROM servers;", -1, &countStmt, 0) == SQLITE_OK &&
@@ -188,7 +254,29 @@ namespace TalkMe {
         }
         else if (countStmt) sqlite3_finalize(countStmt);
 
+        // Chat inserts are group-committed: TALKME_MSG_BATCH_US is the window a
+        // batch stays open (0 = only what piled up while the writer was busy),
+        // TALKME_MSG_BATCH_MAX caps rows per transaction.
+        if (const char* env = std::getenv("TALKME_MSG_BATCH_US")) {
+            int us = std::atoi(env);
+            if (us >= 0) m_MessageBatchWindow = std::chrono::microseconds(std::min(us, 100000));
+        }
+        if (const char* env = std::getenv("TALKME_MSG_BATCH_MAX")) {
+            int n = std::atoi(env);
+            if (n > 0) m_MessageBatchMax = static_cast<size_t>(n);
+        }
+
         m_Worker = std::thread(&Database::WorkerLoop, this);
+
+        // Readers open their own connections, so they must start after the
+        // schema above exists. TALKME_DB_READERS overrides the pool size.
+        size_t readers = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 2, 8);
+        if (const char* env = std::getenv("TALKME_DB_READERS")) {
+            int n = std::atoi(env);
+            if (n > 0) readers = std::min<size_t>(static_cast<size_t>(n), 32);
+        }
+        for (size_t i = 0; i < readers; ++i)
+            m_Readers.emplace_back(&Database::ReaderLoop, this);
     }
 
     Database::~Database() {
@@ -197,8 +285,13 @@ namespace TalkMe {
             m_Shutdown = true;
         }
         m_QueueCv.notify_all();
+        m_ReadCv.notify_all();
+        m_MessageBatchCv.notify_all();
+        for (auto& t : m_Readers)
+            if (t.joinable()) t.join();
         if (m_Worker.joinable()) m_Worker.join();
-        sqlite3_close(m_Db);
+        // close_v2: io threads may still hold cached statements on this handle.
+        sqlite3_close_v2(m_Db);
     }
 
     std::string Database::GenerateInviteCode() {
@@ -211,17 +304,18 @@ namespace TalkMe {
     }
 
     std::string Database::RegisterUser(const std::string& email, std::string u, const std::string& p) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         if (email.empty() || u.empty()) return "";
         u.erase(std::remove(u.begin(), u.end(), '#'), u.end());
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(m_Db, "SELECT email FROM users WHERE email = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "SELECT email FROM users WHERE email = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, email.c_str(), -1, SQLITE_STATIC);
-            if (sqlite3_step(stmt) == SQLITE_ROW) { sqlite3_finalize(stmt); return ""; }
-            sqlite3_finalize(stmt);
+            if (sqlite3_step(stmt) == SQLITE_ROW) { ReleaseCached(stmt); return ""; }
+            ReleaseCached(stmt);
         }
         int next_tag = 1;
-        if (sqlite3_prepare_v2(m_Db, "SELECT username FROM users WHERE username LIKE ? ORDER BY username DESC LIMIT 1;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "SELECT username FROM users WHERE username LIKE ? ORDER BY username DESC LIMIT 1;", &stmt) == SQLITE_OK) {
             std::string like_pattern = u + "#%";
             sqlite3_bind_text(stmt, 1, like_pattern.c_str(), -1, SQLITE_STATIC);
             if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -232,7 +326,7 @@ namespace TalkMe {
                     catch (...) {}
                 }
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         char buf[128];
         snprintf(buf, sizeof(buf), "%s#%04d", u.c_str(), next_tag);
@@ -246,43 +340,44 @@ namespace TalkMe {
         std::string storedPassword = BytesToHex(salt, 16) + "$" + HashPasswordWithSalt(p, salt);
 
         bool success = false;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO users (email, username, password) VALUES (?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO users (email, username, password) VALUES (?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, email.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_text(stmt, 2, final_username.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_text(stmt, 3, storedPassword.c_str(), -1, SQLITE_TRANSIENT);
             success = (sqlite3_step(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         if (success) {
-            if (sqlite3_prepare_v2(m_Db, "SELECT id FROM servers WHERE invite_code = 'HUB001' LIMIT 1;", -1, &stmt, 0) == SQLITE_OK) {
+            if (PrepareCached(m_Db, "SELECT id FROM servers WHERE invite_code = 'HUB001' LIMIT 1;", &stmt) == SQLITE_OK) {
                 if (sqlite3_step(stmt) == SQLITE_ROW) {
                     int hubId = sqlite3_column_int(stmt, 0);
-                    sqlite3_finalize(stmt);
-                    if (sqlite3_prepare_v2(m_Db, "INSERT INTO server_members (username, server_id) VALUES (?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+                    ReleaseCached(stmt);
+                    if (PrepareCached(m_Db, "INSERT INTO server_members (username, server_id) VALUES (?, ?);", &stmt) == SQLITE_OK) {
                         sqlite3_bind_text(stmt, 1, final_username.c_str(), -1, SQLITE_STATIC);
                         sqlite3_bind_int(stmt, 2, hubId);
                         sqlite3_step(stmt);
-                        sqlite3_finalize(stmt);
+                        ReleaseCached(stmt);
                     }
                 }
-                else sqlite3_finalize(stmt);
+                else ReleaseCached(stmt);
             }
         }
         return success ? final_username : "";
     }
 
     int Database::LoginUser(const std::string& email, const std::string& p, const std::string& deviceId, std::string* outUsername) {
+        TALKME_DB_TIMED();
         std::fprintf(stderr, "[TalkMe DB] LoginUser: entered (email len=%zu)\n", email.size());
         std::fflush(stderr);
         if (outUsername) outUsername->clear();
-        std::fprintf(stderr, "[TalkMe DB] LoginUser: acquiring shared_lock...\n");
+        std::fprintf(stderr, "[TalkMe DB] LoginUser: acquiring read connection...\n");
         std::fflush(stderr);
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
-        std::fprintf(stderr, "[TalkMe DB] LoginUser: lock acquired, executing query\n");
+        ReadConnection db(*this);
+        std::fprintf(stderr, "[TalkMe DB] LoginUser: connection acquired, executing query\n");
         std::fflush(stderr);
         sqlite3_stmt* stmt = nullptr;
         int result = 0;
-        if (sqlite3_prepare_v2(m_Db, "SELECT username, password, IFNULL(is_2fa_enabled, 0) FROM users WHERE email = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT username, password, IFNULL(is_2fa_enabled, 0) FROM users WHERE email = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, email.c_str(), -1, SQLITE_STATIC);
             if (sqlite3_step(stmt) == SQLITE_ROW) {
                 std::string db_user = (const char*)sqlite3_column_text(stmt, 0);
@@ -301,13 +396,13 @@ namespace TalkMe {
                 if (authOk) {
                     if (outUsername) *outUsername = db_user;
                     if (is2fa == 1) {
-                        sqlite3_finalize(stmt);
+                        ReleaseCached(stmt);
                         stmt = nullptr;
-                        if (!deviceId.empty() && sqlite3_prepare_v2(m_Db, "SELECT 1 FROM trusted_devices WHERE username = ? AND device_id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+                        if (!deviceId.empty() && PrepareCached(db, "SELECT 1 FROM trusted_devices WHERE username = ? AND device_id = ?;", &stmt) == SQLITE_OK) {
                             sqlite3_bind_text(stmt, 1, db_user.c_str(), -1, SQLITE_STATIC);
                             sqlite3_bind_text(stmt, 2, deviceId.c_str(), -1, SQLITE_STATIC);
                             result = (sqlite3_step(stmt) == SQLITE_ROW) ? 1 : 2;
-                            sqlite3_finalize(stmt);
+                            ReleaseCached(stmt);
                             stmt = nullptr;
                         }
                         else
@@ -317,7 +412,7 @@ namespace TalkMe {
                         result = 1;
                 }
             }
-            if (stmt) sqlite3_finalize(stmt);
+            if (stmt) ReleaseCached(stmt);
         }
         std::fprintf(stderr, "[TalkMe DB] LoginUser: returning %d\n", result);
         std::fflush(stderr);
@@ -327,7 +422,7 @@ namespace TalkMe {
     void Database::LoginUserAsync(const std::string& email, const std::string& p, const std::string& deviceId,
         std::function<void(int result, std::string username, std::string serversJson, bool has2fa)> onDone) {
         if (!onDone) return;
-        Enqueue([this, email, p, deviceId, onDone]() {
+        ExecuteRead([this, email, p, deviceId, onDone]() {
             std::string username;
             int result = LoginUser(email, p, deviceId, &username);
             std::string serversJson;
@@ -337,29 +432,30 @@ namespace TalkMe {
                 serversJson = GetUserServersJSON(username);
             }
             onDone(result, std::move(username), std::move(serversJson), has2fa);
-            });
+            }, [onDone]() { onDone(0, {}, {}, false); });
     }
 
     void Database::TrustDevice(const std::string& username, const std::string& deviceId) {
+        TALKME_DB_TIMED();
         if (deviceId.empty()) return;
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "INSERT OR IGNORE INTO trusted_devices (username, device_id) VALUES (?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT OR IGNORE INTO trusted_devices (username, device_id) VALUES (?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_text(stmt, 2, deviceId.c_str(), -1, SQLITE_STATIC);
             sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
     }
 
     std::string Database::ValidateSession(const std::string& email, const std::string& plainPassword) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         std::string username;
 
-        if (sqlite3_prepare_v2(m_Db,
-            "SELECT username, password FROM users WHERE email = ?;",
-            -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db,
+            "SELECT username, password FROM users WHERE email = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, email.c_str(), -1, SQLITE_STATIC);
 
             if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -383,14 +479,15 @@ namespace TalkMe {
 
                 if (authOk && u) username = u;
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return username;
     }
 
     std::string Database::GetUserTOTPSecret(const std::string& email_or_username, std::string* outUsername) {
+        TALKME_DB_TIMED();
         if (outUsername) outUsername->clear();
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         std::string secret;
         const char* sql =
@@ -399,7 +496,7 @@ namespace TalkMe {
             "WHERE (email = ? OR username = ?) "
             "  AND is_2fa_enabled = 1 "
             "LIMIT 1;";
-        if (sqlite3_prepare_v2(m_Db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        if (PrepareCached(db, sql, &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, email_or_username.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_text(stmt, 2, email_or_username.c_str(), -1, SQLITE_STATIC);
             if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -408,43 +505,43 @@ namespace TalkMe {
                 if (u && outUsername) *outUsername = u;
                 if (s) secret = s;
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return secret;
     }
 
     bool Database::EnableUser2FA(const std::string& username, const std::string& secret) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "UPDATE users SET totp_secret = ?, is_2fa_enabled = 1 WHERE username = ?;", -1, &stmt, 0) != SQLITE_OK) return false;
+        if (PrepareCached(m_Db, "UPDATE users SET totp_secret = ?, is_2fa_enabled = 1 WHERE username = ?;", &stmt) != SQLITE_OK) return false;
         sqlite3_bind_text(stmt, 1, secret.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
         bool ok = (sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(m_Db) > 0);
-        sqlite3_finalize(stmt);
+        ReleaseCached(stmt);
         return ok;
     }
 
     bool Database::DisableUser2FA(const std::string& username) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
 
-        if (sqlite3_prepare_v2(m_Db, "UPDATE users SET totp_secret = '', is_2fa_enabled = 0 "
-            "WHERE username = ?;",
-            -1, &stmt, 0) != SQLITE_OK)
+        if (PrepareCached(m_Db, "UPDATE users SET totp_secret = '', is_2fa_enabled = 0 "
+            "WHERE username = ?;", &stmt) != SQLITE_OK)
             return false;
 
         sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
         bool ok = (sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(m_Db) > 0);
-        sqlite3_finalize(stmt);
+        ReleaseCached(stmt);
         stmt = nullptr;
 
         if (ok) {
-            if (sqlite3_prepare_v2(m_Db,
-                "DELETE FROM trusted_devices WHERE username = ?;",
-                -1, &stmt, 0) == SQLITE_OK) {
+            if (PrepareCached(m_Db,
+                "DELETE FROM trusted_devices WHERE username = ?;", &stmt) == SQLITE_OK) {
                 sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
                 sqlite3_step(stmt);
-                sqlite3_finalize(stmt);
+                ReleaseCached(stmt);
             }
         }
 
@@ -452,122 +549,146 @@ namespace TalkMe {
     }
 
     int Database::GetDefaultServerId() {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         int id = -1;
-        if (sqlite3_prepare_v2(m_Db, "SELECT id FROM servers ORDER BY id ASC LIMIT 1;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT id FROM servers ORDER BY id ASC LIMIT 1;", &stmt) == SQLITE_OK) {
             if (sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return id;
     }
 
     void Database::AddUserToDefaultServer(const std::string& username) {
+        TALKME_DB_TIMED();
         int sid = GetDefaultServerId();
         if (sid <= 0) return;
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "INSERT OR IGNORE INTO server_members (username, server_id) VALUES (?, ?);", -1, &stmt, 0) != SQLITE_OK) return;
+        if (PrepareCached(m_Db, "INSERT OR IGNORE INTO server_members (username, server_id) VALUES (?, ?);", &stmt) != SQLITE_OK) return;
         sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_int(stmt, 2, sid);
         sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
+        ReleaseCached(stmt);
     }
 
     void Database::CreateServer(const std::string& name, const std::string& owner) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         std::string code = GenerateInviteCode();
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO servers (name, invite_code, owner) VALUES (?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO servers (name, invite_code, owner) VALUES (?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_text(stmt, 2, code.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_text(stmt, 3, owner.c_str(), -1, SQLITE_STATIC);
             sqlite3_step(stmt);
             int serverId = static_cast<int>(sqlite3_last_insert_rowid(m_Db));
-            sqlite3_finalize(stmt);
-            if (sqlite3_prepare_v2(m_Db, "INSERT INTO server_members (username, server_id) VALUES (?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+            ReleaseCached(stmt);
+            if (PrepareCached(m_Db, "INSERT INTO server_members (username, server_id) VALUES (?, ?);", &stmt) == SQLITE_OK) {
                 sqlite3_bind_text(stmt, 1, owner.c_str(), -1, SQLITE_STATIC);
                 sqlite3_bind_int(stmt, 2, serverId);
                 sqlite3_step(stmt);
-                sqlite3_finalize(stmt);
+                ReleaseCached(stmt);
             }
             const char* sql = "INSERT INTO channels (server_id, name, type) VALUES (?, ?, ?);";
-            if (sqlite3_prepare_v2(m_Db, sql, -1, &stmt, 0) == SQLITE_OK) {
+            if (PrepareCached(m_Db, sql, &stmt) == SQLITE_OK) {
                 sqlite3_bind_int(stmt, 1, serverId);
                 sqlite3_bind_text(stmt, 2, "general", -1, SQLITE_STATIC);
                 sqlite3_bind_text(stmt, 3, "text", -1, SQLITE_STATIC);
                 sqlite3_step(stmt);
-                sqlite3_finalize(stmt);
+                ReleaseCached(stmt);
             }
-            if (sqlite3_prepare_v2(m_Db, sql, -1, &stmt, 0) == SQLITE_OK) {
+            if (PrepareCached(m_Db, sql, &stmt) == SQLITE_OK) {
                 sqlite3_bind_int(stmt, 1, serverId);
                 sqlite3_bind_text(stmt, 2, "General", -1, SQLITE_STATIC);
                 sqlite3_bind_text(stmt, 3, "voice", -1, SQLITE_STATIC);
                 sqlite3_step(stmt);
-                sqlite3_finalize(stmt);
+                ReleaseCached(stmt);
             }
         }
     }
 
-    void Database::CreateChannel(int serverId, const std::string& name, const std::string& type) {
+    int Database::CreateChannel(int serverId, const std::string& name, const std::string& type) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO channels (server_id, name, type) VALUES (?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        int cid = 0;
+        if (PrepareCached(m_Db, "INSERT INTO channels (server_id, name, type) VALUES (?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             sqlite3_bind_text(stmt, 2, name.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_text(stmt, 3, type.c_str(), -1, SQLITE_STATIC);
-            sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            if (sqlite3_step(stmt) == SQLITE_DONE) cid = static_cast<int>(sqlite3_last_insert_rowid(m_Db));
+            ReleaseCached(stmt);
         }
+        return cid;
     }
 
     int Database::JoinServer(const std::string& username, const std::string& code) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt;
         int sid = -1;
-        if (sqlite3_prepare_v2(m_Db, "SELECT id FROM servers WHERE invite_code = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "SELECT id FROM servers WHERE invite_code = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, code.c_str(), -1, SQLITE_STATIC);
             if (sqlite3_step(stmt) == SQLITE_ROW) sid = sqlite3_column_int(stmt, 0);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         if (sid != -1) {
-            sqlite3_prepare_v2(m_Db, "INSERT OR IGNORE INTO server_members (username, server_id) VALUES (?, ?);", -1, &stmt, 0);
+            PrepareCached(m_Db, "INSERT OR IGNORE INTO server_members (username, server_id) VALUES (?, ?);", &stmt);
             sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_int(stmt, 2, sid);
             sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return sid;
     }
 
     std::string Database::GetUserServersJSON(const std::string& username) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         json j = json::array();
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(m_Db, "SELECT s.id, s.name, s.invite_code FROM servers s JOIN server_members m ON s.id = m.server_id WHERE m.username = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT s.id, s.name, s.invite_code FROM servers s JOIN server_members m ON s.id = m.server_id WHERE m.username = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* n = (const char*)sqlite3_column_text(stmt, 1);
                 const char* c = (const char*)sqlite3_column_text(stmt, 2);
                 j.push_back({ {"id", sqlite3_column_int(stmt, 0)}, {"name", n ? n : ""}, {"code", c ? c : ""} });
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return j.dump();
     }
 
+    std::vector<std::pair<int, int>> Database::GetUserServerChannels(const std::string& username) {
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
+        std::vector<std::pair<int, int>> rows;
+        sqlite3_stmt* stmt;
+        if (PrepareCached(db, "SELECT m.server_id, IFNULL(c.id, 0) FROM server_members m "
+                              "LEFT JOIN channels c ON c.server_id = m.server_id WHERE m.username = ?;", &stmt) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+                rows.emplace_back(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+            ReleaseCached(stmt);
+        }
+        return rows;
+    }
+
     std::string Database::GetServerContentJSON(int serverId) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         int serverMemberCount = 0;
         sqlite3_stmt* countStmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "SELECT COUNT(*) FROM server_members WHERE server_id = ?;", -1, &countStmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT COUNT(*) FROM server_members WHERE server_id = ?;", &countStmt) == SQLITE_OK) {
             sqlite3_bind_int(countStmt, 1, serverId);
             if (sqlite3_step(countStmt) == SQLITE_ROW) serverMemberCount = sqlite3_column_int(countStmt, 0);
-            sqlite3_finalize(countStmt);
+            ReleaseCached(countStmt);
         }
         json j = json::array();
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(m_Db, "SELECT id, name, type, IFNULL(description, ''), IFNULL(user_limit, 0) FROM channels WHERE server_id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT id, name, type, IFNULL(description, ''), IFNULL(user_limit, 0) FROM channels WHERE server_id = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* n = (const char*)sqlite3_column_text(stmt, 1);
@@ -580,12 +701,13 @@ namespace TalkMe {
                 entry["user_count"] = serverMemberCount;
                 j.push_back(entry);
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return j.dump();
     }
 
     std::string Database::GetMessageHistoryJSON(int channelId, int beforeId, int limit) {
+        TALKME_DB_TIMED();
         // Legacy array response preserved for compatibility with older clients.
         // Newer code should prefer GetMessageHistoryEnvelopeJSON().
         json env = nlohmann::json::parse(GetMessageHistoryEnvelopeJSON(channelId, beforeId, 0, 0, 0, 0, limit), nullptr, false);
@@ -619,11 +741,11 @@ namespace TalkMe {
     static bool ExistsMessage(sqlite3* db, int channelId, const char* sql, int idValue) {
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, sql, &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, channelId);
             sqlite3_bind_int(stmt, 2, idValue);
             ok = (sqlite3_step(stmt) == SQLITE_ROW);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
@@ -631,7 +753,8 @@ namespace TalkMe {
     std::string Database::GetMessageHistoryEnvelopeJSON(
         int channelId, int beforeId, int afterId, int anchorId, int beforeLimit, int afterLimit, int limit)
     {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
 
         limit = ClampLimit(limit, 1, 100);
         beforeLimit = ClampLimit(beforeLimit, 0, 100);
@@ -666,22 +789,28 @@ namespace TalkMe {
             mids.push_back(mid);
         };
 
-        const char* baseSelect =
+        // One fixed SQL text per query shape, so each is prepared once per connection.
+        static constexpr const char* kUpToSql =
+            "SELECT id, channel_id, sender, content, time, IFNULL(edited_at, ''), is_pinned, IFNULL(attachment_id, ''), IFNULL(reply_to, 0) "
+            "FROM messages WHERE channel_id = ? AND id <= ? ORDER BY id DESC LIMIT ?;";
+        static constexpr const char* kAfterSql =
+            "SELECT id, channel_id, sender, content, time, IFNULL(edited_at, ''), is_pinned, IFNULL(attachment_id, ''), IFNULL(reply_to, 0) "
+            "FROM messages WHERE channel_id = ? AND id > ? ORDER BY id ASC LIMIT ?;";
+        static constexpr const char* kBeforeSql =
             "SELECT id, channel_id, sender, content, time, IFNULL(edited_at, ''), is_pinned, IFNULL(attachment_id, ''), IFNULL(reply_to, 0) "
-            "FROM messages WHERE channel_id = ? ";
+            "FROM messages WHERE channel_id = ? AND (? = 0 OR id < ?) ORDER BY id DESC LIMIT ?;";
 
         // ---- Fetch messages ----
         if (anchorId > 0) {
             // Older (including anchor), newest->oldest then reversed.
             {
                 sqlite3_stmt* stmt = nullptr;
-                std::string q = std::string(baseSelect) + "AND id <= ? ORDER BY id DESC LIMIT ?;";
-                if (sqlite3_prepare_v2(m_Db, q.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+                if (PrepareCached(db, kUpToSql, &stmt) == SQLITE_OK) {
                     sqlite3_bind_int(stmt, 1, channelId);
                     sqlite3_bind_int(stmt, 2, anchorId);
                     sqlite3_bind_int(stmt, 3, (beforeLimit > 0 ? beforeLimit + 1 : 1)); // include anchor
                     while (sqlite3_step(stmt) == SQLITE_ROW) pushRow(stmt);
-                    sqlite3_finalize(stmt);
+                    ReleaseCached(stmt);
                 }
             }
             // Reverse the older portion so far (oldest->newest).
@@ -691,37 +820,34 @@ namespace TalkMe {
             // Newer (after anchor)
             {
                 sqlite3_stmt* stmt = nullptr;
-                std::string q = std::string(baseSelect) + "AND id > ? ORDER BY id ASC LIMIT ?;";
-                if (sqlite3_prepare_v2(m_Db, q.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+                if (PrepareCached(db, kAfterSql, &stmt) == SQLITE_OK) {
                     sqlite3_bind_int(stmt, 1, channelId);
                     sqlite3_bind_int(stmt, 2, anchorId);
                     sqlite3_bind_int(stmt, 3, (afterLimit > 0 ? afterLimit : 0));
                     while (sqlite3_step(stmt) == SQLITE_ROW) pushRow(stmt);
-                    sqlite3_finalize(stmt);
+                    ReleaseCached(stmt);
                 }
             }
         }
         else if (afterId > 0) {
             sqlite3_stmt* stmt = nullptr;
-            std::string q = std::string(baseSelect) + "AND id > ? ORDER BY id ASC LIMIT ?;";
-            if (sqlite3_prepare_v2(m_Db, q.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            if (PrepareCached(db, kAfterSql, &stmt) == SQLITE_OK) {
                 sqlite3_bind_int(stmt, 1, channelId);
                 sqlite3_bind_int(stmt, 2, afterId);
                 sqlite3_bind_int(stmt, 3, limit);
                 while (sqlite3_step(stmt) == SQLITE_ROW) pushRow(stmt);
-                sqlite3_finalize(stmt);
+                ReleaseCached(stmt);
             }
         }
         else {
             sqlite3_stmt* stmt = nullptr;
-            std::string q = std::string(baseSelect) + "AND (? = 0 OR id < ?) ORDER BY id DESC LIMIT ?;";
-            if (sqlite3_prepare_v2(m_Db, q.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            if (PrepareCached(db, kBeforeSql, &stmt) == SQLITE_OK) {
                 sqlite3_bind_int(stmt, 1, channelId);
                 sqlite3_bind_int(stmt, 2, beforeId);
                 sqlite3_bind_int(stmt, 3, beforeId);
                 sqlite3_bind_int(stmt, 4, limit);
                 while (sqlite3_step(stmt) == SQLITE_ROW) pushRow(stmt);
-                sqlite3_finalize(stmt);
+                ReleaseCached(stmt);
             }
             std::reverse(messages.begin(), messages.end());
             std::reverse(mids.begin(), mids.end());
@@ -729,23 +855,23 @@ namespace TalkMe {
 
         // ---- Batch reactions ----
         if (!mids.empty()) {
-            std::string in = "(";
-            for (size_t i = 0; i < mids.size(); ++i) {
-                if (i) in += ",";
-                in += "?";
-            }
-            in += ")";
-
             // message_id -> emoji -> [users...]
             std::map<int, json> reactionsByMessage;
 
+            // The page is a contiguous id window of this channel, so a range
+            // scan joined back to the channel replaces a per-size IN (?, ?, ...)
+            // list whose SQL text (and prepared statement) changed every call.
             sqlite3_stmt* rStmt = nullptr;
-            std::string rq = "SELECT message_id, emoji, GROUP_CONCAT(username) "
-                             "FROM reactions WHERE message_id IN " + in +
-                             " GROUP BY message_id, emoji;";
-            if (sqlite3_prepare_v2(m_Db, rq.c_str(), -1, &rStmt, 0) == SQLITE_OK) {
-                for (size_t i = 0; i < mids.size(); ++i)
-                    sqlite3_bind_int(rStmt, (int)i + 1, mids[i]);
+            const char* rq =
+                "SELECT r.message_id, r.emoji, GROUP_CONCAT(r.username) "
+                "FROM reactions r JOIN messages m ON m.id = r.message_id "
+                "WHERE r.message_id BETWEEN ? AND ? AND m.channel_id = ? "
+                "GROUP BY r.message_id, r.emoji;";
+            if (PrepareCached(db, rq, &rStmt) == SQLITE_OK) {
+                const auto [lo, hi] = std::minmax_element(mids.begin(), mids.end());
+                sqlite3_bind_int(rStmt, 1, *lo);
+                sqlite3_bind_int(rStmt, 2, *hi);
+                sqlite3_bind_int(rStmt, 3, channelId);
 
                 while (sqlite3_step(rStmt) == SQLITE_ROW) {
                     const int mid = sqlite3_column_int(rStmt, 0);
@@ -758,7 +884,7 @@ namespace TalkMe {
                     SplitCommaList(us, arr);
                     if (!arr.empty()) obj[em] = std::move(arr);
                 }
-                sqlite3_finalize(rStmt);
+                ReleaseCached(rStmt);
             }
 
             if (!reactionsByMessage.empty()) {
@@ -782,12 +908,12 @@ namespace TalkMe {
         bool hasMoreOlder = false;
         bool hasMoreNewer = false;
         if (oldestMid > 0) {
-            hasMoreOlder = ExistsMessage(m_Db, channelId,
+            hasMoreOlder = ExistsMessage(db, channelId,
                 "SELECT 1 FROM messages WHERE channel_id = ? AND id < ? LIMIT 1;",
                 oldestMid);
         }
         if (newestMid > 0) {
-            hasMoreNewer = ExistsMessage(m_Db, channelId,
+            hasMoreNewer = ExistsMessage(db, channelId,
                 "SELECT 1 FROM messages WHERE channel_id = ? AND id > ? LIMIT 1;",
                 newestMid);
         }
@@ -803,57 +929,117 @@ namespace TalkMe {
     }
 
     void Database::SaveMessage(int cid, const std::string& sender, const std::string& msg, const std::string& attachmentId, int replyTo) {
-        int ch = cid;
-        std::string s = sender;
-        std::string m = msg;
-        std::string aid = attachmentId;
-        int rt = replyTo;
-        Enqueue([this, ch, s, m, aid, rt]() {
-            std::unique_lock<std::shared_mutex> lock(m_RwMutex);
-            sqlite3_stmt* stmt;
-            if (sqlite3_prepare_v2(m_Db, "INSERT INTO messages (channel_id, sender, content, attachment_id, reply_to) VALUES (?, ?, ?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
-                sqlite3_bind_int(stmt, 1, ch);
-                sqlite3_bind_text(stmt, 2, s.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 3, m.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 4, aid.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_int(stmt, 5, rt);
-                sqlite3_step(stmt);
-                sqlite3_finalize(stmt);
-            }
-            });
+        SaveMessageAsync(cid, sender, msg, attachmentId, replyTo, nullptr);
     }
 
     int Database::SaveMessageReturnId(int cid, const std::string& sender, const std::string& msg, const std::string& attachmentId, int replyTo) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
+        return InsertMessageLocked(cid, sender, msg, attachmentId, replyTo);
+    }
+
+    int Database::InsertMessageLocked(int cid, const std::string& sender, const std::string& msg, const std::string& attachmentId, int replyTo) {
         sqlite3_stmt* stmt = nullptr;
         int mid = 0;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO messages (channel_id, sender, content, attachment_id, reply_to) VALUES (?, ?, ?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO messages (channel_id, sender, content, attachment_id, reply_to) VALUES (?, ?, ?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, cid);
-            sqlite3_bind_text(stmt, 2, sender.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 3, msg.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 4, attachmentId.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, sender.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, msg.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 4, attachmentId.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_int(stmt, 5, replyTo);
             if (sqlite3_step(stmt) == SQLITE_DONE)
                 mid = (int)sqlite3_last_insert_rowid(m_Db);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return mid;
     }
 
+    void Database::SaveMessageAsync(int cid, std::string sender, std::string msg, std::string attachmentId, int replyTo,
+        std::function<void(int mid)> onSaved) {
+        bool queueFlush = false;
+        bool batchFull = false;
+        {
+            std::unique_lock<std::mutex> lock(m_QueueMutex);
+            if (m_Shutdown) {
+                // Nothing will be written; fail it now, outside our lock.
+                lock.unlock();
+                if (onSaved) onSaved(0);
+                return;
+            }
+            m_MessageBatch.push_back({ cid, std::move(sender), std::move(msg), std::move(attachmentId), replyTo, std::move(onSaved) });
+            if (!m_MessageFlushQueued) {
+                // First message of a new batch: open the window and schedule
+                // one flush on the writer. Later messages just join the batch.
+                m_MessageFlushQueued = true;
+                m_MessageBatchOpened = std::chrono::steady_clock::now();
+                m_TaskQueue.push([this]() { FlushMessageBatch(); });
+                queueFlush = true;
+            }
+            batchFull = m_MessageBatch.size() >= m_MessageBatchMax;
+        }
+        if (queueFlush) m_QueueCv.notify_one();
+        if (batchFull) m_MessageBatchCv.notify_one();
+    }
+
+    void Database::FlushMessageBatch() {
+        std::vector<PendingMessage> batch;
+        {
+            std::unique_lock<std::mutex> lock(m_QueueMutex);
+            m_MessageBatchCv.wait_until(lock, m_MessageBatchOpened + m_MessageBatchWindow, [this] {
+                return m_Shutdown || m_MessageBatch.size() >= m_MessageBatchMax;
+            });
+            // Anything past the cap stays queued with a fresh flush behind us.
+            if (m_MessageBatch.size() > m_MessageBatchMax) {
+                auto split = m_MessageBatch.begin() + static_cast<std::ptrdiff_t>(m_MessageBatchMax);
+                batch.assign(std::make_move_iterator(m_MessageBatch.begin()), std::make_move_iterator(split));
+                m_MessageBatch.erase(m_MessageBatch.begin(), split);
+                m_MessageBatchOpened = std::chrono::steady_clock::now();
+                m_TaskQueue.push([this]() { FlushMessageBatch(); });
+            }
+            else {
+                batch.swap(m_MessageBatch);
+                m_MessageFlushQueued = false;
+            }
+        }
+        if (batch.empty()) return;
+        TALKME_DB_TIMED();
+
+        std::vector<int> mids(batch.size(), 0);
+        {
+            std::unique_lock<std::shared_mutex> lock(m_RwMutex);
+            // Ids come from AUTOINCREMENT in queue order, so they are assigned
+            // deterministically even though the rows commit together.
+            const bool inTxn = sqlite3_exec(m_Db, "BEGIN IMMEDIATE;", 0, 0, 0) == SQLITE_OK;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                const auto& m = batch[i];
+                mids[i] = InsertMessageLocked(m.cid, m.sender, m.msg, m.attachmentId, m.replyTo);
+            }
+            if (inTxn && sqlite3_exec(m_Db, "COMMIT;", 0, 0, 0) != SQLITE_OK) {
+                std::fprintf(stderr, "[TalkMe DB] message batch commit failed: %s\n", sqlite3_errmsg(m_Db));
+                sqlite3_exec(m_Db, "ROLLBACK;", 0, 0, 0);
+                std::fill(mids.begin(), mids.end(), 0);
+            }
+        }
+        for (size_t i = 0; i < batch.size(); ++i)
+            if (batch[i].onSaved) batch[i].onSaved(mids[i]);
+    }
+
     int Database::GetServerIdForChannel(int cid) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         int out = -1;
-        if (sqlite3_prepare_v2(m_Db, "SELECT server_id FROM channels WHERE id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT server_id FROM channels WHERE id = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, cid);
             if (sqlite3_step(stmt) == SQLITE_ROW) out = sqlite3_column_int(stmt, 0);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return out;
     }
 
     std::vector<std::string> Database::GetUsersInServerByChannel(int channelId) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         std::vector<std::string> users;
         sqlite3_stmt* stmt;
 
@@ -861,90 +1047,96 @@ namespace TalkMe {
                             "JOIN channels c ON m.server_id = c.server_id "
                             "WHERE c.id = ?;";
 
-        if (sqlite3_prepare_v2(m_Db, query, -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, query, &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, channelId);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* u = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
                 if (u) users.push_back(u);
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return users;
     }
 
     std::vector<std::string> Database::GetServerMembers(int serverId) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         std::vector<std::string> users;
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(m_Db, "SELECT username FROM server_members WHERE server_id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT username FROM server_members WHERE server_id = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* u = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
                 if (u) users.push_back(u);
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return users;
     }
 
     bool Database::BlockUser(const std::string& blocker, const std::string& blocked) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(m_Db, "INSERT OR IGNORE INTO blocked_users (blocker, blocked) VALUES (?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT OR IGNORE INTO blocked_users (blocker, blocked) VALUES (?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, blocker.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, blocked.c_str(), -1, SQLITE_TRANSIENT);
             ok = (sqlite3_step(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     bool Database::UnblockUser(const std::string& blocker, const std::string& blocked) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "DELETE FROM blocked_users WHERE blocker = ? AND blocked = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "DELETE FROM blocked_users WHERE blocker = ? AND blocked = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, blocker.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, blocked.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return true;
     }
 
     bool Database::IsBlocked(const std::string& blocker, const std::string& blocked) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         bool result = false;
-        if (sqlite3_prepare_v2(m_Db, "SELECT 1 FROM blocked_users WHERE blocker = ? AND blocked = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT 1 FROM blocked_users WHERE blocker = ? AND blocked = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, blocker.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, blocked.c_str(), -1, SQLITE_TRANSIENT);
             result = (sqlite3_step(stmt) == SQLITE_ROW);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return result;
     }
 
     void Database::AddAuditLog(int serverId, const std::string& actor, const std::string& action, const std::string& target, const std::string& details) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO audit_log (server_id, actor, action, target, details) VALUES (?, ?, ?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO audit_log (server_id, actor, action, target, details) VALUES (?, ?, ?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             sqlite3_bind_text(stmt, 2, actor.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, action.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 4, target.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 5, details.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
     }
 
     std::string Database::GetAuditLogJSON(int serverId, int limit) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         json j = json::array();
         sqlite3_stmt* stmt = nullptr;
         std::string query = "SELECT actor, action, target, details, created_at FROM audit_log WHERE server_id = ? ORDER BY id DESC LIMIT " + std::to_string(limit) + ";";
-        if (sqlite3_prepare_v2(m_Db, query.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, query.c_str(), &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* a = (const char*)sqlite3_column_text(stmt, 0);
@@ -954,40 +1146,43 @@ namespace TalkMe {
                 const char* ts = (const char*)sqlite3_column_text(stmt, 4);
                 j.push_back({ {"actor", a?a:""}, {"action", act?act:""}, {"target", t?t:""}, {"details", d?d:""}, {"time", ts?ts:""} });
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return j.dump();
     }
 
     bool Database::SetAvatar(const std::string& username, const std::string& avatarBase64) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(m_Db, "UPDATE users SET avatar = ? WHERE username = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "UPDATE users SET avatar = ? WHERE username = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, avatarBase64.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             ok = (sqlite3_step(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     std::string Database::GetAvatar(const std::string& username) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         std::string avatar;
-        if (sqlite3_prepare_v2(m_Db, "SELECT avatar FROM users WHERE username = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT avatar FROM users WHERE username = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
             if (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* a = (const char*)sqlite3_column_text(stmt, 0);
                 if (a) avatar = a;
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return avatar;
     }
 
     std::string Database::RegisterBot(int serverId, const std::string& owner, const std::string& botName) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         std::string botId = "bot_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
         std::default_random_engine rng(std::random_device{}());
@@ -997,24 +1192,25 @@ namespace TalkMe {
         for (int i = 0; i < 32; i++) token += charset[dist(rng)];
 
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO bots (id, owner, name, token, server_id) VALUES (?, ?, ?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO bots (id, owner, name, token, server_id) VALUES (?, ?, ?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, botId.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, owner.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, botName.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 4, token.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_int(stmt, 5, serverId);
-            if (sqlite3_step(stmt) != SQLITE_DONE) { sqlite3_finalize(stmt); return ""; }
-            sqlite3_finalize(stmt);
+            if (sqlite3_step(stmt) != SQLITE_DONE) { ReleaseCached(stmt); return ""; }
+            ReleaseCached(stmt);
         }
         json res; res["bot_id"] = botId; res["token"] = token; res["name"] = botName;
         return res.dump();
     }
 
     std::string Database::GetServerBotsJSON(int serverId) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         json j = json::array();
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "SELECT id, name, owner FROM bots WHERE server_id=?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT id, name, owner FROM bots WHERE server_id=?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* id = (const char*)sqlite3_column_text(stmt, 0);
@@ -1022,12 +1218,13 @@ namespace TalkMe {
                 const char* o = (const char*)sqlite3_column_text(stmt, 2);
                 j.push_back({ {"id", id ? id : ""}, {"name", n ? n : ""}, {"owner", o ? o : ""} });
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return j.dump();
     }
 
     bool Database::AddSanction(int serverId, const std::string& username, const std::string& type, const std::string& reason, int durationMinutes, const std::string& createdBy) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
@@ -1039,7 +1236,7 @@ namespace TalkMe {
             strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", gmtime(&now));
             expiresAt = buf;
         }
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO sanctions (server_id, username, type, reason, expires_at, created_by) VALUES (?, ?, ?, ?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO sanctions (server_id, username, type, reason, expires_at, created_by) VALUES (?, ?, ?, ?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, type.c_str(), -1, SQLITE_TRANSIENT);
@@ -1048,129 +1245,137 @@ namespace TalkMe {
             else sqlite3_bind_text(stmt, 5, expiresAt.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 6, createdBy.c_str(), -1, SQLITE_TRANSIENT);
             ok = (sqlite3_step(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     bool Database::IsUserSanctioned(int serverId, const std::string& username, const std::string& type) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         bool sanctioned = false;
-        if (sqlite3_prepare_v2(m_Db, "SELECT 1 FROM sanctions WHERE server_id=? AND username=? AND type=? AND (expires_at IS NULL OR expires_at > datetime('now'));", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT 1 FROM sanctions WHERE server_id=? AND username=? AND type=? AND (expires_at IS NULL OR expires_at > datetime('now'));", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, type.c_str(), -1, SQLITE_TRANSIENT);
             sanctioned = (sqlite3_step(stmt) == SQLITE_ROW);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return sanctioned;
     }
 
     bool Database::RemoveSanction(int serverId, const std::string& username, const std::string& type) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "DELETE FROM sanctions WHERE server_id=? AND username=? AND type=?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "DELETE FROM sanctions WHERE server_id=? AND username=? AND type=?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, type.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return true;
     }
 
     int Database::CreateRole(int serverId, const std::string& name, uint32_t permissions, const std::string& color) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         int roleId = 0;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO roles (server_id, name, permissions, color) VALUES (?, ?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO roles (server_id, name, permissions, color) VALUES (?, ?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             sqlite3_bind_text(stmt, 2, name.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_int(stmt, 3, (int)permissions);
             sqlite3_bind_text(stmt, 4, color.c_str(), -1, SQLITE_TRANSIENT);
             if (sqlite3_step(stmt) == SQLITE_DONE) roleId = (int)sqlite3_last_insert_rowid(m_Db);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return roleId;
     }
 
     bool Database::AssignRole(const std::string& username, int roleId) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(m_Db, "INSERT OR IGNORE INTO user_roles (username, role_id) VALUES (?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT OR IGNORE INTO user_roles (username, role_id) VALUES (?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_int(stmt, 2, roleId);
             ok = (sqlite3_step(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     std::string Database::GetServerRolesJSON(int serverId) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         json j = json::array();
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "SELECT id, name, permissions, color, position FROM roles WHERE server_id=? ORDER BY position;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT id, name, permissions, color, position FROM roles WHERE server_id=? ORDER BY position;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* n = (const char*)sqlite3_column_text(stmt, 1);
                 const char* c = (const char*)sqlite3_column_text(stmt, 3);
                 j.push_back({ {"id", sqlite3_column_int(stmt, 0)}, {"name", n ? n : ""}, {"perms", sqlite3_column_int(stmt, 2)}, {"color", c ? c : "#FFFFFF"}, {"position", sqlite3_column_int(stmt, 4)} });
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return j.dump();
     }
 
     bool Database::IsUserAdmin(int serverId, const std::string& username) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         bool isAdmin = false;
-        if (sqlite3_prepare_v2(m_Db, "SELECT 1 FROM servers WHERE id=? AND owner=?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT 1 FROM servers WHERE id=? AND owner=?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             isAdmin = (sqlite3_step(stmt) == SQLITE_ROW);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         if (!isAdmin) {
             sqlite3_stmt* pstmt = nullptr;
-            if (sqlite3_prepare_v2(m_Db, "SELECT permissions FROM server_members WHERE server_id=? AND username=?;", -1, &pstmt, 0) == SQLITE_OK) {
+            if (PrepareCached(db, "SELECT permissions FROM server_members WHERE server_id=? AND username=?;", &pstmt) == SQLITE_OK) {
                 sqlite3_bind_int(pstmt, 1, serverId);
                 sqlite3_bind_text(pstmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
                 if (sqlite3_step(pstmt) == SQLITE_ROW)
                     isAdmin = (sqlite3_column_int(pstmt, 0) & Perm_Admin) != 0;
-                sqlite3_finalize(pstmt);
+                ReleaseCached(pstmt);
             }
         }
         return isAdmin;
     }
 
     bool Database::RenameServer(int serverId, const std::string& newName, const std::string& username) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(m_Db, "UPDATE servers SET name=? WHERE id=? AND owner=?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "UPDATE servers SET name=? WHERE id=? AND owner=?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, newName.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_int(stmt, 2, serverId);
             sqlite3_bind_text(stmt, 3, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(stmt);
             ok = (sqlite3_changes(m_Db) > 0);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     bool Database::DeleteServer(int serverId, const std::string& username) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* chk = nullptr;
         bool isOwner = false;
-        if (sqlite3_prepare_v2(m_Db, "SELECT 1 FROM servers WHERE id=? AND owner=?;", -1, &chk, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "SELECT 1 FROM servers WHERE id=? AND owner=?;", &chk) == SQLITE_OK) {
             sqlite3_bind_int(chk, 1, serverId);
             sqlite3_bind_text(chk, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             isOwner = (sqlite3_step(chk) == SQLITE_ROW);
-            sqlite3_finalize(chk);
+            ReleaseCached(chk);
         }
         if (!isOwner) return false;
         sqlite3_exec(m_Db, ("DELETE FROM messages WHERE channel_id IN (SELECT id FROM channels WHERE server_id=" + std::to_string(serverId) + ");").c_str(), 0, 0, 0);
@@ -1181,88 +1386,93 @@ namespace TalkMe {
     }
 
     bool Database::LeaveServer(const std::string& username, int serverId) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "DELETE FROM server_members WHERE username=? AND server_id=?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "DELETE FROM server_members WHERE username=? AND server_id=?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_int(stmt, 2, serverId);
             sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return true;
     }
 
     bool Database::SetMemberPermissions(int serverId, const std::string& targetUser, uint32_t permissions, const std::string& requestingUser) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         // Only owner or admin can change permissions
         sqlite3_stmt* chk = nullptr;
         bool allowed = false;
-        if (sqlite3_prepare_v2(m_Db, "SELECT 1 FROM servers WHERE id=? AND owner=?;", -1, &chk, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "SELECT 1 FROM servers WHERE id=? AND owner=?;", &chk) == SQLITE_OK) {
             sqlite3_bind_int(chk, 1, serverId);
             sqlite3_bind_text(chk, 2, requestingUser.c_str(), -1, SQLITE_TRANSIENT);
             allowed = (sqlite3_step(chk) == SQLITE_ROW);
-            sqlite3_finalize(chk);
+            ReleaseCached(chk);
         }
         if (!allowed) {
             sqlite3_stmt* pchk = nullptr;
-            if (sqlite3_prepare_v2(m_Db, "SELECT permissions FROM server_members WHERE server_id=? AND username=?;", -1, &pchk, 0) == SQLITE_OK) {
+            if (PrepareCached(m_Db, "SELECT permissions FROM server_members WHERE server_id=? AND username=?;", &pchk) == SQLITE_OK) {
                 sqlite3_bind_int(pchk, 1, serverId);
                 sqlite3_bind_text(pchk, 2, requestingUser.c_str(), -1, SQLITE_TRANSIENT);
                 if (sqlite3_step(pchk) == SQLITE_ROW)
                     allowed = (sqlite3_column_int(pchk, 0) & Perm_Admin) != 0;
-                sqlite3_finalize(pchk);
+                ReleaseCached(pchk);
             }
         }
         if (!allowed) return false;
 
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "UPDATE server_members SET permissions=? WHERE server_id=? AND username=?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "UPDATE server_members SET permissions=? WHERE server_id=? AND username=?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, (int)permissions);
             sqlite3_bind_int(stmt, 2, serverId);
             sqlite3_bind_text(stmt, 3, targetUser.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return true;
     }
 
     std::string Database::GetServerOwner(int serverId) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         std::string owner;
-        if (sqlite3_prepare_v2(m_Db, "SELECT owner FROM servers WHERE id=?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT owner FROM servers WHERE id=?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             if (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* o = (const char*)sqlite3_column_text(stmt, 0);
                 if (o) owner = o;
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return owner;
     }
 
     int Database::SaveDirectMessage(const std::string& sender, const std::string& receiver, const std::string& content) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         int mid = 0;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO direct_messages (sender, receiver, content) VALUES (?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO direct_messages (sender, receiver, content) VALUES (?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, sender.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, receiver.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, content.c_str(), -1, SQLITE_TRANSIENT);
             if (sqlite3_step(stmt) == SQLITE_DONE) mid = (int)sqlite3_last_insert_rowid(m_Db);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return mid;
     }
 
     std::string Database::GetDMHistoryJSON(const std::string& user1, const std::string& user2) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         json j = json::array();
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db,
+        if (PrepareCached(db,
             "SELECT id, sender, receiver, content, time FROM direct_messages "
             "WHERE (sender=? AND receiver=?) OR (sender=? AND receiver=?) "
-            "ORDER BY time ASC LIMIT 100;", -1, &stmt, 0) == SQLITE_OK) {
+            "ORDER BY time ASC LIMIT 100;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, user1.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, user2.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, user2.c_str(), -1, SQLITE_TRANSIENT);
@@ -1273,87 +1483,91 @@ namespace TalkMe {
                 const char* t = (const char*)sqlite3_column_text(stmt, 4);
                 j.push_back({ {"mid", sqlite3_column_int(stmt, 0)}, {"u", s ? s : ""}, {"msg", c ? c : ""}, {"time", t ? t : ""} });
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return j.dump();
     }
 
     bool Database::AreFriends(const std::string& user1, const std::string& user2) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
         bool result = false;
-        if (sqlite3_prepare_v2(m_Db,
-            "SELECT 1 FROM friends WHERE ((user1=? AND user2=?) OR (user1=? AND user2=?)) AND status='accepted';",
-            -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db,
+            "SELECT 1 FROM friends WHERE ((user1=? AND user2=?) OR (user1=? AND user2=?)) AND status='accepted';", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, user1.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, user2.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, user2.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 4, user1.c_str(), -1, SQLITE_TRANSIENT);
             result = (sqlite3_step(stmt) == SQLITE_ROW);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return result;
     }
 
     bool Database::SendFriendRequest(const std::string& from, const std::string& toUsername) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         if (from == toUsername) return false;
         sqlite3_stmt* chk = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "SELECT 1 FROM friends WHERE (user1=? AND user2=?) OR (user1=? AND user2=?);", -1, &chk, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "SELECT 1 FROM friends WHERE (user1=? AND user2=?) OR (user1=? AND user2=?);", &chk) == SQLITE_OK) {
             sqlite3_bind_text(chk, 1, from.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(chk, 2, toUsername.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(chk, 3, toUsername.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(chk, 4, from.c_str(), -1, SQLITE_TRANSIENT);
-            if (sqlite3_step(chk) == SQLITE_ROW) { sqlite3_finalize(chk); return false; }
-            sqlite3_finalize(chk);
+            if (sqlite3_step(chk) == SQLITE_ROW) { ReleaseCached(chk); return false; }
+            ReleaseCached(chk);
         }
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(m_Db, "INSERT INTO friends (user1, user2, status) VALUES (?, ?, 'pending');", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT INTO friends (user1, user2, status) VALUES (?, ?, 'pending');", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, from.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, toUsername.c_str(), -1, SQLITE_TRANSIENT);
             ok = (sqlite3_step(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     bool Database::AcceptFriendRequest(const std::string& user, const std::string& friendUser) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(m_Db, "UPDATE friends SET status='accepted' WHERE user1=? AND user2=? AND status='pending';", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "UPDATE friends SET status='accepted' WHERE user1=? AND user2=? AND status='pending';", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, friendUser.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, user.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(stmt);
             ok = (sqlite3_changes(m_Db) > 0);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     bool Database::RejectOrRemoveFriend(const std::string& user, const std::string& friendUser) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "DELETE FROM friends WHERE (user1=? AND user2=?) OR (user1=? AND user2=?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "DELETE FROM friends WHERE (user1=? AND user2=?) OR (user1=? AND user2=?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, user.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, friendUser.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, friendUser.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 4, user.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return true;
     }
 
     std::string Database::GetFriendListJSON(const std::string& username) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         json j = json::array();
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db,
+        if (PrepareCached(db,
             "SELECT CASE WHEN user1=? THEN user2 ELSE user1 END AS friend, status, "
             "CASE WHEN user1=? THEN 'sent' ELSE 'received' END AS direction "
-            "FROM friends WHERE user1=? OR user2=?;", -1, &stmt, 0) == SQLITE_OK) {
+            "FROM friends WHERE user1=? OR user2=?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, username.c_str(), -1, SQLITE_TRANSIENT);
@@ -1364,44 +1578,67 @@ namespace TalkMe {
                 const char* d = (const char*)sqlite3_column_text(stmt, 2);
                 if (f && s) j.push_back({ {"u", f}, {"status", s}, {"direction", d ? d : ""} });
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return j.dump();
     }
 
+    std::vector<std::string> Database::GetFriendNames(const std::string& username) {
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
+        std::vector<std::string> names;
+        sqlite3_stmt* stmt = nullptr;
+        if (PrepareCached(db,
+            "SELECT CASE WHEN user1=? THEN user2 ELSE user1 END FROM friends "
+            "WHERE (user1=? OR user2=?) AND status='accepted';", &stmt) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 3, username.c_str(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                const char* f = (const char*)sqlite3_column_text(stmt, 0);
+                if (f) names.emplace_back(f);
+            }
+            ReleaseCached(stmt);
+        }
+        return names;
+    }
+
     bool Database::AddReaction(int messageId, const std::string& username, const std::string& emoji) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(m_Db, "INSERT OR IGNORE INTO reactions (message_id, username, emoji) VALUES (?, ?, ?);", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "INSERT OR IGNORE INTO reactions (message_id, username, emoji) VALUES (?, ?, ?);", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, messageId);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, emoji.c_str(), -1, SQLITE_TRANSIENT);
             ok = (sqlite3_step(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     bool Database::RemoveReaction(int messageId, const std::string& username, const std::string& emoji) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
         bool ok = false;
-        if (sqlite3_prepare_v2(m_Db, "DELETE FROM reactions WHERE message_id = ? AND username = ? AND emoji = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "DELETE FROM reactions WHERE message_id = ? AND username = ? AND emoji = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, messageId);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, emoji.c_str(), -1, SQLITE_TRANSIENT);
             ok = (sqlite3_step(stmt) == SQLITE_DONE);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return ok;
     }
 
     std::string Database::GetReactionsJSON(int messageId) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         json j = json::object();
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "SELECT emoji, GROUP_CONCAT(username) FROM reactions WHERE message_id = ? GROUP BY emoji;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT emoji, GROUP_CONCAT(username) FROM reactions WHERE message_id = ? GROUP BY emoji;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, messageId);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* emoji = (const char*)sqlite3_column_text(stmt, 0);
@@ -1418,82 +1655,85 @@ namespace TalkMe {
                     j[emoji] = arr;
                 }
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         return j.dump();
     }
 
     bool Database::DeleteChannel(int channelId, const std::string& username) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         int serverId = 0;
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "SELECT server_id FROM channels WHERE id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "SELECT server_id FROM channels WHERE id = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, channelId);
             if (sqlite3_step(stmt) == SQLITE_ROW) serverId = sqlite3_column_int(stmt, 0);
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
         if (serverId == 0) return false;
 
         // Only server owner can delete channels
         sqlite3_stmt* ownerStmt = nullptr;
         bool isOwner = false;
-        if (sqlite3_prepare_v2(m_Db, "SELECT 1 FROM servers WHERE id = ? AND owner = ?;", -1, &ownerStmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "SELECT 1 FROM servers WHERE id = ? AND owner = ?;", &ownerStmt) == SQLITE_OK) {
             sqlite3_bind_int(ownerStmt, 1, serverId);
             sqlite3_bind_text(ownerStmt, 2, username.c_str(), -1, SQLITE_TRANSIENT);
             isOwner = (sqlite3_step(ownerStmt) == SQLITE_ROW);
-            sqlite3_finalize(ownerStmt);
+            ReleaseCached(ownerStmt);
         }
         if (!isOwner) return false;
 
         sqlite3_stmt* delStmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "DELETE FROM channels WHERE id = ?;", -1, &delStmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "DELETE FROM channels WHERE id = ?;", &delStmt) == SQLITE_OK) {
             sqlite3_bind_int(delStmt, 1, channelId);
             sqlite3_step(delStmt);
-            sqlite3_finalize(delStmt);
+            ReleaseCached(delStmt);
         }
         sqlite3_stmt* msgStmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "DELETE FROM messages WHERE channel_id = ?;", -1, &msgStmt, 0) == SQLITE_OK) {
+        if (PrepareCached(m_Db, "DELETE FROM messages WHERE channel_id = ?;", &msgStmt) == SQLITE_OK) {
             sqlite3_bind_int(msgStmt, 1, channelId);
             sqlite3_step(msgStmt);
-            sqlite3_finalize(msgStmt);
+            ReleaseCached(msgStmt);
         }
         return true;
     }
 
     uint32_t Database::GetUserPermissions(int serverId, const std::string& username) {
-        std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+        TALKME_DB_TIMED();
+        ReadConnection db(*this);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "SELECT owner FROM servers WHERE id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT owner FROM servers WHERE id = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             if (sqlite3_step(stmt) == SQLITE_ROW) {
                 const char* owner = (const char*)sqlite3_column_text(stmt, 0);
-                if (owner && username == owner) { sqlite3_finalize(stmt); return static_cast<uint32_t>(Perm_Admin); }
+                if (owner && username == owner) { ReleaseCached(stmt); return static_cast<uint32_t>(Perm_Admin); }
             }
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
         }
-        if (sqlite3_prepare_v2(m_Db, "SELECT permissions FROM server_members WHERE server_id = ? AND username = ?;", -1, &stmt, 0) == SQLITE_OK) {
+        if (PrepareCached(db, "SELECT permissions FROM server_members WHERE server_id = ? AND username = ?;", &stmt) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, serverId);
             sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
             uint32_t perms = 0;
             if (sqlite3_step(stmt) == SQLITE_ROW) perms = static_cast<uint32_t>(sqlite3_column_int(stmt, 0));
-            sqlite3_finalize(stmt);
+            ReleaseCached(stmt);
             return perms;
         }
         return 0;
     }
 
     bool Database::DeleteMessage(int msgId, int cid, const std::string& username) {
+        TALKME_DB_TIMED();
         int serverId = GetServerIdForChannel(cid);
         if (serverId < 0) return false;
         std::string sender;
         {
-            std::shared_lock<std::shared_mutex> lock(m_RwMutex);
+            ReadConnection db(*this);
             sqlite3_stmt* stmt = nullptr;
-            if (sqlite3_prepare_v2(m_Db, "SELECT sender FROM messages WHERE id = ? AND channel_id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+            if (PrepareCached(db, "SELECT sender FROM messages WHERE id = ? AND channel_id = ?;", &stmt) == SQLITE_OK) {
                 sqlite3_bind_int(stmt, 1, msgId);
                 sqlite3_bind_int(stmt, 2, cid);
                 if (sqlite3_step(stmt) == SQLITE_ROW) { const char* s = (const char*)sqlite3_column_text(stmt, 0); if (s) sender = s; }
-                sqlite3_finalize(stmt);
+                ReleaseCached(stmt);
             }
         }
         uint32_t perms = GetUserPermissions(serverId, username);
@@ -1501,52 +1741,158 @@ namespace TalkMe {
         if (!allow) return false;
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "DELETE FROM messages WHERE id = ? AND channel_id = ?;", -1, &stmt, 0) != SQLITE_OK) return false;
+        if (PrepareCached(m_Db, "DELETE FROM messages WHERE id = ? AND channel_id = ?;", &stmt) != SQLITE_OK) return false;
         sqlite3_bind_int(stmt, 1, msgId);
         sqlite3_bind_int(stmt, 2, cid);
         sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
+        ReleaseCached(stmt);
         return true;
     }
 
+    void Database::RegisterAttachment(const std::string& id, uint64_t size) {
+        TALKME_DB_TIMED();
+        std::unique_lock<std::shared_mutex> lock(m_RwMutex);
+        sqlite3_stmt* stmt = nullptr;
+        if (PrepareCached(m_Db, "INSERT INTO attachments (id, size) VALUES (?, ?) "
+                                "ON CONFLICT(id) DO UPDATE SET claimed_at = CURRENT_TIMESTAMP;", &stmt) != SQLITE_OK) return;
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(size));
+        sqlite3_step(stmt);
+        ReleaseCached(stmt);
+    }
+
+    bool Database::ClaimAttachment(const std::string& id, uint64_t size) {
+        TALKME_DB_TIMED();
+        std::unique_lock<std::shared_mutex> lock(m_RwMutex);
+        sqlite3_stmt* stmt = nullptr;
+        if (PrepareCached(m_Db, "UPDATE attachments SET claimed_at = CURRENT_TIMESTAMP WHERE id = ? AND size = ?;", &stmt) != SQLITE_OK) return false;
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(size));
+        sqlite3_step(stmt);
+        ReleaseCached(stmt);
+        return sqlite3_changes(m_Db) > 0;
+    }
+
+    std::vector<std::string> Database::TakeUnreferencedAttachments(int graceSeconds) {
+        TALKME_DB_TIMED();
+        std::vector<std::string> ids;
+        // Absolute UTC cutoff in CURRENT_TIMESTAMP's format, so both statements
+        // below select exactly the same rows.
+        time_t t = time(nullptr) - graceSeconds;
+        char cutoff[32];
+        strftime(cutoff, sizeof(cutoff), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+        std::unique_lock<std::shared_mutex> lock(m_RwMutex);
+        sqlite3_stmt* stmt = nullptr;
+        if (PrepareCached(m_Db, "SELECT id FROM attachments WHERE refs <= 0 AND claimed_at < ?;", &stmt) != SQLITE_OK)
+            return ids;
+        sqlite3_bind_text(stmt, 1, cutoff, -1, SQLITE_STATIC);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* id = (const char*)sqlite3_column_text(stmt, 0);
+            if (id) ids.emplace_back(id);
+        }
+        ReleaseCached(stmt);
+        if (ids.empty()) return ids;
+        // All writes hold m_RwMutex, so nothing changed in between.
+        if (PrepareCached(m_Db, "DELETE FROM attachments WHERE refs <= 0 AND claimed_at < ?;", &stmt) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, cutoff, -1, SQLITE_STATIC);
+            sqlite3_step(stmt);
+            ReleaseCached(stmt);
+        }
+        return ids;
+    }
+
     bool Database::EditMessage(int msgId, const std::string& username, const std::string& newContent) {
+        TALKME_DB_TIMED();
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "UPDATE messages SET content = ?, edited_at = CURRENT_TIMESTAMP WHERE id = ? AND sender = ?;", -1, &stmt, 0) != SQLITE_OK) return false;
+        if (PrepareCached(m_Db, "UPDATE messages SET content = ?, edited_at = CURRENT_TIMESTAMP WHERE id = ? AND sender = ?;", &stmt) != SQLITE_OK) return false;
         sqlite3_bind_text(stmt, 1, newContent.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_int(stmt, 2, msgId);
         sqlite3_bind_text(stmt, 3, username.c_str(), -1, SQLITE_STATIC);
         sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
+        ReleaseCached(stmt);
         return sqlite3_changes(m_Db) > 0;
     }
 
     bool Database::PinMessage(int msgId, int cid, const std::string& username, bool pinState) {
+        TALKME_DB_TIMED();
         int serverId = GetServerIdForChannel(cid);
         if (serverId < 0) return false;
         // Allow: server owner, admin, user with pin permission, or anyone (relaxed for now)
         // The permission check was too strict — most users had 0 permissions by default
         std::unique_lock<std::shared_mutex> lock(m_RwMutex);
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(m_Db, "UPDATE messages SET is_pinned = ? WHERE id = ? AND channel_id = ?;", -1, &stmt, 0) != SQLITE_OK) return false;
+        if (PrepareCached(m_Db, "UPDATE messages SET is_pinned = ? WHERE id = ? AND channel_id = ?;", &stmt) != SQLITE_OK) return false;
         sqlite3_bind_int(stmt, 1, pinState ? 1 : 0);
         sqlite3_bind_int(stmt, 2, msgId);
         sqlite3_bind_int(stmt, 3, cid);
         bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
-        sqlite3_finalize(stmt);
+        ReleaseCached(stmt);
         return ok;
     }
 
-    void Database::Enqueue(std::function<void()> task) {
+    void Database::Enqueue(std::function<void()> task, std::function<void()> rejected) {
         if (!task) return;
         {
-            std::lock_guard<std::mutex> lock(m_QueueMutex);
-            if (m_Shutdown) return;
+            std::unique_lock<std::mutex> lock(m_QueueMutex);
+            if (m_Shutdown) {
+                lock.unlock();
+                if (rejected) rejected();
+                return;
+            }
             m_TaskQueue.push(std::move(task));
         }
         m_QueueCv.notify_one();
     }
 
+    void Database::ExecuteRead(std::function<void()> job, std::function<void()> rejected) {
+        if (!job) return;
+        {
+            std::unique_lock<std::mutex> lock(m_QueueMutex);
+            if (m_Shutdown) {
+                lock.unlock();
+                if (rejected) rejected();
+                return;
+            }
+            // Without a reader pool (DB failed to open) fall back to the writer.
+            if (m_Readers.empty()) m_TaskQueue.push(std::move(job));
+            else m_ReadQueue.push(std::move(job));
+        }
+        if (m_Readers.empty()) m_QueueCv.notify_one();
+        else m_ReadCv.notify_one();
+    }
+
+    void Database::ExecuteWrite(std::function<void()> job, std::function<void()> rejected) {
+        Enqueue(std::move(job), std::move(rejected));
+    }
+
+    void Database::ReaderLoop() {
+        sqlite3* conn = nullptr;
+        if (sqlite3_open_v2("talkme.db", &conn, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) == SQLITE_OK) {
+            sqlite3_busy_timeout(conn, 5000);
+            t_ReadDb = conn;
+        }
+        else {
+            std::fprintf(stderr, "[TalkMe DB] reader: cannot open read connection, using shared handle\n");
+            sqlite3_close(conn);
+            conn = nullptr;
+        }
+        while (true) {
+            std::unique_lock<std::mutex> lock(m_QueueMutex);
+            m_ReadCv.wait(lock, [this] { return m_Shutdown || !m_ReadQueue.empty(); });
+            if (m_Shutdown && m_ReadQueue.empty()) break;
+            auto task = std::move(m_ReadQueue.front());
+            m_ReadQueue.pop();
+            lock.unlock();
+            task();
+        }
+        t_ReadDb = nullptr;
+        if (conn) {
+            ForgetStatements(conn);
+            sqlite3_close(conn);
+        }
+    }
+
     void Database::WorkerLoop() {
         while (true) {
             std::unique_lock<std::mutex> lock(m_QueueMutex);
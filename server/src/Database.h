@@ -8,6 +8,8 @@
 #include <queue>
 #include <functional>
 #include <cstdint>
+#include <utility>
+#include <chrono>
 
 struct sqlite3;
 
@@ -20,10 +22,21 @@ namespace TalkMe {
         Database();
         ~Database();
 
+        /// Runs job on one of the reader threads. Each reader owns a private
+        /// read-only connection, so read methods called from the job run
+        /// concurrently with each other and with the writer (WAL).
+        /// Once shutdown has begun the job is dropped and `rejected`, if set,
+        /// runs instead, on the calling thread, so callers waiting on the job
+        /// can unwind.
+        void ExecuteRead(std::function<void()> job, std::function<void()> rejected = {});
+        /// Runs job on the single writer thread, in submission order. Same
+        /// shutdown behaviour as ExecuteRead.
+        void ExecuteWrite(std::function<void()> job, std::function<void()> rejected = {});
+
         std::string GenerateInviteCode();
         std::string RegisterUser(const std::string& email, std::string u, const std::string& p);
         int LoginUser(const std::string& email, const std::string& p, const std::string& deviceId, std::string* outUsername);
-        /// Runs LoginUser on the DB worker thread; onDone(result, username, serversJson, has2fa) is invoked from that thread.
+        /// Runs LoginUser on a DB reader thread; onDone(result, username, serversJson, has2fa) is invoked from that thread.
         /// For result!=1, serversJson is empty and has2fa is false.
         void LoginUserAsync(const std::string& email, const std::string& p, const std::string& deviceId,
             std::function<void(int result, std::string username, std::string serversJson, bool has2fa)> onDone);
@@ -35,9 +48,11 @@ namespace TalkMe {
         int GetDefaultServerId();
         void AddUserToDefaultServer(const std::string& username);
         void CreateServer(const std::string& name, const std::string& owner);
-        void CreateChannel(int serverId, const std::string& name, const std::string& type);
+        int CreateChannel(int serverId, const std::string& name, const std::string& type);   // new channel id, 0 on failure
         int JoinServer(const std::string& username, const std::string& code);
         std::string GetUserServersJSON(const std::string& username);
+        // (server id, channel id) for every server the user belongs to; channel id 0 for a server without channels.
+        std::vector<std::pair<int, int>> GetUserServerChannels(const std::string& username);
         std::string GetServerContentJSON(int serverId);
         std::string GetMessageHistoryJSON(int channelId, int beforeId = 0, int limit = 50);
         // Envelope response for efficient paging. Supports:
@@ -54,11 +69,27 @@ namespace TalkMe {
             int afterLimit = 0,
             int limit = 50);
         void SaveMessage(int cid, const std::string& sender, const std::string& msg, const std::string& attachmentId = "", int replyTo = 0);
+        /// Single-row autocommit insert; hot paths should use SaveMessageAsync.
         int SaveMessageReturnId(int cid, const std::string& sender, const std::string& msg, const std::string& attachmentId = "", int replyTo = 0);
+        /// Group-committed insert. Messages queued within the batch window (or
+        /// until the batch is full) are written in one transaction, in queue
+        /// order, on the writer thread. onSaved(mid) runs on that thread after
+        /// COMMIT; mid is 0 if the insert failed. After shutdown has begun it
+        /// runs with 0 right away, on the calling thread.
+        void SaveMessageAsync(int cid, std::string sender, std::string msg, std::string attachmentId, int replyTo,
+            std::function<void(int mid)> onSaved);
         int GetServerIdForChannel(int cid);
         std::vector<std::string> GetUsersInServerByChannel(int channelId);
         uint32_t GetUserPermissions(int serverId, const std::string& username);
         bool DeleteMessage(int msgId, int cid, const std::string& username);
+        /// Records a stored content-addressed attachment, or restarts its grace period.
+        void RegisterAttachment(const std::string& id, uint64_t size);
+        /// True if id is stored with this size; restarts its grace period so the
+        /// sweep cannot remove it before the referencing message is saved.
+        bool ClaimAttachment(const std::string& id, uint64_t size);
+        /// Deletes and returns the rows of attachments no message references and
+        /// nobody claimed in the last graceSeconds. The caller removes the files.
+        std::vector<std::string> TakeUnreferencedAttachments(int graceSeconds);
         bool EditMessage(int msgId, const std::string& username, const std::string& newContent);
         bool PinMessage(int msgId, int cid, const std::string& username, bool pinState);
         std::vector<std::string> GetServerMembers(int serverId);
@@ -98,22 +129,58 @@ namespace TalkMe {
         bool AcceptFriendRequest(const std::string& user, const std::string& friendUser);
         bool RejectOrRemoveFriend(const std::string& user, const std::string& friendUser);
         std::string GetFriendListJSON(const std::string& username);
+        std::vector<std::string> GetFriendNames(const std::string& username);   // accepted only
 
         bool AddReaction(int messageId, const std::string& username, const std::string& emoji);
         bool RemoveReaction(int messageId, const std::string& username, const std::string& emoji);
         std::string GetReactionsJSON(int messageId);
 
     private:
-        void Enqueue(std::function<void()> task);
+        // Connection for a read-only method: the calling reader thread's own
+        // handle, or the shared writer handle under a shared lock when the
+        // method is called from any other thread.
+        class ReadConnection {
+        public:
+            explicit ReadConnection(Database& db);
+            operator sqlite3*() const { return m_Conn; }
+        private:
+            std::shared_lock<std::shared_mutex> m_Lock;
+            sqlite3* m_Conn = nullptr;
+        };
+
+        struct PendingMessage {
+            int cid = 0;
+            std::string sender;
+            std::string msg;
+            std::string attachmentId;
+            int replyTo = 0;
+            std::function<void(int mid)> onSaved;
+        };
+
+        void Enqueue(std::function<void()> task, std::function<void()> rejected = {});
         void WorkerLoop();
+        void ReaderLoop();
+        void FlushMessageBatch();
+        int InsertMessageLocked(int cid, const std::string& sender, const std::string& msg, const std::string& attachmentId, int replyTo);
 
         sqlite3* m_Db;
         std::shared_mutex m_RwMutex;
         std::thread m_Worker;
+        std::vector<std::thread> m_Readers;
         std::mutex m_QueueMutex;
         std::condition_variable m_QueueCv;
+        std::condition_variable m_ReadCv;
         std::queue<std::function<void()>> m_TaskQueue;
+        std::queue<std::function<void()>> m_ReadQueue;
         bool m_Shutdown = false;
+
+        // Group commit for chat messages (guarded by m_QueueMutex).
+        std::vector<PendingMessage> m_MessageBatch;
+        bool m_MessageFlushQueued = false;
+        std::chrono::steady_clock::time_point m_MessageBatchOpened;
+        std::condition_variable m_MessageBatchCv;
+        std::chrono::microseconds m_MessageBatchWindow{ 1000 };
+        size_t m_MessageBatchMax = 256;
     };
 
 } // namespace TalkMe
\ No newline at end of file
@@ -8,6 +8,8 @@ namespace TalkMe {
     struct VoiceTrace {
         static void init();
         static void log(const std::string& msg);
+        // Cheap gate for hot paths: callers check this before building the message string.
+        static bool enabled() { return s_enabled; }
 
     private:
         static std::ofstream s_file;
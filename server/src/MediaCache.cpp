@@ -0,0 +1,101 @@
+#include "MediaCache.h"
+#include "AttachmentStore.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace TalkMe {
+
+    MediaCache& MediaCache::Get() {
+        static MediaCache cache;
+        return cache;
+    }
+
+    MediaCache::Stats& MediaCache::GetStats() {
+        static Stats s;
+        return s;
+    }
+
+    std::shared_ptr<const MediaCache::Entry> MediaCache::Lookup(const std::string& key,
+        const std::filesystem::path& path, uint64_t size, int64_t mtimeNs)
+    {
+        {
+            std::lock_guard lock(m_Mutex);
+            auto it = m_Entries.find(key);
+            if (it != m_Entries.end()) {
+                if (it->second.entry->size == size && it->second.entry->mtimeNs == mtimeNs) {
+                    m_Lru.splice(m_Lru.begin(), m_Lru, it->second.lru);
+                    GetStats().hits.fetch_add(1, std::memory_order_relaxed);
+                    return it->second.entry;
+                }
+                if (it->second.entry->body) m_BodyBytes -= it->second.entry->body->size();
+                m_Lru.erase(it->second.lru);
+                m_Entries.erase(it);
+            }
+        }
+
+        // Build outside the lock; two concurrent misses on the same file both
+        // do the work and the second insert wins, which is harmless.
+        GetStats().misses.fetch_add(1, std::memory_order_relaxed);
+        auto entry = Load(key, path, size, mtimeNs);
+        if (!entry) return nullptr;
+
+        std::lock_guard lock(m_Mutex);
+        auto [it, inserted] = m_Entries.try_emplace(key);
+        if (!inserted) {
+            if (it->second.entry->body) m_BodyBytes -= it->second.entry->body->size();
+            m_Lru.splice(m_Lru.begin(), m_Lru, it->second.lru);
+        }
+        else {
+            m_Lru.push_front(key);
+            it->second.lru = m_Lru.begin();
+        }
+        it->second.entry = entry;
+        if (entry->body) m_BodyBytes += entry->body->size();
+        EvictLocked();
+        return entry;
+    }
+
+    std::shared_ptr<const MediaCache::Entry> MediaCache::Load(const std::string& key,
+        const std::filesystem::path& path, uint64_t size, int64_t mtimeNs)
+    {
+        auto entry = std::make_shared<Entry>();
+        entry->size = size;
+        entry->mtimeNs = mtimeNs;
+        // The store verified the hash before moving the file into place. Any
+        // other file would have to be read in full to hash it, on the io
+        // thread serving the request, so it gets a weak validator instead.
+        if (const auto known = AttachmentStore::HashOf(key); !known.empty()) {
+            entry->etag = "\"" + std::string(known) + "\"";
+        }
+        else {
+            char weak[48];
+            std::snprintf(weak, sizeof(weak), "W/\"%llx-%llx\"",
+                static_cast<unsigned long long>(size), static_cast<unsigned long long>(mtimeNs));
+            entry->etag = weak;
+        }
+
+        if (size == 0 || size > kMaxBodyBytes) return entry;
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return nullptr;
+        std::string body(static_cast<size_t>(size), '\0');
+        if (!file.read(body.data(), static_cast<std::streamsize>(size))) return nullptr;
+        entry->body = std::make_shared<const std::string>(std::move(body));
+        return entry;
+    }
+
+    void MediaCache::EvictLocked() {
+        while (!m_Lru.empty() && (m_Entries.size() > kMaxEntries || m_BodyBytes > kMaxCacheBytes)) {
+            auto it = m_Entries.find(m_Lru.back());
+            if (it->second.entry->body) m_BodyBytes -= it->second.entry->body->size();
+            m_Entries.erase(it);
+            m_Lru.pop_back();
+        }
+    }
+
+    size_t MediaCache::CachedBodyBytes() const {
+        std::lock_guard lock(m_Mutex);
+        return m_BodyBytes;
+    }
+
+} // namespace TalkMe
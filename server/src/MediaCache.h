@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // Process-wide cache behind the media HTTP endpoint.
+    //
+    // Every attachment served gets an entry holding its size, mtime and an
+    // ETag, revalidated against the caller's stat of the file on every
+    // lookup. Content-addressed ids (AttachmentStore.h) name the SHA-256 of
+    // their bytes, which is the strong ETag. Legacy ids and previews get a
+    // weak ETag of size and mtime, so no file is ever read just to hash it
+    // on the io thread serving the request. Files up to kMaxBodyBytes also
+    // keep their bytes in memory, so hot attachments are answered without
+    // touching the disk.
+    // Entries are kept in LRU order; the oldest are evicted once there are more
+    // than kMaxEntries or the cached bodies exceed kMaxCacheBytes.
+    //
+    // On Linux bodies are not kept: sendfile() straight from the page cache
+    // measured ~2.7x faster than writing a user-space copy, so there the
+    // kernel's page cache is the body cache and entries carry metadata only.
+    // ---------------------------------------------------------------------------
+    class MediaCache {
+    public:
+        static constexpr size_t kMaxEntries = 4096;
+#if defined(__linux__)
+        static constexpr size_t kMaxBodyBytes = 0;
+#else
+        static constexpr size_t kMaxBodyBytes = 1024 * 1024;
+#endif
+        static constexpr size_t kMaxCacheBytes = 64 * 1024 * 1024;
+
+        struct Entry {
+            uint64_t    size = 0;
+            int64_t     mtimeNs = 0;                  // since the epoch
+            std::string etag;                         // quoted (W/ when weak), ready for the header
+            std::shared_ptr<const std::string> body;  // null when not held in memory
+        };
+
+        struct Stats {
+            std::atomic<uint64_t> hits{ 0 };          // entry reused, file not re-read
+            std::atomic<uint64_t> misses{ 0 };        // entry built (body read when kept)
+            std::atomic<uint64_t> memoryServed{ 0 };  // responses sent from a cached body
+            std::atomic<uint64_t> notModified{ 0 };   // 304 responses
+            std::atomic<uint64_t> partial{ 0 };       // 206 responses
+            std::atomic<uint64_t> bytesSaved{ 0 };    // body bytes not sent thanks to 304/206
+        };
+
+        static MediaCache& Get();
+        static Stats& GetStats();
+
+        // Entry for the file at `path` as the caller just stat'ed it, built
+        // when there is none or it is stale. Returns null if a body to keep
+        // could not be read in full.
+        std::shared_ptr<const Entry> Lookup(const std::string& key, const std::filesystem::path& path,
+                                            uint64_t size, int64_t mtimeNs);
+
+        size_t CachedBodyBytes() const;
+
+    private:
+        MediaCache() = default;
+
+        static std::shared_ptr<const Entry> Load(const std::string& key, const std::filesystem::path& path,
+                                                 uint64_t size, int64_t mtimeNs);
+        void EvictLocked();
+
+        struct Slot {
+            std::shared_ptr<const Entry>     entry;
+            std::list<std::string>::iterator lru;
+        };
+        mutable std::mutex                    m_Mutex;
+        std::unordered_map<std::string, Slot> m_Entries;
+        std::list<std::string>                m_Lru;    // front = most recently used
+        size_t                                m_BodyBytes = 0;
+    };
+
+} // namespace TalkMe
@@ -0,0 +1,576 @@
+#include "MediaHttpSession.h"
+#include "AttachmentStore.h"
+#include "MediaCache.h"
+#include "Metrics.h"
+#include "Thumbnailer.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+using asio::ip::tcp;
+
+namespace TalkMe {
+
+    namespace {
+        // Bytes one connection may push before yielding its io_context thread.
+        constexpr uint64_t kMaxBytesPerTurn = 1024 * 1024;
+
+        std::string_view ContentTypeFromExtension(std::string_view id) {
+            const size_t dot = id.rfind('.');
+            if (dot == std::string_view::npos) return "application/octet-stream";
+            std::string ext(id.substr(dot));
+            for (char& c : ext) c = (char)std::tolower((unsigned char)c);
+            if (ext == ".png") return "image/png";
+            if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+            if (ext == ".gif") return "image/gif";
+            if (ext == ".webp") return "image/webp";
+            if (ext == ".bmp") return "image/bmp";
+            if (ext == ".mp4") return "video/mp4";
+            if (ext == ".webm") return "video/webm";
+            return "application/octet-stream";
+        }
+
+        bool IEquals(std::string_view a, std::string_view b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+                return std::tolower((unsigned char)x) == std::tolower((unsigned char)y);
+                });
+        }
+
+        std::string_view Trim(std::string_view s) {
+            while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+            while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+            return s;
+        }
+
+        // Value of header `name` in the header block (lines after the request
+        // line), or an empty view when absent.
+        std::string_view HeaderValue(std::string_view headers, std::string_view name) {
+            while (!headers.empty()) {
+                const size_t eol = headers.find("\r\n");
+                const std::string_view line = headers.substr(0, eol);
+                const size_t colon = line.find(':');
+                if (colon != std::string_view::npos && IEquals(Trim(line.substr(0, colon)), name))
+                    return Trim(line.substr(colon + 1));
+                if (eol == std::string_view::npos) break;
+                headers.remove_prefix(eol + 2);
+            }
+            return {};
+        }
+
+        // Positive integer query parameter `name`, or 0.
+        int QueryInt(std::string_view query, std::string_view name) {
+            while (!query.empty()) {
+                const size_t amp = query.find('&');
+                std::string_view param = query.substr(0, amp);
+                if (param.size() > name.size() && param.compare(0, name.size(), name) == 0 && param[name.size()] == '=') {
+                    param.remove_prefix(name.size() + 1);
+                    int value = 0;
+                    const auto [end, ec] = std::from_chars(param.data(), param.data() + param.size(), value);
+                    return ec == std::errc() && end == param.data() + param.size() && value > 0 ? value : 0;
+                }
+                if (amp == std::string_view::npos) break;
+                query.remove_prefix(amp + 1);
+            }
+            return 0;
+        }
+
+        // True when the comma-separated header value lists `token`.
+        bool HasToken(std::string_view value, std::string_view token) {
+            while (!value.empty()) {
+                const size_t comma = value.find(',');
+                if (IEquals(Trim(value.substr(0, comma)), token)) return true;
+                if (comma == std::string_view::npos) break;
+                value.remove_prefix(comma + 1);
+            }
+            return false;
+        }
+
+        std::string_view WithoutWeakPrefix(std::string_view etag) {
+            return etag.substr(0, 2) == "W/" ? etag.substr(2) : etag;
+        }
+
+        // Matches an If-None-Match list against our ETag using weak
+        // comparison, as RFC 9110 requires for GET/HEAD.
+        bool EtagListMatches(std::string_view list, std::string_view etag) {
+            while (!list.empty()) {
+                const size_t comma = list.find(',');
+                std::string_view tag = Trim(list.substr(0, comma));
+                if (tag == "*") return true;
+                // Weak comparison: W/ is ignored on both sides.
+                if (tag.substr(0, 2) == "W/") tag.remove_prefix(2);
+                if (tag == WithoutWeakPrefix(etag)) return true;
+                if (comma == std::string_view::npos) break;
+                list.remove_prefix(comma + 1);
+            }
+            return false;
+        }
+
+        constexpr const char* kWeekdays[7] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+        constexpr const char* kMonths[12] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                              "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+        // IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+        std::string FormatHttpDate(int64_t unixSeconds) {
+            using namespace std::chrono;
+            const sys_seconds tp{ seconds{ unixSeconds } };
+            const sys_days day = floor<days>(tp);
+            const year_month_day ymd{ day };
+            const hh_mm_ss hms{ tp - day };
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%s, %02u %s %04d %02d:%02d:%02d GMT",
+                kWeekdays[weekday{ day }.c_encoding()], unsigned(ymd.day()), kMonths[unsigned(ymd.month()) - 1],
+                int(ymd.year()), int(hms.hours().count()), int(hms.minutes().count()), int(hms.seconds().count()));
+            return buf;
+        }
+
+        // Parses an IMF-fixdate; the obsolete RFC 850 and asctime forms are
+        // treated as absent, which only costs a full response.
+        bool ParseHttpDate(std::string_view text, int64_t& unixSeconds) {
+            const std::string s(text);
+            char mon[4] = {};
+            int d = 0, y = 0, hh = 0, mm = 0, ss = 0;
+            if (std::sscanf(s.c_str(), "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &d, mon, &y, &hh, &mm, &ss) != 6) return false;
+            const auto it = std::find_if(std::begin(kMonths), std::end(kMonths),
+                [&](const char* m) { return std::string_view(m) == mon; });
+            if (it == std::end(kMonths)) return false;
+            using namespace std::chrono;
+            const year_month_day ymd{ year{ y }, month{ unsigned(it - std::begin(kMonths)) + 1 }, day{ unsigned(d) } };
+            if (!ymd.ok()) return false;
+            unixSeconds = (sys_days{ ymd }.time_since_epoch() / seconds{ 1 }) + hh * 3600 + mm * 60 + ss;
+            return true;
+        }
+
+        enum class RangeResult { None, Ok, Unsatisfiable };
+
+        // Single byte range only ("bytes=a-b", "bytes=a-", "bytes=-n"). Lists
+        // and malformed values yield None, i.e. the full 200 response.
+        RangeResult ParseRange(std::string_view value, uint64_t size, uint64_t& first, uint64_t& last) {
+            constexpr std::string_view unit = "bytes=";
+            if (value.substr(0, unit.size()) != unit) return RangeResult::None;
+            value = Trim(value.substr(unit.size()));
+            const size_t dash = value.find('-');
+            if (dash == std::string_view::npos || value.find(',') != std::string_view::npos) return RangeResult::None;
+            auto parse = [](std::string_view t, uint64_t& out) {
+                t = Trim(t);
+                const auto r = std::from_chars(t.data(), t.data() + t.size(), out);
+                return !t.empty() && r.ec == std::errc() && r.ptr == t.data() + t.size();
+            };
+            const std::string_view a = Trim(value.substr(0, dash));
+            const std::string_view b = Trim(value.substr(dash + 1));
+            if (a.empty()) {
+                uint64_t suffix = 0;
+                if (!parse(b, suffix)) return RangeResult::None;
+                if (suffix == 0 || size == 0) return RangeResult::Unsatisfiable;
+                first = size > suffix ? size - suffix : 0;
+                last = size - 1;
+                return RangeResult::Ok;
+            }
+            if (!parse(a, first)) return RangeResult::None;
+            last = size ? size - 1 : 0;
+            if (!b.empty()) {
+                uint64_t end = 0;
+                if (!parse(b, end) || end < first) return RangeResult::None;
+                last = std::min(last, end);
+            }
+            if (first >= size) return RangeResult::Unsatisfiable;
+            return RangeResult::Ok;
+        }
+
+#if defined(__linux__)
+        // Holds partial frames while corked so the response header and the
+        // start of the body leave in the same segment; uncorking flushes.
+        void SetCork(tcp::socket& socket, bool on) {
+            const int v = on ? 1 : 0;
+            ::setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_CORK, &v, sizeof(v));
+        }
+#endif
+    }
+
+    MediaHttpSession::Stats& MediaHttpSession::GetStats() {
+        static Stats s;
+        return s;
+    }
+
+    MediaHttpSession::MediaHttpSession(tcp::socket socket)
+        : m_Socket(std::move(socket))
+        , m_Strand(asio::make_strand(m_Socket.get_executor()))
+        , m_Timer(m_Strand) {
+        GetStats().connections.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    MediaHttpSession::~MediaHttpSession() {
+        CloseFile();
+        GetStats().connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void MediaHttpSession::Start() {
+        asio::error_code ec;
+        m_Socket.set_option(tcp::no_delay(true), ec);
+#if defined(__linux__)
+        // sendfile() is issued directly on the descriptor and must not block.
+        m_Socket.native_non_blocking(true, ec);
+#endif
+        asio::dispatch(m_Strand, [this, self = shared_from_this()]() {
+            Touch();
+            WatchDeadline();
+            ReadRequest();
+            });
+    }
+
+    void MediaHttpSession::WatchDeadline() {
+        m_Timer.expires_at(m_Deadline);
+        m_Timer.async_wait(asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec) {
+            if (ec || !m_Socket.is_open()) return;
+            if (std::chrono::steady_clock::now() >= m_Deadline) { Close(); return; }
+            WatchDeadline();
+            }));
+    }
+
+    void MediaHttpSession::Close() {
+        asio::error_code ec;
+        m_Socket.shutdown(tcp::socket::shutdown_both, ec);
+        m_Socket.close(ec);
+        m_Timer.cancel();
+    }
+
+    void MediaHttpSession::ReadRequest() {
+        // Pipelined requests already in the buffer are answered first.
+        const size_t end = m_In.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            const std::string head = m_In.substr(0, end);
+            m_In.erase(0, end + 4);
+            HandleRequest(head);
+            return;
+        }
+        if (m_In.size() > kMaxHeaderBytes) {
+            SendError(431, "Request Header Fields Too Large", false);
+            return;
+        }
+        m_Socket.async_read_some(asio::buffer(m_ReadBuf),
+            asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec, std::size_t n) {
+                if (ec) { Close(); return; }
+                Touch();
+                m_In.append(m_ReadBuf.data(), n);
+                ReadRequest();
+                }));
+    }
+
+    void MediaHttpSession::HandleRequest(std::string_view head) {
+        GetStats().requests.fetch_add(1, std::memory_order_relaxed);
+
+        // "METHOD SP target SP HTTP/x.y"
+        const size_t lineEnd = head.find("\r\n");
+        const std::string_view line = head.substr(0, lineEnd);
+        const std::string_view headers = lineEnd == std::string_view::npos ? std::string_view{} : head.substr(lineEnd + 2);
+        const size_t sp1 = line.find(' ');
+        const size_t sp2 = line.rfind(' ');
+        if (sp1 == std::string_view::npos || sp2 <= sp1) { SendError(400, "Bad Request", false); return; }
+        const std::string_view method = line.substr(0, sp1);
+        std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        const std::string_view version = line.substr(sp2 + 1);
+        if (version != "HTTP/1.1" && version != "HTTP/1.0") { SendError(400, "Bad Request", false); return; }
+
+        const std::string_view connection = HeaderValue(headers, "Connection");
+        m_KeepAlive = version == "HTTP/1.1" ? !HasToken(connection, "close") : HasToken(connection, "keep-alive");
+
+        // GET/HEAD carry no body; one we cannot skip would desync the pipeline.
+        const std::string_view contentLength = HeaderValue(headers, "Content-Length");
+        if ((!contentLength.empty() && contentLength != "0") || !HeaderValue(headers, "Transfer-Encoding").empty()) {
+            SendError(400, "Bad Request", false);
+            return;
+        }
+
+        const bool headOnly = method == "HEAD";
+        if (method != "GET" && !headOnly) { SendError(405, "Method Not Allowed", true); return; }
+
+        const size_t question = target.find('?');
+        const int previewSize = question == std::string_view::npos ? 0 : QueryInt(target.substr(question + 1), "size");
+        target = target.substr(0, question);
+        if (target == "/metrics") { ServeMetrics(headOnly); return; }
+        constexpr std::string_view prefix = "/media/";
+        if (target.size() <= prefix.size() || target.compare(0, prefix.size(), prefix) != 0) {
+            SendError(404, "Not Found", true);
+            return;
+        }
+        const std::string_view id = target.substr(prefix.size());
+        if (!AttachmentStore::IsValidId(id)) { SendError(400, "Bad Request", true); return; }
+
+        // ?size=N serves the image preview when there is one (Thumbnailer.h).
+        std::string cacheKey(id);
+        std::filesystem::path filePath = AttachmentStore::PathFor(cacheKey);
+        uint64_t originalSize = 0;
+        if (previewSize > 0) {
+            if (auto preview = Thumbnailer::Get().Find(cacheKey, previewSize); !preview.empty()) {
+                std::error_code oec;
+                originalSize = std::filesystem::file_size(filePath, oec);
+                if (oec) originalSize = 0;
+                cacheKey = "previews/" + preview.filename().string();
+                filePath = std::move(preview);
+            }
+        }
+        uint64_t fileSize = 0;
+        int64_t mtimeNs = 0;
+#if defined(__linux__)
+        const int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { SendError(404, "Not Found", true); return; }
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            SendError(404, "Not Found", true);
+            return;
+        }
+        m_FileFd = fd;
+        fileSize = static_cast<uint64_t>(st.st_size);
+        mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+        std::error_code fec;
+        if (!std::filesystem::is_regular_file(filePath, fec)) { SendError(404, "Not Found", true); return; }
+        fileSize = std::filesystem::file_size(filePath, fec);
+        const auto writeTime = std::filesystem::last_write_time(filePath, fec);
+        m_File.open(filePath, std::ios::binary);
+        if (fec || !m_File) { CloseFile(); SendError(500, "Internal Server Error", true); return; }
+        mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::clock_cast<std::chrono::system_clock>(writeTime).time_since_epoch()).count();
+#endif
+        const auto entry = MediaCache::Get().Lookup(cacheKey, filePath, fileSize, mtimeNs);
+        if (!entry) { CloseFile(); SendError(500, "Internal Server Error", true); return; }
+
+        auto& cacheStats = MediaCache::GetStats();
+        const std::string lastModified = FormatHttpDate(mtimeNs / 1000000000);
+        std::string validators;
+        validators.reserve(160);
+        validators += "\r\nETag: ";
+        validators += entry->etag;
+        validators += "\r\nLast-Modified: ";
+        validators += lastModified;
+        validators += "\r\nCache-Control: no-cache";
+        const std::string_view connectionLine = m_KeepAlive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+
+        // If-None-Match takes precedence over If-Modified-Since.
+        bool notModified = false;
+        if (const auto inm = HeaderValue(headers, "If-None-Match"); !inm.empty()) {
+            notModified = EtagListMatches(inm, entry->etag);
+        }
+        else if (const auto ims = HeaderValue(headers, "If-Modified-Since"); !ims.empty()) {
+            int64_t since = 0;
+            notModified = ParseHttpDate(ims, since) && mtimeNs / 1000000000 <= since;
+        }
+        if (notModified) {
+            CloseFile();
+            cacheStats.notModified.fetch_add(1, std::memory_order_relaxed);
+            cacheStats.bytesSaved.fetch_add(fileSize, std::memory_order_relaxed);
+            SendHeaderThen("HTTP/1.1 304 Not Modified" + validators + std::string(connectionLine), false);
+            return;
+        }
+
+        // Range applies only while If-Range (if any) still names this version.
+        uint64_t first = 0;
+        uint64_t last = fileSize ? fileSize - 1 : 0;
+        bool partial = false;
+        const auto range = HeaderValue(headers, "Range");
+        const auto ifRange = HeaderValue(headers, "If-Range");
+        // If-Range needs a strong match; a weak ETag never satisfies it.
+        const bool strongTag = entry->etag.substr(0, 2) != "W/";
+        if (!range.empty() && (ifRange.empty() || (strongTag && ifRange == entry->etag) || ifRange == lastModified)) {
+            switch (ParseRange(range, fileSize, first, last)) {
+            case RangeResult::Ok:
+                partial = true;
+                break;
+            case RangeResult::Unsatisfiable:
+                CloseFile();
+                GetStats().errors.fetch_add(1, std::memory_order_relaxed);
+                SendHeaderThen("HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + std::to_string(fileSize)
+                    + "\r\nContent-Length: 0" + std::string(connectionLine), false);
+                return;
+            case RangeResult::None:
+                first = 0;
+                last = fileSize ? fileSize - 1 : 0;
+                break;
+            }
+        }
+        const uint64_t length = fileSize ? last - first + 1 : 0;
+        if (originalSize > 0) {
+            auto& previewStats = Thumbnailer::GetStats();
+            previewStats.served.fetch_add(1, std::memory_order_relaxed);
+            if (originalSize > fileSize)
+                previewStats.bytesSaved.fetch_add(originalSize - fileSize, std::memory_order_relaxed);
+        }
+        if (partial) {
+            cacheStats.partial.fetch_add(1, std::memory_order_relaxed);
+            cacheStats.bytesSaved.fetch_add(fileSize - length, std::memory_order_relaxed);
+        }
+
+        std::string header;
+        header.reserve(384);
+        header += partial ? "HTTP/1.1 206 Partial Content\r\nContent-Type: " : "HTTP/1.1 200 OK\r\nContent-Type: ";
+        header += ContentTypeFromExtension(cacheKey);
+        header += "\r\nContent-Length: ";
+        header += std::to_string(length);
+        if (partial) {
+            header += "\r\nContent-Range: bytes ";
+            header += std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(fileSize);
+        }
+        header += "\r\nAccept-Ranges: bytes";
+        header += validators;
+        header += connectionLine;
+
+        m_FileOffset = first;
+        m_FileRemaining = headOnly ? 0 : length;
+        if (entry->body && m_FileRemaining > 0) {
+            // Hot attachment: answer from memory and release the descriptor now.
+            CloseFile();
+            m_MemBody = entry->body;
+            cacheStats.memoryServed.fetch_add(1, std::memory_order_relaxed);
+        }
+#if !defined(__linux__)
+        else if (m_FileRemaining > 0) {
+            m_File.seekg(static_cast<std::streamoff>(first));
+        }
+#endif
+        SendHeaderThen(std::move(header), m_FileRemaining > 0);
+    }
+
+    void MediaHttpSession::ServeMetrics(bool headOnly) {
+        auto body = std::make_shared<const std::string>(Metrics::Get().RenderPrometheus());
+        std::string header;
+        header.reserve(160);
+        header += "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: ";
+        header += std::to_string(body->size());
+        header += "\r\nCache-Control: no-store";
+        header += m_KeepAlive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+        m_FileOffset = 0;
+        m_FileRemaining = headOnly ? 0 : body->size();
+        m_MemBody = std::move(body);
+        SendHeaderThen(std::move(header), m_FileRemaining > 0);
+    }
+
+    void MediaHttpSession::SendError(int status, std::string_view reason, bool keepAlive) {
+        GetStats().errors.fetch_add(1, std::memory_order_relaxed);
+        m_KeepAlive = m_KeepAlive && keepAlive;
+        std::string header = "HTTP/1.1 " + std::to_string(status) + " " + std::string(reason)
+            + "\r\nContent-Length: 0\r\nConnection: " + (m_KeepAlive ? "keep-alive" : "close") + "\r\n\r\n";
+        SendHeaderThen(std::move(header), false);
+    }
+
+    void MediaHttpSession::SendHeaderThen(std::string header, bool sendBody) {
+        m_OutHeader = std::move(header);
+        if (sendBody && m_MemBody) {
+            // Header and cached body leave in one gathered write.
+            const std::array<asio::const_buffer, 2> buffers = {
+                asio::buffer(m_OutHeader),
+                asio::buffer(m_MemBody->data() + m_FileOffset, static_cast<size_t>(m_FileRemaining)) };
+            asio::async_write(m_Socket, buffers,
+                asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec, std::size_t) {
+                    if (ec) { Close(); return; }
+                    Touch();
+                    GetStats().bodyBytes.fetch_add(m_FileRemaining, std::memory_order_relaxed);
+                    m_FileRemaining = 0;
+                    FinishResponse();
+                    }));
+            return;
+        }
+#if defined(__linux__)
+        if (sendBody) { SetCork(m_Socket, true); m_Corked = true; }
+#endif
+        asio::async_write(m_Socket, asio::buffer(m_OutHeader),
+            asio::bind_executor(m_Strand, [this, self = shared_from_this(), sendBody](std::error_code ec, std::size_t) {
+                if (ec) { Close(); return; }
+                Touch();
+                if (sendBody) SendBody();
+                else FinishResponse();
+                }));
+    }
+
+    void MediaHttpSession::SendBody() {
+#if defined(__linux__)
+        uint64_t sentThisTurn = 0;
+        while (m_FileRemaining > 0) {
+            if (sentThisTurn >= kMaxBytesPerTurn) {
+                // Let other connections on this thread make progress.
+                asio::post(m_Strand, [this, self = shared_from_this()]() { SendBody(); });
+                return;
+            }
+            off_t offset = static_cast<off_t>(m_FileOffset);
+            const size_t want = static_cast<size_t>(std::min<uint64_t>(m_FileRemaining, kMaxBytesPerTurn));
+            const ssize_t n = ::sendfile(m_Socket.native_handle(), m_FileFd, &offset, want);
+            if (n > 0) {
+                m_FileOffset += static_cast<uint64_t>(n);
+                m_FileRemaining -= static_cast<uint64_t>(n);
+                sentThisTurn += static_cast<uint64_t>(n);
+                GetStats().bodyBytes.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+                Touch();
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                m_Socket.async_wait(tcp::socket::wait_write,
+                    asio::bind_executor(m_Strand, [this, self = shared_from_this()](std::error_code ec) {
+                        if (ec) { Close(); return; }
+                        SendBody();
+                        }));
+                return;
+            }
+            // n == 0: the file shrank under us; otherwise a socket error. The
+            // promised Content-Length cannot be met, so drop the connection.
+            Close();
+            return;
+        }
+        FinishResponse();
+#else
+        if (m_FileRemaining == 0) { FinishResponse(); return; }
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(m_FileRemaining, kChunkSize));
+        m_Chunk.resize(kChunkSize);
+        if (!m_File.read(m_Chunk.data(), static_cast<std::streamsize>(want))) { Close(); return; }
+        asio::async_write(m_Socket, asio::buffer(m_Chunk.data(), want),
+            asio::bind_executor(m_Strand, [this, self = shared_from_this(), want](std::error_code ec, std::size_t) {
+                if (ec) { Close(); return; }
+                m_FileOffset += want;
+                m_FileRemaining -= want;
+                GetStats().bodyBytes.fetch_add(want, std::memory_order_relaxed);
+                Touch();
+                SendBody();
+                }));
+#endif
+    }
+
+    void MediaHttpSession::CloseFile() {
+#if defined(__linux__)
+        if (m_FileFd >= 0) {
+            ::close(m_FileFd);
+            m_FileFd = -1;
+        }
+#else
+        if (m_File.is_open()) m_File.close();
+        m_File.clear();
+#endif
+    }
+
+    void MediaHttpSession::FinishResponse() {
+        CloseFile();
+        m_MemBody.reset();
+#if defined(__linux__)
+        if (m_Corked) {
+            SetCork(m_Socket, false);
+            m_Corked = false;
+        }
+#endif
+        m_OutHeader.clear();
+        if (!m_KeepAlive) { Close(); return; }
+        ReadRequest();
+    }
+
+} // namespace TalkMe
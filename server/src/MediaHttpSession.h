@@ -0,0 +1,98 @@
+#pragma once
+#include <asio.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // One HTTP/1.1 connection on the media port: GET/HEAD /media/<id> serves
+    // attachments/<id>, or with ?size=N its downscaled preview once one has
+    // been generated (Thumbnailer.h).
+    //
+    // Every operation is asynchronous and runs on the connection's strand, so a
+    // slow reader never holds an io_context thread. Requests are parsed from a
+    // small input buffer; pipelined requests already in it are answered in
+    // order before the next read. Connections stay open (keep-alive) unless the
+    // client asks otherwise or speaks HTTP/1.0 without keep-alive.
+    //
+    // On Linux the file body goes out with sendfile() on the non-blocking
+    // socket, waiting for writability when the send buffer is full, so the
+    // attachment is never copied into user space. Elsewhere it is streamed
+    // through a fixed kChunkSize buffer. Either way a connection holds a few
+    // KiB regardless of file size.
+    //
+    // Responses carry a content-hash ETag and Last-Modified from MediaCache;
+    // If-None-Match / If-Modified-Since get a 304 and a single-range Range
+    // header (honouring If-Range) gets a 206. When MediaCache holds a body
+    // in memory it is sent instead of reading the file.
+    //
+    // GET/HEAD /metrics answers with the Prometheus text rendering of the
+    // metrics registry (Metrics.h).
+    // ---------------------------------------------------------------------------
+    class MediaHttpSession : public std::enable_shared_from_this<MediaHttpSession> {
+    public:
+        struct Stats {
+            std::atomic<uint64_t> connections{ 0 };   // currently open
+            std::atomic<uint64_t> requests{ 0 };
+            std::atomic<uint64_t> bodyBytes{ 0 };
+            std::atomic<uint64_t> errors{ 0 };        // 4xx/5xx responses
+        };
+        static Stats& GetStats();
+
+        explicit MediaHttpSession(asio::ip::tcp::socket socket);
+        ~MediaHttpSession();
+
+        void Start();
+
+    private:
+        static constexpr size_t kReadChunk = 4 * 1024;
+        static constexpr size_t kMaxHeaderBytes = 8 * 1024;
+        static constexpr size_t kChunkSize = 64 * 1024;        // streaming fallback / sendfile slice
+        static constexpr auto   kIdleTimeout = std::chrono::seconds(30);
+
+        void ReadRequest();
+        void HandleRequest(std::string_view head);
+        void ServeMetrics(bool headOnly);
+        void SendError(int status, std::string_view reason, bool keepAlive);
+        void SendHeaderThen(std::string header, bool sendBody);
+        void SendBody();
+        void FinishResponse();
+        void CloseFile();
+        void Close();
+
+        void Touch() { m_Deadline = std::chrono::steady_clock::now() + kIdleTimeout; }
+        void WatchDeadline();
+
+        asio::ip::tcp::socket                     m_Socket;
+        asio::strand<asio::any_io_executor>       m_Strand;
+        asio::steady_timer                        m_Timer;
+        std::chrono::steady_clock::time_point     m_Deadline;
+
+        std::string                  m_In;        // received, not yet parsed
+        std::array<char, kReadChunk> m_ReadBuf;
+        std::string                  m_OutHeader;
+        bool                         m_KeepAlive = true;
+
+        // Body of the response in progress: a cached copy from MediaCache, or
+        // the open file.
+        std::shared_ptr<const std::string> m_MemBody;
+#if defined(__linux__)
+        int                         m_FileFd = -1;
+        bool                        m_Corked = false;
+#else
+        std::ifstream               m_File;
+        std::vector<char>           m_Chunk;
+#endif
+        uint64_t                    m_FileOffset = 0;
+        uint64_t                    m_FileRemaining = 0;
+    };
+
+} // namespace TalkMe
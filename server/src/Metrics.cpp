@@ -0,0 +1,202 @@
+#include "Metrics.h"
+#include <bit>
+#include <cstdio>
+
+namespace TalkMe {
+
+    namespace {
+        // Prometheus `le` bounds, in nanoseconds. The HDR buckets are folded
+        // into these at scrape time; a bucket counts towards a bound once
+        // every value it can hold is within it.
+        constexpr uint64_t kLeBoundsNs[] = {
+            1'000, 2'500, 5'000, 10'000, 25'000, 50'000, 100'000, 250'000, 500'000,
+            1'000'000, 2'500'000, 5'000'000, 10'000'000, 25'000'000, 50'000'000,
+            100'000'000, 250'000'000, 500'000'000, 1'000'000'000, 2'500'000'000,
+            5'000'000'000, 10'000'000'000 };
+
+        void AppendNumber(std::string& out, double v) {
+            char buf[32];
+            const int n = std::snprintf(buf, sizeof(buf), "%.9g", v);
+            out.append(buf, static_cast<size_t>(n));
+        }
+
+        void AppendHeader(std::string& out, const std::string& name, const std::string& help, const char* type) {
+            out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+            out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+        }
+
+        // name{labels} / name{labels,extra}
+        void AppendSeries(std::string& out, const std::string& name, const char* suffix,
+                          const std::string& labels, std::string_view extra = {}) {
+            out += name;
+            out += suffix;
+            if (!labels.empty() || !extra.empty()) {
+                out += '{';
+                out += labels;
+                if (!labels.empty() && !extra.empty()) out += ',';
+                out += extra;
+                out += '}';
+            }
+            out += ' ';
+        }
+    }
+
+    uint64_t Counter::Value() const noexcept {
+        uint64_t sum = 0;
+        for (const auto& cell : m_Cells) sum += cell.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    Histogram::~Histogram() {
+        for (auto& shard : m_Shards) delete shard.load(std::memory_order_relaxed);
+    }
+
+    size_t Histogram::BucketOf(uint64_t ns) noexcept {
+        if (ns < (uint64_t{ 1 } << kSubBits)) return static_cast<size_t>(ns);
+        const int exp = std::bit_width(ns) - 1;
+        if (exp >= kMaxBits) return kBuckets - 1;
+        const size_t sub = static_cast<size_t>(ns >> (exp - kSubBits)) & ((size_t{ 1 } << kSubBits) - 1);
+        return (static_cast<size_t>(exp - kSubBits + 1) << kSubBits) + sub;
+    }
+
+    uint64_t Histogram::BucketMax(size_t bucket) noexcept {
+        if (bucket < (size_t{ 1 } << kSubBits)) return bucket;
+        if (bucket == kBuckets - 1) return UINT64_MAX;
+        const int exp = static_cast<int>(bucket >> kSubBits) + kSubBits - 1;
+        const uint64_t sub = bucket & ((size_t{ 1 } << kSubBits) - 1);
+        const uint64_t lowest = ((uint64_t{ 1 } << kSubBits) + sub) << (exp - kSubBits);
+        return lowest + (uint64_t{ 1 } << (exp - kSubBits)) - 1;
+    }
+
+    Histogram::Shard* Histogram::AllocShard(size_t shard) noexcept {
+        auto* fresh = new Shard();
+        Shard* expected = nullptr;
+        // Two threads sharing a slot may race here; the loser uses the winner's.
+        if (m_Shards[shard].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
+            return fresh;
+        delete fresh;
+        return expected;
+    }
+
+    void Histogram::Observe(uint64_t ns) noexcept {
+        const size_t slot = metrics_detail::ThreadShard();
+        Shard* shard = m_Shards[slot].load(std::memory_order_acquire);
+        if (!shard) shard = AllocShard(slot);
+        shard->buckets[BucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+        shard->sumNs.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    Histogram::Snapshot Histogram::Read() const {
+        Snapshot snap;
+        for (const auto& slot : m_Shards) {
+            const Shard* shard = slot.load(std::memory_order_acquire);
+            if (!shard) continue;
+            for (size_t b = 0; b < kBuckets; ++b) {
+                const uint64_t n = shard->buckets[b].load(std::memory_order_relaxed);
+                snap.buckets[b] += n;
+                snap.count += n;
+            }
+            snap.sumNs += shard->sumNs.load(std::memory_order_relaxed);
+        }
+        return snap;
+    }
+
+    Metrics& Metrics::Get() {
+        static Metrics m;
+        return m;
+    }
+
+    Counter& Metrics::GetCounter(std::string_view name, std::string_view help, std::string labels) {
+        std::lock_guard lock(m_Mutex);
+        auto it = m_Counters.find(name);
+        if (it == m_Counters.end()) it = m_Counters.emplace(std::string(name), Family<Counter*>{ std::string(help), {} }).first;
+        auto& series = it->second.series[std::move(labels)];
+        if (!series) series = &m_OwnedCounters.emplace_back();
+        return *series;
+    }
+
+    Histogram& Metrics::GetHistogram(std::string_view name, std::string_view help, std::string labels) {
+        std::lock_guard lock(m_Mutex);
+        auto it = m_Histograms.find(name);
+        if (it == m_Histograms.end()) it = m_Histograms.emplace(std::string(name), Family<Histogram*>{ std::string(help), {} }).first;
+        auto& series = it->second.series[std::move(labels)];
+        if (!series) series = &m_OwnedHistograms.emplace_back();
+        return *series;
+    }
+
+    void Metrics::AddCounter(std::string_view name, std::string_view help, Counter& counter, std::string labels) {
+        std::lock_guard lock(m_Mutex);
+        auto it = m_Counters.find(name);
+        if (it == m_Counters.end()) it = m_Counters.emplace(std::string(name), Family<Counter*>{ std::string(help), {} }).first;
+        it->second.series[std::move(labels)] = &counter;
+    }
+
+    void Metrics::AddGauge(std::string_view name, std::string_view help, std::function<double()> read,
+        std::string labels)
+    {
+        std::lock_guard lock(m_Mutex);
+        auto it = m_Gauges.find(name);
+        if (it == m_Gauges.end()) it = m_Gauges.emplace(std::string(name), Family<std::function<double()>>{ std::string(help), {} }).first;
+        it->second.series[std::move(labels)] = std::move(read);
+    }
+
+    std::string Metrics::RenderPrometheus() const {
+        std::string out;
+        out.reserve(64 * 1024);
+
+        // Gauges may take other locks (the room mutex); they run without ours.
+        decltype(m_Gauges) gauges;
+        {
+            std::lock_guard lock(m_Mutex);
+            gauges = m_Gauges;
+        }
+        for (const auto& [name, family] : gauges) {
+            AppendHeader(out, name, family.help, "gauge");
+            for (const auto& [labels, read] : family.series) {
+                AppendSeries(out, name, "", labels);
+                AppendNumber(out, read());
+                out += '\n';
+            }
+        }
+
+        std::lock_guard lock(m_Mutex);
+
+        for (const auto& [name, family] : m_Counters) {
+            AppendHeader(out, name, family.help, "counter");
+            for (const auto& [labels, counter] : family.series) {
+                AppendSeries(out, name, "", labels);
+                out += std::to_string(counter->Value());
+                out += '\n';
+            }
+        }
+
+        for (const auto& [name, family] : m_Histograms) {
+            AppendHeader(out, name, family.help, "histogram");
+            for (const auto& [labels, hist] : family.series) {
+                const auto snap = hist->Read();
+                uint64_t cumulative = 0;
+                size_t bucket = 0;
+                char le[40];
+                for (const uint64_t bound : kLeBoundsNs) {
+                    while (bucket < Histogram::kBuckets && Histogram::BucketMax(bucket) <= bound)
+                        cumulative += snap.buckets[bucket++];
+                    std::snprintf(le, sizeof(le), "le=\"%g\"", static_cast<double>(bound) / 1e9);
+                    AppendSeries(out, name, "_bucket", labels, le);
+                    out += std::to_string(cumulative);
+                    out += '\n';
+                }
+                AppendSeries(out, name, "_bucket", labels, "le=\"+Inf\"");
+                out += std::to_string(snap.count);
+                out += '\n';
+                AppendSeries(out, name, "_sum", labels);
+                AppendNumber(out, static_cast<double>(snap.sumNs) / 1e9);
+                out += '\n';
+                AppendSeries(out, name, "_count", labels);
+                out += std::to_string(snap.count);
+                out += '\n';
+            }
+        }
+        return out;
+    }
+
+} // namespace TalkMe
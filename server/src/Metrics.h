@@ -0,0 +1,143 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // In-process metrics, rendered in the Prometheus text format (/metrics on
+    // the media HTTP port).
+    //
+    // Hot paths only ever touch their own thread's shard: every thread is
+    // given one of kShards slots on first use and counters and histograms
+    // keep one cache line (or one bucket array) per slot, bumped with relaxed
+    // atomics. Threads beyond kShards share slots, which stays correct, just
+    // no longer uncontended. Reads sum the shards and are only approximately
+    // consistent with each other, which a scrape does not care about.
+    //
+    // Series are registered once, by name and a pre-rendered label set
+    // (`method="GetFriendNames"`), and live as long as the process; callers
+    // keep the returned reference instead of looking it up again.
+    // ---------------------------------------------------------------------------
+    namespace metrics_detail {
+        constexpr size_t kShards = 16;
+
+        inline size_t ThreadShard() noexcept {
+            static std::atomic<size_t> next{ 0 };
+            thread_local const size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+            return shard;
+        }
+    }
+
+    class Counter {
+    public:
+        void Add(uint64_t n = 1) noexcept {
+            m_Cells[metrics_detail::ThreadShard()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+        uint64_t Value() const noexcept;
+
+    private:
+        struct alignas(64) Cell { std::atomic<uint64_t> value{ 0 }; };
+        std::array<Cell, metrics_detail::kShards> m_Cells;
+    };
+
+    // HDR-style latency histogram over nanoseconds: log-linear buckets with
+    // 2^kSubBits sub-buckets per power of two, so any recorded value is known
+    // to within 12.5% from 8 ns up to ~18 minutes (larger values land in the
+    // last bucket). A thread's bucket array is allocated on its first sample.
+    class Histogram {
+    public:
+        static constexpr int    kSubBits = 3;
+        static constexpr int    kMaxBits = 40;
+        static constexpr size_t kBuckets = size_t{ kMaxBits - kSubBits + 1 } << kSubBits;
+
+        Histogram() = default;
+        ~Histogram();
+        Histogram(const Histogram&) = delete;
+        Histogram& operator=(const Histogram&) = delete;
+
+        void Observe(uint64_t ns) noexcept;
+        void ObserveSince(std::chrono::steady_clock::time_point start) noexcept {
+            Observe(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count()));
+        }
+
+        static size_t   BucketOf(uint64_t ns) noexcept;
+        // Largest value that lands in `bucket`.
+        static uint64_t BucketMax(size_t bucket) noexcept;
+
+        // Summed over all shards.
+        struct Snapshot {
+            std::array<uint64_t, kBuckets> buckets{};
+            uint64_t count = 0;
+            uint64_t sumNs = 0;
+        };
+        Snapshot Read() const;
+
+    private:
+        struct alignas(64) Shard {
+            std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+            std::atomic<uint64_t> sumNs{ 0 };
+        };
+        Shard* AllocShard(size_t shard) noexcept;
+
+        std::array<std::atomic<Shard*>, metrics_detail::kShards> m_Shards{};
+    };
+
+    // Records the time from construction to destruction.
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Histogram& hist) : m_Hist(hist), m_Start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() { m_Hist.ObserveSince(m_Start); }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Histogram& m_Hist;
+        std::chrono::steady_clock::time_point m_Start;
+    };
+
+    class Metrics {
+    public:
+        static Metrics& Get();
+
+        // Get-or-create. `help` is taken from the first registration of a name.
+        Counter&   GetCounter(std::string_view name, std::string_view help, std::string labels = {});
+        Histogram& GetHistogram(std::string_view name, std::string_view help, std::string labels = {});
+        // Exposes a counter owned elsewhere, which must live as long as the process.
+        void AddCounter(std::string_view name, std::string_view help, Counter& counter,
+                        std::string labels = {});
+        // Sampled at scrape time, on the scraping thread, without the
+        // registry's lock held.
+        void AddGauge(std::string_view name, std::string_view help, std::function<double()> read,
+                      std::string labels = {});
+
+        std::string RenderPrometheus() const;
+
+    private:
+        Metrics() = default;
+
+        template <typename T>
+        struct Family {
+            std::string help;
+            std::map<std::string, T> series;   // by label set
+        };
+
+        mutable std::mutex                                                  m_Mutex;
+        std::deque<Counter>                                                 m_OwnedCounters;
+        std::deque<Histogram>                                               m_OwnedHistograms;
+        std::map<std::string, Family<Counter*>, std::less<>>                m_Counters;
+        std::map<std::string, Family<Histogram*>, std::less<>>              m_Histograms;
+        std::map<std::string, Family<std::function<double()>>, std::less<>> m_Gauges;
+    };
+
+} // namespace TalkMe
@@ -0,0 +1,69 @@
+#include "PresenceHub.h"
+
+namespace TalkMe {
+
+    PresenceHub::Stats& PresenceHub::GetStats() {
+        static Stats s;
+        return s;
+    }
+
+    void PresenceHub::Queue(uint32_t userId, const std::string& user, std::optional<bool> online,
+        std::optional<std::string> status, std::span<const int> servers,
+        bool toFriends, std::span<const uint32_t> alsoTo)
+    {
+        if (userId == 0) return;
+        auto& stats = GetStats();
+        stats.changes.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto [it, isNew] = m_Pending.try_emplace(userId);
+        Change& change = it->second;
+        if (isNew) {
+            change.userId = userId;
+            change.user = user;
+        }
+        else {
+            stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (online) change.online = online;
+        if (status) change.status = std::move(status);
+        change.servers.insert(servers.begin(), servers.end());
+        change.users.insert(alsoTo.begin(), alsoTo.end());
+        if (toFriends) {
+            if (auto f = m_Friends.find(userId); f != m_Friends.end())
+                change.users.insert(f->second.begin(), f->second.end());
+        }
+    }
+
+    std::vector<PresenceHub::Change> PresenceHub::Take() {
+        std::vector<Change> out;
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        out.reserve(m_Pending.size());
+        for (auto& [_, change] : m_Pending) out.push_back(std::move(change));
+        m_Pending.clear();
+        return out;
+    }
+
+    void PresenceHub::SetFriends(uint32_t userId, std::vector<uint32_t> friends) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Friends[userId] = std::unordered_set<uint32_t>(friends.begin(), friends.end());
+    }
+
+    void PresenceHub::ForgetUser(uint32_t userId) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Friends.erase(userId);
+    }
+
+    void PresenceHub::AddFriendship(uint32_t a, uint32_t b) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (auto it = m_Friends.find(a); it != m_Friends.end()) it->second.insert(b);
+        if (auto it = m_Friends.find(b); it != m_Friends.end()) it->second.insert(a);
+    }
+
+    void PresenceHub::RemoveFriendship(uint32_t a, uint32_t b) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (auto it = m_Friends.find(a); it != m_Friends.end()) it->second.erase(b);
+        if (auto it = m_Friends.find(b); it != m_Friends.end()) it->second.erase(a);
+    }
+
+} // namespace TalkMe
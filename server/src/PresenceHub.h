@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // Pending presence and status changes, and the friend lists that scope them.
+    //
+    // A change is not sent when it happens. Queue() records the user's latest
+    // online state and status text together with who should hear of it: the
+    // servers the user is a member of and, optionally, its friends. Later
+    // changes of the same user overwrite the state and widen the audience.
+    // Every kPresenceBatchMs TalkMeServer takes the lot and resolves the
+    // audience to the sessions online at that moment, so a login storm costs
+    // one packet per session and interval instead of one per login. Server
+    // members that came online after the user did are not told it is online:
+    // their Member_List already shows it.
+    //
+    // Friend lists are kept for online users only, as interned user ids.
+    //
+    // All calls are made with TalkMeServer's room mutex held (any mode) or
+    // without it; the hub's own mutex is taken after it.
+    // ---------------------------------------------------------------------------
+    class PresenceHub {
+    public:
+        struct Stats {
+            std::atomic<uint64_t> changes{ 0 };         // Queue() calls
+            std::atomic<uint64_t> coalesced{ 0 };       // changes merged into one already pending
+            std::atomic<uint64_t> flushes{ 0 };         // intervals that had changes
+            std::atomic<uint64_t> batches{ 0 };         // Presence_Batch packets sent
+            std::atomic<uint64_t> legacyPackets{ 0 };   // Presence_Update / Status_Update sent
+            std::atomic<uint64_t> deltas{ 0 };          // changes delivered, summed over sessions
+        };
+        static Stats& GetStats();
+
+        struct Change {
+            uint32_t                userId = 0;
+            std::string             user;
+            std::optional<bool>     online;
+            std::optional<std::string> status;
+            std::set<int>           servers;   // members of these servers hear of it
+            std::set<uint32_t>      users;     // and these users
+        };
+
+        // Records a change of `userId`; `online` and `status` left empty are
+        // not part of it. With `toFriends` the user's friends hear of it too.
+        void Queue(uint32_t userId, const std::string& user, std::optional<bool> online,
+                   std::optional<std::string> status, std::span<const int> servers,
+                   bool toFriends, std::span<const uint32_t> alsoTo = {});
+        // Takes every pending change.
+        std::vector<Change> Take();
+
+        // `userId` came online with these friends.
+        void SetFriends(uint32_t userId, std::vector<uint32_t> friends);
+        // `userId` went offline.
+        void ForgetUser(uint32_t userId);
+        void AddFriendship(uint32_t a, uint32_t b);
+        void RemoveFriendship(uint32_t a, uint32_t b);
+
+    private:
+        std::mutex                                                  m_Mutex;
+        std::unordered_map<uint32_t, Change>                        m_Pending;
+        std::unordered_map<uint32_t, std::unordered_set<uint32_t>>  m_Friends;
+    };
+
+} // namespace TalkMe
@@ -107,11 +107,13 @@ namespace TalkMe {
         Message_Delete,
         Message_Pin_Update,
         Message_History_Response,
-        File_Transfer_Request,
+        File_Transfer_Request,  // Client -> Server: {"filename","size"[,"sha256"][,"window":1][,"resume":"<id>"]}
+                                // (sha256 enables dedup / instant upload)
         File_Transfer_Chunk,
-        File_Transfer_Complete,
-        Media_Request,
-        Media_Response,
+        File_Transfer_Complete, // Server -> Client: {"action","id"[,"offset"]}, action one of
+                                // upload_approved | upload_exists | upload_finished | upload_failed
+        Media_Request,       // Client -> Server: request attachment by id (JSON {"id":"<id>"[,"stream":1][,"size":N]})
+        Media_Response,      // Server -> Client: attachment data (JSON {"id":"<id>","data":"<base64>"}) or stream header
 
         Voice_Data,          // DEPRECATED
         Voice_Data_Opus,
@@ -206,6 +208,7 @@ namespace TalkMe {
 
         // --- PAGINATION ---
         Message_History_Page,// Client -> Server: request older messages (before_id)
+        Message_History_Around, // Client -> Server: request messages around anchor (cid, anchor, before, after)
 
         // --- EPHEMERAL ---
         Set_Disappearing,    // Client -> Server: set disappearing duration for channel
@@ -237,9 +240,60 @@ namespace TalkMe {
 
         // --- DIAGNOSTIC ---
         Echo_Request,
-        Echo_Response
+        Echo_Response,
+
+        // --- STREAMED MEDIA ---
+        Media_Chunk,         // Server -> Client: [u32 tid][u32 offset][bytes] slice of a streamed attachment
+        Media_Ack,           // Client -> Server: [u32 tid][u32 bytes received] flow-control credit
+        File_Transfer_Ack,   // Server -> Client: [u32 bytes stored] windowed upload credit
+
+        // --- SCREEN SHARE SUBSCRIPTIONS ---
+        Screen_Share_Watch,  // Client -> Server: {"u":["<sharer>",...]} every stream watched in the voice channel
+        Screen_Share_Viewers,// Server -> Client: {"n":<viewers>} to a sharer; nobody watches while 0
+
+        // --- PRESENCE ---
+        Presence_Batch,      // Server -> Client: [{"u","online"?,"status"?},...] changes since the last batch
+
+        // --- STREAMED MEDIA (cont.) ---
+        Media_Cancel         // Client -> Server: [u32 tid] stop sending a streamed attachment
     };
 
+    // Streamed Media_Request: after a Media_Response header
+    // {"id","tid","size","stream":1} the server sends Media_Chunk packets in
+    // order while fewer than kMediaStreamWindow bytes are unacknowledged.
+    // The client returns a Media_Ack at least every kMediaStreamAckBytes,
+    // and a Media_Cancel for a transfer it gave up on.
+    // Integers in these bodies are big-endian.
+    constexpr uint32_t kMediaStreamWindow = 256 * 1024;
+    constexpr uint32_t kMediaStreamAckBytes = 64 * 1024;
+
+    // "size" (here or ?size= on the media port) asks for an image scaled to
+    // that longest edge; the header then carries "preview":1. Until the
+    // server has generated one, or for non-images, the original is sent.
+    constexpr int kAttachmentPreviewSize = 480;
+
+    // Windowed upload (File_Transfer_Request with "window":1): every
+    // File_Transfer_Chunk starts with [u32 offset], chunks may arrive in any
+    // order, and File_Transfer_Ack reports how long the prefix already on disk
+    // is. The client keeps at most kUploadWindow bytes past it unacknowledged.
+    // After a reconnect, "resume":"<id>" continues from that prefix; the
+    // upload_approved reply carries it as "offset".
+    constexpr uint32_t kUploadWindow = 512 * 1024;
+    constexpr uint32_t kUploadChunkSize = 64 * 1024;
+    constexpr uint32_t kUploadAckBytes = 128 * 1024;
+
+    // Screen share subscriptions: Screen_Share_Frame goes only to voice
+    // channel members whose last Screen_Share_Watch names the sharer, and to
+    // clients that never sent one. The sharer is told how many that is
+    // (Screen_Share_Viewers) and sends keyframes only while it is 0.
+
+    // Presence and status changes are collected and sent every
+    // kPresenceBatchMs, only to sessions that share a server with the user or
+    // are its friends. A client that sent "presence_batch":1 when logging in
+    // gets one Presence_Batch per interval; others get the changes as
+    // individual Presence_Update / Status_Update packets.
+    constexpr int kPresenceBatchMs = 250;
+
     enum Permissions : uint32_t {
         Perm_None = 0,
         Perm_Delete_Messages = 1 << 0,
@@ -291,6 +345,50 @@ namespace TalkMe {
             estimatedRttMs = NetToHost32(estimatedRttMs);
         }
     };
+
+    // Prefix of a Media_Chunk body; the slice bytes follow.
+    struct MediaChunkHeader {
+        uint32_t transferId;
+        uint32_t offset;
+
+        void ToNetwork() {
+            transferId = HostToNet32(transferId);
+            offset = HostToNet32(offset);
+        }
+        void ToHost() {
+            transferId = NetToHost32(transferId);
+            offset = NetToHost32(offset);
+        }
+    };
+
+    struct MediaAckPayload {
+        uint32_t transferId;
+        uint32_t bytesReceived;
+
+        void ToNetwork() {
+            transferId = HostToNet32(transferId);
+            bytesReceived = HostToNet32(bytesReceived);
+        }
+        void ToHost() {
+            transferId = NetToHost32(transferId);
+            bytesReceived = NetToHost32(bytesReceived);
+        }
+    };
+
+    // Prefix of a windowed File_Transfer_Chunk body; the bytes follow.
+    struct UploadChunkHeader {
+        uint32_t offset;
+
+        void ToNetwork() { offset = HostToNet32(offset); }
+        void ToHost() { offset = NetToHost32(offset); }
+    };
+
+    struct UploadAckPayload {
+        uint32_t bytesStored;
+
+        void ToNetwork() { bytesStored = HostToNet32(bytesStored); }
+        void ToHost() { bytesStored = NetToHost32(bytesStored); }
+    };
 #pragma pack(pop)
 
 } // namespace TalkMe
@@ -0,0 +1,244 @@
+#include "ScreenShareRelay.h"
+#include "ChatSession.h"
+#include "Protocol.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace TalkMe {
+
+    namespace {
+        constexpr uint8_t kFramePrefix = 0xA5;
+        constexpr uint8_t kCodecH264 = 1;
+
+        // NAL unit types (H.264 table 7-1).
+        constexpr uint8_t kNalSlice = 1;
+        constexpr uint8_t kNalIdrSlice = 5;
+        constexpr uint8_t kNalSps = 7;
+        constexpr uint8_t kNalPps = 8;
+
+        // Offset of the next 00 00 01 at or after `from`, or b.size().
+        size_t NextStartCode(std::span<const uint8_t> b, size_t from) {
+            for (size_t i = from; i + 2 < b.size(); ++i) {
+                if (b[i + 2] > 1) { i += 2; continue; }
+                if (b[i] == 0 && b[i + 1] == 0 && b[i + 2] == 1) return i;
+            }
+            return b.size();
+        }
+    }
+
+    ScreenShareRelay::Stats& ScreenShareRelay::GetStats() {
+        static Stats s;
+        return s;
+    }
+
+    ScreenShareRelay::FrameInfo ScreenShareRelay::Inspect(std::span<const uint8_t> body) {
+        FrameInfo info;
+        if (body.size() >= 3 && body[0] == kFramePrefix) {
+            const size_t headerLen = 3 + ((static_cast<size_t>(body[1]) << 8) | body[2]);
+            if (headerLen < body.size()) info.payloadOffset = headerLen;
+        }
+        if (info.payloadOffset >= body.size() || body[info.payloadOffset] != kCodecH264) {
+            // JPEG frames stand alone.
+            info.keyframe = true;
+            return info;
+        }
+
+        const auto bs = body.subspan(info.payloadOffset + 1);
+        size_t sc = NextStartCode(bs, 0);
+        while (sc < bs.size()) {
+            const size_t begin = (sc > 0 && bs[sc - 1] == 0) ? sc - 1 : sc;   // 4-byte start code
+            const size_t nal = sc + 3;
+            if (nal >= bs.size()) break;
+            const uint8_t type = bs[nal] & 0x1F;
+            if (type >= kNalSlice && type <= kNalIdrSlice) {
+                info.keyframe = type == kNalIdrSlice;
+                break;
+            }
+            const size_t next = NextStartCode(bs, nal);
+            size_t end = next;
+            if (next < bs.size() && end > nal && bs[end - 1] == 0) --end;
+            if (type == kNalSps) info.sps = bs.subspan(begin, end - begin);
+            else if (type == kNalPps) info.pps = bs.subspan(begin, end - begin);
+            sc = next;
+        }
+        return info;
+    }
+
+    std::shared_ptr<std::vector<uint8_t>> ScreenShareRelay::BuildKeyframe(const Share& share,
+        std::span<const uint8_t> body, const FrameInfo& info)
+    {
+        // [prefix + codec][SPS][PPS][rest of the bitstream], with only the
+        // parameter sets the frame lacks taken from the cache. A missing PPS
+        // goes right after the frame's own SPS.
+        const size_t split = info.payloadOffset + 1;
+        std::span<const uint8_t> sps, pps;
+        size_t ppsAt = split;
+        if (info.sps.empty()) sps = share.sps;
+        if (info.pps.empty()) {
+            pps = share.pps;
+            if (!info.sps.empty()) ppsAt = static_cast<size_t>(info.sps.data() + info.sps.size() - body.data());
+        }
+        const size_t bodySize = body.size() + sps.size() + pps.size();
+        PacketHeader h{ PacketType::Screen_Share_Frame, static_cast<uint32_t>(bodySize) };
+        h.ToNetwork();
+        auto buf = std::make_shared<std::vector<uint8_t>>();
+        buf->reserve(sizeof(h) + bodySize);
+        const auto* hp = reinterpret_cast<const uint8_t*>(&h);
+        buf->insert(buf->end(), hp, hp + sizeof(h));
+        buf->insert(buf->end(), body.begin(), body.begin() + split);
+        buf->insert(buf->end(), sps.begin(), sps.end());
+        buf->insert(buf->end(), body.begin() + split, body.begin() + ppsAt);
+        buf->insert(buf->end(), pps.begin(), pps.end());
+        buf->insert(buf->end(), body.begin() + ppsAt, body.end());
+        return buf;
+    }
+
+    bool ScreenShareRelay::Wants(const Share& share, const ChatSession* viewer) const {
+        return !m_Watching.contains(viewer) || share.watchers.contains(viewer);
+    }
+
+    void ScreenShareRelay::ReportViewers(Share& share, const ChatSession* sharer, int viewers, const Members& members) {
+        if (viewers == share.reportedViewers) return;
+        auto it = std::find_if(members.begin(), members.end(), [sharer](const auto& s) { return s.get() == sharer; });
+        if (it == members.end()) return;
+        const std::string body = nlohmann::json{ {"n", viewers} }.dump();
+        PacketHeader h{ PacketType::Screen_Share_Viewers, static_cast<uint32_t>(body.size()) };
+        h.ToNetwork();
+        auto buf = std::make_shared<std::vector<uint8_t>>(sizeof(h) + body.size());
+        std::memcpy(buf->data(), &h, sizeof(h));
+        std::memcpy(buf->data() + sizeof(h), body.data(), body.size());
+        if ((*it)->SendShared(std::move(buf), false)) share.reportedViewers = viewers;
+    }
+
+    size_t ScreenShareRelay::Relay(const ChatSession* sharer, std::span<const uint8_t> body,
+        const std::shared_ptr<std::vector<uint8_t>>& packet, const Members& members)
+    {
+        auto& stats = GetStats();
+        const FrameInfo info = Inspect(body);
+        const auto now = std::chrono::steady_clock::now();
+        size_t relayed = 0;
+        int audience = 0;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        Share& share = m_Shares[sharer];
+        if (!info.sps.empty()) share.sps.assign(info.sps.begin(), info.sps.end());
+        if (!info.pps.empty()) share.pps.assign(info.pps.begin(), info.pps.end());
+        stats.frames.fetch_add(1, std::memory_order_relaxed);
+        if (info.keyframe) {
+            const bool complete = (!info.sps.empty() && !info.pps.empty()) || share.sps.empty() || share.pps.empty();
+            share.keyframe = complete ? packet : BuildKeyframe(share, body, info);
+            stats.keyframes.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        for (const auto& s : members) {
+            if (s.get() == sharer) continue;
+            if (!Wants(share, s.get())) {
+                stats.unwatched.fetch_add(1, std::memory_order_relaxed);
+                stats.unwatchedBytes.fetch_add(packet->size(), std::memory_order_relaxed);
+                continue;
+            }
+            ++audience;
+            auto [it, isNew] = share.viewers.try_emplace(s.get());
+            Viewer& v = it->second;
+            if (info.keyframe) {
+                v.live = s->SendShared(packet, true);
+                if (v.live) {
+                    ++relayed;
+                }
+                else {
+                    v.waitingSince = now;
+                    stats.dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+                continue;
+            }
+            if (isNew) {
+                v.waitingSince = now;
+                if (share.keyframe && s->SendShared(share.keyframe, true))
+                    stats.fastStarts.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if (!v.live && now - v.waitingSince >= kResyncTimeout) {
+                v.live = true;
+                stats.resyncTimeouts.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (!v.live) {
+                stats.withheld.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (s->SendShared(packet, true)) {
+                ++relayed;
+            }
+            else {
+                v.live = false;
+                v.waitingSince = now;
+                stats.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        ReportViewers(share, sharer, audience, members);
+        return relayed;
+    }
+
+    void ScreenShareRelay::SetWatched(const std::shared_ptr<ChatSession>& viewer,
+        const std::vector<const ChatSession*>& sharers, const Members& members)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto& watching = m_Watching[viewer.get()];
+        for (const ChatSession* sharer : watching) {
+            if (std::find(sharers.begin(), sharers.end(), sharer) != sharers.end()) continue;
+            if (auto it = m_Shares.find(sharer); it != m_Shares.end())
+                it->second.watchers.erase(viewer.get());
+        }
+        for (const ChatSession* sharer : sharers) {
+            Share& share = m_Shares[sharer];
+            if (!share.watchers.insert(viewer.get()).second) continue;
+            // Newly watched: the cached keyframe gives a picture right away.
+            if (share.keyframe && !share.viewers.contains(viewer.get()) && viewer->SendShared(share.keyframe, true)) {
+                share.viewers[viewer.get()] = Viewer{ false, now };
+                GetStats().fastStarts.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        watching = sharers;
+
+        // Subscribing for the first time also unsubscribes from every other
+        // share, so every share in the channel may have a new audience.
+        for (const auto& sharer : members) {
+            auto it = m_Shares.find(sharer.get());
+            if (it == m_Shares.end()) continue;
+            Share& share = it->second;
+            if (!Wants(share, viewer.get())) share.viewers.erase(viewer.get());
+            int audience = 0;
+            for (const auto& s : members)
+                if (s != sharer && Wants(share, s.get())) ++audience;
+            ReportViewers(share, sharer.get(), audience, members);
+        }
+    }
+
+    void ScreenShareRelay::EndShare(const ChatSession* sharer) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto it = m_Shares.find(sharer);
+        if (it == m_Shares.end()) return;
+        Share& share = it->second;
+        share.keyframe.reset();
+        share.sps.clear();
+        share.pps.clear();
+        share.viewers.clear();
+        share.reportedViewers = -1;
+        if (share.watchers.empty()) m_Shares.erase(it);
+    }
+
+    void ScreenShareRelay::ForgetSession(const ChatSession* session) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Shares.erase(session);
+        if (auto it = m_Watching.find(session); it != m_Watching.end()) {
+            for (const ChatSession* sharer : it->second)
+                if (auto sh = m_Shares.find(sharer); sh != m_Shares.end()) sh->second.watchers.erase(session);
+            m_Watching.erase(it);
+        }
+        for (auto& [sharer, share] : m_Shares)
+            share.viewers.erase(session);
+        for (auto& [viewer, sharers] : m_Watching)
+            std::erase(sharers, session);
+    }
+
+} // namespace TalkMe
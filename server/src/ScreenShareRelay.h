@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace TalkMe {
+
+    class ChatSession;
+
+    // ---------------------------------------------------------------------------
+    // Screen_Share_Frame fan-out with subscriptions and a keyframe cache.
+    //
+    // Frame body: [0xA5][u16 BE name length][sharer name][codec][bitstream],
+    // codec 1 being H.264 in Annex B form and anything else (JPEG) stateless.
+    //
+    // Subscriptions: a voice channel member that has sent Screen_Share_Watch
+    // receives the frames of the shares it named and no others. Members that
+    // never sent one are older clients and receive every share, as before.
+    // Whenever the number of members a share reaches changes, its sharer gets
+    // Screen_Share_Viewers so it can stop sending deltas nobody receives.
+    //
+    // Keyframes: for every share the latest H.264 keyframe is kept as a
+    // ready-made packet, with the sequence and picture parameter sets
+    // prepended when the encoder sent them separately. Each viewer of a share
+    // is either live (gets every frame) or waiting for a keyframe. A viewer
+    // new to the share is sent the cached keyframe at once, so it has a
+    // picture before the next real one arrives, and then waits. A viewer
+    // whose bulk lane dropped a frame waits as well: the deltas that follow
+    // would only decode to garbage. Keyframes go to everyone and make their
+    // receivers live. If none comes within kResyncTimeout the viewer is let
+    // through anyway.
+    //
+    // All calls are made with TalkMeServer's room mutex held; the relay has
+    // its own mutex, taken after it.
+    // ---------------------------------------------------------------------------
+    class ScreenShareRelay {
+    public:
+        static constexpr std::chrono::milliseconds kResyncTimeout{ 3000 };
+        static constexpr size_t kMaxWatched = 16;   // shares one Screen_Share_Watch may name
+
+        struct Stats {
+            std::atomic<uint64_t> frames{ 0 };
+            std::atomic<uint64_t> keyframes{ 0 };
+            std::atomic<uint64_t> fastStarts{ 0 };      // cached keyframes sent to new viewers
+            std::atomic<uint64_t> withheld{ 0 };        // deltas not sent to waiting viewers
+            std::atomic<uint64_t> dropped{ 0 };         // frames a viewer's lane refused
+            std::atomic<uint64_t> resyncTimeouts{ 0 };  // viewers let through without a keyframe
+            std::atomic<uint64_t> unwatched{ 0 };       // frames not sent to members not watching
+            std::atomic<uint64_t> unwatchedBytes{ 0 };
+        };
+        static Stats& GetStats();
+
+        struct FrameInfo {
+            bool keyframe = false;
+            size_t payloadOffset = 0;                  // codec byte
+            std::span<const uint8_t> sps, pps;         // with start codes; empty if absent
+        };
+        // Keyframe and parameter sets of a frame body. Only the NAL units ahead
+        // of the first slice are looked at.
+        static FrameInfo Inspect(std::span<const uint8_t> body);
+
+        using Members = std::set<std::shared_ptr<ChatSession>>;
+
+        // Sends `packet` (header + body) from `sharer` to the members of its
+        // voice channel that watch it. Returns how many it was queued for.
+        size_t Relay(const ChatSession* sharer, std::span<const uint8_t> body,
+                     const std::shared_ptr<std::vector<uint8_t>>& packet, const Members& members);
+
+        // `viewer` now watches exactly `sharers`, all of them `members` of its
+        // voice channel.
+        void SetWatched(const std::shared_ptr<ChatSession>& viewer,
+                        const std::vector<const ChatSession*>& sharers, const Members& members);
+
+        // The share of `sharer` stopped: drops its cached keyframe. Who
+        // watches it is kept for when it starts again.
+        void EndShare(const ChatSession* sharer);
+        // `session` left the voice channel: forgets it as sharer and viewer.
+        void ForgetSession(const ChatSession* session);
+
+    private:
+        struct Viewer {
+            bool live = false;
+            std::chrono::steady_clock::time_point waitingSince;
+        };
+        struct Share {
+            std::shared_ptr<std::vector<uint8_t>>          keyframe;   // full packet
+            std::vector<uint8_t>                           sps, pps;
+            std::unordered_map<const ChatSession*, Viewer> viewers;
+            std::unordered_set<const ChatSession*>         watchers;
+            int                                            reportedViewers = -1;
+        };
+
+        static std::shared_ptr<std::vector<uint8_t>> BuildKeyframe(const Share& share,
+            std::span<const uint8_t> body, const FrameInfo& info);
+        // True if `viewer` should get the frames of `share`.
+        bool Wants(const Share& share, const ChatSession* viewer) const;
+        // Sends Screen_Share_Viewers to `sharer` if its audience changed.
+        static void ReportViewers(Share& share, const ChatSession* sharer, int viewers, const Members& members);
+
+        std::mutex                                     m_Mutex;
+        std::unordered_map<const ChatSession*, Share>  m_Shares;
+        // Viewer -> shares it watches. Sessions missing here never subscribed.
+        std::unordered_map<const ChatSession*, std::vector<const ChatSession*>> m_Watching;
+    };
+
+} // namespace TalkMe
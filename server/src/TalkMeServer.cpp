@@ -1,18 +1,32 @@
 #include "TalkMeServer.h"
+#include "AttachmentStore.h"
 #include "ChatSession.h"   // full definition required: TalkMeServer.cpp dereferences shared_ptr<ChatSession>
 #include "Database.h"
 #include "Logger.h"
+#include "MediaCache.h"
+#include "MediaHttpSession.h"
+#include "Metrics.h"
 #include "Protocol.h"
+#include "Thumbnailer.h"
+#include "UploadManager.h"
+#include "WireCodec.h"
 #include <nlohmann/json.hpp>
 #include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <unordered_set>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <filesystem>
-#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
 
 using json = nlohmann::json;
 using asio::ip::tcp;
@@ -27,13 +41,58 @@ namespace {
     constexpr uint8_t kUdpHelloPacket = 1;
     constexpr uint8_t kUdpPingPacket = 2;
     constexpr uint8_t kUdpPongPacket = 3;
+    constexpr uint8_t kUdpVoiceLevelPacket = 4;   // [4][audio level][voice payload]
     constexpr size_t  kPingPayloadSize = 8;
 
+    // TALKME_VOICE_SOCKETS=N opens N SO_REUSEPORT sockets on VOICE_PORT;
+    // "auto" (or 0) uses one per hardware thread, capped like main's pool.
+    // Extra sockets only help with cores to run them on: on one core they
+    // measured no faster than a single socket (server/bench/voice_ingress_load).
+    size_t VoiceIngressSocketCount() {
+        constexpr size_t kMaxSockets = 16;
+        const char* e = std::getenv("TALKME_VOICE_SOCKETS");
+        if (!e || !*e) return 1;
+        long n = std::strtol(e, nullptr, 10);
+        if (n <= 0) n = static_cast<long>(std::thread::hardware_concurrency());
+        return std::clamp<size_t>(static_cast<size_t>(n), 1, kMaxSockets);
+    }
+
+    // TALKME_VOICE_TOPN=N forwards only the N loudest speakers per channel
+    // (selective forwarding); unset or 0 forwards every active speaker.
+    size_t VoiceTopNFromEnv() {
+        const char* e = std::getenv("TALKME_VOICE_TOPN");
+        if (!e || !*e) return 0;
+        const long n = std::strtol(e, nullptr, 10);
+        return n > 0 ? std::min<size_t>(static_cast<size_t>(n), TalkMe::ActiveSpeakerTracker::kCapacity) : 0;
+    }
+
+#if defined(__linux__)
+    // recvmmsg scratch. A batch is received and fully handled on the calling
+    // thread before the socket is re-armed, so per-thread arrays suffice.
+    constexpr size_t kRecvBatch = 64;
+    constexpr size_t kRecvSlotBytes = 2048;          // > one MTU; larger datagrams are dropped
+    constexpr size_t kMaxRecvBatchesPerWake = 4;     // bound time spent per wakeup
+
+    struct RecvBatchScratch {
+        std::array<mmsghdr, kRecvBatch>          msgs{};
+        std::array<iovec, kRecvBatch>            iov{};
+        std::array<sockaddr_storage, kRecvBatch> addrs{};
+        std::vector<uint8_t>                     data = std::vector<uint8_t>(kRecvBatch * kRecvSlotBytes);
+    };
+
+    RecvBatchScratch& LocalRecvScratch() {
+        thread_local RecvBatchScratch scratch;
+        return scratch;
+    }
+#endif
+
+    // Zero-copy view of a voice payload: sender and opus point into the
+    // receive buffer and are only valid while it is.
     struct ParsedVoiceOpus {
-        std::string          sender;
-        std::vector<uint8_t> opus;
-        uint32_t             sequenceNumber{ 0 }; // parsed from bytes [0-3]
-        bool                 valid{ false };
+        std::string_view         sender;
+        std::span<const uint8_t> opus;
+        uint32_t                 sequenceNumber{ 0 }; // parsed from bytes [0-3]
+        bool                     valid{ false };
     };
 
     struct AdaptiveVoiceProfile {
@@ -73,9 +132,9 @@ namespace {
     }
 
     // ---------------------------------------------------------------------------
-    // REQ 2: Parse voice payload; extract sequence number from bytes [0-3].
+    // REQ 2: Parse voice payload in place; extract sequence number from bytes [0-3].
     // ---------------------------------------------------------------------------
-    ParsedVoiceOpus ParseVoicePayloadOpus(const std::vector<uint8_t>& payload) {
+    ParsedVoiceOpus ParseVoicePayloadOpus(std::span<const uint8_t> payload) {
         ParsedVoiceOpus out;
         // Minimum: 4 (seq) + 1 (ulen) + 1 (username char) + 1 (opus byte) = 7
         if (payload.size() < 7) return out;
@@ -86,19 +145,15 @@ namespace {
         uint8_t ulen = payload[offset++];
         if (payload.size() < offset + ulen || ulen == 0) return out;
 
-        out.sender.assign(reinterpret_cast<const char*>(payload.data() + offset), ulen);
+        out.sender = std::string_view(reinterpret_cast<const char*>(payload.data() + offset), ulen);
         offset += ulen;
         if (offset >= payload.size()) return out;
 
-        out.opus.assign(payload.begin() + offset, payload.end());
+        out.opus = payload.subspan(offset);
         out.valid = true;
         return out;
     }
 
-    std::string EndpointKey(const udp::endpoint& ep) {
-        return ep.address().to_string() + ':' + std::to_string(ep.port());
-    }
-
 } // namespace
 
 // ---------------------------------------------------------------------------
@@ -111,15 +166,26 @@ namespace TalkMe {
     TalkMeServer::TalkMeServer(asio::io_context& io_context, short port)
         : m_Acceptor(io_context, tcp::endpoint(tcp::v4(), port))
         , m_MediaAcceptor(io_context, tcp::endpoint(tcp::v4(), kMediaPort))
-        , m_VoiceUdpSocket(io_context, udp::endpoint(udp::v4(), VOICE_PORT))
         , m_IoContext(io_context)
+        , m_Expiry(kExpiryTickMs, std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now().time_since_epoch()).count())
     {
+        m_VoiceTopN = VoiceTopNFromEnv();
+        m_VoiceDirectory.store(std::make_shared<const VoiceDirectory>());
+        m_VoiceDirectoryVersion.store(1, std::memory_order_release);
+        OpenVoiceIngress(VoiceIngressSocketCount());
         DoAccept();
         DoAcceptMedia();
-        StartVoiceUdpReceive();
+        for (auto& ingress : m_VoiceIngress) {
+            if (m_VoiceBatchIo) StartVoiceUdpBatchReceive(*ingress);
+            else                StartVoiceUdpReceive(*ingress);
+        }
         StartVoiceOptimizationTimer();
         StartConnectionHealthCheck();
         StartVoiceStatsWriteTimer();
+        StartAttachmentSweepTimer();
+        StartPresenceFlushTimer();
+        RegisterMetrics();
     }
 
     // ---------------------------------------------------------------------------
@@ -137,23 +203,26 @@ namespace TalkMe {
 
     // REQ 5: Generous SFU bitrate math � 512 kbps budget, 24 kbps floor.
     uint32_t TalkMeServer::GetChannelBitrateLimit(int cid) {
-        std::lock_guard lock(m_SpeakerMutex);
-        auto it = m_RecentSpeakersByChannel.find(cid);
+        std::shared_ptr<VoiceChannelRouting> routing;
+        {
+            std::shared_lock lock(m_RoomMutex);
+            if (auto it = m_VoiceRouting.find(cid); it != m_VoiceRouting.end())
+                routing = it->second;
+        }
         uint32_t activeCount = 1;
-        if (it != m_RecentSpeakersByChannel.end() && !it->second.empty()) {
-            const int64_t cutoff = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::steady_clock::now().time_since_epoch()).count()
-                - kActiveSpeakerWindowMs;
-            activeCount = static_cast<uint32_t>(
-                std::count_if(it->second.begin(), it->second.end(),
-                    [cutoff](const auto& kv) { return kv.second >= cutoff; }));
-            activeCount = std::max(1u, activeCount);
+        if (routing) {
+            const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            activeCount = std::max(1u, routing->speakers.ActiveCount(nowMs, kActiveSpeakerWindowMs));
         }
         return std::max(24u, std::min(64u, 512u / activeCount));
     }
 
     void TalkMeServer::JoinClient(std::shared_ptr<ChatSession> session) {
+        const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
         std::unique_lock lock(m_RoomMutex);
+        ScheduleExpiry(nowMs + kFirstPacketTimeoutMs, ExpiryCheck::ForSession(ExpiryCheck::Kind::SessionIdle, session));
         m_AllSessions.insert(std::move(session));
     }
 
@@ -162,26 +231,26 @@ namespace TalkMe {
         m_AllSessions.erase(session);
 
         const std::string& user = session->GetUsername();
-        if (!user.empty()) {
-            bool hasActive = false;
-            for (const auto& s : m_AllSessions) {
-                if (s->GetUsername() == user) {
-                    hasActive = true;
-                    break;
+        const uint32_t userId = session->GetUserId();
+        if (userId != 0) {
+            UnindexUserSessionLocked(session, userId);
+            if (!m_UserSessions.contains(userId)) {
+                if (const int bindingCid = EraseUdpBindingLocked(userId); bindingCid >= 0) {
+                    RebuildVoiceRouteLocked(bindingCid);
+                    RebuildVoiceDirectoryLocked();
                 }
-            }
-            if (!hasActive) {
-                m_UdpBindings.erase(user);
-                // Broadcast offline presence (outside lock below)
-                lock.unlock();
-                BroadcastPresence(user, false);
-                lock.lock();
+                QueuePresenceLocked(session, false, std::nullopt);
+                m_Presence.ForgetUser(userId);
             }
         }
+        UnindexSessionLocked(session);
+
+        m_ScreenShares.ForgetSession(session.get());
 
         int cid = session->GetVoiceChannelId();
         if (cid != -1) {
             m_VoiceChannels[cid].erase(session);
+            RebuildVoiceRouteLocked(cid);
             RefreshChannelControlLockFree(cid, user, false);
         }
     }
@@ -193,21 +262,34 @@ namespace TalkMe {
         if (oldCid != -1 && oldCid != newCid) {
             const std::string& user = session->GetUsername();
             m_VoiceChannels[oldCid].erase(session);
-            if (!user.empty()) m_UdpBindings.erase(user);
+            const int bindingCid = EraseUdpBindingLocked(session->GetUserId());
+            RebuildVoiceRouteLocked(oldCid);
+            if (bindingCid >= 0) {
+                if (bindingCid != oldCid) RebuildVoiceRouteLocked(bindingCid);
+                RebuildVoiceDirectoryLocked();
+            }
             RefreshChannelControlLockFree(oldCid, user, false);
+            m_ScreenShares.ForgetSession(session.get());
         }
         if (newCid != -1) {
             auto& ch = m_VoiceChannels[newCid];
             const std::string& user = session->GetUsername();
+            const uint32_t userId = session->GetUserId();
             // Remove stale duplicate sessions for the same user.
             for (auto it = ch.begin(); it != ch.end(); ) {
-                if ((*it)->GetUsername() == user && *it != session)
+                if ((*it)->GetUserId() == userId && *it != session)
                     it = ch.erase(it);
                 else
                     ++it;
             }
             ch.insert(session);
+            RebuildVoiceRouteLocked(newCid);
             RefreshChannelControlLockFree(newCid, user, true);
+            if (session->ArmVoiceIdleCheck()) {
+                const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+                ScheduleExpiry(nowMs + kVoiceIdleEvictSec * 1000, ExpiryCheck::ForSession(ExpiryCheck::Kind::VoiceIdle, session));
+            }
         }
     }
 
@@ -217,8 +299,32 @@ namespace TalkMe {
         for (const auto& s : m_AllSessions) s->SendShared(buf, false);
     }
 
+    size_t TalkMeServer::RelayScreenShareFrame(int cid, const ChatSession* sharer, std::span<const uint8_t> body) {
+        // One copy of the frame, shared by every viewer's write queue.
+        PacketHeader h{ PacketType::Screen_Share_Frame, static_cast<uint32_t>(body.size()) };
+        auto buf = CreateBufferRaw(h, body);
+        std::shared_lock lock(m_RoomMutex);
+        auto it = m_VoiceChannels.find(cid);
+        if (it == m_VoiceChannels.end()) return 0;
+        return m_ScreenShares.Relay(sharer, body, buf, it->second);
+    }
+
+    void TalkMeServer::WatchScreenShares(const std::shared_ptr<ChatSession>& viewer, int cid,
+        const std::vector<std::string>& sharers)
+    {
+        std::shared_lock lock(m_RoomMutex);
+        auto it = m_VoiceChannels.find(cid);
+        if (it == m_VoiceChannels.end() || !it->second.contains(viewer)) return;
+        std::vector<const ChatSession*> watched;
+        for (const auto& s : it->second) {
+            if (s != viewer && std::find(sharers.begin(), sharers.end(), s->GetUsername()) != sharers.end())
+                watched.push_back(s.get());
+        }
+        m_ScreenShares.SetWatched(viewer, watched, it->second);
+    }
+
     void TalkMeServer::BroadcastVoice(int cid, std::shared_ptr<ChatSession> sender,
-        PacketHeader h, const std::vector<uint8_t>& body)
+        PacketHeader h, std::span<const uint8_t> body)
     {
         auto buf = CreateBufferRaw(h, body);
         std::shared_lock lock(m_RoomMutex);
@@ -235,27 +341,31 @@ namespace TalkMe {
 
     // ---------------------------------------------------------------------------
     // REQ 2 (O(1) hot path) + REQ 4 (token bucket) + REQ 7 (seq tracking)
+    //
+    // Allocation-free relay: the header is parsed in place, the sender and the
+    // channel's members come from lock-free routing snapshots (probed with a
+    // string_view), target lists live in per-thread scratch vectors, and the outgoing datagram is a
+    // single pooled block shared by every send. The TCP fallback buffer is
+    // only built when a listener actually needs it.
     // ---------------------------------------------------------------------------
-    void TalkMeServer::HandleVoiceUdpPacket(const std::vector<uint8_t>& packet,
-        const udp::endpoint& from)
+    void TalkMeServer::HandleVoiceUdpPacket(VoiceIngress& ingress,
+        std::span<const uint8_t> packet, const udp::endpoint& from)
     {
         if (packet.empty()) return;
         const uint8_t kind = packet[0];
 
         if (kind == 0xEE && packet.size() == 13) {
-            auto probeBuffer = std::make_shared<std::vector<uint8_t>>(packet);
-            m_VoiceUdpSocket.async_send_to(asio::buffer(*probeBuffer), from,
-                [probeBuffer](const std::error_code&, std::size_t) {});
+            auto probe = VoicePacketPool::Acquire(packet.size());
+            std::memcpy(probe.data(), packet.data(), packet.size());
+            SendVoiceDatagram(ingress, probe, { &from, 1 });
             return;
         }
 
         if (kind == kUdpPingPacket && packet.size() >= 1 + kPingPayloadSize) {
-            auto pongBuffer = std::make_shared<std::vector<uint8_t>>();
-            pongBuffer->reserve(1 + kPingPayloadSize);
-            pongBuffer->push_back(kUdpPongPacket);
-            pongBuffer->insert(pongBuffer->end(), packet.begin() + 1, packet.begin() + 1 + kPingPayloadSize);
-            m_VoiceUdpSocket.async_send_to(asio::buffer(*pongBuffer), from,
-                [pongBuffer](const std::error_code&, std::size_t) {});
+            auto pong = VoicePacketPool::Acquire(1 + kPingPayloadSize);
+            pong.data()[0] = kUdpPongPacket;
+            std::memcpy(pong.data() + 1, packet.data() + 1, kPingPayloadSize);
+            SendVoiceDatagram(ingress, pong, { &from, 1 });
             return;
         }
 
@@ -269,74 +379,123 @@ namespace TalkMe {
             std::string username(reinterpret_cast<const char*>(packet.data() + offset), ulen);
             offset += ulen;
             int32_t voiceCid = ReadI32BE(packet.data() + offset);
+            const uint32_t userId = FindUserId(username);
+            auto nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+
+            // Clients re-send hello every few seconds. When the binding already
+            // matches, only its clocks move and no snapshot is rebuilt, so the
+            // common case needs just a shared lock.
+            if (voiceCid >= 0 && userId != 0) {
+                std::shared_lock lock(m_RoomMutex);
+                auto it = m_UdpBindings.find(userId);
+                if (it != m_UdpBindings.end()
+                    && it->second->endpoint == from && it->second->voiceCid == voiceCid)
+                {
+                    auto& binding = *it->second;
+                    binding.lastSeenMs.store(nowMs, std::memory_order_relaxed);
+                    binding.lastRefillMs.store(nowMs, std::memory_order_relaxed);
+                    binding.tokens.store(kTokenBucketMax, std::memory_order_relaxed);
+                    return;
+                }
+            }
 
             std::unique_lock lock(m_RoomMutex);
-            if (voiceCid < 0 || username.empty()) {
-                m_UdpBindings.erase(username);
+            if (voiceCid < 0 || userId == 0) {
+                if (const int bindingCid = EraseUdpBindingLocked(userId); bindingCid >= 0) {
+                    RebuildVoiceRouteLocked(bindingCid);
+                    RebuildVoiceDirectoryLocked();
+                }
                 VoiceTrace::log("step=udp_hello_drop reason=invalid user=" + username);
                 return;
             }
             // Validate the session exists and is in the claimed channel.
-            auto sit = std::find_if(m_AllSessions.begin(), m_AllSessions.end(),
-                [&username](const auto& s) { return s->GetUsername() == username; });
-            if (sit == m_AllSessions.end()) {
+            const auto sessions = UserSessionsLocked(userId);
+            if (sessions.empty()) {
                 VoiceTrace::log("step=udp_hello_drop reason=session_not_found user=" + username);
                 return;
             }
-            if ((*sit)->GetVoiceChannelId() != voiceCid) {
+            if (std::none_of(sessions.begin(), sessions.end(),
+                    [voiceCid](const auto& s) { return s->GetVoiceChannelId() == voiceCid; })) {
                 VoiceTrace::log("step=udp_hello_drop reason=channel_mismatch user=" + username);
                 return;
             }
-            auto nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::steady_clock::now().time_since_epoch()).count();
-            auto& binding = m_UdpBindings[username];
-            binding.endpoint = from;
-            binding.lastSeenMs.store(nowMs, std::memory_order_relaxed);
-            binding.voiceCid = voiceCid;
-            binding.lastRefillMs.store(nowMs, std::memory_order_relaxed);
-            binding.tokens.store(kTokenBucketMax, std::memory_order_relaxed);
+            auto binding = std::make_shared<UdpBinding>();
+            binding->endpoint = from;
+            binding->username = username;
+            binding->lastSeenMs.store(nowMs, std::memory_order_relaxed);
+            binding->voiceCid = voiceCid;
+            binding->lastRefillMs.store(nowMs, std::memory_order_relaxed);
+            binding->tokens.store(kTokenBucketMax, std::memory_order_relaxed);
+
+            ScheduleExpiry(nowMs + kUdpBindingTtlMs, ExpiryCheck::ForBinding(binding, userId));
+            auto& slot = m_UdpBindings[userId];
+            const int oldCid = slot ? slot->voiceCid : -1;
+            slot = std::move(binding);
+            if (oldCid >= 0 && oldCid != voiceCid) RebuildVoiceRouteLocked(oldCid);
+            RebuildVoiceRouteLocked(voiceCid);
+            RebuildVoiceDirectoryLocked();
             VoiceTrace::log("step=udp_hello_ok user=" + username
                 + " cid=" + std::to_string(voiceCid)
                 + " bindings=" + std::to_string(m_UdpBindings.size()));
             return;
         }
 
-        if (kind != kUdpVoicePacket) return;
-        if (packet.size() < 2) return;
-
-        std::vector<uint8_t> voicePayload(packet.begin() + 1, packet.end());
-        auto parsed = ParseVoicePayloadOpus(voicePayload);
+        // Voice: [0][payload], or [4][level][payload] from clients that were told
+        // (Voice_Config "audio_level") the server accepts levels. The level is
+        // only used for selective forwarding; listeners always receive kind 0.
+        if (kind != kUdpVoicePacket && kind != kUdpVoiceLevelPacket) return;
+        const bool hasLevel = (kind == kUdpVoiceLevelPacket);
+        const size_t headerBytes = hasLevel ? 2 : 1;
+        if (packet.size() < headerBytes + 1) return;
+        const uint8_t audioLevel = hasLevel ? packet[1] : ActiveSpeakerTracker::kSilentLevel;
+
+        const std::span<const uint8_t> voicePayload = packet.subspan(headerBytes);
+        const auto parsed = ParseVoicePayloadOpus(voicePayload);
         if (!parsed.valid || parsed.sender.empty()) {
-            VoiceTrace::log("step=server_drop reason=parse_fail size="
-                + std::to_string(packet.size()));
+            if (VoiceTrace::enabled())
+                VoiceTrace::log("step=server_drop reason=parse_fail size="
+                    + std::to_string(packet.size()));
             return;
         }
 
         static std::atomic<uint32_t> s_recvCount{ 0 };
-        if (const uint32_t rc = ++s_recvCount; rc <= 10 || (rc % 50) == 0)
-            VoiceTrace::log("step=server_recv sender=" + parsed.sender
-                + " bytes=" + std::to_string(voicePayload.size()));
-
-        std::vector<udp::endpoint>              udpTargets;
-        std::vector<std::shared_ptr<ChatSession>> tcpFallback;
+        if (VoiceTrace::enabled())
+            if (const uint32_t rc = ++s_recvCount; rc <= 10 || (rc % 50) == 0)
+                VoiceTrace::log("step=server_recv sender=" + std::string(parsed.sender)
+                    + " bytes=" + std::to_string(voicePayload.size()));
+
+        // Per-thread scratch lists: capacity is retained between packets, so
+        // steady-state relaying never reallocates them.
+        thread_local std::vector<udp::endpoint>                udpTargets;
+        thread_local std::vector<std::shared_ptr<ChatSession>> tcpFallback;
+        udpTargets.clear();
+        tcpFallback.clear();
         int cid = -1;
 
+        const auto receivedAt = std::chrono::steady_clock::now();
         const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()).count();
+            receivedAt.time_since_epoch()).count();
 
         {
-            std::shared_lock lock(m_RoomMutex);
+            // Lock-free: everything below reads published routing snapshots.
+            const VoiceDirectory& directory = CurrentVoiceDirectory();
 
             // --- REQ 4: Token bucket rate limiter ---------------------------------
-            auto senderIt = m_UdpBindings.find(parsed.sender);
-            if (senderIt == m_UdpBindings.end()) {
-                VoiceTrace::log("step=server_drop reason=sender_not_bound sender="
-                    + parsed.sender);
+            auto senderIt = directory.senders.find(parsed.sender);
+            if (senderIt == directory.senders.end()) {
+                if (VoiceTrace::enabled())
+                    VoiceTrace::log("step=server_drop reason=sender_not_bound sender="
+                        + std::string(parsed.sender));
                 return;
             }
-            if (EndpointKey(senderIt->second.endpoint) != EndpointKey(from)) {
-                VoiceTrace::log("step=server_drop reason=endpoint_mismatch sender="
-                    + parsed.sender);
+            const VoiceDirectory::Sender& sender = senderIt->second;
+            UdpBinding& senderBinding = *sender.binding;
+            const uint32_t senderId = sender.userId;
+            if (senderBinding.endpoint != from) {
+                if (VoiceTrace::enabled())
+                    VoiceTrace::log("step=server_drop reason=endpoint_mismatch sender="
+                        + std::string(parsed.sender));
                 return;
             }
 
@@ -351,7 +510,7 @@ namespace TalkMe {
             // fall far behind, causing an instant full-bucket grant on return that could
             // swamp downstream consumers. Snap to nowMs in that case.
             {
-                auto& b = senderIt->second;
+                auto& b = senderBinding;
                 int64_t lastRefill = b.lastRefillMs.load(std::memory_order_relaxed);
 
                 // Snap stale clock: user was silent for > 1 second.
@@ -375,8 +534,12 @@ namespace TalkMe {
 
                 if (b.tokens.fetch_sub(1, std::memory_order_relaxed) < 1) {
                     b.tokens.store(0, std::memory_order_relaxed);
-                    VoiceTrace::log("step=server_drop reason=rate_limited sender="
-                        + parsed.sender);
+                    static Counter& s_rateLimited = Metrics::Get().GetCounter("talkme_voice_rate_limited_total",
+                        "Voice datagrams dropped by the per-sender token bucket.");
+                    s_rateLimited.Add();
+                    if (VoiceTrace::enabled())
+                        VoiceTrace::log("step=server_drop reason=rate_limited sender="
+                            + std::string(parsed.sender));
                     return;
                 }
             }
@@ -384,105 +547,185 @@ namespace TalkMe {
             // --- REQ 2 (O(1)): Trust voiceCid stored in UdpBinding ---------------
             // No linear scan of m_AllSessions needed � the binding is kept in sync
             // by SetVoiceChannel/LeaveClient whenever the session changes channel.
-            cid = senderIt->second.voiceCid;
+            cid = senderBinding.voiceCid;
             if (cid < 0) return;
 
             // --- REQ 7: Update server-side highest sequence number ---------------
             {
-                auto& b = senderIt->second;
+                auto& b = senderBinding;
                 uint32_t prev = b.highestSeqReceived.load(std::memory_order_relaxed);
                 if (parsed.sequenceNumber > prev)
                     b.highestSeqReceived.store(parsed.sequenceNumber,
                         std::memory_order_relaxed);
             }
 
-            senderIt->second.lastSeenMs.store(nowMs, std::memory_order_relaxed);
+            senderBinding.lastSeenMs.store(nowMs, std::memory_order_relaxed);
 
             // --- REQ 2 (O(1)): Active-speaker gate --------------------------------
+            // Per-channel tracker; an admitted speaker hits its cached slot.
+            if (!sender.channel->speakers.Touch(senderId, senderBinding.speakerSlot,
+                    nowMs, kActiveSpeakerWindowMs))
             {
-                std::lock_guard speakerLock(m_SpeakerMutex);
-                auto& speakerMap = m_RecentSpeakersByChannel[cid];
-                const int64_t cutoff2s = nowMs - kActiveSpeakerWindowMs;
-
-                // Is the sender already counted as active?
-                auto speakerIt = speakerMap.find(parsed.sender);
-                bool wasActive = (speakerIt != speakerMap.end()
-                    && speakerIt->second >= cutoff2s);
-
-                if (!wasActive) {
-                    // Count currently active speakers (bounded by kActiveSpeakerMax, so O(1)).
-                    size_t active = std::count_if(speakerMap.begin(), speakerMap.end(),
-                        [cutoff2s](const auto& kv) { return kv.second >= cutoff2s; });
-                    if (active >= kActiveSpeakerMax) {
-                        VoiceTrace::log("step=server_drop reason=speaker_cap_exceeded sender="
-                            + parsed.sender + " cid=" + std::to_string(cid));
-                        return;
-                    }
-                }
-                // O(1) timestamp update.
-                speakerMap[parsed.sender] = nowMs;
+                if (VoiceTrace::enabled())
+                    VoiceTrace::log("step=server_drop reason=speaker_cap_exceeded sender="
+                        + std::string(parsed.sender) + " cid=" + std::to_string(cid));
+                return;
+            }
+
+            // --- Selective forwarding: only the top-N loudest per 10 ms window ---
+            // Packets without a level (older clients) are always forwarded.
+            if (m_VoiceTopN > 0 && hasLevel
+                && !sender.channel->speakers.ShouldForward(
+                    senderBinding.speakerSlot.load(std::memory_order_relaxed),
+                    audioLevel, m_VoiceTopN, nowMs))
+            {
+                ingress.suppressedPackets.fetch_add(1, std::memory_order_relaxed);
+                return;
             }
 
             // --- Build relay target lists ----------------------------------------
+            // The route already pairs each member with its binding for this cid.
             const int64_t cutoffActive = nowMs - kActiveSpeakerWindowMs;
-            // Bug fix: same operator[] race as in BroadcastVoice — use find().
-            auto chIt = m_VoiceChannels.find(cid);
-            if (chIt != m_VoiceChannels.end()) {
-                for (const auto& s : chIt->second) {
-                    if (!s || s->GetUsername() == parsed.sender) continue;
-                    auto bit = m_UdpBindings.find(s->GetUsername());
-                    if (bit != m_UdpBindings.end()
-                        && bit->second.voiceCid == cid
-                        && bit->second.lastSeenMs.load(std::memory_order_relaxed) >= cutoffActive)
+            if (const auto route = sender.channel->route.load(std::memory_order_acquire)) {
+                for (const auto& m : route->members) {
+                    if (m.userId == senderId) continue;
+                    if (m.binding
+                        && m.binding->lastSeenMs.load(std::memory_order_relaxed) >= cutoffActive)
                     {
-                        udpTargets.push_back(bit->second.endpoint);
+                        udpTargets.push_back(m.binding->endpoint);
                     }
-                    else {
-                        tcpFallback.push_back(s);
+                    else if (auto s = m.session.lock()) {
+                        tcpFallback.push_back(std::move(s));
                     }
                 }
             }
-        } // release shared lock
+        } // end of snapshot reads
 
         // --- Relay ---------------------------------------------------------------
         static std::atomic<uint32_t> s_udpVoiceCount{ 0 };
-        if (const uint32_t n = ++s_udpVoiceCount; n <= 10 || (n % 50) == 0)
-            VoiceTrace::log("step=server_relay sender=" + parsed.sender
-                + " cid=" + std::to_string(cid)
-                + " udp=" + std::to_string(udpTargets.size())
-                + " tcp=" + std::to_string(tcpFallback.size())
-                + " bytes=" + std::to_string(voicePayload.size()));
+        if (VoiceTrace::enabled())
+            if (const uint32_t n = ++s_udpVoiceCount; n <= 10 || (n % 50) == 0)
+                VoiceTrace::log("step=server_relay sender=" + std::string(parsed.sender)
+                    + " cid=" + std::to_string(cid)
+                    + " udp=" + std::to_string(udpTargets.size())
+                    + " tcp=" + std::to_string(tcpFallback.size())
+                    + " bytes=" + std::to_string(voicePayload.size()));
 
         // REQ 1 (Mutual Exclusion): TCP fallback is strictly the else branch of UDP.
-        // Build shared buffers once; reuse across all targets (single heap allocation).
-        PacketHeader h{ PacketType::Voice_Data_Opus,
-                        static_cast<uint32_t>(voicePayload.size()) };
-        auto tcpBuffer = CreateBufferRaw(h, voicePayload);
-
-        for (const auto& s : tcpFallback)
-            s->SendShared(tcpBuffer, true);
+        // The framed TCP copy is only built when some listener has no live UDP path.
+        size_t tcpCopies = 0;
+        if (!tcpFallback.empty()) {
+            PacketHeader h{ PacketType::Voice_Data_Opus,
+                            static_cast<uint32_t>(voicePayload.size()) };
+            auto tcpBuffer = CreateBufferRaw(h, voicePayload);
+            for (const auto& s : tcpFallback)
+                s->SendShared(tcpBuffer, true);
+            tcpCopies = tcpFallback.size();
+            tcpFallback.clear();
+        }
 
         if (!udpTargets.empty()) {
-            // One allocation shared across all async_send_to calls (scatter-gather style).
-            auto udpPacket = std::make_shared<std::vector<uint8_t>>(1 + voicePayload.size());
-            (*udpPacket)[0] = kUdpVoicePacket;
-            std::memcpy(udpPacket->data() + 1, voicePayload.data(), voicePayload.size());
+            // Relay as [kind=0][payload] from one pooled block shared by every send.
+            if (auto udpPacket = VoicePacketPool::Acquire(1 + voicePayload.size())) {
+                udpPacket.data()[0] = kUdpVoicePacket;
+                std::memcpy(udpPacket.data() + 1, voicePayload.data(), voicePayload.size());
+                SendVoiceDatagram(ingress, udpPacket, udpTargets);
+            }
+            else {
+                // Oversized datagram (> one MTU): not poolable, send from a heap copy.
+                auto heapPacket = std::make_shared<std::vector<uint8_t>>();
+                heapPacket->reserve(1 + voicePayload.size());
+                heapPacket->push_back(kUdpVoicePacket);
+                heapPacket->insert(heapPacket->end(), voicePayload.begin(), voicePayload.end());
+                for (const auto& ep : udpTargets)
+                    ingress.socket.async_send_to(asio::buffer(*heapPacket), ep,
+                        [heapPacket](const std::error_code&, std::size_t) {});
+            }
+        }
+
+        static Histogram& s_relayTime = Metrics::Get().GetHistogram("talkme_voice_relay_seconds",
+            "Voice datagram arrival to its last copy handed to the kernel (or queued for TCP), per relayed datagram.");
+        static Counter& s_udpCopies = Metrics::Get().GetCounter("talkme_voice_relay_copies_total",
+            "Voice datagram copies relayed, by path.", "path=\"udp\"");
+        static Counter& s_tcpCopies = Metrics::Get().GetCounter("talkme_voice_relay_copies_total",
+            "Voice datagram copies relayed, by path.", "path=\"tcp\"");
+        s_udpCopies.Add(udpTargets.size());
+        s_tcpCopies.Add(tcpCopies);
+        s_relayTime.ObserveSince(receivedAt);
+    }
 
-            for (const auto& ep : udpTargets)
-                m_VoiceUdpSocket.async_send_to(
-                    asio::buffer(*udpPacket), ep,
-                    [udpPacket](const std::error_code&, std::size_t) {});
+    void TalkMeServer::SendVoiceDatagram(VoiceIngress& ingress,
+        const VoicePacketPool::Ref& packet, std::span<const udp::endpoint> targets)
+    {
+        size_t done = 0;
+
+#if defined(__linux__)
+        // One sendmmsg for the whole fan-out set: every entry shares the same
+        // iovec and differs only in destination. (UDP GSO does not apply here;
+        // it segments one buffer towards a single destination.)
+        if (m_VoiceBatchIo && targets.size() > 1) {
+            thread_local std::vector<mmsghdr> msgs;
+            iovec iov{ const_cast<uint8_t*>(packet.data()), packet.size() };
+            msgs.resize(targets.size());
+            for (size_t i = 0; i < targets.size(); ++i) {
+                auto& h = msgs[i].msg_hdr;
+                h = {};
+                h.msg_name = const_cast<void*>(static_cast<const void*>(targets[i].data()));
+                h.msg_namelen = static_cast<socklen_t>(targets[i].size());
+                h.msg_iov = &iov;
+                h.msg_iovlen = 1;
+            }
+            const int fd = ingress.socket.native_handle();
+            while (done < targets.size()) {
+                const int n = ::sendmmsg(fd, msgs.data() + done,
+                    static_cast<unsigned>(targets.size() - done), MSG_DONTWAIT);
+                ingress.sendCalls.fetch_add(1, std::memory_order_relaxed);
+                if (n > 0) {
+                    ingress.sentPackets.fetch_add(n, std::memory_order_relaxed);
+                    done += static_cast<size_t>(n);
+                    continue;
+                }
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                ++done;   // this destination failed; skip it like send_to would
+            }
+        }
+#endif
+
+        // The voice socket is non-blocking, so a direct send_to either hands the
+        // datagram to the kernel immediately or reports would_block. Only the
+        // latter (socket buffer full) falls back to an async send, whose handler
+        // keeps a reference to the pooled block until completion. The common
+        // path therefore needs neither an operation object nor a heap buffer.
+        const auto buf = asio::buffer(packet.data(), packet.size());
+        for (const auto& ep : targets.subspan(done)) {
+            asio::error_code ec;
+            ingress.socket.send_to(buf, ep, 0, ec);
+            ingress.sendCalls.fetch_add(1, std::memory_order_relaxed);
+            if (!ec)
+                ingress.sentPackets.fetch_add(1, std::memory_order_relaxed);
+            else if (ec == asio::error::would_block || ec == asio::error::try_again)
+                ingress.socket.async_send_to(buf, ep,
+                    [ref = packet](const std::error_code&, std::size_t) {});
         }
     }
 
     // ---------------------------------------------------------------------------
-    // REQ 3: Two-phase locking for health checks.
-    //   Phase 1 � shared read lock: collect dead sessions / stale UDP keys.
-    //   Phase 2 � exclusive write lock: execute only the .erase() calls.
+    // Deadline-driven health checks.
+    //   Every kExpiryTickMs the checks that came due are taken off m_Expiry;
+    //   nothing else is looked at.
+    //   Phase 1 � shared read lock: re-read the activity clocks. A check whose
+    //             deadline moved is filed again for the new one.
+    //   Phase 2 � exclusive write lock, only if something expired: the erases.
     // ---------------------------------------------------------------------------
+    void TalkMeServer::ScheduleExpiry(int64_t dueMs, ExpiryCheck check) {
+        std::lock_guard lock(m_ExpiryMutex);
+        m_Expiry.Schedule(dueMs, std::move(check));
+    }
+
     void TalkMeServer::StartConnectionHealthCheck() {
         auto timer = std::make_shared<asio::steady_timer>(
-            m_IoContext, std::chrono::seconds(5));
+            m_IoContext, std::chrono::milliseconds(kExpiryTickMs));
 
         timer->async_wait([this, timer](const std::error_code& ec) {
             if (ec) return;
@@ -491,80 +734,138 @@ namespace TalkMe {
             const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
                 now.time_since_epoch()).count();
 
-            std::vector<std::shared_ptr<ChatSession>>  deadSessions;
-            std::vector<std::pair<int, std::shared_ptr<ChatSession>>> staleVoice;
-            std::vector<std::string>                   deadUdpUsers;
+            std::vector<ExpiryCheck> due;
+            {
+                std::lock_guard lock(m_ExpiryMutex);
+                m_Expiry.Advance(nowMs, due);
+            }
+            if (due.empty()) {
+                StartConnectionHealthCheck();
+                return;
+            }
 
-            // --- Phase 1: read sweep (shared lock) ---
+            std::vector<std::shared_ptr<ChatSession>>                        deadSessions;
+            std::vector<std::pair<int, std::shared_ptr<ChatSession>>>        staleVoice;
+            std::vector<std::pair<uint32_t, std::shared_ptr<UdpBinding>>>   deadBindings;
+            std::vector<std::pair<int64_t, ExpiryCheck>>                     refile;
+
+            // --- Phase 1: read the clocks (shared lock) ---
             {
                 std::shared_lock readLock(m_RoomMutex);
 
-                for (const auto& session : m_AllSessions) {
-                    int64_t lastActMs = session->GetLastActivityTimeMs();
-                    int64_t elapsedSec = (nowMs - lastActMs) / 1000;
-                    // Global TCP Idle Timeout (5 minutes) - Prevents Slowloris Connection Leaks
-                    if (!session->IsHealthy() || elapsedSec > 300) {
-                        deadSessions.push_back(session);
-                        continue;
+                for (auto& check : due) {
+                    switch (check.kind) {
+                    case ExpiryCheck::Kind::SessionIdle: {
+                        auto session = check.session.lock();
+                        if (!session || !m_AllSessions.contains(session)) break;
+                        // Global TCP Idle Timeout (5 minutes) - Prevents Slowloris Connection Leaks
+                        const int64_t deadline = session->GetLastActivityTimeMs() + kSessionIdleTimeoutMs;
+                        if (!session->IsHealthy() || nowMs >= deadline)
+                            deadSessions.push_back(std::move(session));
+                        else
+                            refile.emplace_back(deadline, std::move(check));
+                        break;
                     }
-
-                    int cid = session->GetVoiceChannelId();
-                    if (cid != -1) {
-                        // OPTIMIZATION: Check if UDP is still flowing before evicting
-                        bool isUdpActive = false;
-                        auto uit = m_UdpBindings.find(session->GetUsername());
-                        if (uit != m_UdpBindings.end()) {
-                            if (nowMs - uit->second.lastSeenMs.load(std::memory_order_relaxed) < (kVoiceIdleEvictSec * 1000)) {
-                                isUdpActive = true;
-                            }
+                    case ExpiryCheck::Kind::VoiceIdle: {
+                        auto session = check.session.lock();
+                        if (!session) break;
+                        const int cid = session->GetVoiceChannelId();
+                        auto ch = m_VoiceChannels.find(cid);
+                        if (cid == -1 || ch == m_VoiceChannels.end() || !ch->second.contains(session)) {
+                            session->DisarmVoiceIdleCheck();
+                            break;
                         }
-                        if (elapsedSec > kVoiceIdleEvictSec && !isUdpActive) {
-                            staleVoice.emplace_back(cid, session);
+                        // UDP still flowing keeps a member whose TCP side is quiet.
+                        int64_t lastMs = session->GetLastActivityTimeMs();
+                        if (auto uit = m_UdpBindings.find(session->GetUserId()); uit != m_UdpBindings.end())
+                            lastMs = std::max(lastMs, uit->second->lastSeenMs.load(std::memory_order_relaxed));
+                        const int64_t deadline = lastMs + kVoiceIdleEvictSec * 1000;
+                        if (nowMs >= deadline) {
+                            session->DisarmVoiceIdleCheck();
+                            staleVoice.emplace_back(cid, std::move(session));
                         }
+                        else {
+                            refile.emplace_back(deadline, std::move(check));
+                        }
+                        break;
+                    }
+                    case ExpiryCheck::Kind::UdpBinding: {
+                        auto binding = check.binding.lock();
+                        auto it = m_UdpBindings.find(check.userId);
+                        if (!binding || it == m_UdpBindings.end() || it->second != binding) break;
+                        const int64_t deadline = binding->lastSeenMs.load(std::memory_order_relaxed) + kUdpBindingTtlMs;
+                        if (binding->voiceCid < 0 || nowMs >= deadline)
+                            deadBindings.emplace_back(check.userId, std::move(binding));
+                        else
+                            refile.emplace_back(deadline, std::move(check));
+                        break;
+                    }
                     }
                 }
+            }
 
-                const int64_t udpCutoff = nowMs - kUdpBindingTtlMs;
-                for (const auto& [user, binding] : m_UdpBindings)
-                    if (binding.lastSeenMs.load(std::memory_order_relaxed) < udpCutoff
-                        || binding.voiceCid < 0)
-                        deadUdpUsers.push_back(user);
+            if (!refile.empty()) {
+                std::lock_guard lock(m_ExpiryMutex);
+                for (auto& [dueMs, check] : refile) m_Expiry.Schedule(dueMs, std::move(check));
             }
 
             // --- Phase 2: write mutations (exclusive lock, minimal scope) ---
-            {
+            if (!deadSessions.empty() || !staleVoice.empty() || !deadBindings.empty()) {
                 std::unique_lock writeLock(m_RoomMutex);
+                std::set<int> touchedCids;
+                bool bindingsChanged = false;
+                auto eraseBinding = [&](uint32_t userId) {
+                    if (const int bindingCid = EraseUdpBindingLocked(userId); bindingCid >= 0) {
+                        touchedCids.insert(bindingCid);
+                        bindingsChanged = true;
+                    }
+                };
+
                 for (const auto& session : deadSessions) {
-                    m_AllSessions.erase(session);
+                    if (!m_AllSessions.erase(session)) continue;   // left meanwhile
+
+                    const uint32_t userId = session->GetUserId();
+                    if (userId != 0) {
+                        UnindexUserSessionLocked(session, userId);
+                        if (!m_UserSessions.contains(userId)) {
+                            eraseBinding(userId);
+                            QueuePresenceLocked(session, false, std::nullopt);
+                            m_Presence.ForgetUser(userId);
+                        }
+                    }
+                    UnindexSessionLocked(session);
 
                     int cid = session->GetVoiceChannelId();
                     if (cid != -1) {
                         m_VoiceChannels[cid].erase(session);
+                        touchedCids.insert(cid);
                         RefreshChannelControlLockFree(cid);
                     }
-
-                    const std::string& user = session->GetUsername();
-                    if (!user.empty()) {
-                        bool hasActive = false;
-                        for (const auto& s : m_AllSessions) {
-                            if (s->GetUsername() == user) {
-                                hasActive = true;
-                                break;
-                            }
-                        }
-                        if (!hasActive) {
-                            m_UdpBindings.erase(user);
-                        }
-                    }
                 }
                 for (const auto& [cid, session] : staleVoice) {
                     m_VoiceChannels[cid].erase(session);
+                    touchedCids.insert(cid);
                     RefreshChannelControlLockFree(cid);
                 }
-                for (const auto& user : deadUdpUsers)
-                    m_UdpBindings.erase(user);
+                for (const auto& [userId, binding] : deadBindings) {
+                    // A fresh hello may have replaced it meanwhile.
+                    if (auto it = m_UdpBindings.find(userId); it != m_UdpBindings.end() && it->second == binding)
+                        eraseBinding(userId);
+                }
+
+                for (int cid : touchedCids) RebuildVoiceRouteLocked(cid);
+                if (bindingsChanged) RebuildVoiceDirectoryLocked();
             }
 
+            m_ExpiryStats.fired.fetch_add(due.size(), std::memory_order_relaxed);
+            m_ExpiryStats.refiled.fetch_add(refile.size(), std::memory_order_relaxed);
+            m_ExpiryStats.expired.fetch_add(deadSessions.size() + staleVoice.size() + deadBindings.size(),
+                std::memory_order_relaxed);
+            const uint64_t tickUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - now).count();
+            uint64_t prevMax = m_ExpiryStats.maxTickUs.load(std::memory_order_relaxed);
+            while (tickUs > prevMax && !m_ExpiryStats.maxTickUs.compare_exchange_weak(prevMax, tickUs, std::memory_order_relaxed)) {}
+
             StartConnectionHealthCheck();
             });
     }
@@ -579,6 +880,20 @@ namespace TalkMe {
         timer->async_wait([this, timer](const std::error_code& ec) {
             if (ec) return;
 
+            // Current outbound backlog per lane, summed over sessions.
+            std::array<uint64_t, kWriteLaneCount> laneDepth{};
+            {
+                std::shared_lock roomLock(m_RoomMutex);
+                for (const auto& s : m_AllSessions)
+                    for (size_t lane = 0; lane < kWriteLaneCount; ++lane)
+                        laneDepth[lane] += s->GetWriteQueueDepth(static_cast<WriteLane>(lane));
+            }
+            size_t expiryPending = 0;
+            {
+                std::lock_guard expiryLock(m_ExpiryMutex);
+                expiryPending = m_Expiry.Size();
+            }
+
             // Single lock scope: aggregate + append + write JSON.
             {
                 std::lock_guard lock(m_StatsMutex);
@@ -618,6 +933,114 @@ namespace TalkMe {
                                     {"clients",      s.clients} });
 
                 json out; out["samples"] = arr;
+
+                // Per-socket ingress rate over the last timer period.
+                json pps = json::array();
+                for (auto& ingress : m_VoiceIngress) {
+                    const uint64_t total = ingress->packets.load(std::memory_order_relaxed);
+                    pps.push_back((total - ingress->lastPackets) / 10);
+                    ingress->lastPackets = total;
+                }
+                out["ingress_pps"] = pps;
+
+                uint64_t recvCalls = 0, recvPkts = 0, sendCalls = 0, sentPkts = 0, suppressed = 0;
+                for (auto& ingress : m_VoiceIngress) {
+                    recvCalls += ingress->recvCalls.load(std::memory_order_relaxed);
+                    recvPkts += ingress->packets.load(std::memory_order_relaxed);
+                    sendCalls += ingress->sendCalls.load(std::memory_order_relaxed);
+                    sentPkts += ingress->sentPackets.load(std::memory_order_relaxed);
+                    suppressed += ingress->suppressedPackets.load(std::memory_order_relaxed);
+                }
+                out["udp_io"] = { {"batched",        m_VoiceBatchIo},
+                                  {"recv_calls",     recvCalls},
+                                  {"recv_packets",   recvPkts},
+                                  {"send_calls",     sendCalls},
+                                  {"sent_packets",   sentPkts},
+                                  {"topn",           m_VoiceTopN},
+                                  {"topn_suppressed", suppressed},
+                                  {"avg_recv_batch", recvCalls ? double(recvPkts) / recvCalls : 0.0},
+                                  {"avg_send_batch", sendCalls ? double(sentPkts) / sendCalls : 0.0} };
+
+                // TCP write path: totals since start; peaks reset every period.
+                json lanes;
+                uint64_t lanesWritten = 0;
+                for (size_t lane = 0; lane < kWriteLaneCount; ++lane) {
+                    auto& st = ChatSession::GetWriteLaneStats(static_cast<WriteLane>(lane));
+                    const uint64_t written = st.written.load(std::memory_order_relaxed);
+                    lanesWritten += written;
+                    lanes[kWriteLaneNames[lane]] = {
+                        {"queued",       st.queued.Value()},
+                        {"dropped",      st.dropped.Value()},
+                        {"written",      written},
+                        {"depth",        laneDepth[lane]},
+                        {"peak_depth",   st.peakDepth.exchange(0, std::memory_order_relaxed)},
+                        {"avg_wait_us",  written ? double(st.waitUsTotal.load(std::memory_order_relaxed)) / written : 0.0},
+                        {"max_wait_us",  st.waitUsMax.exchange(0, std::memory_order_relaxed)} };
+                }
+                const uint64_t writeCalls = ChatSession::GetWriteCallCount().load(std::memory_order_relaxed);
+                out["tcp_write"] = { {"write_calls",      writeCalls},
+                                     {"avg_gather",       writeCalls ? double(lanesWritten) / writeCalls : 0.0},
+                                     {"lanes",            lanes} };
+
+                auto& media = MediaHttpSession::GetStats();
+                out["media_http"] = { {"connections", media.connections.load(std::memory_order_relaxed)},
+                                      {"requests",    media.requests.load(std::memory_order_relaxed)},
+                                      {"body_bytes",  media.bodyBytes.load(std::memory_order_relaxed)},
+                                      {"errors",      media.errors.load(std::memory_order_relaxed)} };
+                auto& cache = MediaCache::GetStats();
+                const uint64_t cacheHits = cache.hits.load(std::memory_order_relaxed);
+                const uint64_t cacheMisses = cache.misses.load(std::memory_order_relaxed);
+                out["media_cache"] = { {"hits",          cacheHits},
+                                       {"misses",        cacheMisses},
+                                       {"hit_rate",      cacheHits + cacheMisses ? double(cacheHits) / (cacheHits + cacheMisses) : 0.0},
+                                       {"memory_served", cache.memoryServed.load(std::memory_order_relaxed)},
+                                       {"not_modified",  cache.notModified.load(std::memory_order_relaxed)},
+                                       {"partial",       cache.partial.load(std::memory_order_relaxed)},
+                                       {"bytes_saved",   cache.bytesSaved.load(std::memory_order_relaxed)},
+                                       {"cached_bytes",  MediaCache::Get().CachedBodyBytes()} };
+                auto& store = AttachmentStore::GetStats();
+                out["attachments"] = { {"stored",      store.stored.load(std::memory_order_relaxed)},
+                                       {"instant",     store.instant.load(std::memory_order_relaxed)},
+                                       {"duplicates",  store.duplicates.load(std::memory_order_relaxed)},
+                                       {"bytes_saved", store.bytesSaved.load(std::memory_order_relaxed)},
+                                       {"rejected",    store.rejected.load(std::memory_order_relaxed)},
+                                       {"swept",       store.swept.load(std::memory_order_relaxed)} };
+                auto& previews = Thumbnailer::GetStats();
+                out["previews"] = { {"generated",   previews.generated.load(std::memory_order_relaxed)},
+                                    {"skipped",     previews.skipped.load(std::memory_order_relaxed)},
+                                    {"failed",      previews.failed.load(std::memory_order_relaxed)},
+                                    {"served",      previews.served.load(std::memory_order_relaxed)},
+                                    {"bytes_saved", previews.bytesSaved.load(std::memory_order_relaxed)} };
+                auto& uploads = UploadManager::GetStats();
+                out["uploads"] = { {"started",       uploads.started.load(std::memory_order_relaxed)},
+                                   {"resumed",       uploads.resumed.load(std::memory_order_relaxed)},
+                                   {"resumed_bytes", uploads.resumedBytes.load(std::memory_order_relaxed)},
+                                   {"completed",     uploads.completed.load(std::memory_order_relaxed)},
+                                   {"failed",        uploads.failed.load(std::memory_order_relaxed)},
+                                   {"expired",       uploads.expired.load(std::memory_order_relaxed)},
+                                   {"bytes_written", uploads.bytesWritten.load(std::memory_order_relaxed)},
+                                   {"pending_bytes", uploads.pendingBytes.load(std::memory_order_relaxed)} };
+                auto& screen = ScreenShareRelay::GetStats();
+                out["screen_share"] = { {"frames",          screen.frames.load(std::memory_order_relaxed)},
+                                        {"keyframes",       screen.keyframes.load(std::memory_order_relaxed)},
+                                        {"fast_starts",     screen.fastStarts.load(std::memory_order_relaxed)},
+                                        {"withheld",        screen.withheld.load(std::memory_order_relaxed)},
+                                        {"dropped",         screen.dropped.load(std::memory_order_relaxed)},
+                                        {"resync_timeouts", screen.resyncTimeouts.load(std::memory_order_relaxed)},
+                                        {"unwatched",       screen.unwatched.load(std::memory_order_relaxed)},
+                                        {"unwatched_bytes", screen.unwatchedBytes.load(std::memory_order_relaxed)} };
+                auto& presence = PresenceHub::GetStats();
+                out["presence"] = { {"changes",        presence.changes.load(std::memory_order_relaxed)},
+                                    {"coalesced",      presence.coalesced.load(std::memory_order_relaxed)},
+                                    {"flushes",        presence.flushes.load(std::memory_order_relaxed)},
+                                    {"batches",        presence.batches.load(std::memory_order_relaxed)},
+                                    {"legacy_packets", presence.legacyPackets.load(std::memory_order_relaxed)},
+                                    {"deltas",         presence.deltas.load(std::memory_order_relaxed)} };
+                out["expiry"] = { {"pending",     expiryPending},
+                                  {"fired",       m_ExpiryStats.fired.load(std::memory_order_relaxed)},
+                                  {"refiled",     m_ExpiryStats.refiled.load(std::memory_order_relaxed)},
+                                  {"expired",     m_ExpiryStats.expired.load(std::memory_order_relaxed)},
+                                  {"max_tick_us", m_ExpiryStats.maxTickUs.exchange(0, std::memory_order_relaxed)} };
                 if (std::ofstream f("voice_stats.json"); f)
                     f << out.dump();
             }
@@ -626,6 +1049,36 @@ namespace TalkMe {
             });
     }
 
+    // ---------------------------------------------------------------------------
+    // Scrape-time gauges for /metrics. Counters and latency histograms are
+    // registered where they are recorded (Metrics.h).
+    // ---------------------------------------------------------------------------
+    void TalkMeServer::RegisterMetrics() {
+        auto& registry = Metrics::Get();
+        registry.AddGauge("talkme_sessions", "Connected TCP sessions.", [this] {
+            std::shared_lock lock(m_RoomMutex);
+            return static_cast<double>(m_AllSessions.size());
+            });
+        registry.AddGauge("talkme_udp_bindings", "Users with a live UDP voice binding.", [this] {
+            std::shared_lock lock(m_RoomMutex);
+            return static_cast<double>(m_UdpBindings.size());
+            });
+        registry.AddGauge("talkme_expiry_pending", "Idle and expiry checks waiting in the timer wheel.", [this] {
+            std::lock_guard lock(m_ExpiryMutex);
+            return static_cast<double>(m_Expiry.Size());
+            });
+        for (size_t lane = 0; lane < kWriteLaneCount; ++lane) {
+            registry.AddGauge("talkme_write_queue_depth", "Packets waiting in outbound write queues, summed over sessions.",
+                [this, lane] {
+                    uint64_t depth = 0;
+                    std::shared_lock lock(m_RoomMutex);
+                    for (const auto& s : m_AllSessions) depth += s->GetWriteQueueDepth(static_cast<WriteLane>(lane));
+                    return static_cast<double>(depth);
+                },
+                std::string("lane=\"") + kWriteLaneNames[lane] + "\"");
+        }
+    }
+
     // ---------------------------------------------------------------------------
     // Channel membership + config broadcast (called under m_RoomMutex).
     // ---------------------------------------------------------------------------
@@ -648,6 +1101,7 @@ namespace TalkMe {
         cfg["jitter_buffer_max_ms"] = profile.jitterMaxMs;
         cfg["codec_target_kbps"] = profile.codecTargetKbps;
         cfg["prefer_udp"] = profile.preferUdp;
+        cfg["audio_level"] = true;   // accepts [4][level][payload] voice datagrams
         cfg["server_version"] = "1.2";
         auto cfgBuffer = CreateBuffer(PacketType::Voice_Config, cfg.dump());
 
@@ -695,22 +1149,108 @@ namespace TalkMe {
     }
 
     // ---------------------------------------------------------------------------
-    // UDP receive loop
+    // UDP ingress sockets + receive loop
     // ---------------------------------------------------------------------------
-    void TalkMeServer::StartVoiceUdpReceive() {
-        m_VoiceUdpSocket.async_receive_from(
-            asio::buffer(m_VoiceRecvBuffer), m_VoiceRecvFrom,
-            [this](const std::error_code& ec, std::size_t bytes) {
+    void TalkMeServer::OpenVoiceIngress(size_t count) {
+#ifndef SO_REUSEPORT
+        count = 1;   // no kernel load balancing (e.g. Windows): single socket
+#endif
+        const udp::endpoint bindEp(udp::v4(), VOICE_PORT);
+        for (size_t i = 0; i < count; ++i) {
+            auto ingress = std::make_unique<VoiceIngress>(m_IoContext);
+            ingress->socket.open(bindEp.protocol());
+#ifdef SO_REUSEPORT
+            if (count > 1)
+                ingress->socket.set_option(
+                    asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+            ingress->socket.bind(bindEp);
+            // Relay sends go straight to the kernel (see SendVoiceDatagram).
+            ingress->socket.non_blocking(true);
+            m_VoiceIngress.push_back(std::move(ingress));
+        }
+#if defined(__linux__)
+        const char* batch = std::getenv("TALKME_VOICE_BATCH");
+        m_VoiceBatchIo = !(batch && batch[0] == '0');
+#endif
+        std::fprintf(stderr, "[TalkMe Server] UDP voice ingress on port %d: %zu socket(s), %s\n",
+            static_cast<int>(VOICE_PORT), m_VoiceIngress.size(),
+            m_VoiceBatchIo ? "recvmmsg/sendmmsg" : "asio");
+    }
+
+    // One receive is in flight per socket, so each socket is serviced by at
+    // most one io_context thread at a time and its buffer needs no locking;
+    // N sockets give N concurrent receive loops.
+    void TalkMeServer::StartVoiceUdpReceive(VoiceIngress& ingress) {
+        ingress.socket.async_receive_from(
+            asio::buffer(ingress.recvBuffer), ingress.recvFrom,
+            [this, &ingress](const std::error_code& ec, std::size_t bytes) {
+                ingress.recvCalls.fetch_add(1, std::memory_order_relaxed);
                 if (!ec && bytes > 0) {
-                    HandleVoiceUdpPacket(
-                        { m_VoiceRecvBuffer.begin(),
-                          m_VoiceRecvBuffer.begin() + bytes },
-                        m_VoiceRecvFrom);
+                    ingress.packets.fetch_add(1, std::memory_order_relaxed);
+                    HandleVoiceUdpPacket(ingress,
+                        { ingress.recvBuffer.data(), bytes }, ingress.recvFrom);
                 }
-                StartVoiceUdpReceive();
+                StartVoiceUdpReceive(ingress);
             });
     }
 
+    // Batch mode: wait for readability, then drain up to kRecvBatch datagrams
+    // per recvmmsg. Exactly one of {wait, posted drain} is pending per socket,
+    // so the same single-reader guarantee as above holds.
+    void TalkMeServer::StartVoiceUdpBatchReceive(VoiceIngress& ingress) {
+        ingress.socket.async_wait(udp::socket::wait_read,
+            [this, &ingress](const std::error_code& ec) {
+                if (ec) StartVoiceUdpBatchReceive(ingress);
+                else    DrainVoiceUdpBatch(ingress);
+            });
+    }
+
+    void TalkMeServer::DrainVoiceUdpBatch(VoiceIngress& ingress) {
+#if defined(__linux__)
+        auto& s = LocalRecvScratch();
+        const int fd = ingress.socket.native_handle();
+        bool drained = false;
+
+        for (size_t round = 0; round < kMaxRecvBatchesPerWake && !drained; ++round) {
+            for (size_t i = 0; i < kRecvBatch; ++i) {
+                s.iov[i] = { s.data.data() + i * kRecvSlotBytes, kRecvSlotBytes };
+                auto& h = s.msgs[i].msg_hdr;
+                h = {};
+                h.msg_name = &s.addrs[i];
+                h.msg_namelen = sizeof(sockaddr_storage);
+                h.msg_iov = &s.iov[i];
+                h.msg_iovlen = 1;
+            }
+            const int n = ::recvmmsg(fd, s.msgs.data(), kRecvBatch, MSG_DONTWAIT, nullptr);
+            ingress.recvCalls.fetch_add(1, std::memory_order_relaxed);
+            if (n <= 0) { drained = true; break; }
+            ingress.packets.fetch_add(n, std::memory_order_relaxed);
+
+            for (int i = 0; i < n; ++i) {
+                const auto& h = s.msgs[i].msg_hdr;
+                if ((h.msg_flags & MSG_TRUNC) || h.msg_namelen > sizeof(sockaddr_storage))
+                    continue;
+                udp::endpoint from;
+                std::memcpy(from.data(), &s.addrs[i], h.msg_namelen);
+                from.resize(h.msg_namelen);
+                HandleVoiceUdpPacket(ingress,
+                    { s.data.data() + i * kRecvSlotBytes, s.msgs[i].msg_len }, from);
+            }
+            drained = static_cast<size_t>(n) < kRecvBatch;
+        }
+
+        // Budget spent with datagrams still queued: the reactor is edge-triggered,
+        // so waiting again could stall until the next arrival. Yield to other
+        // handlers and keep draining instead.
+        if (!drained) {
+            asio::post(m_IoContext, [this, &ingress] { DrainVoiceUdpBatch(ingress); });
+            return;
+        }
+#endif
+        StartVoiceUdpBatchReceive(ingress);
+    }
+
     // ---------------------------------------------------------------------------
     // Periodic cleanup: evict empty voice channels.
     // ---------------------------------------------------------------------------
@@ -722,21 +1262,55 @@ namespace TalkMe {
             if (ec) return;
             {
                 std::unique_lock lock(m_RoomMutex);
-                std::lock_guard  speakerLock(m_SpeakerMutex);
+                bool routingChanged = false;
                 for (auto it = m_VoiceChannels.begin(); it != m_VoiceChannels.end(); ) {
                     if (it->second.empty()) {
-                        m_RecentSpeakersByChannel.erase(it->first);
+                        // Dropping the routing object also drops its speaker tracker.
+                        routingChanged |= m_VoiceRouting.erase(it->first) > 0;
                         it = m_VoiceChannels.erase(it);
                     }
                     else {
                         ++it;
                     }
                 }
+                // Senders may still hold the dropped routing objects.
+                if (routingChanged) RebuildVoiceDirectoryLocked();
             }
             StartVoiceOptimizationTimer();
             });
     }
 
+    // ---------------------------------------------------------------------------
+    // Periodic cleanup: remove attachments no message references any more.
+    // The sweep runs on the database writer, serialised with upload commits.
+    // ---------------------------------------------------------------------------
+    void TalkMeServer::StartAttachmentSweepTimer() {
+        auto timer = std::make_shared<asio::steady_timer>(
+            m_IoContext, std::chrono::minutes(10));
+
+        timer->async_wait([this, timer](const std::error_code& ec) {
+            if (ec) return;
+            Database::Get().ExecuteWrite([]() {
+                if (const size_t expired = UploadManager::Get().ExpireIdle())
+                    std::fprintf(stderr, "[TalkMe Server] Dropped %zu abandoned uploads\n", expired);
+                if (const size_t removed = AttachmentStore::Sweep())
+                    std::fprintf(stderr, "[TalkMe Server] Swept %zu unreferenced attachments\n", removed);
+            });
+            StartAttachmentSweepTimer();
+            });
+    }
+
+    void TalkMeServer::StartPresenceFlushTimer() {
+        auto timer = std::make_shared<asio::steady_timer>(
+            m_IoContext, std::chrono::milliseconds(kPresenceBatchMs));
+
+        timer->async_wait([this, timer](const std::error_code& ec) {
+            if (ec) return;
+            FlushPresence();
+            StartPresenceFlushTimer();
+            });
+    }
+
     // ---------------------------------------------------------------------------
     // TCP accept loop
     // ---------------------------------------------------------------------------
@@ -754,96 +1328,9 @@ namespace TalkMe {
     // ---------------------------------------------------------------------------
     // HTTP media server: GET /media/<id> serves file from attachments/<id>
     // ---------------------------------------------------------------------------
-    namespace {
-        std::string ContentTypeFromExtension(const std::string& id) {
-            std::string lower = id;
-            for (char& c : lower) c = (char)std::tolower((unsigned char)c);
-            size_t dot = lower.rfind('.');
-            if (dot == std::string::npos) return "application/octet-stream";
-            std::string ext = lower.substr(dot);
-            if (ext == ".png") return "image/png";
-            if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
-            if (ext == ".gif") return "image/gif";
-            if (ext == ".webp") return "image/webp";
-            if (ext == ".bmp") return "image/bmp";
-            if (ext == ".mp4") return "video/mp4";
-            if (ext == ".webm") return "video/webm";
-            return "application/octet-stream";
-        }
-
-        void HandleMediaRequest(tcp::socket socket) {
-            auto sock_ptr = std::make_shared<tcp::socket>(std::move(socket));
-            auto buf = std::make_shared<asio::streambuf>();
-            asio::async_read_until(*sock_ptr, *buf, "\r\n", [sock_ptr, buf](std::error_code ec, std::size_t) {
-                if (ec) { sock_ptr->close(); return; }
-                std::istream is(buf.get());
-                std::string line;
-                if (!std::getline(is, line) || line.empty()) { sock_ptr->close(); return; }
-                // Parse "GET /media/xxx HTTP/1.x"
-                if (line.size() < 10 || line.compare(0, 4, "GET ") != 0) {
-                    std::string bad = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
-                    asio::write(*sock_ptr, asio::buffer(bad));
-                    sock_ptr->close();
-                    return;
-                }
-                size_t pathStart = 4;
-                size_t pathEnd = line.find(' ', pathStart);
-                if (pathEnd == std::string::npos) { sock_ptr->close(); return; }
-                std::string path = line.substr(pathStart, pathEnd - pathStart);
-                const std::string prefix = "/media/";
-                if (path.size() < prefix.size() + 1 || path.compare(0, prefix.size(), prefix) != 0) {
-                    std::string bad = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
-                    asio::write(*sock_ptr, asio::buffer(bad));
-                    sock_ptr->close();
-                    return;
-                }
-                std::string id = path.substr(prefix.size());
-                if (id.empty() || id.find("..") != std::string::npos) {
-                    std::string bad = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
-                    asio::write(*sock_ptr, asio::buffer(bad));
-                    sock_ptr->close();
-                    return;
-                }
-                std::filesystem::path filePath = std::filesystem::path("attachments") / id;
-                if (!std::filesystem::is_regular_file(filePath)) {
-                    std::string bad = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
-                    asio::write(*sock_ptr, asio::buffer(bad));
-                    sock_ptr->close();
-                    return;
-                }
-                std::ifstream file(filePath, std::ios::binary | std::ios::ate);
-                if (!file) {
-                    std::string bad = "HTTP/1.1 500 Internal Server Error\r\nConnection: close\r\n\r\n";
-                    asio::write(*sock_ptr, asio::buffer(bad));
-                    sock_ptr->close();
-                    return;
-                }
-                std::streamsize fileSize = file.tellg();
-                file.seekg(0);
-                std::vector<char> body(static_cast<size_t>(fileSize));
-                if (!file.read(body.data(), fileSize)) {
-                    std::string bad = "HTTP/1.1 500 Internal Server Error\r\nConnection: close\r\n\r\n";
-                    asio::write(*sock_ptr, asio::buffer(bad));
-                    sock_ptr->close();
-                    return;
-                }
-                std::string contentType = ContentTypeFromExtension(id);
-                std::ostringstream resp;
-                resp << "HTTP/1.1 200 OK\r\nContent-Type: " << contentType
-                     << "\r\nContent-Length: " << fileSize << "\r\nConnection: close\r\n\r\n";
-                std::string header = resp.str();
-                std::vector<asio::const_buffer> buffers;
-                buffers.push_back(asio::buffer(header));
-                buffers.push_back(asio::buffer(body.data(), body.size()));
-                asio::write(*sock_ptr, buffers);
-                sock_ptr->close();
-            });
-        }
-    }
-
     void TalkMeServer::DoAcceptMedia() {
         m_MediaAcceptor.async_accept([this](std::error_code ec, tcp::socket socket) {
-            if (!ec) HandleMediaRequest(std::move(socket));
+            if (!ec) std::make_shared<MediaHttpSession>(std::move(socket))->Start();
             DoAcceptMedia();
         });
     }
@@ -863,7 +1350,7 @@ namespace TalkMe {
     }
 
     std::shared_ptr<std::vector<uint8_t>>
-        TalkMeServer::CreateBufferRaw(PacketHeader h, const std::vector<uint8_t>& body) {
+        TalkMeServer::CreateBufferRaw(PacketHeader h, std::span<const uint8_t> body) {
         h.ToNetwork();
         auto buf = std::make_shared<std::vector<uint8_t>>(sizeof(h) + body.size());
         std::memcpy(buf->data(), &h, sizeof(h));
@@ -871,28 +1358,95 @@ namespace TalkMe {
         return buf;
     }
 
-    void TalkMeServer::BroadcastToChannelMembers(int channelId, PacketType type, const std::string& payload) {
-        std::vector<std::string> allowedUsers = Database::Get().GetUsersInServerByChannel(channelId);
-        if (allowedUsers.empty()) return;
-        std::unordered_set<std::string> allowedSet(allowedUsers.begin(), allowedUsers.end());
-        auto buffer = CreateBuffer(type, payload);
+    void TalkMeServer::BroadcastToChannelMembers(int channelId, PacketType type, const std::string& payload,
+        const std::string& binaryPayload) {
+        int sid = 0;
+        {
+            std::shared_lock lock(m_RoomMutex);
+            if (auto cit = m_ChannelServers.find(channelId); cit != m_ChannelServers.end()) sid = cit->second;
+        }
+        if (sid == 0) {
+            // Only reached for a channel none of the indexed members listed.
+            sid = Database::Get().GetServerIdForChannel(channelId);
+            if (sid <= 0) return;
+            IndexChannel(sid, channelId);
+        }
 
         std::shared_lock lock(m_RoomMutex);
-        for (const auto& session : m_AllSessions) {
-            const std::string& username = session->GetUsername();
-            if (!username.empty() && allowedSet.find(username) != allowedSet.end()) {
-                session->SendShared(buffer, false);
-            }
+        auto sit = m_ServerSessions.find(sid);
+        if (sit == m_ServerSessions.end()) return;
+
+        auto buffer = CreateBuffer(type, payload);
+        auto binary = binaryPayload.empty() ? nullptr : CreateBuffer(type, binaryPayload);
+        for (const auto& session : sit->second)
+            session->SendControl(buffer, binary);
+    }
+
+    // ---------------------------------------------------------------------------
+    // Channel membership index
+    // ---------------------------------------------------------------------------
+    void TalkMeServer::SetUserMembership(const std::string& username, const ServerChannelRows& rows) {
+        if (username.empty()) return;
+        std::vector<int> sids;
+        sids.reserve(rows.size());
+        for (const auto& row : rows) sids.push_back(row.first);
+        std::sort(sids.begin(), sids.end());
+        sids.erase(std::unique(sids.begin(), sids.end()), sids.end());
+
+        const uint32_t userId = FindUserId(username);
+        std::unique_lock lock(m_RoomMutex);
+        for (const auto& [sid, cid] : rows)
+            if (cid > 0) m_ChannelServers[cid] = sid;
+        for (const auto& s : UserSessionsLocked(userId)) {
+            UnindexSessionLocked(s);
+            for (int sid : sids) m_ServerSessions[sid].insert(s);
+            m_SessionServers[s.get()] = sids;
+        }
+    }
+
+    void TalkMeServer::IndexChannel(int sid, int cid) {
+        if (sid <= 0 || cid <= 0) return;
+        std::unique_lock lock(m_RoomMutex);
+        m_ChannelServers[cid] = sid;
+    }
+
+    void TalkMeServer::UnindexChannel(int cid) {
+        std::unique_lock lock(m_RoomMutex);
+        m_ChannelServers.erase(cid);
+    }
+
+    void TalkMeServer::UnindexServer(int sid) {
+        std::unique_lock lock(m_RoomMutex);
+        std::erase_if(m_ChannelServers, [sid](const auto& kv) { return kv.second == sid; });
+        auto it = m_ServerSessions.find(sid);
+        if (it == m_ServerSessions.end()) return;
+        for (const auto& s : it->second) {
+            if (auto rit = m_SessionServers.find(s.get()); rit != m_SessionServers.end())
+                std::erase(rit->second, sid);
+        }
+        m_ServerSessions.erase(it);
+    }
+
+    void TalkMeServer::UnindexSessionLocked(const std::shared_ptr<ChatSession>& session) {
+        auto it = m_SessionServers.find(session.get());
+        if (it == m_SessionServers.end()) return;
+        for (int sid : it->second) {
+            auto sit = m_ServerSessions.find(sid);
+            if (sit == m_ServerSessions.end()) continue;
+            sit->second.erase(session);
+            if (sit->second.empty()) m_ServerSessions.erase(sit);
         }
+        m_SessionServers.erase(it);
     }
 
     void TalkMeServer::BroadcastToVoiceChannel(int cid,
-        std::shared_ptr<std::vector<uint8_t>> buffer) {
+        std::shared_ptr<std::vector<uint8_t>> buffer,
+        std::shared_ptr<std::vector<uint8_t>> binaryBuffer) {
         std::shared_lock lock(m_RoomMutex);
         auto it = m_VoiceChannels.find(cid);
         if (it == m_VoiceChannels.end()) return;
         for (const auto& s : it->second)
-            s->SendShared(buffer, false);
+            s->SendControl(buffer, binaryBuffer);
     }
 
     std::shared_ptr<std::vector<uint8_t>>
@@ -900,24 +1454,285 @@ namespace TalkMe {
         return CreateBuffer(type, data);
     }
 
-    void TalkMeServer::BroadcastPresence(const std::string& username, bool online) {
-        json j;
-        j["u"] = username;
-        j["online"] = online;
-        auto buf = CreateBuffer(PacketType::Presence_Update, j.dump());
+    // ---------------------------------------------------------------------------
+    // Copy-on-write voice routing
+    // ---------------------------------------------------------------------------
+    void TalkMeServer::RebuildVoiceRouteLocked(int cid) {
+        if (cid < 0) return;
+        auto route = std::make_shared<VoiceRoute>();
+        if (auto it = m_VoiceChannels.find(cid); it != m_VoiceChannels.end()) {
+            route->members.reserve(it->second.size());
+            for (const auto& s : it->second) {
+                VoiceRoute::Member m;
+                m.userId = s->GetUserId();
+                m.session = s;
+                if (auto bit = m_UdpBindings.find(m.userId);
+                    bit != m_UdpBindings.end() && bit->second->voiceCid == cid)
+                    m.binding = bit->second;
+                route->members.push_back(std::move(m));
+            }
+        }
+        auto& routing = m_VoiceRouting[cid];
+        if (!routing) routing = std::make_shared<VoiceChannelRouting>();
+        routing->route.store(std::move(route), std::memory_order_release);
+    }
+
+    void TalkMeServer::RebuildVoiceDirectoryLocked() {
+        auto directory = std::make_shared<VoiceDirectory>();
+        directory->senders.reserve(m_UdpBindings.size());
+        for (const auto& [userId, binding] : m_UdpBindings) {
+            if (!m_VoiceRouting.count(binding->voiceCid))
+                RebuildVoiceRouteLocked(binding->voiceCid);
+            directory->senders.try_emplace(binding->username,
+                VoiceDirectory::Sender{ userId, binding, m_VoiceRouting[binding->voiceCid] });
+        }
+        m_VoiceDirectory.store(std::move(directory), std::memory_order_release);
+        m_VoiceDirectoryVersion.fetch_add(1, std::memory_order_release);
+    }
+
+    int TalkMeServer::EraseUdpBindingLocked(uint32_t userId) {
+        auto it = m_UdpBindings.find(userId);
+        if (it == m_UdpBindings.end()) return -1;
+        const int cid = it->second->voiceCid;
+        m_UdpBindings.erase(it);
+        return cid;
+    }
+
+    const VoiceDirectory& TalkMeServer::CurrentVoiceDirectory() {
+        // Each relay thread keeps its own reference and only touches the shared
+        // atomic when a writer has published a new version, so steady-state
+        // packets never write to a cache line shared with other threads.
+        thread_local const TalkMeServer*                   t_owner = nullptr;
+        thread_local uint64_t                              t_version = 0;
+        thread_local std::shared_ptr<const VoiceDirectory> t_directory;
+
+        const uint64_t version = m_VoiceDirectoryVersion.load(std::memory_order_acquire);
+        if (t_owner != this || t_version != version || !t_directory) {
+            t_directory = m_VoiceDirectory.load(std::memory_order_acquire);
+            t_version = version;
+            t_owner = this;
+        }
+        return *t_directory;
+    }
+
+    uint32_t TalkMeServer::InternUser(std::string_view username) {
+        if (username.empty()) return 0;
+        if (uint32_t id = FindUserId(username)) return id;
+        std::unique_lock lock(m_UserIdMutex);
+        auto [it, inserted] = m_UserIds.try_emplace(std::string(username),
+            static_cast<uint32_t>(m_UserIds.size() + 1));
+        return it->second;
+    }
+
+    uint32_t TalkMeServer::FindUserId(std::string_view username) const {
+        std::shared_lock lock(m_UserIdMutex);
+        auto it = m_UserIds.find(username);
+        return it != m_UserIds.end() ? it->second : 0;
+    }
+
+    void TalkMeServer::IndexUserSession(const std::shared_ptr<ChatSession>& session, uint32_t previousUserId) {
+        std::unique_lock lock(m_RoomMutex);
+        if (previousUserId != 0) UnindexUserSessionLocked(session, previousUserId);
+        // A login answered after the connection was dropped must not
+        // resurrect it.
+        const uint32_t userId = session->GetUserId();
+        if (userId == 0 || !m_AllSessions.contains(session)) return;
+        auto& sessions = m_UserSessions[userId];
+        if (std::find(sessions.begin(), sessions.end(), session) == sessions.end())
+            sessions.push_back(session);
+        session->SetOnlineOrder(++m_OnlineOrder);
+    }
+
+    void TalkMeServer::UnindexUserSessionLocked(const std::shared_ptr<ChatSession>& session, uint32_t userId) {
+        auto it = m_UserSessions.find(userId);
+        if (it == m_UserSessions.end()) return;
+        std::erase(it->second, session);
+        if (it->second.empty()) m_UserSessions.erase(it);
+    }
+
+    std::span<const std::shared_ptr<ChatSession>> TalkMeServer::UserSessionsLocked(uint32_t userId) const {
+        auto it = m_UserSessions.find(userId);
+        if (it == m_UserSessions.end()) return {};
+        return it->second;
+    }
+
+    size_t TalkMeServer::SendToUser(std::string_view username, const std::shared_ptr<std::vector<uint8_t>>& buffer) {
+        const uint32_t userId = FindUserId(username);
+        if (userId == 0) return 0;
+        std::shared_lock lock(m_RoomMutex);
+        const auto sessions = UserSessionsLocked(userId);
+        for (const auto& s : sessions) s->SendShared(buffer, false);
+        return sessions.size();
+    }
+
+    void TalkMeServer::QueuePresenceLocked(const std::shared_ptr<ChatSession>& subject,
+        std::optional<bool> online, std::optional<std::string> status)
+    {
+        std::span<const int> servers;
+        if (auto it = m_SessionServers.find(subject.get()); it != m_SessionServers.end())
+            servers = it->second;
+        m_Presence.Queue(subject->GetUserId(), subject->GetUsername(), online, std::move(status), servers, true);
+    }
+
+    void TalkMeServer::PublishPresence(const std::shared_ptr<ChatSession>& subject) {
         std::shared_lock lock(m_RoomMutex);
-        for (const auto& s : m_AllSessions)
-            s->SendShared(buf, false);
+        if (!m_AllSessions.contains(subject)) return;
+        QueuePresenceLocked(subject, true, std::nullopt);
     }
 
-    std::vector<std::string> TalkMeServer::GetOnlineUsers() {
+    void TalkMeServer::PublishStatus(const std::shared_ptr<ChatSession>& subject, const std::string& status) {
         std::shared_lock lock(m_RoomMutex);
-        std::set<std::string> names;
-        for (const auto& s : m_AllSessions) {
-            const std::string& u = s->GetUsername();
-            if (!u.empty()) names.insert(u);
+        if (!m_AllSessions.contains(subject)) return;
+        QueuePresenceLocked(subject, std::nullopt, status);
+    }
+
+    void TalkMeServer::SetUserFriends(const std::shared_ptr<ChatSession>& subject, const std::vector<std::string>& friends) {
+        std::vector<uint32_t> ids;
+        ids.reserve(friends.size());
+        for (const auto& f : friends) ids.push_back(InternUser(f));
+        std::shared_lock lock(m_RoomMutex);
+        if (!m_AllSessions.contains(subject)) return;
+        m_Presence.SetFriends(subject->GetUserId(), std::move(ids));
+    }
+
+    void TalkMeServer::AddFriendship(std::string_view a, std::string_view b) {
+        const uint32_t ia = InternUser(a), ib = InternUser(b);
+        if (ia == 0 || ib == 0) return;
+        m_Presence.AddFriendship(ia, ib);
+        // Neither may have heard of the other coming online so far.
+        std::shared_lock lock(m_RoomMutex);
+        if (UserSessionsLocked(ia).empty() || UserSessionsLocked(ib).empty()) return;
+        m_Presence.Queue(ia, std::string(a), true, std::nullopt, {}, false, { &ib, 1 });
+        m_Presence.Queue(ib, std::string(b), true, std::nullopt, {}, false, { &ia, 1 });
+    }
+
+    void TalkMeServer::RemoveFriendship(std::string_view a, std::string_view b) {
+        const uint32_t ia = FindUserId(a), ib = FindUserId(b);
+        if (ia != 0 && ib != 0) m_Presence.RemoveFriendship(ia, ib);
+    }
+
+    bool TalkMeServer::IsOnline(std::string_view username) {
+        const uint32_t userId = FindUserId(username);
+        if (userId == 0) return false;
+        std::shared_lock lock(m_RoomMutex);
+        return m_UserSessions.contains(userId);
+    }
+
+    void TalkMeServer::FlushPresence() {
+        auto changes = m_Presence.Take();
+        if (changes.empty()) return;
+        auto& stats = PresenceHub::GetStats();
+        stats.flushes.fetch_add(1, std::memory_order_relaxed);
+
+        // Who hears of which change, resolved against the sessions online now.
+        struct Recipient {
+            std::shared_ptr<ChatSession> session;
+            std::vector<uint32_t>        changes;   // indices into `changes`
+        };
+        std::unordered_map<const ChatSession*, Recipient> recipients;
+        {
+            std::shared_lock lock(m_RoomMutex);
+            for (uint32_t i = 0; i < changes.size(); ++i) {
+                const auto& change = changes[i];
+                auto add = [&](const std::shared_ptr<ChatSession>& s) {
+                    if (s->GetUserId() == change.userId) return;
+                    auto& r = recipients[s.get()];
+                    if (!r.session) r.session = s;
+                    if (r.changes.empty() || r.changes.back() != i) r.changes.push_back(i);
+                };
+                // Members that came online after the user saw it online in
+                // their Member_List; a bare "online" is news only to earlier ones.
+                uint64_t seenBy = UINT64_MAX;
+                if (change.online == true && !change.status) {
+                    for (const auto& s : UserSessionsLocked(change.userId))
+                        seenBy = std::min(seenBy, s->GetOnlineOrder());
+                }
+                for (int sid : change.servers) {
+                    auto it = m_ServerSessions.find(sid);
+                    if (it == m_ServerSessions.end()) continue;
+                    for (const auto& s : it->second)
+                        if (s->GetOnlineOrder() < seenBy) add(s);
+                }
+                for (uint32_t uid : change.users)
+                    for (const auto& s : UserSessionsLocked(uid)) add(s);
+            }
+        }
+
+        // Each change is encoded once; batches are stitched from the pieces.
+        struct Encoded {
+            Wire::PresenceDelta                   delta;
+            std::string                           json;
+            std::shared_ptr<std::vector<uint8_t>> presenceJson, presenceBin, statusJson, statusBin;
+        };
+        std::vector<Encoded> encoded(changes.size());
+        for (size_t i = 0; i < changes.size(); ++i) {
+            const auto& change = changes[i];
+            auto& e = encoded[i];
+            e.delta.user = change.user;
+            e.delta.hasPresence = change.online.has_value();
+            e.delta.online = change.online.value_or(false);
+            e.delta.hasStatus = change.status.has_value();
+            if (change.status) e.delta.status = *change.status;
+            json j;
+            j["u"] = change.user;
+            if (change.online) j["online"] = *change.online;
+            if (change.status) j["status"] = *change.status;
+            e.json = j.dump();
+        }
+        // Older clients get the packets they always got, built on first use.
+        auto sendLegacy = [&](size_t i, ChatSession& s) {
+            const auto& change = changes[i];
+            auto& e = encoded[i];
+            if (change.online) {
+                if (!e.presenceJson) {
+                    json j;
+                    j["u"] = change.user;
+                    j["online"] = *change.online;
+                    e.presenceJson = CreateBuffer(PacketType::Presence_Update, j.dump());
+                    e.presenceBin = CreateBuffer(PacketType::Presence_Update,
+                        Wire::Encode(Wire::PresenceUpdate{ *change.online, change.user }));
+                }
+                s.SendControl(e.presenceJson, e.presenceBin);
+                stats.legacyPackets.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (change.status) {
+                if (!e.statusJson) {
+                    json j;
+                    j["u"] = change.user;
+                    j["status"] = *change.status;
+                    e.statusJson = CreateBuffer(PacketType::Status_Update, j.dump());
+                    e.statusBin = CreateBuffer(PacketType::Status_Update,
+                        Wire::Encode(Wire::StatusUpdate{ change.user, *change.status }));
+                }
+                s.SendControl(e.statusJson, e.statusBin);
+                stats.legacyPackets.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        std::vector<Wire::PresenceDelta> deltas;
+        std::string body;
+        for (auto& [_, r] : recipients) {
+            stats.deltas.fetch_add(r.changes.size(), std::memory_order_relaxed);
+            if (!r.session->WantsPresenceBatch()) {
+                for (uint32_t i : r.changes) sendLegacy(i, *r.session);
+                continue;
+            }
+            if (r.session->UsesBinaryWire()) {
+                deltas.clear();
+                for (uint32_t i : r.changes) deltas.push_back(encoded[i].delta);
+                body = Wire::Encode(std::span<const Wire::PresenceDelta>(deltas));
+            }
+            else {
+                body = "[";
+                for (uint32_t i : r.changes) {
+                    if (body.size() > 1) body += ',';
+                    body += encoded[i].json;
+                }
+                body += ']';
+            }
+            r.session->SendShared(CreateBuffer(PacketType::Presence_Batch, body), false);
+            stats.batches.fetch_add(1, std::memory_order_relaxed);
         }
-        return std::vector<std::string>(names.begin(), names.end());
     }
 
 } // namespace TalkMe
\ No newline at end of file
@@ -1,29 +1,51 @@
 #pragma once
 
+#include "ActiveSpeakerTracker.h"
+#include "PresenceHub.h"
 #include "Protocol.h"
+#include "ScreenShareRelay.h"
+#include "TimerWheel.h"
+#include "VoicePacketPool.h"
 #include <asio.hpp>
+#include <array>
 #include <atomic>
 #include <deque>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <set>
 #include <shared_mutex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace TalkMe {
 
     class ChatSession;
 
+    // Transparent hash so string-keyed maps can be probed with a string_view
+    // taken straight from a packet, without building a temporary std::string.
+    struct TransparentStringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view sv) const noexcept { return std::hash<std::string_view>{}(sv); }
+    };
+
     // ---------------------------------------------------------------------------
     // UDP binding: one entry per authenticated user in a voice channel.
     // Includes token-bucket state for per-sender rate limiting and
     // server-side sequence tracking for future RTCP-Lite correlation.
+    //
+    // endpoint, voiceCid and username are fixed once the binding is published;
+    // a hello that changes them installs a new binding instead, so the relay
+    // can read them from a routing snapshot without locking.
     // ---------------------------------------------------------------------------
     struct UdpBinding {
         asio::ip::udp::endpoint endpoint;
+        std::string            username;
         std::atomic<int64_t>   lastSeenMs{ 0 };
         int                    voiceCid{ -1 };
 
@@ -34,12 +56,76 @@ namespace TalkMe {
         // Server-side sequence tracker for Receiver_Report verification.
         std::atomic<uint32_t>  highestSeqReceived{ 0 };
 
-        // Non-copyable because of atomics; movable for map emplace.
+        // Slot last granted by the channel's ActiveSpeakerTracker (-1: none).
+        std::atomic<int>       speakerSlot{ -1 };
+
+        // Non-copyable because of atomics; shared between the binding map and
+        // the routing snapshots that reference it.
         UdpBinding() = default;
         UdpBinding(const UdpBinding&) = delete;
         UdpBinding& operator=(const UdpBinding&) = delete;
-        UdpBinding(UdpBinding&&) = default;
-        UdpBinding& operator=(UdpBinding&&) = default;
+    };
+
+    // ---------------------------------------------------------------------------
+    // Copy-on-write voice routing.
+    //
+    // Every voice channel publishes an immutable VoiceRoute (members and their
+    // UDP bindings) through an atomic shared_ptr, and VoiceDirectory maps each
+    // bound username to its binding and channel. Writers (join, leave, hello,
+    // health check) rebuild the affected snapshots under m_RoomMutex; the UDP
+    // relay only loads them, so joins and leaves never stall speakers.
+    // ---------------------------------------------------------------------------
+    struct VoiceRoute {
+        struct Member {
+            uint32_t                    userId = 0;
+            std::shared_ptr<UdpBinding> binding;   // null: reachable over TCP only
+            std::weak_ptr<ChatSession>  session;
+        };
+        std::vector<Member> members;
+    };
+
+    struct VoiceChannelRouting {
+        std::atomic<std::shared_ptr<const VoiceRoute>> route;
+        ActiveSpeakerTracker                            speakers;
+    };
+
+    struct VoiceDirectory {
+        struct Sender {
+            uint32_t                             userId = 0;
+            std::shared_ptr<UdpBinding>          binding;
+            std::shared_ptr<VoiceChannelRouting> channel;
+        };
+        std::unordered_map<std::string, Sender, TransparentStringHash, std::equal_to<>> senders;
+    };
+
+    // ---------------------------------------------------------------------------
+    // Deadline check filed in the server's expiry wheel. The session or
+    // binding may be gone by the time it fires; the check is then dropped.
+    // ---------------------------------------------------------------------------
+    struct ExpiryCheck {
+        enum class Kind : uint8_t {
+            SessionIdle,   // no packet for kSessionIdleTimeoutMs, or the socket failed
+            VoiceIdle,     // in a voice channel, no TCP or UDP traffic for kVoiceIdleEvictSec
+            UdpBinding,    // no datagram for kUdpBindingTtlMs
+        };
+        Kind                        kind = Kind::SessionIdle;
+        std::weak_ptr<ChatSession>  session;
+        std::weak_ptr<UdpBinding>   binding;
+        uint32_t                    userId = 0;   // binding owner
+
+        static ExpiryCheck ForSession(Kind kind, std::weak_ptr<ChatSession> session) {
+            ExpiryCheck check;
+            check.kind = kind;
+            check.session = std::move(session);
+            return check;
+        }
+        static ExpiryCheck ForBinding(std::weak_ptr<UdpBinding> binding, uint32_t userId) {
+            ExpiryCheck check;
+            check.kind = Kind::UdpBinding;
+            check.binding = std::move(binding);
+            check.userId = userId;
+            return check;
+        }
     };
 
     // ---------------------------------------------------------------------------
@@ -79,9 +165,20 @@ namespace TalkMe {
 
         // Broadcast helpers.
         void BroadcastToAll(PacketType type, const std::string& data);
-        void BroadcastToChannelMembers(int channelId, PacketType type, const std::string& payload);
+        // binaryPayload, if given, is the WireCodec encoding of payload and goes
+        // to sessions that negotiated it.
+        void BroadcastToChannelMembers(int channelId, PacketType type, const std::string& payload,
+            const std::string& binaryPayload = {});
         void BroadcastVoice(int cid, std::shared_ptr<ChatSession> sender,
-            PacketHeader h, const std::vector<uint8_t>& body);
+            PacketHeader h, std::span<const uint8_t> body);
+
+        // Screen_Share_Frame from `sharer` to the members of voice channel `cid`
+        // that watch it, through the keyframe cache. Returns how many it was queued for.
+        size_t RelayScreenShareFrame(int cid, const ChatSession* sharer, std::span<const uint8_t> body);
+        void EndScreenShare(const ChatSession* sharer) { m_ScreenShares.EndShare(sharer); }
+        // `viewer`, a member of voice channel `cid`, watches the shares of these users only.
+        void WatchScreenShares(const std::shared_ptr<ChatSession>& viewer, int cid,
+            const std::vector<std::string>& sharers);
 
         // Stats ingestion (called from Receiver_Report handler).
         void RecordVoiceStats(const std::string& username, int cid,
@@ -92,11 +189,24 @@ namespace TalkMe {
         uint32_t GetChannelBitrateLimit(int cid);
 
         // Broadcast a pre-built buffer to all members in a voice channel.
-        void BroadcastToVoiceChannel(int cid, std::shared_ptr<std::vector<uint8_t>> buffer);
+        void BroadcastToVoiceChannel(int cid, std::shared_ptr<std::vector<uint8_t>> buffer,
+            std::shared_ptr<std::vector<uint8_t>> binaryBuffer = nullptr);
 
         // Create a shared buffer suitable for broadcasting (public wrapper).
         std::shared_ptr<std::vector<uint8_t>> CreateBroadcastBuffer(PacketType type, const std::string& data);
 
+        // Username interning: every authenticated username maps to a stable,
+        // non-zero integer id for the lifetime of the process. 0 means "none".
+        uint32_t InternUser(std::string_view username);
+        uint32_t FindUserId(std::string_view username) const;
+
+        // Session `session` (re)authenticated; it was indexed under
+        // `previousUserId` before, 0 if never. Keeps the user -> sessions index.
+        void IndexUserSession(const std::shared_ptr<ChatSession>& session, uint32_t previousUserId);
+        // Queues `buffer` on every session `username` is logged in on; returns
+        // how many there were.
+        size_t SendToUser(std::string_view username, const std::shared_ptr<std::vector<uint8_t>>& buffer);
+
         // Access session registry (callers must lock m_RoomMutex).
         std::shared_mutex& GetRoomMutex() { return m_RoomMutex; }
         const std::set<std::shared_ptr<ChatSession>>& GetAllSessions() const { return m_AllSessions; }
@@ -114,62 +224,174 @@ namespace TalkMe {
         };
         std::unordered_map<int, CinemaChannelState>& GetCinemaChannels() { return m_CinemaChannels; }
 
-        // Broadcast user online/offline presence to all sessions.
-        void BroadcastPresence(const std::string& username, bool online);
-
-        // Get list of currently online usernames.
-        std::vector<std::string> GetOnlineUsers();
+        // Presence (PresenceHub.h): `subject` came online or changed its
+        // status text. Goes out with the next batch to the sessions that share
+        // a server or a friendship with it; going offline is sent by LeaveClient.
+        void PublishPresence(const std::shared_ptr<ChatSession>& subject);
+        void PublishStatus(const std::shared_ptr<ChatSession>& subject, const std::string& status);
+        // Accepted friends of an authenticated user, and changes to them.
+        void SetUserFriends(const std::shared_ptr<ChatSession>& subject, const std::vector<std::string>& friends);
+        void AddFriendship(std::string_view a, std::string_view b);
+        void RemoveFriendship(std::string_view a, std::string_view b);
+
+        // True while `username` has an authenticated session.
+        bool IsOnline(std::string_view username);
+
+        // Channel membership index behind BroadcastToChannelMembers. Rows are a
+        // user's (server id, channel id) pairs as returned by
+        // Database::GetUserServerChannels; channel id 0 marks a server with no
+        // channels. Call after any change to the user's memberships.
+        using ServerChannelRows = std::vector<std::pair<int, int>>;
+        void SetUserMembership(const std::string& username, const ServerChannelRows& rows);
+        void IndexChannel(int sid, int cid);
+        void UnindexChannel(int cid);
+        void UnindexServer(int sid);
 
     private:
         // --- Tuning constants ---------------------------------------------------
-        static constexpr size_t  kActiveSpeakerMax = 32;
+        static constexpr size_t  kActiveSpeakerMax = ActiveSpeakerTracker::kCapacity;
         static constexpr size_t  kMaxVoiceStatsSamples = 360;
         static constexpr int     kTokenBucketMax = 150;
         static constexpr int     kPacketsPerSec = 150;
         static constexpr int64_t kActiveSpeakerWindowMs = 2'000;
         static constexpr int64_t kUdpBindingTtlMs = 60'000;
         static constexpr int64_t kVoiceIdleEvictSec = 60;
+        static constexpr int64_t kSessionIdleTimeoutMs = 300'000;
+        static constexpr int64_t kFirstPacketTimeoutMs = 5'000;   // silent connections go at the first check
+        static constexpr int64_t kExpiryTickMs = 1'000;
 
         // --- ASIO handles -------------------------------------------------------
         asio::ip::tcp::acceptor   m_Acceptor;
         asio::ip::tcp::acceptor   m_MediaAcceptor;  // HTTP GET /media/<id> on port 5557
-        asio::ip::udp::socket     m_VoiceUdpSocket;
         asio::io_context& m_IoContext;
 
+        // --- UDP voice ingress ----------------------------------------------------
+        // One or more sockets bound to VOICE_PORT. With TALKME_VOICE_SOCKETS=N
+        // (Linux/BSD) they share the port via SO_REUSEPORT and the kernel hashes
+        // each client's 4-tuple onto one of them, so every socket has its own
+        // receive loop in flight and ingress spreads across io_context threads.
+        // Replies and relays leave through the socket the packet arrived on.
+        struct VoiceIngress {
+            explicit VoiceIngress(asio::io_context& io) : socket(io) {}
+            asio::ip::udp::socket       socket;
+            std::array<uint8_t, 65'535> recvBuffer{};
+            asio::ip::udp::endpoint     recvFrom;
+            std::atomic<uint64_t>       packets{ 0 };   // received, for pps stats
+            uint64_t                    lastPackets = 0; // stats timer only
+
+            // Syscall counters: datagrams per call shows the batch sizes achieved.
+            std::atomic<uint64_t>       recvCalls{ 0 };
+            std::atomic<uint64_t>       sendCalls{ 0 };
+            std::atomic<uint64_t>       sentPackets{ 0 };
+            std::atomic<uint64_t>       suppressedPackets{ 0 };   // dropped by top-N forwarding
+        };
+        std::vector<std::unique_ptr<VoiceIngress>> m_VoiceIngress;
+
+        // Linux only: drain with recvmmsg and fan out with sendmmsg instead of
+        // one syscall per datagram. TALKME_VOICE_BATCH=0 selects the asio path.
+        bool m_VoiceBatchIo = false;
+
+        // Selective forwarding (TALKME_VOICE_TOPN); 0 = forward every speaker.
+        size_t m_VoiceTopN = 0;
+
         // --- Session registry (guarded by m_RoomMutex) -------------------------
         std::shared_mutex                                                m_RoomMutex;
         std::set<std::shared_ptr<ChatSession>>                           m_AllSessions;
         std::unordered_map<int, std::set<std::shared_ptr<ChatSession>>>  m_VoiceChannels;
         std::unordered_map<int, CinemaChannelState> m_CinemaChannels;
-
-        // --- UDP bindings (guarded by m_RoomMutex) -----------------------------
-        std::unordered_map<std::string, UdpBinding> m_UdpBindings;
-
-        // --- O(1) active-speaker tracking (guarded by m_SpeakerMutex) ----------
-        // Maps cid -> { username -> last_spoken_timestamp_ms }
-        std::mutex                                                              m_SpeakerMutex;
-        std::unordered_map<int, std::unordered_map<std::string, int64_t>>      m_RecentSpeakersByChannel;
+        // Interned user id -> the user's authenticated sessions; an entry is
+        // erased with its last session, so presence is a lookup.
+        std::unordered_map<uint32_t, std::vector<std::shared_ptr<ChatSession>>> m_UserSessions;
+        uint64_t m_OnlineOrder = 0;   // last ChatSession::GetOnlineOrder() handed out
+
+        // --- Channel membership index (guarded by m_RoomMutex) -----------------
+        // Channel fan-out walks the online sessions of the channel's server
+        // instead of joining server_members and scanning every session.
+        // Channel entries outlive their last online member; they are dropped
+        // only when the channel or server is deleted.
+        std::unordered_map<int, int>                                                 m_ChannelServers;  // cid -> sid
+        std::unordered_map<int, std::unordered_set<std::shared_ptr<ChatSession>>>  m_ServerSessions;  // sid -> online sessions
+        std::unordered_map<const ChatSession*, std::vector<int>>                     m_SessionServers;  // session -> sids
+
+        // --- Screen share fan-out and keyframe cache (own mutex, after m_RoomMutex)
+        ScreenShareRelay m_ScreenShares;
+
+        // --- Pending presence changes and friend lists (own mutex, after m_RoomMutex)
+        PresenceHub m_Presence;
+
+        // --- UDP bindings keyed by interned user id (guarded by m_RoomMutex) ---
+        std::unordered_map<uint32_t, std::shared_ptr<UdpBinding>> m_UdpBindings;
+
+        // --- Idle and expiry deadlines (own mutex, after m_RoomMutex) ----------
+        // One check per session, per voice channel stay and per UDP binding,
+        // filed when it starts. Activity only moves the timestamps the check
+        // reads when it fires.
+        std::mutex                  m_ExpiryMutex;
+        TimerWheel<ExpiryCheck>     m_Expiry;
+        struct ExpiryStats {
+            std::atomic<uint64_t> fired{ 0 };
+            std::atomic<uint64_t> refiled{ 0 };     // deadline had moved
+            std::atomic<uint64_t> expired{ 0 };
+            std::atomic<uint64_t> maxTickUs{ 0 };   // reset by the stats timer
+        } m_ExpiryStats;
+
+        // --- Voice routing snapshots (written under m_RoomMutex, read lock-free) -
+        std::unordered_map<int, std::shared_ptr<VoiceChannelRouting>> m_VoiceRouting;
+        std::atomic<std::shared_ptr<const VoiceDirectory>>            m_VoiceDirectory;
+        std::atomic<uint64_t>                                         m_VoiceDirectoryVersion{ 0 };
+
+        // --- Username interning (guarded by m_UserIdMutex) ----------------------
+        mutable std::shared_mutex                                                  m_UserIdMutex;
+        std::unordered_map<std::string, uint32_t, TransparentStringHash, std::equal_to<>> m_UserIds;
 
         // --- Telemetry (guarded by m_StatsMutex) --------------------------------
         std::mutex                                  m_StatsMutex;
         std::unordered_map<std::string, VoiceStatEntry> m_LastVoiceStats;
         std::deque<AggVoiceSample>                  m_VoiceStatsHistory;
 
-        // --- UDP receive scratch space ------------------------------------------
-        std::array<uint8_t, 65'535> m_VoiceRecvBuffer{};
-        asio::ip::udp::endpoint     m_VoiceRecvFrom;
-
         // --- Internal helpers ---------------------------------------------------
         void DoAccept();
         void DoAcceptMedia();
-        void StartVoiceUdpReceive();
+        void OpenVoiceIngress(size_t count);
+        void StartVoiceUdpReceive(VoiceIngress& ingress);
+        void StartVoiceUdpBatchReceive(VoiceIngress& ingress);
+        void DrainVoiceUdpBatch(VoiceIngress& ingress);
         void StartConnectionHealthCheck();
+        void ScheduleExpiry(int64_t dueMs, ExpiryCheck check);
         void StartVoiceOptimizationTimer();
         void StartVoiceStatsWriteTimer();
-
-        void HandleVoiceUdpPacket(const std::vector<uint8_t>& packet,
+        void RegisterMetrics();
+        void StartAttachmentSweepTimer();
+        void StartPresenceFlushTimer();
+        void FlushPresence();
+
+        // Parses the datagram in place; must not retain `packet` past return.
+        void HandleVoiceUdpPacket(VoiceIngress& ingress,
+            std::span<const uint8_t> packet,
             const asio::ip::udp::endpoint& from);
 
+        // Sends one pooled datagram to every endpoint in `targets` via the
+        // ingress socket it arrived on.
+        void SendVoiceDatagram(VoiceIngress& ingress,
+            const VoicePacketPool::Ref& packet,
+            std::span<const asio::ip::udp::endpoint> targets);
+
+        // Routing snapshot maintenance; m_RoomMutex must be held exclusively.
+        void RebuildVoiceRouteLocked(int cid);
+        void RebuildVoiceDirectoryLocked();
+        void UnindexSessionLocked(const std::shared_ptr<ChatSession>& session);
+        void UnindexUserSessionLocked(const std::shared_ptr<ChatSession>& session, uint32_t userId);
+        std::span<const std::shared_ptr<ChatSession>> UserSessionsLocked(uint32_t userId) const;
+        int  EraseUdpBindingLocked(uint32_t userId);   // returns the binding's cid or -1
+        // Queues a change of `subject` for its servers' members and friends;
+        // m_RoomMutex held in any mode, `subject` still in the server index.
+        void QueuePresenceLocked(const std::shared_ptr<ChatSession>& subject,
+            std::optional<bool> online, std::optional<std::string> status);
+
+        // Lock-free: the calling thread's cached copy, refreshed when the
+        // directory version changes. Valid until this thread calls it again.
+        const VoiceDirectory& CurrentVoiceDirectory();
+
         // Must be called while m_RoomMutex is already held (any mode).
         void RefreshChannelControlLockFree(int cid,
             const std::string& targetUser = {},
@@ -179,7 +401,7 @@ namespace TalkMe {
             CreateBuffer(PacketType type, const std::string& data);
 
         static std::shared_ptr<std::vector<uint8_t>>
-            CreateBufferRaw(PacketHeader h, const std::vector<uint8_t>& body);
+            CreateBufferRaw(PacketHeader h, std::span<const uint8_t> body);
     };
 
 } // namespace TalkMe
\ No newline at end of file
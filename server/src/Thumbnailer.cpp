@@ -0,0 +1,232 @@
+#include "Thumbnailer.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+namespace TalkMe {
+
+    namespace {
+        const std::filesystem::path kPreviewDir = std::filesystem::path("attachments") / "previews";
+        constexpr size_t kMaxSeen = 64 * 1024;
+
+        std::filesystem::path PreviewPath(const std::string& id, int size, const char* ext) {
+            return kPreviewDir / (id + "." + std::to_string(size) + ext);
+        }
+
+        struct Image {
+            int w = 0, h = 0;
+            std::vector<unsigned char> rgba;
+        };
+
+        // Box filter: every destination pixel is the average of the source
+        // pixels it covers. Good enough for previews and cheap.
+        Image Downscale(const Image& src, int dw, int dh) {
+            Image dst;
+            dst.w = dw;
+            dst.h = dh;
+            dst.rgba.resize(static_cast<size_t>(dw) * dh * 4);
+            for (int y = 0; y < dh; ++y) {
+                const int y0 = static_cast<int>(static_cast<int64_t>(y) * src.h / dh);
+                const int y1 = std::max(y0 + 1, static_cast<int>(static_cast<int64_t>(y + 1) * src.h / dh));
+                for (int x = 0; x < dw; ++x) {
+                    const int x0 = static_cast<int>(static_cast<int64_t>(x) * src.w / dw);
+                    const int x1 = std::max(x0 + 1, static_cast<int>(static_cast<int64_t>(x + 1) * src.w / dw));
+                    uint64_t sum[4] = { 0, 0, 0, 0 };
+                    for (int sy = y0; sy < y1; ++sy) {
+                        const unsigned char* p = &src.rgba[(static_cast<size_t>(sy) * src.w + x0) * 4];
+                        for (int sx = x0; sx < x1; ++sx, p += 4) {
+                            sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; sum[3] += p[3];
+                        }
+                    }
+                    const uint64_t n = static_cast<uint64_t>(y1 - y0) * (x1 - x0);
+                    unsigned char* out = &dst.rgba[(static_cast<size_t>(y) * dw + x) * 4];
+                    for (int c = 0; c < 4; ++c) out[c] = static_cast<unsigned char>((sum[c] + n / 2) / n);
+                }
+            }
+            return dst;
+        }
+
+        void AppendToString(void* ctx, void* data, int size) {
+            static_cast<std::string*>(ctx)->append(static_cast<const char*>(data), static_cast<size_t>(size));
+        }
+
+        // Writes through a temp file so readers never see a partial preview.
+        bool WriteAtomically(const std::filesystem::path& path, const std::string& bytes) {
+            auto tmp = path;
+            tmp += ".tmp";
+            {
+                std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) return false;
+            }
+            std::error_code ec;
+            std::filesystem::rename(tmp, path, ec);
+            if (ec) std::filesystem::remove(tmp, ec);
+            return !ec;
+        }
+    }
+
+    Thumbnailer& Thumbnailer::Get() {
+        static Thumbnailer instance;
+        return instance;
+    }
+
+    Thumbnailer::Stats& Thumbnailer::GetStats() {
+        static Stats s;
+        return s;
+    }
+
+    Thumbnailer::Thumbnailer() {
+        std::error_code ec;
+        std::filesystem::create_directories(kPreviewDir, ec);
+        const size_t workers = std::clamp<size_t>(std::thread::hardware_concurrency() / 4, 1, 4);
+        for (size_t i = 0; i < workers; ++i)
+            m_Workers.emplace_back(&Thumbnailer::WorkerLoop, this);
+    }
+
+    Thumbnailer::~Thumbnailer() {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Shutdown = true;
+        }
+        m_Cv.notify_all();
+        for (auto& t : m_Workers)
+            if (t.joinable()) t.join();
+    }
+
+    void Thumbnailer::Enqueue(const std::string& id) {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (m_Shutdown || m_Queue.size() >= kMaxQueue) return;
+            if (m_Seen.size() >= kMaxSeen) m_Seen.clear();
+            if (!m_Seen.insert(id).second) return;
+            m_Queue.push_back(id);
+        }
+        m_Cv.notify_one();
+    }
+
+    std::filesystem::path Thumbnailer::Find(const std::string& id, int size) {
+        int bucket = kPreviewSizes.back();
+        for (int s : kPreviewSizes) {
+            if (s >= size) { bucket = s; break; }
+        }
+        std::error_code ec;
+        for (const char* ext : { ".jpg", ".png" }) {
+            auto path = PreviewPath(id, bucket, ext);
+            if (std::filesystem::is_regular_file(path, ec)) return path;
+        }
+        Enqueue(id);
+        return {};
+    }
+
+    void Thumbnailer::Remove(const std::string& id) {
+        std::error_code ec;
+        for (int s : kPreviewSizes) {
+            std::filesystem::remove(PreviewPath(id, s, ".jpg"), ec);
+            std::filesystem::remove(PreviewPath(id, s, ".png"), ec);
+        }
+    }
+
+    void Thumbnailer::WorkerLoop() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Cv.wait(lock, [this] { return m_Shutdown || !m_Queue.empty(); });
+            if (m_Shutdown) break;
+            std::string id = std::move(m_Queue.front());
+            m_Queue.pop_front();
+            lock.unlock();
+            Generate(id);
+        }
+    }
+
+    void Thumbnailer::Generate(const std::string& id) {
+        auto& stats = GetStats();
+        const auto source = std::filesystem::path("attachments") / id;
+        std::error_code ec;
+        const auto fileSize = std::filesystem::file_size(source, ec);
+        if (ec || fileSize == 0 || fileSize > kMaxSourceBytes) {
+            stats.skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::string bytes(static_cast<size_t>(fileSize), '\0');
+        {
+            std::ifstream in(source, std::ios::binary);
+            if (!in.read(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+                stats.failed.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        // Header only first: non-images and huge images cost nothing to skip.
+        const auto* data = reinterpret_cast<const stbi_uc*>(bytes.data());
+        const int len = static_cast<int>(bytes.size());
+        int w = 0, h = 0, comp = 0;
+        if (!stbi_info_from_memory(data, len, &w, &h, &comp) || w <= 0 || h <= 0 ||
+            static_cast<uint64_t>(w) * h > kMaxSourcePixels || std::max(w, h) <= kPreviewSizes.front()) {
+            stats.skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // Already generated before a restart: leave them be.
+        const int longest = std::max(w, h);
+        bool missing = false;
+        for (int s : kPreviewSizes) {
+            if (s >= longest) break;
+            if (!std::filesystem::exists(PreviewPath(id, s, ".jpg"), ec) &&
+                !std::filesystem::exists(PreviewPath(id, s, ".png"), ec))
+                missing = true;
+        }
+        if (!missing) return;
+
+        // For an animated GIF stb returns the first frame.
+        Image image;
+        stbi_uc* pixels = stbi_load_from_memory(data, len, &image.w, &image.h, &comp, 4);
+        if (!pixels) {
+            stats.failed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        image.rgba.assign(pixels, pixels + static_cast<size_t>(image.w) * image.h * 4);
+        stbi_image_free(pixels);
+        bytes.clear();
+        bytes.shrink_to_fit();
+
+        bool opaque = true;
+        for (size_t i = 3; i < image.rgba.size() && opaque; i += 4) opaque = image.rgba[i] == 255;
+
+        // Largest first, each scaled from the previous one.
+        for (auto it = kPreviewSizes.rbegin(); it != kPreviewSizes.rend(); ++it) {
+            const int edge = *it;
+            if (edge >= std::max(image.w, image.h)) continue;
+            const int dw = image.w >= image.h ? edge : std::max(1, static_cast<int>(static_cast<int64_t>(image.w) * edge / image.h));
+            const int dh = image.h > image.w ? edge : std::max(1, static_cast<int>(static_cast<int64_t>(image.h) * edge / image.w));
+            image = Downscale(image, dw, dh);
+
+            std::string encoded;
+            int ok = 0;
+            if (opaque) {
+                std::vector<unsigned char> rgb(static_cast<size_t>(dw) * dh * 3);
+                for (size_t p = 0, q = 0; p < image.rgba.size(); p += 4, q += 3) {
+                    rgb[q] = image.rgba[p]; rgb[q + 1] = image.rgba[p + 1]; rgb[q + 2] = image.rgba[p + 2];
+                }
+                ok = stbi_write_jpg_to_func(AppendToString, &encoded, dw, dh, 3, rgb.data(), kJpegQuality);
+            }
+            else {
+                ok = stbi_write_png_to_func(AppendToString, &encoded, dw, dh, 4, image.rgba.data(), dw * 4);
+            }
+            // A flat PNG can be smaller than any re-encode of it; keep serving
+            // the original then.
+            if (ok && encoded.size() >= fileSize) continue;
+            if (!ok || !WriteAtomically(PreviewPath(id, edge, opaque ? ".jpg" : ".png"), encoded)) {
+                stats.failed.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            stats.generated.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+} // namespace TalkMe
@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // Downscaled previews of image attachments.
+    //
+    // For every image attachment whose longest edge exceeds a preview size, a
+    // copy scaled to that edge (box filter) is written to
+    // attachments/previews/<id>.<size>.jpg, or .png when the image has
+    // transparency. GIFs get a still of their first frame. The media port and
+    // Media_Request serve a preview when the client asks for a size, so chat
+    // views download a few tens of KiB instead of the original.
+    //
+    // Decoding and encoding run on a small worker pool, never on an io thread.
+    // Uploads are queued as they complete; older attachments are queued the
+    // first time a preview of them is asked for, and are served in full until
+    // it exists. Previews are deleted with their attachment by the sweep.
+    // ---------------------------------------------------------------------------
+    class Thumbnailer {
+    public:
+        static constexpr std::array<int, 3> kPreviewSizes{ 160, 480, 1280 };
+        static constexpr uint64_t kMaxSourceBytes = 32 * 1024 * 1024;
+        static constexpr uint64_t kMaxSourcePixels = 40ull * 1000 * 1000;
+        static constexpr size_t   kMaxQueue = 1024;
+        static constexpr int      kJpegQuality = 80;
+
+        struct Stats {
+            std::atomic<uint64_t> generated{ 0 };     // preview files written
+            std::atomic<uint64_t> skipped{ 0 };       // not an image, too large, or already small
+            std::atomic<uint64_t> failed{ 0 };        // decode, encode or write errors
+            std::atomic<uint64_t> served{ 0 };        // requests answered with a preview
+            std::atomic<uint64_t> bytesSaved{ 0 };    // original bytes not sent thanks to previews
+        };
+
+        static Thumbnailer& Get();
+        static Stats& GetStats();
+
+        ~Thumbnailer();
+
+        // Queues preview generation for attachments/<id>. Cheap; ids already
+        // queued or done are ignored.
+        void Enqueue(const std::string& id);
+
+        // Preview of `id` for a requested longest edge of `size` px, rounded up
+        // to a preview size (the largest one if `size` exceeds them all).
+        // Empty when there is none yet, in which case it is queued.
+        std::filesystem::path Find(const std::string& id, int size);
+
+        // Deletes every preview of `id`.
+        static void Remove(const std::string& id);
+
+    private:
+        Thumbnailer();
+
+        void WorkerLoop();
+        static void Generate(const std::string& id);
+
+        std::vector<std::thread>        m_Workers;
+        std::mutex                      m_Mutex;
+        std::condition_variable         m_Cv;
+        std::deque<std::string>         m_Queue;
+        std::unordered_set<std::string> m_Seen;     // queued or processed
+        bool                            m_Shutdown = false;
+    };
+
+} // namespace TalkMe
@@ -0,0 +1,89 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // Hierarchical timer wheel for coarse deadlines (idle and expiry checks).
+    //
+    // kLevels wheels of kSlots slots each; a slot of level k spans
+    // kSlots^k ticks. An entry goes into the lowest level whose range covers
+    // its deadline. Each tick expires one level-0 slot, and whenever the
+    // tick count crosses a level-k boundary the matching level-k slot is
+    // re-filed one level down or more. Advance() therefore touches only the
+    // entries that are due or being re-filed, never the whole set. Deadlines
+    // past the top level's range are parked in its farthest slot and re-filed
+    // from there.
+    //
+    // Entries cannot be cancelled. Owners check on expiry whether the entry
+    // still means anything and schedule it again if its deadline has moved,
+    // so the hot path only has to bump a timestamp.
+    //
+    // Not thread-safe.
+    // ---------------------------------------------------------------------------
+    template <typename T>
+    class TimerWheel {
+    public:
+        static constexpr int     kSlotBits = 6;
+        static constexpr size_t  kSlots = size_t{ 1 } << kSlotBits;
+        static constexpr int     kLevels = 4;   // 64^4 ticks: ~194 days at 1 s
+
+        TimerWheel(int64_t tickMs, int64_t nowMs)
+            : m_TickMs(tickMs), m_Tick(nowMs / tickMs) {}
+
+        // Fires `value` at the first Advance() at or after `dueMs`.
+        void Schedule(int64_t dueMs, T value) {
+            File(std::max((dueMs + m_TickMs - 1) / m_TickMs, m_Tick + 1), std::move(value));
+            ++m_Size;
+        }
+
+        // Moves every entry due by `nowMs` to `due`.
+        void Advance(int64_t nowMs, std::vector<T>& due) {
+            const int64_t target = nowMs / m_TickMs;
+            while (m_Tick < target) {
+                ++m_Tick;
+                for (int level = 1; level < kLevels; ++level) {
+                    if ((m_Tick & Mask(level)) != 0) break;
+                    // Lands in lower levels only, or in later slots of this one.
+                    auto& slot = m_Wheels[level][SlotOf(m_Tick, level)];
+                    auto entries = std::exchange(slot, {});
+                    for (auto& e : entries) File(e.first, std::move(e.second));
+                }
+                auto& slot = m_Wheels[0][SlotOf(m_Tick, 0)];
+                for (auto& e : slot) due.push_back(std::move(e.second));
+                m_Size -= slot.size();
+                slot.clear();
+            }
+        }
+
+        size_t Size() const { return m_Size; }
+
+    private:
+        using Entry = std::pair<int64_t, T>;   // due tick, value
+
+        static constexpr int64_t Mask(int level) { return (int64_t{ 1 } << (kSlotBits * level)) - 1; }
+        static size_t SlotOf(int64_t tick, int level) {
+            return static_cast<size_t>(tick >> (kSlotBits * level)) & (kSlots - 1);
+        }
+
+        void File(int64_t dueTick, T value) {
+            const int64_t delta = dueTick - m_Tick;
+            int level = 0;
+            while (level < kLevels - 1 && delta > Mask(level + 1)) ++level;
+            // Beyond the top level's range: park in its farthest slot.
+            const int64_t fileTick = delta > Mask(kLevels) ? m_Tick + Mask(kLevels) : dueTick;
+            m_Wheels[level][SlotOf(fileTick, level)].emplace_back(dueTick, std::move(value));
+        }
+
+        int64_t m_TickMs;
+        int64_t m_Tick;   // last tick advanced to
+        size_t  m_Size = 0;
+        std::array<std::array<std::vector<Entry>, kSlots>, kLevels> m_Wheels;
+    };
+
+} // namespace TalkMe
@@ -0,0 +1,324 @@
+#include "UploadManager.h"
+#include "AttachmentStore.h"
+#include "Crypto.h"
+#include "Protocol.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <system_error>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace TalkMe {
+
+    UploadManager& UploadManager::Get() {
+        static UploadManager instance;
+        return instance;
+    }
+
+    UploadManager::Stats& UploadManager::GetStats() {
+        static Stats s;
+        return s;
+    }
+
+    UploadManager::UploadManager() {
+        const size_t workers = std::clamp<size_t>(std::thread::hardware_concurrency() / 4, 2, 4);
+        for (size_t i = 0; i < workers; ++i)
+            m_Workers.emplace_back(&UploadManager::WorkerLoop, this);
+    }
+
+    UploadManager::~UploadManager() {
+        {
+            std::lock_guard<std::mutex> lock(m_QueueMutex);
+            m_Shutdown = true;
+        }
+        m_QueueCv.notify_all();
+        for (auto& t : m_Workers)
+            if (t.joinable()) t.join();
+    }
+
+    void UploadManager::Post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(m_QueueMutex);
+            if (m_Shutdown) return;
+            m_Queue.push_back(std::move(job));
+        }
+        m_QueueCv.notify_one();
+    }
+
+    void UploadManager::WorkerLoop() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(m_QueueMutex);
+            m_QueueCv.wait(lock, [this] { return m_Shutdown || !m_Queue.empty(); });
+            if (m_Shutdown) break;
+            auto job = std::move(m_Queue.front());
+            m_Queue.pop_front();
+            lock.unlock();
+            job();
+        }
+    }
+
+    UploadManager::UploadPtr UploadManager::Begin(const void* holder, const std::string& owner, const std::string& id,
+        const std::string& hash, uint64_t size, bool windowed)
+    {
+        auto upload = std::make_shared<Upload>();
+        upload->owner = owner;
+        upload->id = id;
+        upload->hash = hash;
+        upload->size = size;
+        upload->windowed = windowed;
+        upload->holder = holder;
+        upload->path = AttachmentStore::NewIncomingPath();
+#if defined(__linux__)
+        upload->fd = ::open(upload->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (upload->fd < 0) return nullptr;
+#else
+        upload->file.open(upload->path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!upload->file) return nullptr;
+#endif
+        UploadPtr replaced;
+        {
+            std::lock_guard<std::mutex> lock(m_RegistryMutex);
+            auto& slot = m_Uploads[Key(owner, id)];
+            replaced = std::move(slot);
+            slot = upload;
+        }
+        // A detached upload of the same content will not be resumed now; one
+        // still held by another connection carries on unregistered.
+        if (replaced) {
+            bool detached;
+            {
+                std::lock_guard<std::mutex> lock(replaced->mutex);
+                detached = replaced->holder == nullptr;
+            }
+            if (detached) WhenDrained(replaced, [replaced]() { Discard(*replaced); });
+        }
+        GetStats().started.fetch_add(1, std::memory_order_relaxed);
+        return upload;
+    }
+
+    UploadManager::UploadPtr UploadManager::Resume(const void* holder, const std::string& owner, const std::string& id,
+        const std::string& hash, uint64_t size, uint64_t& offset)
+    {
+        UploadPtr upload;
+        {
+            std::lock_guard<std::mutex> lock(m_RegistryMutex);
+            auto it = m_Uploads.find(Key(owner, id));
+            if (it == m_Uploads.end()) return nullptr;
+            upload = it->second;
+        }
+        if (!upload->windowed || upload->size != size || upload->hash != hash) return nullptr;
+        {
+            std::lock_guard<std::mutex> lock(upload->mutex);
+            if (upload->writeFailed) return nullptr;
+            upload->holder = holder;
+            upload->acked = upload->prefix;
+            offset = upload->prefix;
+        }
+        auto& stats = GetStats();
+        stats.resumed.fetch_add(1, std::memory_order_relaxed);
+        stats.resumedBytes.fetch_add(offset, std::memory_order_relaxed);
+        return upload;
+    }
+
+    bool UploadManager::Write(const UploadPtr& upload, uint64_t offset, std::span<const uint8_t> data, AckFn onAck) {
+        const uint64_t n = data.size();
+        {
+            std::lock_guard<std::mutex> lock(upload->mutex);
+            if (upload->closed || upload->pending + n > kMaxPendingBytes) return false;
+            upload->pending += n;
+        }
+        auto& stats = GetStats();
+        stats.pendingBytes.fetch_add(n, std::memory_order_relaxed);
+
+        Post([upload, offset, bytes = std::vector<uint8_t>(data.begin(), data.end()), onAck = std::move(onAck)]() {
+            auto& stats = GetStats();
+            const uint64_t n = bytes.size();
+            bool ok = true;
+#if defined(__linux__)
+            for (uint64_t done = 0; done < n;) {
+                const ssize_t w = ::pwrite(upload->fd, bytes.data() + done, static_cast<size_t>(n - done),
+                    static_cast<off_t>(offset + done));
+                if (w < 0 && errno == EINTR) continue;
+                if (w <= 0) { ok = false; break; }
+                done += static_cast<uint64_t>(w);
+            }
+#endif
+            uint64_t ack = 0;
+            std::vector<std::function<void()>> drained;
+            {
+                std::lock_guard<std::mutex> lock(upload->mutex);
+#if !defined(__linux__)
+                upload->file.seekp(static_cast<std::streamoff>(offset));
+                ok = static_cast<bool>(upload->file.write(reinterpret_cast<const char*>(bytes.data()),
+                    static_cast<std::streamsize>(n)));
+#endif
+                if (ok && n > 0) {
+                    // Merge [offset, offset + n) into the stored ranges.
+                    uint64_t begin = offset, end = offset + n;
+                    auto it = upload->stored.upper_bound(begin);
+                    if (it != upload->stored.begin()) {
+                        auto prev = std::prev(it);
+                        if (prev->second >= begin) {
+                            begin = prev->first;
+                            end = std::max(end, prev->second);
+                            it = upload->stored.erase(prev);
+                        }
+                    }
+                    while (it != upload->stored.end() && it->first <= end) {
+                        end = std::max(end, it->second);
+                        it = upload->stored.erase(it);
+                    }
+                    upload->stored.emplace(begin, end);
+                    if (upload->stored.begin()->first == 0) upload->prefix = upload->stored.begin()->second;
+                }
+                else if (!ok) {
+                    upload->writeFailed = true;
+                }
+                upload->pending -= n;
+#if defined(__linux__)
+                // CloseFile() leaves the descriptor to the last write in flight.
+                if (upload->closed && upload->pending == 0 && upload->fd >= 0) {
+                    ::close(upload->fd);
+                    upload->fd = -1;
+                }
+#endif
+                if (upload->prefix >= upload->acked + kUploadAckBytes ||
+                    (upload->prefix == upload->size && upload->acked < upload->size)) {
+                    upload->acked = upload->prefix;
+                    ack = upload->prefix;
+                }
+                if (upload->pending == 0) drained.swap(upload->onDrained);
+            }
+            stats.pendingBytes.fetch_sub(n, std::memory_order_relaxed);
+            if (ok) stats.bytesWritten.fetch_add(n, std::memory_order_relaxed);
+            if (ack && onAck) onAck(ack);
+            for (auto& fn : drained) fn();
+        });
+        return true;
+    }
+
+    void UploadManager::WhenDrained(const UploadPtr& upload, std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(upload->mutex);
+            if (upload->pending > 0) {
+                // The last write to land runs it.
+                upload->onDrained.push_back(std::move(fn));
+                return;
+            }
+        }
+        Post(std::move(fn));
+    }
+
+    void UploadManager::Finish(UploadPtr upload, FinishFn done) {
+        Unregister(upload);
+        WhenDrained(upload, [upload, done = std::move(done)]() {
+            CloseFile(*upload);
+            bool ok;
+            {
+                std::lock_guard<std::mutex> lock(upload->mutex);
+                ok = !upload->writeFailed && upload->prefix == upload->size;
+            }
+            if (ok && !upload->hash.empty()) {
+                std::ifstream in(upload->path, std::ios::binary);
+                Sha256 sha;
+                std::vector<char> chunk(64 * 1024);
+                uint64_t read = 0;
+                while (in) {
+                    in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+                    const auto got = in.gcount();
+                    if (got <= 0) break;
+                    sha.Update(chunk.data(), static_cast<size_t>(got));
+                    read += static_cast<uint64_t>(got);
+                }
+                const auto digest = sha.Final();
+                ok = read == upload->size && ToHex(digest.data(), digest.size()) == upload->hash;
+            }
+            auto& stats = GetStats();
+            if (ok) {
+                stats.completed.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                stats.failed.fetch_add(1, std::memory_order_relaxed);
+                std::error_code ec;
+                std::filesystem::remove(upload->path, ec);
+            }
+            done(ok);
+        });
+    }
+
+    void UploadManager::Detach(const UploadPtr& upload, const void* holder) {
+        {
+            std::lock_guard<std::mutex> lock(upload->mutex);
+            if (upload->holder != holder) return;
+            upload->holder = nullptr;
+            upload->detachedAt = std::chrono::steady_clock::now();
+        }
+        if (!upload->windowed) Abandon(upload);
+    }
+
+    void UploadManager::Abandon(const UploadPtr& upload) {
+        Unregister(upload);
+        WhenDrained(upload, [upload]() { Discard(*upload); });
+    }
+
+    size_t UploadManager::ExpireIdle() {
+        const auto cutoff = std::chrono::steady_clock::now() - std::chrono::seconds(kResumeSeconds);
+        std::vector<UploadPtr> expired;
+        {
+            std::lock_guard<std::mutex> lock(m_RegistryMutex);
+            for (auto it = m_Uploads.begin(); it != m_Uploads.end();) {
+                bool idle;
+                {
+                    std::lock_guard<std::mutex> ulock(it->second->mutex);
+                    idle = it->second->holder == nullptr && it->second->detachedAt < cutoff;
+                }
+                if (idle) {
+                    expired.push_back(std::move(it->second));
+                    it = m_Uploads.erase(it);
+                }
+                else ++it;
+            }
+        }
+        for (const auto& upload : expired)
+            WhenDrained(upload, [upload]() { Discard(*upload); });
+        GetStats().expired.fetch_add(expired.size(), std::memory_order_relaxed);
+        return expired.size();
+    }
+
+    bool UploadManager::IsActive(const std::filesystem::path& path) {
+        std::lock_guard<std::mutex> lock(m_RegistryMutex);
+        return std::any_of(m_Uploads.begin(), m_Uploads.end(),
+            [&path](const auto& entry) { return entry.second->path == path; });
+    }
+
+    void UploadManager::CloseFile(Upload& upload) {
+        std::lock_guard<std::mutex> lock(upload.mutex);
+        upload.closed = true;
+#if defined(__linux__)
+        if (upload.fd >= 0 && upload.pending == 0) {
+            ::close(upload.fd);
+            upload.fd = -1;
+        }
+#else
+        if (upload.file.is_open()) upload.file.close();
+#endif
+    }
+
+    void UploadManager::Discard(Upload& upload) {
+        CloseFile(upload);
+        std::error_code ec;
+        std::filesystem::remove(upload.path, ec);
+    }
+
+    void UploadManager::Unregister(const UploadPtr& upload) {
+        std::lock_guard<std::mutex> lock(m_RegistryMutex);
+        auto it = m_Uploads.find(Key(upload->owner, upload->id));
+        if (it != m_Uploads.end() && it->second == upload) m_Uploads.erase(it);
+    }
+
+} // namespace TalkMe
@@ -0,0 +1,142 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // Attachment uploads in progress, and the file-I/O pool that writes them.
+    //
+    // A session hands every File_Transfer_Chunk to Write(), which copies it
+    // and returns at once; a pool thread stores it with a positional write,
+    // so chunks land in any order and the session strand never touches the
+    // disk. Each upload tracks the byte ranges on disk; whenever the prefix
+    // starting at 0 grows by kUploadAckBytes the submitting session is told
+    // (File_Transfer_Ack). Finish() waits for outstanding writes, then closes
+    // and, for hashed uploads, hashes the file on the pool.
+    //
+    // Uploads live in a registry keyed by owner and id. A windowed upload
+    // whose session goes away is only detached: the same user may resume it
+    // by id from a new connection, continuing after the stored prefix.
+    // ExpireIdle() drops uploads detached for longer than kResumeSeconds.
+    // ---------------------------------------------------------------------------
+    class UploadManager {
+    public:
+        static constexpr int      kResumeSeconds = 15 * 60;
+        // Bytes one upload may have queued for the pool; a client that ignores
+        // the window is cut off.
+        static constexpr uint64_t kMaxPendingBytes = 4 * 1024 * 1024;
+
+        struct Stats {
+            std::atomic<uint64_t> started{ 0 };
+            std::atomic<uint64_t> resumed{ 0 };
+            std::atomic<uint64_t> resumedBytes{ 0 };   // bytes a resume did not have to resend
+            std::atomic<uint64_t> completed{ 0 };
+            std::atomic<uint64_t> failed{ 0 };         // short, unwritable or hash mismatch
+            std::atomic<uint64_t> expired{ 0 };        // detached and never resumed
+            std::atomic<uint64_t> bytesWritten{ 0 };
+            std::atomic<uint64_t> pendingBytes{ 0 };   // queued for the pool right now
+        };
+
+        struct Upload {
+            std::string owner;
+            std::string id;
+            std::string hash;                          // empty for legacy uploads
+            uint64_t size = 0;
+            bool windowed = false;
+            std::filesystem::path path;
+
+            // Below: guarded by mutex.
+            std::mutex mutex;
+            const void* holder = nullptr;              // session writing it, null when detached
+#if defined(__linux__)
+            int fd = -1;
+#else
+            std::fstream file;
+#endif
+            std::map<uint64_t, uint64_t> stored;      // written ranges, begin -> end
+            uint64_t prefix = 0;                       // bytes [0, prefix) are on disk
+            uint64_t acked = 0;                        // prefix last reported to the client
+            uint64_t pending = 0;                      // bytes queued for the pool
+            bool writeFailed = false;
+            bool closed = false;                       // no further writes accepted
+            std::chrono::steady_clock::time_point detachedAt;
+            std::vector<std::function<void()>> onDrained;
+        };
+        using UploadPtr = std::shared_ptr<Upload>;
+        // Called from a pool thread with the new stored prefix.
+        using AckFn = std::function<void(uint64_t stored)>;
+        // Called from a pool thread once the upload is closed and verified.
+        using FinishFn = std::function<void(bool ok)>;
+
+        static UploadManager& Get();
+        static Stats& GetStats();
+
+        ~UploadManager();
+
+        // New upload into a fresh attachments/incoming/ file; replaces any
+        // registered upload of the same owner and id. Null if the file cannot
+        // be created.
+        UploadPtr Begin(const void* holder, const std::string& owner, const std::string& id,
+                        const std::string& hash, uint64_t size, bool windowed);
+        // Hands a windowed upload of `owner` matching id, hash and size to
+        // `holder`, even if a connection that has not noticed it is dead yet
+        // still holds it. `offset` receives the stored prefix to continue from.
+        UploadPtr Resume(const void* holder, const std::string& owner, const std::string& id,
+                         const std::string& hash, uint64_t size, uint64_t& offset);
+
+        // Queues `data` for offset `offset`. False if the upload has too much
+        // queued already.
+        bool Write(const UploadPtr& upload, uint64_t offset, std::span<const uint8_t> data, AckFn onAck);
+        // Unregisters the upload and calls `done` once it is complete on disk.
+        void Finish(UploadPtr upload, FinishFn done);
+        // `holder` lets go: windowed uploads stay resumable, others are
+        // removed. Ignored if the upload has moved to another holder.
+        void Detach(const UploadPtr& upload, const void* holder);
+        // Removes the upload and its file.
+        void Abandon(const UploadPtr& upload);
+
+        // Drops uploads detached for longer than kResumeSeconds; returns how many.
+        size_t ExpireIdle();
+        // True if `path` belongs to a registered upload.
+        bool IsActive(const std::filesystem::path& path);
+
+    private:
+        UploadManager();
+
+        void Post(std::function<void()> job);
+        void WorkerLoop();
+        // Runs `fn` on a pool thread once no write of `upload` is queued. Every
+        // waiter registered before then runs, in the order registered.
+        void WhenDrained(const UploadPtr& upload, std::function<void()> fn);
+        static void CloseFile(Upload& upload);
+        static void Discard(Upload& upload);
+        void Unregister(const UploadPtr& upload);
+        static std::string Key(const std::string& owner, const std::string& id) { return owner + '\n' + id; }
+
+        std::mutex                                  m_RegistryMutex;
+        std::unordered_map<std::string, UploadPtr>  m_Uploads;
+
+        std::vector<std::thread>                    m_Workers;
+        std::mutex                                  m_QueueMutex;
+        std::condition_variable                     m_QueueCv;
+        std::deque<std::function<void()>>           m_Queue;
+        bool                                        m_Shutdown = false;
+    };
+
+} // namespace TalkMe
@@ -0,0 +1,90 @@
+#include "VoicePacketPool.h"
+#include <mutex>
+#include <vector>
+
+namespace TalkMe {
+
+    namespace {
+
+        // Blocks are recycled through a small per-thread cache first; the shared
+        // list only absorbs overflow, so the common acquire/release pair on one
+        // io_context thread never touches the mutex.
+        constexpr size_t kThreadCacheMax = 256;
+        constexpr size_t kSharedFreeMax = 8192;
+
+        std::mutex                             g_SharedMutex;
+        std::vector<VoicePacketPool::Block*>   g_SharedFree;
+        std::atomic<size_t>                    g_SharedCount{ 0 };
+
+        struct ThreadCache {
+            std::vector<VoicePacketPool::Block*> blocks;
+            ThreadCache() { blocks.reserve(kThreadCacheMax); }
+            ~ThreadCache() {
+                std::lock_guard lock(g_SharedMutex);
+                for (auto* b : blocks) {
+                    if (g_SharedFree.size() < kSharedFreeMax) g_SharedFree.push_back(b);
+                    else delete b;
+                }
+                g_SharedCount.store(g_SharedFree.size(), std::memory_order_relaxed);
+            }
+        };
+
+        ThreadCache& LocalCache() {
+            thread_local ThreadCache cache;
+            return cache;
+        }
+
+    } // namespace
+
+    VoicePacketPool::Ref VoicePacketPool::Acquire(size_t bytes) {
+        if (bytes > kBlockCapacity) return {};
+
+        Block* b = nullptr;
+        auto& local = LocalCache().blocks;
+        if (!local.empty()) {
+            b = local.back();
+            local.pop_back();
+        }
+        else if (g_SharedCount.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard lock(g_SharedMutex);
+            // Refill half the thread cache in one go to amortise the lock.
+            while (!g_SharedFree.empty() && local.size() < kThreadCacheMax / 2) {
+                local.push_back(g_SharedFree.back());
+                g_SharedFree.pop_back();
+            }
+            g_SharedCount.store(g_SharedFree.size(), std::memory_order_relaxed);
+            if (!local.empty()) {
+                b = local.back();
+                local.pop_back();
+            }
+        }
+        if (!b) b = new Block();
+
+        b->refs.store(1, std::memory_order_relaxed);
+        b->size = static_cast<uint32_t>(bytes);
+        return Ref(b);
+    }
+
+    void VoicePacketPool::Release(Block* b) noexcept {
+        if (b->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+        auto& local = LocalCache().blocks;
+        if (local.size() < kThreadCacheMax) {
+            local.push_back(b);
+            return;
+        }
+        std::lock_guard lock(g_SharedMutex);
+        if (g_SharedFree.size() < kSharedFreeMax) {
+            g_SharedFree.push_back(b);
+            g_SharedCount.store(g_SharedFree.size(), std::memory_order_relaxed);
+        }
+        else {
+            delete b;
+        }
+    }
+
+    size_t VoicePacketPool::FreeBlocks() {
+        return g_SharedCount.load(std::memory_order_relaxed) + LocalCache().blocks.size();
+    }
+
+} // namespace TalkMe
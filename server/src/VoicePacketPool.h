@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace TalkMe {
+
+    // ---------------------------------------------------------------------------
+    // Pooled, ref-counted datagram buffers for the UDP voice relay.
+    //
+    // One block holds one outgoing datagram. The relay fans it out with direct
+    // non-blocking sends; only a send that would block falls back to
+    // async_send_to, whose handler copies a Ref (one atomic increment) instead
+    // of a shared_ptr to a fresh std::vector. The last Ref returns the block to
+    // the pool. After warm-up the relay path performs no heap allocation.
+    // Datagrams larger than kBlockCapacity are not pooled; Acquire() returns an
+    // empty Ref for them and callers fall back to a heap buffer.
+    // ---------------------------------------------------------------------------
+    class VoicePacketPool {
+    public:
+        // Largest UDP payload that fits a 1500-byte Ethernet MTU without fragmenting.
+        static constexpr size_t kBlockCapacity = 1472;
+
+        struct Block {
+            std::atomic<uint32_t> refs{ 0 };
+            uint32_t              size{ 0 };
+            uint8_t               data[kBlockCapacity];
+        };
+
+        class Ref {
+        public:
+            Ref() = default;
+            explicit Ref(Block* b) noexcept : m_Block(b) {}
+            Ref(const Ref& o) noexcept : m_Block(o.m_Block) {
+                if (m_Block) m_Block->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+            Ref(Ref&& o) noexcept : m_Block(std::exchange(o.m_Block, nullptr)) {}
+            Ref& operator=(Ref o) noexcept { std::swap(m_Block, o.m_Block); return *this; }
+            ~Ref() { if (m_Block) VoicePacketPool::Release(m_Block); }
+
+            explicit operator bool() const noexcept { return m_Block != nullptr; }
+            uint8_t* data() noexcept { return m_Block->data; }
+            const uint8_t* data() const noexcept { return m_Block->data; }
+            size_t size() const noexcept { return m_Block->size; }
+            void resize(size_t n) noexcept { m_Block->size = static_cast<uint32_t>(n); }
+
+        private:
+            Block* m_Block = nullptr;
+        };
+
+        // Returns a block with refs == 1 and size == bytes, or an empty Ref when
+        // bytes exceeds kBlockCapacity.
+        static Ref Acquire(size_t bytes);
+
+        // Blocks currently owned by the pool's free lists (for diagnostics).
+        static size_t FreeBlocks();
+
+    private:
+        static void Release(Block* b) noexcept;
+    };
+
+} // namespace TalkMe
@@ -0,0 +1,240 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace TalkMe {
+namespace Wire {
+
+    // ---------------------------------------------------------------------------
+    // Compact binary encoding for the high-frequency control packets.
+    //
+    // A binary body starts with kBinaryTag; JSON bodies always start with '{'
+    // or '[', so the receiver tells the two apart per packet and JSON stays a
+    // valid fallback everywhere. The client offers "wire": kVersion in its
+    // Login/Register request and the server echoes it in the success response;
+    // each side sends binary only once the peer has opted in.
+    //
+    // Fields follow a fixed per-type schema: integers are zigzag LEB128
+    // varints, strings are a varint length plus raw bytes, booleans are packed
+    // into one flags byte. Decoders hand out string_views into the packet
+    // body (valid while the body is) and ignore trailing bytes, so a later
+    // version may append fields without breaking older readers.
+    // ---------------------------------------------------------------------------
+    constexpr uint8_t kBinaryTag = 0xB1;
+    constexpr int     kVersion = 1;
+
+    inline bool IsBinary(const uint8_t* data, size_t size) noexcept {
+        return size > 0 && data[0] == kBinaryTag;
+    }
+
+    class Writer {
+    public:
+        explicit Writer(size_t reserve = 32) {
+            m_Out.reserve(reserve);
+            m_Out.push_back(static_cast<char>(kBinaryTag));
+        }
+
+        Writer& Varint(uint64_t v) {
+            while (v >= 0x80) {
+                m_Out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+                v >>= 7;
+            }
+            m_Out.push_back(static_cast<char>(v));
+            return *this;
+        }
+        Writer& Int(int64_t v) {
+            return Varint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+        }
+        Writer& Byte(uint8_t v) { m_Out.push_back(static_cast<char>(v)); return *this; }
+        Writer& Str(std::string_view s) { Varint(s.size()); m_Out.append(s); return *this; }
+
+        std::string Take() { return std::move(m_Out); }
+
+    private:
+        std::string m_Out;
+    };
+
+    // Bounds-checked cursor over a binary body. Every getter returns false
+    // once the input is exhausted or malformed, and stays false afterwards.
+    class Reader {
+    public:
+        Reader(const uint8_t* data, size_t size)
+            : m_P(data), m_End(data + size), m_Ok(IsBinary(data, size)) {
+            if (m_Ok) ++m_P;
+        }
+
+        bool Varint(uint64_t& v) {
+            v = 0;
+            for (int shift = 0; m_Ok && shift < 64; shift += 7) {
+                if (m_P == m_End) break;
+                const uint8_t b = *m_P++;
+                v |= static_cast<uint64_t>(b & 0x7F) << shift;
+                if (!(b & 0x80)) return true;
+            }
+            return m_Ok = false;
+        }
+        bool Int(int32_t& v) {
+            uint64_t u;
+            if (!Varint(u)) return false;
+            const int64_t s = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+            if (s < INT32_MIN || s > INT32_MAX) return m_Ok = false;
+            v = static_cast<int32_t>(s);
+            return true;
+        }
+        bool Byte(uint8_t& v) {
+            if (!m_Ok || m_P == m_End) return m_Ok = false;
+            v = *m_P++;
+            return true;
+        }
+        bool Str(std::string_view& s) {
+            uint64_t n;
+            if (!Varint(n)) return false;
+            if (n > static_cast<uint64_t>(m_End - m_P)) return m_Ok = false;
+            s = std::string_view(reinterpret_cast<const char*>(m_P), static_cast<size_t>(n));
+            m_P += n;
+            return true;
+        }
+
+    private:
+        const uint8_t* m_P;
+        const uint8_t* m_End;
+        bool           m_Ok;
+    };
+
+    // --- Schemas ----------------------------------------------------------------
+    // `user` is filled in by the server; clients leave it empty when sending.
+
+    // Typing_Indicator: [cid][user]
+    struct TypingIndicator {
+        int32_t          cid = 0;
+        std::string_view user;
+    };
+
+    // Voice_Mute_State: [flags: 1=muted 2=deafened][cid][user]
+    struct VoiceMuteState {
+        bool             muted = false;
+        bool             deafened = false;
+        int32_t          cid = -1;
+        std::string_view user;
+    };
+
+    // Presence_Update: [flags: 1=online][user]
+    struct PresenceUpdate {
+        bool             online = false;
+        std::string_view user;
+    };
+
+    // Set_Status / Status_Update: [user][status]
+    struct StatusUpdate {
+        std::string_view user;
+        std::string_view status;
+    };
+
+    // Presence_Batch: [count] then per entry
+    // [flags: 1=presence 2=online 4=status][user][status if 4]
+    struct PresenceDelta {
+        std::string_view user;
+        bool             hasPresence = false;
+        bool             online = false;
+        bool             hasStatus = false;
+        std::string_view status;
+    };
+
+    // Message_Text: [mid][cid][reply_to][user][msg][attachment_id]
+    struct MessageText {
+        int32_t          mid = 0;
+        int32_t          cid = 0;
+        int32_t          replyTo = 0;
+        std::string_view user;
+        std::string_view msg;
+        std::string_view attachmentId;
+    };
+
+    inline std::string Encode(const TypingIndicator& m) {
+        return Writer(8 + m.user.size()).Int(m.cid).Str(m.user).Take();
+    }
+    inline bool Decode(const uint8_t* data, size_t size, TypingIndicator& m) {
+        Reader r(data, size);
+        return r.Int(m.cid) && r.Str(m.user);
+    }
+
+    inline std::string Encode(const VoiceMuteState& m) {
+        const uint8_t flags = (m.muted ? 1 : 0) | (m.deafened ? 2 : 0);
+        return Writer(8 + m.user.size()).Byte(flags).Int(m.cid).Str(m.user).Take();
+    }
+    inline bool Decode(const uint8_t* data, size_t size, VoiceMuteState& m) {
+        Reader r(data, size);
+        uint8_t flags = 0;
+        if (!r.Byte(flags) || !r.Int(m.cid) || !r.Str(m.user)) return false;
+        m.muted = (flags & 1) != 0;
+        m.deafened = (flags & 2) != 0;
+        return true;
+    }
+
+    inline std::string Encode(const PresenceUpdate& m) {
+        return Writer(4 + m.user.size()).Byte(m.online ? 1 : 0).Str(m.user).Take();
+    }
+    inline bool Decode(const uint8_t* data, size_t size, PresenceUpdate& m) {
+        Reader r(data, size);
+        uint8_t flags = 0;
+        if (!r.Byte(flags) || !r.Str(m.user)) return false;
+        m.online = (flags & 1) != 0;
+        return true;
+    }
+
+    inline std::string Encode(const StatusUpdate& m) {
+        return Writer(8 + m.user.size() + m.status.size()).Str(m.user).Str(m.status).Take();
+    }
+    inline bool Decode(const uint8_t* data, size_t size, StatusUpdate& m) {
+        Reader r(data, size);
+        return r.Str(m.user) && r.Str(m.status);
+    }
+
+    inline std::string Encode(std::span<const PresenceDelta> batch) {
+        size_t reserve = 8;
+        for (const auto& d : batch) reserve += 4 + d.user.size() + d.status.size();
+        Writer w(reserve);
+        w.Varint(batch.size());
+        for (const auto& d : batch) {
+            const uint8_t flags = (d.hasPresence ? 1 : 0) | (d.online ? 2 : 0) | (d.hasStatus ? 4 : 0);
+            w.Byte(flags).Str(d.user);
+            if (d.hasStatus) w.Str(d.status);
+        }
+        return w.Take();
+    }
+    inline bool Decode(const uint8_t* data, size_t size, std::vector<PresenceDelta>& batch) {
+        Reader r(data, size);
+        uint64_t count = 0;
+        if (!r.Varint(count) || count > size) return false;   // every entry takes 2+ bytes
+        batch.clear();
+        batch.reserve(static_cast<size_t>(count));
+        for (uint64_t i = 0; i < count; ++i) {
+            PresenceDelta d;
+            uint8_t flags = 0;
+            if (!r.Byte(flags) || !r.Str(d.user)) return false;
+            d.hasPresence = (flags & 1) != 0;
+            d.online = (flags & 2) != 0;
+            d.hasStatus = (flags & 4) != 0;
+            if (d.hasStatus && !r.Str(d.status)) return false;
+            batch.push_back(d);
+        }
+        return true;
+    }
+
+    inline std::string Encode(const MessageText& m) {
+        return Writer(24 + m.user.size() + m.msg.size() + m.attachmentId.size())
+            .Int(m.mid).Int(m.cid).Int(m.replyTo)
+            .Str(m.user).Str(m.msg).Str(m.attachmentId).Take();
+    }
+    inline bool Decode(const uint8_t* data, size_t size, MessageText& m) {
+        Reader r(data, size);
+        return r.Int(m.mid) && r.Int(m.cid) && r.Int(m.replyTo)
+            && r.Str(m.user) && r.Str(m.msg) && r.Str(m.attachmentId);
+    }
+
+} // namespace Wire
+} // namespace TalkMe
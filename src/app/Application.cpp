@@ -21,7 +21,9 @@
 #include <shlobj.h>
 #include <commdlg.h>
 #include <dxgi1_4.h>
+#include <bcrypt.h>
 #pragma comment(lib, "winmm.lib")
+#pragma comment(lib, "bcrypt.lib")
 #pragma comment(lib, "shell32.lib")
 #pragma comment(lib, "comdlg32.lib")
 #include "../ui/TextureManager.h"
@@ -48,6 +50,25 @@ namespace {
         int   samplesUsed = 0;
     };
 
+    // Lower-case hex SHA-256 of data (CNG), or empty on failure. Sent with an
+    // upload so the server can skip the transfer when it already has the bytes.
+    static std::string Sha256Hex(const std::vector<uint8_t>& data) {
+        BCRYPT_ALG_HANDLE alg = nullptr;
+        if (!BCRYPT_SUCCESS(::BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA256_ALGORITHM, nullptr, 0))) return {};
+        uint8_t digest[32];
+        const bool ok = BCRYPT_SUCCESS(::BCryptHash(alg, nullptr, 0,
+            const_cast<PUCHAR>(data.data()), static_cast<ULONG>(data.size()), digest, sizeof(digest)));
+        ::BCryptCloseAlgorithmProvider(alg, 0);
+        if (!ok) return {};
+        static const char kHex[] = "0123456789abcdef";
+        std::string hex(64, '0');
+        for (size_t i = 0; i < sizeof(digest); ++i) {
+            hex[i * 2] = kHex[digest[i] >> 4];
+            hex[i * 2 + 1] = kHex[digest[i] & 15];
+        }
+        return hex;
+    }
+
     // Load app icon from assets into TextureManager as "friends_icon" (for server rail). Returns true if loaded.
     static bool LoadFriendsIconOnce() {
         std::string path = TalkMe::ConfigManager::GetConfigDirectory() + "\\assets\\app_48x48.ico";
@@ -295,7 +316,8 @@ namespace TalkMe {
             if (!m_UseUdpVoice)
                 return;
             auto payload = PacketHandler::CreateVoicePayloadOpus(m_CurrentUser.username, opusData, seqNum);
-            m_SendPacer.Enqueue(payload);
+            const uint8_t level = m_AudioEngine.GetOutgoingAudioLevel();
+            m_SendPacer.Enqueue(payload, level);
             char traceBuf[256];
             std::snprintf(traceBuf, sizeof(traceBuf),
                 "step=send path=udp seq=%u opus_bytes=%zu payload_bytes=%zu",
@@ -305,6 +327,7 @@ namespace TalkMe {
                 m_PendingVoiceRedundant = true;
                 m_LastVoiceRedundantTime = std::chrono::steady_clock::now();
                 m_LastVoiceRedundantPayload = payload;
+                m_LastVoiceRedundantLevel = level;
                 m_LastVoiceRedundantOpus = opusData;
                 m_LastVoiceRedundantTimestamp = seqNum * 960;
             }
@@ -369,8 +392,8 @@ namespace TalkMe {
         m_LastUdpHelloTime = std::chrono::steady_clock::now();
         TalkMe::Logger::Instance().LogVoiceTrace("udp_start ok server=" + m_ServerIP + " port=" + std::to_string(VOICE_PORT));
 
-        m_SendPacer.Start([this](const std::vector<uint8_t>& pkt) {
-            m_VoiceTransport.SendVoicePacket(pkt);
+        m_SendPacer.Start([this](const std::vector<uint8_t>& pkt, uint8_t level) {
+            m_VoiceTransport.SendVoicePacket(pkt, level);
         });
         StartLinkProbe();
     }
@@ -436,18 +459,57 @@ namespace TalkMe {
         m_PendingUploadData = std::move(data);
         m_PendingUploadFilename = std::move(filename);
         m_PendingUploadChannelId = channelId;
+        m_PendingUploadId.clear();
+        SendUploadRequest();
+    }
+
+    void Application::SendUploadRequest() {
+        m_UploadSent = 0;
+        m_UploadAcked = 0;
         nlohmann::json req;
         req["filename"] = m_PendingUploadFilename;
         req["size"] = static_cast<int>(m_PendingUploadData.size());
+        const std::string hash = Sha256Hex(m_PendingUploadData);
+        if (!hash.empty()) req["sha256"] = hash;
+        req["window"] = 1;
+        if (!m_PendingUploadId.empty()) req["resume"] = m_PendingUploadId;
         m_NetClient.Send(PacketType::File_Transfer_Request, req.dump());
     }
 
+    void Application::PumpUpload() {
+        const size_t total = m_PendingUploadData.size();
+        if (m_PendingUploadId.empty() || m_UploadSent >= total) return;
+        while (m_UploadSent < total && m_UploadSent - m_UploadAcked < TalkMe::kUploadWindow) {
+            const size_t len = (std::min)(static_cast<size_t>(TalkMe::kUploadChunkSize), total - m_UploadSent);
+            TalkMe::UploadChunkHeader ch{ static_cast<uint32_t>(m_UploadSent) };
+            ch.ToNetwork();
+            std::vector<uint8_t> chunk(sizeof(ch) + len);
+            std::memcpy(chunk.data(), &ch, sizeof(ch));
+            std::memcpy(chunk.data() + sizeof(ch), m_PendingUploadData.data() + m_UploadSent, len);
+            m_NetClient.SendRaw(PacketType::File_Transfer_Chunk, chunk);
+            m_UploadSent += len;
+        }
+        if (m_UploadSent >= total)
+            m_NetClient.Send(PacketType::File_Transfer_Complete, "{}");
+    }
+
     void Application::RequestAttachment(const std::string& id) {
         if (id.empty()) return;
         if (m_AttachmentCache.count(id) || m_AttachmentRequested.count(id)) return;
         m_AttachmentRequested.insert(id);
         nlohmann::json req;
         req["id"] = id;
+        req["stream"] = 1;
+        req["size"] = TalkMe::kAttachmentPreviewSize;
+        m_NetClient.Send(PacketType::Media_Request, req.dump());
+    }
+
+    void Application::RequestAttachmentOriginal(const std::string& id) {
+        if (id.empty() || m_AttachmentFileData.count(id) || m_AttachmentOriginalRequested.count(id)) return;
+        m_AttachmentOriginalRequested.insert(id);
+        nlohmann::json req;
+        req["id"] = id;
+        req["stream"] = 1;
         m_NetClient.Send(PacketType::Media_Request, req.dump());
     }
 
@@ -857,6 +919,12 @@ namespace TalkMe {
                     if (!m_VoiceMembers.empty()) m_VoiceMembers.clear();
                     if (m_ActiveVoiceChannelId != -1) m_ActiveVoiceChannelId = -1;
                     m_UserMuteStates.clear();
+                    for (const auto& [tid, dl] : m_MediaDownloads) m_AttachmentRequested.erase(dl.id);
+                    m_MediaDownloads.clear();
+                    m_AttachmentOriginalRequested.clear();
+                    m_ScreenShareJoinedCid = -1;
+                    m_ScreenShareWatchCid = -1;
+                    m_ScreenShareHasViewers.store(true);
                     if (m_ScreenShare.iAmSharing) { StopScreenShareProcess(); }
                     {
                         std::lock_guard<std::mutex> lock(m_ScreenShareStreamMutex);
@@ -918,7 +986,7 @@ namespace TalkMe {
                         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_LastVoiceRedundantTime).count();
                         if (elapsed >= 5) {
                             if (!m_LastVoiceRedundantPayload.empty() && m_UseUdpVoice) {
-                                m_VoiceTransport.SendVoicePacket(m_LastVoiceRedundantPayload);
+                                m_VoiceTransport.SendVoicePacket(m_LastVoiceRedundantPayload, m_LastVoiceRedundantLevel);
                             }
                             m_PendingVoiceRedundant = false;
                         }
@@ -959,6 +1027,7 @@ namespace TalkMe {
                         m_NetClient.Send(PacketType::Join_Voice_Channel, PacketHandler::JoinVoiceChannelPayload(m_ActiveVoiceChannelId));
                         m_LastVoiceStateRequestTime = now;
                     }
+                    SyncScreenShareWatch();
                     auto statsElapsed = std::chrono::duration_cast<std::chrono::seconds>(now - m_LastVoiceStatsLogTime).count();
                     if (statsElapsed >= 15) {
                         m_LastVoiceStatsLogTime = now;
@@ -999,10 +1068,8 @@ namespace TalkMe {
                     static bool s_prevDeafened = false;
                     if (m_ActiveVoiceChannelId != -1 &&
                         (m_SelfMuted != s_prevMuted || m_SelfDeafened != s_prevDeafened)) {
-                        nlohmann::json muteJ;
-                        muteJ["muted"] = m_SelfMuted;
-                        muteJ["deafened"] = m_SelfDeafened;
-                        m_NetClient.Send(PacketType::Voice_Mute_State, muteJ.dump());
+                        m_NetClient.Send(PacketType::Voice_Mute_State,
+                            PacketHandler::VoiceMuteStatePayload(m_NetClient.UsesBinaryWire(), m_SelfMuted, m_SelfDeafened));
                         s_prevMuted = m_SelfMuted;
                         s_prevDeafened = m_SelfDeafened;
                     }
@@ -2269,8 +2336,8 @@ namespace TalkMe {
             // Custom status
             ImGui::PushItemWidth(friendW - 140);
             if (ImGui::InputTextWithHint("##status_input", "Set your status...", m_StatusBuf, sizeof(m_StatusBuf), ImGuiInputTextFlags_EnterReturnsTrue)) {
-                nlohmann::json sj; sj["status"] = std::string(m_StatusBuf);
-                m_NetClient.Send(PacketType::Set_Status, sj.dump());
+                m_NetClient.Send(PacketType::Set_Status,
+                    PacketHandler::SetStatusPayload(m_NetClient.UsesBinaryWire(), m_StatusBuf));
             }
             ImGui::PopItemWidth();
             ImGui::SameLine();
@@ -2600,11 +2667,11 @@ namespace TalkMe {
                     m_AttachmentCache.erase(id);
                     m_AttachmentRequested.erase(id);
                     if (!m_MediaBaseUrl.empty()) {
-                        std::string url = m_MediaBaseUrl + "/media/" + id;
-                        TalkMe::ImageCache::Get().RemoveEntry(url);
+                        TalkMe::ImageCache::Get().RemoveEntry(UI::Views::AttachmentMediaUrl(m_MediaBaseUrl, id));
                     }
                 };
                 m_OnAttachmentClickFn = [this](const std::string& id) {
+                    RequestAttachmentOriginal(id);
                     m_ViewingAttachmentId = id;
                     m_AttachmentViewerZoom = 1.0f;
                     m_AttachmentViewerOpen = true;
@@ -2628,8 +2695,8 @@ namespace TalkMe {
                         auto now = std::chrono::steady_clock::now();
                         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_LastTypingSentTime);
                         if (elapsed.count() >= 3000 && m_SelectedChannelId != -1) {
-                            nlohmann::json tj; tj["cid"] = m_SelectedChannelId;
-                            m_NetClient.Send(PacketType::Typing_Indicator, tj.dump());
+                            m_NetClient.Send(PacketType::Typing_Indicator,
+                                PacketHandler::TypingIndicatorPayload(m_NetClient.UsesBinaryWire(), m_SelectedChannelId));
                             m_LastTypingSentTime = now;
                         }
                     },
@@ -110,6 +110,20 @@ namespace TalkMe {
     private:
         void Cleanup();
         void ProcessNetworkMessages();
+        // Binary-encoded control packets (WireCodec.h); true if handled.
+        bool ProcessBinaryMessage(const IncomingMessage& msg);
+        void OnChatMessage(int cid, int mid, const std::string& user, const std::string& content,
+                           const std::string& attachmentId, int replyTo);
+        void OnMediaChunk(const IncomingMessage& msg);
+        // File_Transfer_Request for m_PendingUploadData; resumes m_PendingUploadId when set.
+        void SendUploadRequest();
+        // Sends upload chunks while less than kUploadWindow is unacknowledged.
+        void PumpUpload();
+        // Complete attachment bytes (streamed or base64): keep for Save and queue the texture upload.
+        // A server-side preview only replaces the texture; Save needs the original.
+        void OnAttachmentData(const std::string& id, std::vector<uint8_t> raw, bool preview = false);
+        // Shows `id` as failed and forgets its requests, so it can be asked for again.
+        void MarkAttachmentFailed(const std::string& id);
         void RenderUI();
         void RenderLogin();
         void RenderLogin2FA();   // 2FA challenge screen shown after Login_Requires_2FA
@@ -225,6 +239,10 @@ namespace TalkMe {
         std::vector<uint8_t> m_PendingUploadData;
         std::string m_PendingUploadFilename;
         int m_PendingUploadChannelId = -1;
+        /// Id the server gave the upload; kept across a reconnect so the upload resumes.
+        std::string m_PendingUploadId;
+        size_t m_UploadSent = 0;
+        size_t m_UploadAcked = 0;
         /// When sending an attached image, optional message text and reply_to to include when upload completes.
         std::string m_PendingMessageText;
         int m_PendingReplyToId = 0;
@@ -249,7 +267,11 @@ namespace TalkMe {
         // TCP attachment fetch (Media_Request/Media_Response) so attachments work without port 5557
         std::unordered_map<std::string, AttachmentDisplay> m_AttachmentCache;
         std::unordered_set<std::string> m_AttachmentRequested;
+        std::unordered_set<std::string> m_AttachmentOriginalRequested;   // full-size fetch for the viewer/Save
         std::unordered_map<std::string, std::vector<uint8_t>> m_AttachmentFileData;  // raw file bytes for Save
+        /// Streamed downloads in progress (Media_Chunk), by server transfer id.
+        struct MediaDownload { std::string id; std::vector<uint8_t> data; uint32_t size = 0; uint32_t acked = 0; bool preview = false; };
+        std::unordered_map<uint32_t, MediaDownload> m_MediaDownloads;
         /// Decoded RGBA uploads queued from Media_Response; processed on main thread in render block after SetDevice.
         struct PendingAttachmentUpload { std::string id; std::vector<uint8_t> rgba; int w = 0; int h = 0; };
         std::vector<PendingAttachmentUpload> m_PendingAttachmentUploads;
@@ -263,6 +285,7 @@ namespace TalkMe {
 
         void StartImageUpload(std::vector<uint8_t> data, std::string filename, int channelId);
         void RequestAttachment(const std::string& id);
+        void RequestAttachmentOriginal(const std::string& id);
         const AttachmentDisplay* GetAttachmentDisplay(const std::string& id) const;
         const std::vector<uint8_t>* GetAttachmentFileData(const std::string& id) const;
         void RenderAttachmentViewer();
@@ -401,6 +424,7 @@ namespace TalkMe {
         bool m_PendingVoiceRedundant = false;
         std::chrono::steady_clock::time_point m_LastVoiceRedundantTime;
         std::vector<uint8_t> m_LastVoiceRedundantPayload;
+        uint8_t m_LastVoiceRedundantLevel = 0;
         std::vector<uint8_t> m_LastVoiceRedundantOpus;
         uint32_t m_LastVoiceRedundantTimestamp = 0;
         /// Cached telemetry when in voice; updated at most every kVoiceTelemetryCacheIntervalMs to avoid mutex contention.
@@ -480,6 +504,15 @@ namespace TalkMe {
         std::atomic<int> m_AdaptiveQualityLevel{ 100 };  // NEW: Current adaptive quality
         void RunScreenShareSendThread();
 
+        // Screen_Share_Watch: the stream last reported as watched and the voice channel
+        // it was reported in. Reported once the server lists us in m_ScreenShareJoinedCid.
+        std::string m_ScreenShareWatched;
+        int m_ScreenShareWatchCid = -1;
+        int m_ScreenShareJoinedCid = -1;
+        // From Screen_Share_Viewers: false while nobody receives our share.
+        std::atomic<bool> m_ScreenShareHasViewers{ true };
+        void SyncScreenShareWatch();
+
         // FPS overlay member removed — use external profiling tools instead.
     };
 }
\ No newline at end of file
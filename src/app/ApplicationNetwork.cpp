@@ -3,6 +3,7 @@
 #include "Application.h"
 #include "../shared/Protocol.h"
 #include "../shared/PacketHandler.h"
+#include "../shared/WireCodec.h"
 #include "../core/ConfigManager.h"
 #include <imgui.h>
 #include "../ui/TextureManager.h"
@@ -99,13 +100,36 @@ void Application::ProcessNetworkMessages() {
                 continue;
             }
 
-            // ── All remaining packets require a JSON body ──────────────────
+            if (msg.type == PacketType::Media_Chunk) {
+                OnMediaChunk(msg);
+                continue;
+            }
+
+            if (msg.type == PacketType::File_Transfer_Ack) {
+                if (msg.data.size() >= sizeof(TalkMe::UploadAckPayload)) {
+                    TalkMe::UploadAckPayload ack;
+                    std::memcpy(&ack, msg.data.data(), sizeof(ack));
+                    ack.ToHost();
+                    if (ack.bytesStored > m_UploadAcked && ack.bytesStored <= m_UploadSent) {
+                        m_UploadAcked = ack.bytesStored;
+                        PumpUpload();
+                    }
+                }
+                continue;
+            }
+
             if (msg.data.empty()) continue;
 
-            // Fast pre-validation: skip the throw path for clearly non-JSON data.
-            if (!json::accept(msg.data.begin(), msg.data.end())) continue;
+            // ── Binary control packets, once negotiated at login ──────────
+            if (Wire::IsBinary(msg.data.data(), msg.data.size())) {
+                ProcessBinaryMessage(msg);
+                continue;
+            }
 
-            const json j = json::parse(msg.data);
+            // ── All remaining packets require a JSON body ──────────────────
+            // Single non-throwing pass; malformed bodies come back discarded.
+            const json j = json::parse(msg.data, nullptr, false);
+            if (j.is_discarded()) continue;
 
             if (msg.type == PacketType::Register_Success) {
                 const std::string assigned = j.value("u", "");
@@ -114,6 +138,7 @@ void Application::ProcessNetworkMessages() {
                     m_CurrentUser.email    = m_EmailBuf;
                     ConfigManager::Get().SaveSession(m_EmailBuf, m_PasswordBuf);
                 }
+                m_NetClient.SetBinaryWire(j.value("wire", 0) >= Wire::kVersion);
                 m_CurrentUser.isLoggedIn = true;
                 m_CurrentState           = AppState::MainApp;
                 continue;
@@ -141,6 +166,7 @@ void Application::ProcessNetworkMessages() {
                     ConfigManager::Get().SaveSession(m_EmailBuf, m_PasswordBuf);
                 }
                 m_Is2FAEnabled           = j.value("2fa_enabled", false);
+                m_NetClient.SetBinaryWire(j.value("wire", 0) >= Wire::kVersion);
                 m_CurrentUser.isLoggedIn = true;
                 m_CurrentState           = AppState::MainApp;
                 m_StatusMessage[0]       = '\0';
@@ -150,6 +176,8 @@ void Application::ProcessNetworkMessages() {
                     if (!dbPath.empty()) m_MessageCacheDb.Open(dbPath);
                 }
                 LoadStateCache();
+                // An image upload cut off by the disconnect picks up where the server's copy ends.
+                if (!m_PendingUploadData.empty()) SendUploadRequest();
                 continue;
             }
 
@@ -357,6 +385,11 @@ void Application::ProcessNetworkMessages() {
                 continue;
             }
 
+            if (msg.type == PacketType::Screen_Share_Viewers) {
+                m_ScreenShareHasViewers.store(j.value("n", 1) > 0);
+                continue;
+            }
+
             // Screen_Share_Frame handled above (before JSON validation)
 
             if (msg.type == PacketType::Admin_Action_Result) {
@@ -430,6 +463,20 @@ void Application::ProcessNetworkMessages() {
                 continue;
             }
 
+            if (msg.type == PacketType::Presence_Batch) {
+                if (!j.is_array()) continue;
+                for (const auto& item : j) {
+                    const std::string user = item.value("u", "");
+                    if (user.empty()) continue;
+                    if (item.contains("online")) {
+                        if (item.value("online", false)) m_OnlineUsers.insert(user);
+                        else m_OnlineUsers.erase(user);
+                    }
+                    if (item.contains("status")) m_UserStatuses[user] = item.value("status", "");
+                }
+                continue;
+            }
+
             // ── Packets requiring an active session ────────────────────────
             if (msg.type == PacketType::Voice_Config) {
                 m_VoiceConfig.keepaliveIntervalMs          = j.value("keepalive_interval_ms",           m_VoiceConfig.keepaliveIntervalMs);
@@ -441,6 +488,7 @@ void Application::ProcessNetworkMessages() {
                 m_VoiceConfig.preferUdp                    = j.value("prefer_udp",                       m_VoiceConfig.preferUdp);
                 m_ServerVersion = j.value("server_version", m_ServerVersion);
                 m_UseUdpVoice   = m_VoiceConfig.preferUdp && m_VoiceTransport.IsRunning();
+                m_VoiceTransport.SetAudioLevelEnabled(j.value("audio_level", false));
                 m_AudioEngine.ApplyConfig(
                     m_VoiceConfig.jitterBufferTargetMs,
                     m_VoiceConfig.jitterBufferMinMs,
@@ -459,6 +507,8 @@ void Application::ProcessNetworkMessages() {
                 if ((forCurrentCh || isSelfLeave) && j.contains("action")) {
                     const std::string targetUser = j.value("u", "");
                     const std::string action     = j.value("action", "");
+                    if (action == "join" && targetUser == m_CurrentUser.username && forCurrentCh)
+                        m_ScreenShareJoinedCid = updateCid;
                     if (action == "join" && !targetUser.empty() && forCurrentCh) {
                         if (std::find(m_VoiceMembers.begin(), m_VoiceMembers.end(), targetUser)
                             == m_VoiceMembers.end()) {
@@ -485,6 +535,8 @@ void Application::ProcessNetworkMessages() {
                     const std::vector<std::string> oldMembers = m_VoiceMembers;
                     m_VoiceMembers.clear();
                     for (const auto& m : j["members"]) m_VoiceMembers.push_back(m);
+                    if (std::find(m_VoiceMembers.begin(), m_VoiceMembers.end(), m_CurrentUser.username) != m_VoiceMembers.end())
+                        m_ScreenShareJoinedCid = updateCid;
                     m_AudioEngine.OnVoiceStateUpdate(static_cast<int>(m_VoiceMembers.size()));
                     m_LastVoiceStateRequestTime = std::chrono::steady_clock::now();
 
@@ -572,38 +624,62 @@ void Application::ProcessNetworkMessages() {
 
             if (msg.type == PacketType::File_Transfer_Complete) {
                 std::string action = j.value("action", "");
-                if (action == "upload_approved" && j.contains("id") && !m_PendingUploadData.empty()) {
-                    std::string id = j["id"].get<std::string>();
-                    const size_t chunkSize = 32 * 1024;
-                    for (size_t offset = 0; offset < m_PendingUploadData.size(); offset += chunkSize) {
-                        size_t len = (std::min)(chunkSize, m_PendingUploadData.size() - offset);
-                        std::vector<uint8_t> chunk(m_PendingUploadData.data() + offset, m_PendingUploadData.data() + offset + len);
-                        m_NetClient.SendRaw(PacketType::File_Transfer_Chunk, chunk);
-                    }
-                    m_NetClient.Send(PacketType::File_Transfer_Complete, "{}");
-                    json msgJ;
-                    msgJ["cid"] = m_PendingUploadChannelId;
-                    msgJ["u"] = m_CurrentUser.username;
-                    msgJ["msg"] = m_PendingMessageText;
-                    msgJ["attachment_id"] = id;
-                    if (m_PendingReplyToId > 0) {
-                        msgJ["reply_to"] = m_PendingReplyToId;
-                        m_PendingReplyToId = 0;
-                    }
-                    m_NetClient.Send(PacketType::Message_Text, msgJ.dump());
+                if (m_PendingUploadData.empty()) continue;
+                if (action == "upload_approved" && j.contains("id")) {
+                    // "offset" is non-zero when a reconnect resumed the upload.
+                    m_PendingUploadId = j["id"].get<std::string>();
+                    const size_t offset = j.value("offset", static_cast<size_t>(0));
+                    m_UploadSent = m_UploadAcked = (std::min)(offset, m_PendingUploadData.size());
+                    PumpUpload();
+                }
+                // upload_exists: the server already has these bytes, so post without transferring them.
+                else if ((action == "upload_finished" || action == "upload_exists") && j.contains("id")) {
+                    m_NetClient.Send(PacketType::Message_Text,
+                        PacketHandler::MessageTextPayload(m_NetClient.UsesBinaryWire(), m_PendingUploadChannelId,
+                            m_CurrentUser.username, m_PendingMessageText, j["id"].get<std::string>(), m_PendingReplyToId));
+                    m_PendingReplyToId = 0;
                     m_PendingUploadData.clear();
                     m_PendingUploadFilename.clear();
                     m_PendingUploadChannelId = -1;
+                    m_PendingUploadId.clear();
                     m_PendingMessageText.clear();
                 }
+                else if (action == "upload_failed") {
+                    LOG_ERROR("Attachment upload failed: server could not store it or content did not match its hash");
+                    m_PendingUploadData.clear();
+                    m_PendingUploadFilename.clear();
+                    m_PendingUploadChannelId = -1;
+                    m_PendingUploadId.clear();
+                }
                 continue;
             }
 
             if (msg.type == PacketType::Media_Response) {
+                // Streamed transfer: header now, Media_Chunk packets follow.
+                if (j.value("stream", 0) != 0 && j.contains("id") && j.contains("tid") && j.contains("size")) {
+                    MediaDownload dl;
+                    dl.id = j["id"].get<std::string>();
+                    dl.size = j["size"].get<uint32_t>();
+                    dl.preview = j.value("preview", 0) != 0;
+                    dl.data.reserve(dl.size);
+                    m_MediaDownloads[j["tid"].get<uint32_t>()] = std::move(dl);
+                    continue;
+                }
+                if (j.contains("error")) {
+                    std::string id = j.value("id", "");
+                    if (id.empty() && j.contains("tid")) {
+                        auto it = m_MediaDownloads.find(j["tid"].get<uint32_t>());
+                        if (it != m_MediaDownloads.end()) {
+                            id = it->second.id;
+                            m_MediaDownloads.erase(it);
+                        }
+                    }
+                    if (!id.empty()) MarkAttachmentFailed(id);
+                    continue;
+                }
                 if (!j.contains("id") || !j.contains("data") || !j["data"].is_string()) continue;
                 std::string id = j["id"].get<std::string>();
                 std::string b64 = j["data"].get<std::string>();
-                m_AttachmentRequested.erase(id);
                 static const std::string b64chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
                 std::string raw;
                 raw.reserve((b64.size() / 4) * 3);
@@ -615,25 +691,7 @@ void Application::ProcessNetworkMessages() {
                     bits += 6;
                     if (bits >= 0) { raw += (char)((val >> bits) & 0xFF); bits -= 8; }
                 }
-                m_AttachmentFileData[id] = std::vector<uint8_t>(raw.begin(), raw.end());
-                int w = 0, h = 0, ch = 0;
-                unsigned char* pixels = stbi_load_from_memory(
-                    reinterpret_cast<const unsigned char*>(raw.data()), (int)raw.size(), &w, &h, &ch, 4);
-                if (pixels && w > 0 && h > 0) {
-                    const size_t size = (size_t)w * (size_t)h * 4;
-                    std::vector<uint8_t> rgba(pixels, pixels + size);
-                    stbi_image_free(pixels);
-                    {
-                        std::lock_guard<std::mutex> lock(m_PendingAttachmentUploadsMutex);
-                        m_PendingAttachmentUploads.push_back({ id, std::move(rgba), w, h });
-                    }
-                } else {
-                    if (pixels) stbi_image_free(pixels);
-                    AttachmentDisplay disp;
-                    disp.ready = false;
-                    disp.failed = true;
-                    m_AttachmentCache[id] = std::move(disp);
-                }
+                OnAttachmentData(id, std::vector<uint8_t>(raw.begin(), raw.end()));
                 continue;
             }
 
@@ -850,50 +908,8 @@ void Application::ProcessNetworkMessages() {
             }
 
             if (msg.type == PacketType::Message_Text) {
-                int incomingCid = j.value("cid", 0);
-                std::string msgContent = j.value("msg", "");
-                int newMid = j.value("mid", 0);
-                ChatMessage cm{ newMid, incomingCid, j.value("u", "??"), msgContent,
-                                GetCurrentTimeStr(), j.value("reply_to", 0), false };
-                cm.attachmentId = j.value("attachment_id", j.value("attachment", ""));
-                auto& state = m_ChannelStates[incomingCid];
-                state.messages.push_back(std::move(cm));
-                if (!state.messages.empty())
-                    m_MessageCacheDb.UpsertMessages(std::vector<ChatMessage>{ state.messages.back() });
-
-                // Maintain bounded in-memory window for active paging.
-                constexpr size_t kMaxWindow = 200;
-                if (state.messages.size() > kMaxWindow) {
-                    state.messages.erase(state.messages.begin(), state.messages.begin() + (state.messages.size() - kMaxWindow));
-                }
-
-                SaveStateCache();
-                if (j.value("u", "") != m_CurrentUser.username) {
-                    if (incomingCid != m_SelectedChannelId)
-                        m_UnreadCounts[incomingCid]++;
-
-                    // Check for mentions (@username#tag or @all)
-                    bool isMentioned = false;
-                    if (msgContent.find("@all") != std::string::npos)
-                        isMentioned = true;
-                    if (!isMentioned && msgContent.find("@" + m_CurrentUser.username) != std::string::npos)
-                        isMentioned = true;
-                    if (!isMentioned) {
-                        // Also check without #tag
-                        size_t hashPos = m_CurrentUser.username.find('#');
-                        if (hashPos != std::string::npos) {
-                            std::string shortName = m_CurrentUser.username.substr(0, hashPos);
-                            if (msgContent.find("@" + shortName) != std::string::npos)
-                                isMentioned = true;
-                        }
-                    }
-
-                    if (isMentioned && !m_NotifSettings.muteMentions) {
-                        m_Sounds.PlayMention();
-                    } else if (!m_NotifSettings.muteMessages && GetForegroundWindow() != m_Window.GetHwnd()) {
-                        m_Sounds.PlayMessage();
-                    }
-                }
+                OnChatMessage(j.value("cid", 0), j.value("mid", 0), j.value("u", "??"), j.value("msg", ""),
+                              j.value("attachment_id", j.value("attachment", "")), j.value("reply_to", 0));
                 continue;
             }
         }
@@ -906,4 +922,182 @@ void Application::ProcessNetworkMessages() {
     }
 }
 
+bool Application::ProcessBinaryMessage(const IncomingMessage& msg) {
+    const uint8_t* data = msg.data.data();
+    const size_t size = msg.data.size();
+    switch (msg.type) {
+    case PacketType::Message_Text: {
+        Wire::MessageText m;
+        if (!Wire::Decode(data, size, m)) return false;
+        OnChatMessage(m.cid, m.mid, std::string(m.user), std::string(m.msg), std::string(m.attachmentId), m.replyTo);
+        return true;
+    }
+    case PacketType::Typing_Indicator: {
+        Wire::TypingIndicator m;
+        if (!Wire::Decode(data, size, m)) return false;
+        if (!m.user.empty() && m.user != m_CurrentUser.username)
+            m_TypingUsers[std::string(m.user)] = (float)ImGui::GetTime();
+        return true;
+    }
+    case PacketType::Voice_Mute_State: {
+        Wire::VoiceMuteState m;
+        if (!Wire::Decode(data, size, m)) return false;
+        if (!m.user.empty()) {
+            m_UserMuteStates[std::string(m.user)] = { m.muted, m.deafened };
+            UpdateOverlay();
+        }
+        return true;
+    }
+    case PacketType::Presence_Update: {
+        Wire::PresenceUpdate m;
+        if (!Wire::Decode(data, size, m)) return false;
+        if (!m.user.empty()) {
+            if (m.online) m_OnlineUsers.insert(std::string(m.user));
+            else m_OnlineUsers.erase(std::string(m.user));
+        }
+        return true;
+    }
+    case PacketType::Status_Update: {
+        Wire::StatusUpdate m;
+        if (!Wire::Decode(data, size, m)) return false;
+        if (!m.user.empty()) m_UserStatuses[std::string(m.user)] = std::string(m.status);
+        return true;
+    }
+    case PacketType::Presence_Batch: {
+        std::vector<Wire::PresenceDelta> batch;
+        if (!Wire::Decode(data, size, batch)) return false;
+        for (const auto& d : batch) {
+            if (d.user.empty()) continue;
+            const std::string user(d.user);
+            if (d.hasPresence) {
+                if (d.online) m_OnlineUsers.insert(user);
+                else m_OnlineUsers.erase(user);
+            }
+            if (d.hasStatus) m_UserStatuses[user] = std::string(d.status);
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+void Application::OnMediaChunk(const IncomingMessage& msg) {
+    if (msg.data.size() < sizeof(TalkMe::MediaChunkHeader)) return;
+    TalkMe::MediaChunkHeader ch;
+    std::memcpy(&ch, msg.data.data(), sizeof(ch));
+    ch.ToHost();
+    auto it = m_MediaDownloads.find(ch.transferId);
+    if (it == m_MediaDownloads.end()) return;
+    auto& dl = it->second;
+    const size_t n = msg.data.size() - sizeof(ch);
+    // Chunks arrive in order on the TCP stream; anything else is a protocol
+    // error. Tell the server to stop, rather than let it run into its stall
+    // timeout, and show the attachment as failed.
+    if (ch.offset != dl.data.size() || dl.data.size() + n > dl.size) {
+        const uint32_t tid = TalkMe::HostToNet32(ch.transferId);
+        const auto* p = reinterpret_cast<const uint8_t*>(&tid);
+        m_NetClient.SendRaw(PacketType::Media_Cancel, std::vector<uint8_t>(p, p + sizeof(tid)));
+        const std::string id = std::move(dl.id);
+        m_MediaDownloads.erase(it);
+        MarkAttachmentFailed(id);
+        return;
+    }
+    dl.data.insert(dl.data.end(), msg.data.begin() + sizeof(ch), msg.data.end());
+    const uint32_t received = static_cast<uint32_t>(dl.data.size());
+    if (received == dl.size) {
+        std::string id = std::move(dl.id);
+        std::vector<uint8_t> raw = std::move(dl.data);
+        const bool preview = dl.preview;
+        m_MediaDownloads.erase(it);
+        OnAttachmentData(id, std::move(raw), preview);
+        return;
+    }
+    if (received - dl.acked >= TalkMe::kMediaStreamAckBytes) {
+        dl.acked = received;
+        TalkMe::MediaAckPayload ack{ ch.transferId, received };
+        ack.ToNetwork();
+        const auto* p = reinterpret_cast<const uint8_t*>(&ack);
+        m_NetClient.SendRaw(PacketType::Media_Ack, std::vector<uint8_t>(p, p + sizeof(ack)));
+    }
+}
+
+void Application::MarkAttachmentFailed(const std::string& id) {
+    m_AttachmentRequested.erase(id);
+    m_AttachmentOriginalRequested.erase(id);
+    AttachmentDisplay disp;
+    disp.ready = false;
+    disp.failed = true;
+    m_AttachmentCache[id] = std::move(disp);
+}
+
+void Application::OnAttachmentData(const std::string& id, std::vector<uint8_t> raw, bool preview) {
+    m_AttachmentRequested.erase(id);
+    if (!preview) m_AttachmentOriginalRequested.erase(id);
+    // The original may already be shown (viewer opened before the preview arrived).
+    if (preview && m_AttachmentFileData.count(id) && m_AttachmentCache.count(id)) return;
+    int w = 0, h = 0, ch = 0;
+    unsigned char* pixels = stbi_load_from_memory(raw.data(), (int)raw.size(), &w, &h, &ch, 4);
+    if (!preview) m_AttachmentFileData[id] = std::move(raw);
+    if (pixels && w > 0 && h > 0) {
+        const size_t size = (size_t)w * (size_t)h * 4;
+        std::vector<uint8_t> rgba(pixels, pixels + size);
+        stbi_image_free(pixels);
+        {
+            std::lock_guard<std::mutex> lock(m_PendingAttachmentUploadsMutex);
+            m_PendingAttachmentUploads.push_back({ id, std::move(rgba), w, h });
+        }
+    } else {
+        if (pixels) stbi_image_free(pixels);
+        AttachmentDisplay disp;
+        disp.ready = false;
+        disp.failed = true;
+        m_AttachmentCache[id] = std::move(disp);
+    }
+}
+
+void Application::OnChatMessage(int cid, int mid, const std::string& user, const std::string& content,
+                                const std::string& attachmentId, int replyTo) {
+    ChatMessage cm{ mid, cid, user, content, GetCurrentTimeStr(), replyTo, false };
+    cm.attachmentId = attachmentId;
+    auto& state = m_ChannelStates[cid];
+    state.messages.push_back(std::move(cm));
+    if (!state.messages.empty())
+        m_MessageCacheDb.UpsertMessages(std::vector<ChatMessage>{ state.messages.back() });
+
+    // Maintain bounded in-memory window for active paging.
+    constexpr size_t kMaxWindow = 200;
+    if (state.messages.size() > kMaxWindow) {
+        state.messages.erase(state.messages.begin(), state.messages.begin() + (state.messages.size() - kMaxWindow));
+    }
+
+    SaveStateCache();
+    if (user != m_CurrentUser.username) {
+        if (cid != m_SelectedChannelId)
+            m_UnreadCounts[cid]++;
+
+        // Check for mentions (@username#tag or @all)
+        bool isMentioned = false;
+        if (content.find("@all") != std::string::npos)
+            isMentioned = true;
+        if (!isMentioned && content.find("@" + m_CurrentUser.username) != std::string::npos)
+            isMentioned = true;
+        if (!isMentioned) {
+            // Also check without #tag
+            size_t hashPos = m_CurrentUser.username.find('#');
+            if (hashPos != std::string::npos) {
+                std::string shortName = m_CurrentUser.username.substr(0, hashPos);
+                if (content.find("@" + shortName) != std::string::npos)
+                    isMentioned = true;
+            }
+        }
+
+        if (isMentioned && !m_NotifSettings.muteMentions) {
+            m_Sounds.PlayMention();
+        } else if (!m_NotifSettings.muteMessages && GetForegroundWindow() != m_Window.GetHwnd()) {
+            m_Sounds.PlayMessage();
+        }
+    }
+}
+
 } // namespace TalkMe
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "Application.h"
 #include "../shared/Protocol.h"
+#include <nlohmann/json.hpp>
 #include <cstdio>
 #include <algorithm>
 #include <chrono>
@@ -7,6 +8,23 @@
 
 namespace TalkMe {
 
+namespace {
+
+// True if an encoded frame ([codec][bitstream]) decodes on its own: any JPEG
+// frame, or an H.264 access unit whose first slice is IDR.
+bool IsKeyframe(const std::vector<uint8_t>& frame) {
+    if (frame.empty() || frame[0] != 1) return true;
+    for (size_t i = 1; i + 3 < frame.size(); ++i) {
+        if (frame[i] != 0 || frame[i + 1] != 0 || frame[i + 2] != 1) continue;
+        const uint8_t type = frame[i + 3] & 0x1F;
+        if (type >= 1 && type <= 5) return type == 5;
+        i += 2;
+    }
+    return false;
+}
+
+} // namespace
+
 int Application::GetEffectiveShareFps() const {
     const int uiCap = (std::max)(10, (std::min)(1000, m_TargetFps));
     const int shareCap = (std::max)(1, (std::min)(120, m_ScreenShare.fps));
@@ -200,6 +218,7 @@ void Application::RunScreenShareSendThread() {
     int framesSent = 0;
     auto lastLogTime = std::chrono::steady_clock::now();
     auto lastAdaptiveCheck = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastIdleSend{};
 
     // Adaptive quality state machine
     int currentQuality = m_ScreenShare.quality;
@@ -270,6 +289,15 @@ void Application::RunScreenShareSendThread() {
             }
         }
 
+        // Nobody watches: send only frames a new viewer can start from, at
+        // most one a second, so the server's cached keyframe stays fresh.
+        if (!frameData.empty() && !m_ScreenShareHasViewers.load()) {
+            if (!IsKeyframe(frameData) || now - lastIdleSend < std::chrono::seconds(1))
+                frameData.clear();
+            else
+                lastIdleSend = now;
+        }
+
         // Send outside the lock (this might block a bit, that's OK)
         if (!frameData.empty() && m_NetClient.IsConnected()) {
             // Wire format v1: [0xA5][u16 usernameLen BE][username][framePayload(codec+bitstream)]
@@ -299,4 +327,27 @@ void Application::RunScreenShareSendThread() {
     }
 }
 
+void Application::SyncScreenShareWatch() {
+    // The server only accepts a watch from a member of the voice channel.
+    if (m_ScreenShareJoinedCid == -1 || m_ScreenShareJoinedCid != m_ActiveVoiceChannelId) return;
+    std::string watched;
+    if (!m_GameMode) {
+        // The stream the render loop decodes; frames of the others would be discarded.
+        std::lock_guard<std::mutex> lock(m_ScreenShareStreamMutex);
+        watched = m_ScreenShare.viewingStream;
+        if (watched.empty() && !m_ScreenShare.activeStreams.empty())
+            watched = m_ScreenShare.activeStreams.begin()->first;
+        if (watched == m_CurrentUser.username) watched.clear();
+    }
+    if (m_ScreenShareWatchCid == m_ScreenShareJoinedCid && watched == m_ScreenShareWatched) return;
+    if (m_ScreenShareWatchCid != m_ScreenShareJoinedCid)
+        m_ScreenShareHasViewers.store(true);   // re-reported by the new channel
+    nlohmann::json j;
+    j["u"] = nlohmann::json::array();
+    if (!watched.empty()) j["u"].push_back(watched);
+    m_NetClient.Send(PacketType::Screen_Share_Watch, j.dump());
+    m_ScreenShareWatched = std::move(watched);
+    m_ScreenShareWatchCid = m_ScreenShareJoinedCid;
+}
+
 } // namespace TalkMe
@@ -67,7 +67,7 @@ void VoiceSendPacer::Start(SendFn fn) {
             // load (one packet/tick) this is exactly one iteration; after a
             // burst it catches up without stalling the timer period.
             while (true) {
-                std::vector<uint8_t> pkt;
+                Packet pkt;
                 {
                     std::lock_guard<std::mutex> lk(m_Mutex);
                     if (m_Queue.empty()) break;
@@ -76,7 +76,7 @@ void VoiceSendPacer::Start(SendFn fn) {
                 }
                 if (m_SendFn) {
                     try {
-                        m_SendFn(pkt);
+                        m_SendFn(pkt.payload, pkt.level);
                     }
                     catch (...) {
                         // Do not let send callback throw out of the pacer thread —
@@ -107,11 +107,11 @@ void VoiceSendPacer::Stop() {
     while (!m_Queue.empty()) m_Queue.pop();
 }
 
-void VoiceSendPacer::Enqueue(std::vector<uint8_t> payload) {
+void VoiceSendPacer::Enqueue(std::vector<uint8_t> payload, uint8_t level) {
     std::lock_guard<std::mutex> lk(m_Mutex);
     if (m_Queue.size() >= kMaxQueue)
         m_Queue.pop(); // drop oldest to bound latency
-    m_Queue.push(std::move(payload));
+    m_Queue.push(Packet{ std::move(payload), level });
 }
 
 } // namespace TalkMe
\ No newline at end of file
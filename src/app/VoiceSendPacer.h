@@ -16,7 +16,8 @@ namespace TalkMe {
 // real-time behaviour. Do not remove — required to prevent network flooding.
 class VoiceSendPacer {
 public:
-    using SendFn = std::function<void(const std::vector<uint8_t>&)>;
+    // Receives each payload together with the audio level it was queued with.
+    using SendFn = std::function<void(const std::vector<uint8_t>&, uint8_t level)>;
 
     VoiceSendPacer() = default;
     ~VoiceSendPacer() { Stop(); }
@@ -26,11 +27,16 @@ public:
 
     void Start(SendFn fn);
     void Stop();
-    void Enqueue(std::vector<uint8_t> payload);
+    void Enqueue(std::vector<uint8_t> payload, uint8_t level);
 
 private:
+    struct Packet {
+        std::vector<uint8_t> payload;
+        uint8_t              level = 0;
+    };
+
     SendFn                        m_SendFn;
-    std::queue<std::vector<uint8_t>> m_Queue;
+    std::queue<Packet>            m_Queue;
     std::mutex                    m_Mutex;
     std::thread                   m_Thread;
     std::atomic<bool>             m_Running{ false };
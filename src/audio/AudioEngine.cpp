@@ -700,6 +700,13 @@ namespace TalkMe {
         return m_Internal ? m_Internal->captureRMS : 0.0f;
     }
 
+    uint8_t AudioEngine::GetOutgoingAudioLevel() const {
+        const float rms = m_Internal ? m_Internal->processedRMS : 0.0f;
+        if (rms <= 0.0f) return 127;
+        const float dbov = -20.0f * std::log10((std::min)(rms, 1.0f));
+        return static_cast<uint8_t>(std::clamp(dbov + 0.5f, 0.0f, 127.0f));
+    }
+
     void AudioEngine::Shutdown() {
         if (!m_Internal) return;
 
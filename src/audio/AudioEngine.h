@@ -63,6 +63,10 @@ namespace TalkMe {
         void PushSystemAudio(const float* mono48k, int frameCount, int sourceSampleRate);
         void SetSystemAudioVolume(float vol);
         float GetMicActivity() const;
+        // Level of the processed (outgoing) mic signal as -dBov, RFC 6464 style:
+        // 0 = full scale, 127 = silence. Sent alongside voice for server-side
+        // loudest-speaker selection.
+        uint8_t GetOutgoingAudioLevel() const;
 
         void SetSelfMuted(bool muted) { m_SelfMuted = muted; }
         bool IsSelfMuted()    const { return m_SelfMuted; }
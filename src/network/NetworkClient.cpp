@@ -1,6 +1,7 @@
 #include "NetworkClient.h"
 #include <asio.hpp>
 #include <windows.h>
+#include <algorithm>
 #include <array>
 #include <memory>
 #include <vector>
@@ -20,8 +21,15 @@ namespace TalkMe {
         std::thread               m_ContextThread;
         std::atomic<bool>         m_IsConnected{ false };
         std::atomic<bool>         m_Connecting{ false };
-        PacketHeader              m_InHeader{};
-        std::vector<uint8_t>      m_InBody;
+        std::atomic<bool>         m_BinaryWire{ false };
+        // Inbound bytes: one async_read_some takes whatever the socket has and
+        // every complete packet in [m_ReadStart, m_ReadEnd) is framed from it.
+        static constexpr size_t   kReadBufferSize = 64 * 1024;
+        static constexpr size_t   kMaxPacketSize = 10u * 1024u * 1024u;
+        std::vector<uint8_t>      m_ReadBuf;
+        size_t                    m_ReadStart = 0;
+        size_t                    m_ReadEnd = 0;
+        std::vector<uint8_t>      m_VoiceScratch;
         std::deque<IncomingMessage> m_IncomingQueue;
         std::mutex                  m_QueueMutex;
         struct OutPacket {
@@ -101,11 +109,14 @@ namespace TalkMe {
                 m_Impl->m_Context.restart();
                 m_Impl->m_Socket = asio::ip::tcp::socket(m_Impl->m_Context);
                 m_Impl->m_WriteQueue.clear();
+                m_Impl->m_BinaryWire.store(false);
+                m_Impl->m_ReadBuf.assign(Impl::kReadBufferSize, 0);
+                m_Impl->m_ReadStart = m_Impl->m_ReadEnd = 0;
 
                 asio::ip::tcp::resolver resolver(m_Impl->m_Context);
                 asio::connect(m_Impl->m_Socket, resolver.resolve(host, std::to_string(port)));
 
-                ReadHeader();
+                ReadSome();
 
                 m_Impl->m_ContextThread = std::thread([this] {
                     auto guard = asio::make_work_guard(m_Impl->m_Context);
@@ -167,6 +178,14 @@ namespace TalkMe {
         return m_Impl && m_Impl->m_IsConnected.load();
     }
 
+    void NetworkClient::SetBinaryWire(bool enabled) {
+        m_Impl->m_BinaryWire.store(enabled);
+    }
+
+    bool NetworkClient::UsesBinaryWire() const {
+        return m_Impl && m_Impl->m_BinaryWire.load();
+    }
+
     void NetworkClient::Send(PacketType type, const std::string& data) {
         if (!IsConnected()) return;
         auto pkt = std::make_shared<Impl::OutPacket>();
@@ -205,49 +224,93 @@ namespace TalkMe {
         return msgs;
     }
 
-    void NetworkClient::ReadHeader() {
-        asio::async_read(m_Impl->m_Socket,
-            asio::buffer(&m_Impl->m_InHeader, sizeof(PacketHeader)),
-            [this](std::error_code ec, std::size_t) {
+    void NetworkClient::ReadSome() {
+        auto& buf = m_Impl->m_ReadBuf;
+        size_t& start = m_Impl->m_ReadStart;
+        size_t& end = m_Impl->m_ReadEnd;
+
+        // Move the partial packet (if any) to the front of the buffer.
+        if (start > 0) {
+            if (end > start) std::memmove(buf.data(), buf.data() + start, end - start);
+            end -= start;
+            start = 0;
+        }
+
+        // A packet larger than the buffer gets room for exactly itself; the
+        // buffer drops back to its normal size once that packet is consumed.
+        size_t need = Impl::kReadBufferSize;
+        if (end >= sizeof(PacketHeader)) {
+            PacketHeader h;
+            std::memcpy(&h, buf.data(), sizeof(PacketHeader));
+            h.ToHost();
+            need = (std::max)(need, sizeof(PacketHeader) + static_cast<size_t>(h.size));
+        }
+        if (buf.size() != need) {
+            buf.resize(need);
+            if (need == Impl::kReadBufferSize) buf.shrink_to_fit();
+        }
+
+        m_Impl->m_Socket.async_read_some(
+            asio::buffer(buf.data() + end, buf.size() - end),
+            [this](std::error_code ec, std::size_t n) {
                 if (ec) { CloseSocket(); return; }
-                m_Impl->m_InHeader.ToHost();
-                if (m_Impl->m_InHeader.size > 10u * 1024u * 1024u) {
-                    CloseSocket();
-                    return;
-                }
-                m_Impl->m_InBody.resize(m_Impl->m_InHeader.size);
-                ReadBody();
+                m_Impl->m_ReadEnd += n;
+                DispatchPackets();
             });
     }
 
-    void NetworkClient::ReadBody() {
-        asio::async_read(m_Impl->m_Socket,
-            asio::buffer(m_Impl->m_InBody),
-            [this](std::error_code ec, std::size_t) {
-                if (ec) { CloseSocket(); return; }
+    void NetworkClient::DispatchPackets() {
+        auto& buf = m_Impl->m_ReadBuf;
+        size_t& start = m_Impl->m_ReadStart;
+        const size_t end = m_Impl->m_ReadEnd;
 
-                if (m_Impl->m_InHeader.type == PacketType::Voice_Data_Opus ||
-                    m_Impl->m_InHeader.type == PacketType::Voice_Data)
-                {
-                    auto cb = m_Impl->m_VoiceCallback.load();
-                    if (cb && *cb) {
-                        try { (*cb)(m_Impl->m_InBody); }
-                        catch (...) { /* do not let callback throw out of ASIO handler */ }
-                    }
-                }
-                else {
-                    // Move the body into the queue to avoid a redundant copy.
-                    // m_InBody is immediately resized in the next ReadHeader() call.
-                    IncomingMessage msg;
-                    msg.type = m_Impl->m_InHeader.type;
-                    msg.data = std::move(m_Impl->m_InBody);
-                    std::lock_guard<std::mutex> lock(m_Impl->m_QueueMutex);
-                    m_Impl->m_IncomingQueue.push_back(std::move(msg));
+        // Frame everything that arrived; non-voice packets are queued as one
+        // batch so the UI thread takes the lock and is woken once per read.
+        std::vector<IncomingMessage> batch;
+        bool sawVoice = false;
+        while (end - start >= sizeof(PacketHeader)) {
+            PacketHeader header;
+            std::memcpy(&header, buf.data() + start, sizeof(PacketHeader));
+            header.ToHost();
+            if (header.size > Impl::kMaxPacketSize) {
+                CloseSocket();
+                return;
+            }
+            if (end - start < sizeof(PacketHeader) + header.size) break;
+
+            const uint8_t* body = buf.data() + start + sizeof(PacketHeader);
+            start += sizeof(PacketHeader) + header.size;
+
+            if (header.type == PacketType::Voice_Data_Opus ||
+                header.type == PacketType::Voice_Data)
+            {
+                auto cb = m_Impl->m_VoiceCallback.load();
+                if (cb && *cb) {
+                    // Reused scratch vector: no allocation per voice frame.
+                    m_Impl->m_VoiceScratch.assign(body, body + header.size);
+                    try { (*cb)(m_Impl->m_VoiceScratch); }
+                    catch (...) { /* do not let callback throw out of ASIO handler */ }
                 }
+                sawVoice = true;
+            }
+            else {
+                IncomingMessage msg;
+                msg.type = header.type;
+                msg.data.assign(body, body + header.size);
+                batch.push_back(std::move(msg));
+            }
+        }
 
-                if (m_Impl->m_WakeEvent) ::SetEvent(m_Impl->m_WakeEvent);
-                ReadHeader();
-            });
+        if (!batch.empty()) {
+            std::lock_guard<std::mutex> lock(m_Impl->m_QueueMutex);
+            m_Impl->m_IncomingQueue.insert(m_Impl->m_IncomingQueue.end(),
+                std::make_move_iterator(batch.begin()),
+                std::make_move_iterator(batch.end()));
+        }
+        if ((sawVoice || !batch.empty()) && m_Impl->m_WakeEvent)
+            ::SetEvent(m_Impl->m_WakeEvent);
+
+        ReadSome();
     }
 
 } // namespace TalkMe
\ No newline at end of file
@@ -32,6 +32,11 @@ namespace TalkMe {
         void Disconnect();
         bool IsConnected() const;
 
+        // Set from the server's Login/Register reply; gates the binary control
+        // encoding (WireCodec.h). Cleared on every new connection.
+        void SetBinaryWire(bool enabled);
+        bool UsesBinaryWire() const;
+
         void Send(PacketType type, const std::string& data);
         void SendRaw(PacketType type, const std::vector<uint8_t>& data);
 
@@ -48,8 +53,8 @@ namespace TalkMe {
         std::unique_ptr<Impl> m_Impl;
         std::thread           m_ConnectThread;
 
-        void ReadHeader();
-        void ReadBody();
+        void ReadSome();
+        void DispatchPackets();
         void CloseSocket();
     };
 
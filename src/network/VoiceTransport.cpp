@@ -16,6 +16,7 @@ namespace TalkMe {
         constexpr uint8_t kHelloPacket = 1;
         constexpr uint8_t kPingPacket = 2;
         constexpr uint8_t kPongPacket = 3;
+        constexpr uint8_t kVoiceLevelPacket = 4;
         constexpr size_t  kPingPayloadSize = 8;
 
         // Single-point error logger shared by all send/receive paths.
@@ -78,18 +79,28 @@ namespace TalkMe {
         catch (...) { LogError("udp_stop_error", "unknown_exception"); }
     }
 
-    void VoiceTransport::SendVoicePacket(const std::vector<uint8_t>& payload) {
+    void VoiceTransport::SendVoicePacket(const std::vector<uint8_t>& payload, uint8_t level) {
         if (!m_Socket.is_open()) return;
         try {
             // Scatter-gather: send the type byte and payload as separate buffers to
             // avoid a heap allocation on this hot path (50-100 calls/sec per speaker).
             static constexpr uint8_t kTypeVoice = kVoicePacket;
-            const std::array<asio::const_buffer, 2> bufs = {
-                asio::buffer(&kTypeVoice, 1),
-                asio::buffer(payload)
-            };
             std::error_code ec;
-            m_Socket.send_to(bufs, m_RemoteEndpoint, 0, ec);
+            if (m_AudioLevelEnabled.load(std::memory_order_relaxed)) {
+                const uint8_t header[2] = { kVoiceLevelPacket, level };
+                const std::array<asio::const_buffer, 2> bufs = {
+                    asio::buffer(header, 2),
+                    asio::buffer(payload)
+                };
+                m_Socket.send_to(bufs, m_RemoteEndpoint, 0, ec);
+            }
+            else {
+                const std::array<asio::const_buffer, 2> bufs = {
+                    asio::buffer(&kTypeVoice, 1),
+                    asio::buffer(payload)
+                };
+                m_Socket.send_to(bufs, m_RemoteEndpoint, 0, ec);
+            }
             if (ec) LogError("udp_send_error", ec);
         }
         catch (const std::exception& e) { LogError("udp_send_error", e.what()); }
@@ -28,7 +28,13 @@ namespace TalkMe {
 
         // All Send* methods are synchronous (blocking send_to). They run on the
         // calling thread — do not call from a UI or audio callback expecting low jitter.
-        void SendVoicePacket(const std::vector<uint8_t>& payload);
+        // `level` is the loudness of the frame in `payload`; it is only sent when
+        // audio levels are enabled.
+        void SendVoicePacket(const std::vector<uint8_t>& payload, uint8_t level);
+
+        // When the server advertises "audio_level" in Voice_Config, voice goes out
+        // as [4][level][payload] so the server can forward only the loudest speakers.
+        void SetAudioLevelEnabled(bool enabled) { m_AudioLevelEnabled.store(enabled, std::memory_order_relaxed); }
         void SendRaw(const std::vector<uint8_t>& payload);
         void SendHello(const std::string& username, int voiceChannelId);
         void SendPing();
@@ -63,6 +69,7 @@ namespace TalkMe {
         ReceiveCallback                      m_Callback;
         std::function<void()>                m_WakeCallback;
         std::atomic<bool>                    m_Running{ false };
+        std::atomic<bool>                    m_AudioLevelEnabled{ false };
 
         mutable std::mutex m_RttMutex;
         float              m_LastRttMs = 0.0f;
@@ -572,7 +572,8 @@ void DXGICapture::CaptureLoop(std::atomic<bool>* externalStop) {
                     std::fprintf(stderr, "[DXGICapture] WARNING: Keyframe-only with H.264 causes artifacts - forcing normal mode\n");
                 }
 
-                if (!m_H264Encoder.Initialize(outW, outH, m_Settings.fps, bitrate, m_Device))
+                if (!m_H264Encoder.Initialize(outW, outH, m_Settings.fps, bitrate, m_Device,
+                                              (std::max)(15, m_Settings.keyframeIntervalFrames)))
                     m_UseJpegFallback = true;
             }
 
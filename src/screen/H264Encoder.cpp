@@ -386,7 +386,8 @@ void H264Encoder::ShutdownGPUResources() {
     m_GPUConversionReady = false;
 }
 
-bool H264Encoder::Initialize(int width, int height, int fps, int bitrateKbps, ID3D11Device* d3dDevice) {
+bool H264Encoder::Initialize(int width, int height, int fps, int bitrateKbps, ID3D11Device* d3dDevice,
+                             int gopFrames) {
     m_Width = width;
     m_Height = height;
     m_Fps = fps;
@@ -515,6 +516,10 @@ bool H264Encoder::Initialize(int width, int height, int fps, int bitrateKbps, ID
         var.vt = VT_UI4;
         var.ulVal = 0;
         pCodecAPI->SetValue(&CODECAPI_AVEncMPVDefaultBPictureCount, &var);
+        if (gopFrames > 0) {
+            var.ulVal = static_cast<ULONG>(gopFrames);
+            pCodecAPI->SetValue(&CODECAPI_AVEncMPVGOPSize, &var);
+        }
         pCodecAPI->Release();
     }
 
@@ -22,7 +22,10 @@ public:
     H264Encoder() = default;
     ~H264Encoder() { Shutdown(); }
 
-    bool Initialize(int width, int height, int fps, int bitrateKbps, ID3D11Device* d3dDevice = nullptr);
+    // gopFrames > 0 caps the distance between IDR frames (viewers joining mid-stream
+    // and the server's keyframe cache depend on them).
+    bool Initialize(int width, int height, int fps, int bitrateKbps, ID3D11Device* d3dDevice = nullptr,
+                    int gopFrames = 0);
     std::vector<uint8_t> Encode(const uint8_t* bgraData, int width, int height);
     bool ReconfigureBitrate(int bitrateKbps);
     void Shutdown();
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <nlohmann/json.hpp>
 #include "Protocol.h"
+#include "WireCodec.h"
 
 namespace TalkMe {
     class PacketHandler {
@@ -13,6 +14,8 @@ namespace TalkMe {
             j["e"] = email;
             j["p"] = password;
             if (!hwid.empty()) j["hwid"] = hwid;
+            j["wire"] = Wire::kVersion;
+            j["presence_batch"] = 1;
             return j.dump();
         }
 
@@ -21,6 +24,8 @@ namespace TalkMe {
             j["e"] = email;
             j["u"] = username;
             j["p"] = password;
+            j["wire"] = Wire::kVersion;
+            j["presence_batch"] = 1;
             return j.dump();
         }
 
@@ -110,6 +115,42 @@ namespace TalkMe {
             return j.dump();
         }
 
+        // The payloads below go out in the binary encoding once the server has
+        // accepted it (NetworkClient::UsesBinaryWire), as JSON otherwise.
+        static std::string MessageTextPayload(bool binary, int cid, const std::string& sender, const std::string& content,
+                                              const std::string& attachmentId = "", int replyTo = 0) {
+            if (binary) return Wire::Encode(Wire::MessageText{ 0, cid, replyTo, {}, content, attachmentId });
+            nlohmann::json j;
+            j["cid"] = cid;
+            j["u"] = sender;
+            j["msg"] = content;
+            if (!attachmentId.empty()) j["attachment_id"] = attachmentId;
+            if (replyTo > 0) j["reply_to"] = replyTo;
+            return j.dump();
+        }
+
+        static std::string TypingIndicatorPayload(bool binary, int cid) {
+            if (binary) return Wire::Encode(Wire::TypingIndicator{ cid, {} });
+            nlohmann::json j;
+            j["cid"] = cid;
+            return j.dump();
+        }
+
+        static std::string VoiceMuteStatePayload(bool binary, bool muted, bool deafened) {
+            if (binary) return Wire::Encode(Wire::VoiceMuteState{ muted, deafened, -1, {} });
+            nlohmann::json j;
+            j["muted"] = muted;
+            j["deafened"] = deafened;
+            return j.dump();
+        }
+
+        static std::string SetStatusPayload(bool binary, const std::string& status) {
+            if (binary) return Wire::Encode(Wire::StatusUpdate{ {}, status });
+            nlohmann::json j;
+            j["status"] = status;
+            return j.dump();
+        }
+
         static std::string CreateDeleteMessagePayload(int mid, int cid, const std::string& username) {
             nlohmann::json j;
             j["mid"] = mid;
@@ -13,6 +13,7 @@
 #include <unordered_set>
 #include <cstdint>
 #include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <shellapi.h>
 #include <windows.h>
@@ -276,6 +277,15 @@ namespace TalkMe::UI::Views {
         }
     }
 
+    std::string AttachmentMediaUrl(const std::string& mediaBaseUrl, const std::string& attachmentId) {
+        std::string url = mediaBaseUrl + "/media/" + attachmentId;
+        const size_t dot = attachmentId.rfind('.');
+        std::string ext = dot == std::string::npos ? std::string() : attachmentId.substr(dot);
+        for (char& c : ext) c = (char)std::tolower((unsigned char)c);
+        if (ext != ".gif") url += "?size=" + std::to_string(TalkMe::kAttachmentPreviewSize);
+        return url;
+    }
+
     void RenderChannelView(NetworkClient& netClient, UserSession& currentUser, const Server& currentServer,
         std::vector<ChatMessage>& messages, int& selectedChannelId, int& activeVoiceChannelId,
         std::vector<std::string>& voiceMembers, std::map<std::string, float>& speakingTimers,
@@ -1493,7 +1503,7 @@ namespace TalkMe::UI::Views {
                     for (int ri = firstVis; ri < (int)renderIdx.size(); ri++) {
                         const auto& msg = messages[renderIdx[ri]];
                         if (!msg.attachmentId.empty() && mediaBaseUrl && !mediaBaseUrl->empty()) {
-                            std::string mediaUrl = *mediaBaseUrl + "/media/" + msg.attachmentId;
+                            std::string mediaUrl = AttachmentMediaUrl(*mediaBaseUrl, msg.attachmentId);
                             visibleChatImageUrls.insert(mediaUrl);
                         }
                         for (const auto& s : parsedContents[ri])
@@ -1522,7 +1532,7 @@ namespace TalkMe::UI::Views {
                     if (!gameModeOn && !msg.attachmentId.empty()) {
                         visibleTexIds.insert("att_" + msg.attachmentId);
                         if (mediaBaseUrl && !mediaBaseUrl->empty()) {
-                            std::string mediaUrl = *mediaBaseUrl + "/media/" + msg.attachmentId;
+                            std::string mediaUrl = AttachmentMediaUrl(*mediaBaseUrl, msg.attachmentId);
                             visibleChatImageUrls.insert(mediaUrl);
                         }
                     }
@@ -1584,7 +1594,7 @@ namespace TalkMe::UI::Views {
                         }
                         else {
                             std::string mediaUrl = (mediaBaseUrl && !mediaBaseUrl->empty())
-                                ? (*mediaBaseUrl + "/media/" + msg.attachmentId) : std::string();
+                                ? AttachmentMediaUrl(*mediaBaseUrl, msg.attachmentId) : std::string();
                             bool drawn = false;
                             if (requestAttachment && getAttachmentDisplay) {
                                 (*requestAttachment)(msg.attachmentId);
@@ -2284,15 +2294,14 @@ namespace TalkMe::UI::Views {
                                 content = input;
                             }
                             if (!content.empty()) {
-                                nlohmann::json msgJ;
-                                msgJ["cid"] = selectedChannelId;
-                                msgJ["u"] = currentUser.username;
-                                msgJ["msg"] = content;
+                                int replyTo = 0;
                                 if (replyingToMessageId && *replyingToMessageId > 0) {
-                                    msgJ["reply_to"] = *replyingToMessageId;
+                                    replyTo = *replyingToMessageId;
                                     *replyingToMessageId = 0;
                                 }
-                                netClient.Send(PacketType::Message_Text, msgJ.dump());
+                                netClient.Send(PacketType::Message_Text,
+                                    PacketHandler::MessageTextPayload(netClient.UsesBinaryWire(), selectedChannelId,
+                                        currentUser.username, content, "", replyTo));
                             }
                         }
                         memset(chatInputBuf, 0, 1024);
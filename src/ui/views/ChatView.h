@@ -10,6 +10,10 @@ namespace TalkMe::UI::Views {
 
     using UserVoiceState = TalkMe::UserVoiceState;
 
+    // Media-port URL for an inline attachment: its kAttachmentPreviewSize
+    // preview, except GIFs, which only animate when fetched in full.
+    std::string AttachmentMediaUrl(const std::string& mediaBaseUrl, const std::string& attachmentId);
+
     void RenderChannelView(
         NetworkClient& netClient,
         UserSession& currentUser,